@@ -1172,51 +1172,42 @@ void ZHashMap_ResizeImpl<K, V, HT, H, LF, LA, AA>::Call(ZHashMap<K, V, HT, H, LF
 	for (size_t i = 0; i < _self.Map.Size(); i++)
 		_self.Map.Data()[i] = NULL;
 
-	_self.EmptyNode.Next = &_self.EmptyNode;
-	_self.EmptyNode.Previous = &_self.EmptyNode;
-
 	_self.Map.Resize(_buckets, NULL);
 
-	//Loop through our previous nodes and place them back in the map in their new spots
+	//Chain the nodes by their new bucket first (through Next), then relink the buckets in order.
+	//Placing nodes one at a time would scan for the next non-empty bucket on every insert, which
+	//is quadratic while the new map is still sparse.
 	while (node != &_self.EmptyNode)
 	{
-		//Compute new bucket
-		node->Element.HashMod = node->Element.Hash % _buckets;
-		
-		//Determine where we should be placing this node
 		ZListNode< ZHashNode<K, V, HT> >* curNode = node;
-		ZListNode< ZHashNode<K, V, HT> >* nextNode = _self.Map.Data()[node->Element.HashMod];
-
-		//Get the next node to place now, before we scribble the pointers
 		node = curNode->Next;
 
-		//If the bucket has NULL linkage, next node
-		if (nextNode == NULL)
-		{			
-			//Empty bucket, so search for the next nextNode
-			for (size_t i = curNode->Element.HashMod + 1; i < _self.Map.Size(); i++)
-			{
-				nextNode = _self.Map.Data()[i];
+		curNode->Element.HashMod = curNode->Element.Hash % _buckets;
+		curNode->Next = _self.Map.Data()[curNode->Element.HashMod];
+		_self.Map.Data()[curNode->Element.HashMod] = curNode;
+	}
 
-				if (nextNode != NULL)
-					break;
-			}
+	//Reestablish linkage
+	ZListNode< ZHashNode<K, V, HT> >* tail = &_self.EmptyNode;
 
-			//No nextNode was found, so use the empty nextNode
-			if (nextNode == NULL)
-				nextNode = &_self.EmptyNode;
-		}
-	
-		//Reestablish linkage
-		curNode->Next = nextNode;
-		curNode->Previous = nextNode->Previous;
+	for (size_t i = 0; i < _buckets; i++)
+	{
+		ZListNode< ZHashNode<K, V, HT> >* curNode = _self.Map.Data()[i];
 
-		curNode->Previous->Next = curNode;
-		curNode->Next->Previous = curNode;	
-		
-		//Since we are pushing front, this always means we set the pointer
-		_self.Map.Data()[curNode->Element.HashMod] = curNode;
+		while (curNode != NULL)
+		{
+			ZListNode< ZHashNode<K, V, HT> >* nextNode = curNode->Next;
+
+			tail->Next = curNode;
+			curNode->Previous = tail;
+			tail = curNode;
+
+			curNode = nextNode;
+		}
 	}
+
+	tail->Next = &_self.EmptyNode;
+	_self.EmptyNode.Previous = tail;
 }
 
 /*************************************************************************/
@@ -0,0 +1,229 @@
+#include "AssetBundle.hpp"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <SST/SST_Endian.h>
+#include <SST/SST_Time.h>
+
+//The request body: the URIs, one per line. Returns a malloc'd buffer, or NULL.
+static char* BuildRequest(const char** uris, uint32_t count, size_t* sizeReturn)
+{
+	size_t size = 0;
+	for(uint32_t i=0; i<count; i++)
+		size += strlen(uris[i]) + 1;
+
+	char* body = (char*)malloc(size > 0 ? size : 1);
+	if(body == NULL)
+		return NULL;
+
+	char* p = body;
+	for(uint32_t i=0; i<count; i++) {
+		size_t len = strlen(uris[i]);
+		memcpy(p, uris[i], len);
+		p[len] = '\n';
+		p += len + 1;
+	}
+
+	*sizeReturn = size;
+	return body;
+}
+
+AssetBundle::AssetBundle()
+	: data(NULL), size(0), header(NULL), entries(NULL)
+{
+}
+
+AssetBundle::~AssetBundle()
+{
+	Release();
+}
+
+bool AssetBundle::Pull(AssetConnection* connection, const char** uris, uint32_t count)
+{
+	size_t bodySize;
+	char* body = BuildRequest(uris, count, &bodySize);
+	if(body == NULL)
+		return false;
+
+	void* received = NULL;
+	size_t receivedSize = 0;
+	bool ok = connection->PostAsset(ASSET_BUNDLE_URI, body, bodySize, &received, &receivedSize);
+	free(body);
+
+	if(!ok)
+		return false;
+
+	if(!Open((char*)received, receivedSize))
+		return false;
+
+	//A bundle that doesn't answer every URI belongs to some other request
+	if(GetCount() != count) {
+		Release();
+		return false;
+	}
+
+	return true;
+}
+
+bool AssetBundle::Open(char* bundleData, size_t bundleSize)
+{
+	Release();
+
+	//The header and entry table are swapped to host order in place, so the accessors can read them directly
+	AssetBundleHeader* bundleHeader = (AssetBundleHeader*)bundleData;
+	if(bundleData != NULL && bundleSize >= sizeof(AssetBundleHeader)) {
+		bundleHeader->magic = SST_OS_LEToHost32(bundleHeader->magic);
+		bundleHeader->version = SST_OS_LEToHost32(bundleHeader->version);
+		bundleHeader->count = SST_OS_LEToHost32(bundleHeader->count);
+	}
+
+	if(bundleData == NULL || bundleSize < sizeof(AssetBundleHeader) ||
+	   bundleHeader->magic != ASSET_BUNDLE_MAGIC || bundleHeader->version != ASSET_BUNDLE_VERSION ||
+	   bundleHeader->count > (bundleSize - sizeof(AssetBundleHeader)) / sizeof(AssetBundleEntry))
+	{
+		printf("Asset bundle: bad header\n");
+		free(bundleData);
+		return false;
+	}
+
+	AssetBundleEntry* bundleEntries = (AssetBundleEntry*)(bundleData + sizeof(AssetBundleHeader));
+	for(uint32_t i=0; i<bundleHeader->count; i++)
+	{
+		AssetBundleEntry& entry = bundleEntries[i];
+		entry.offset = SST_OS_LEToHost64(entry.offset);
+		entry.size = SST_OS_LEToHost64(entry.size);
+		entry.status = SST_OS_LEToHost32(entry.status);
+
+		if(entry.status != 200)
+			continue;
+
+		if(entry.offset > bundleSize || entry.size > bundleSize - entry.offset) {
+			printf("Asset bundle: entry %u runs past the end\n", i);
+			free(bundleData);
+			return false;
+		}
+
+		//Callers cast blobs to vertex and index types
+		if(entry.offset % ASSET_BUNDLE_ALIGNMENT != 0) {
+			printf("Asset bundle: entry %u is not aligned to %u bytes\n", i, ASSET_BUNDLE_ALIGNMENT);
+			free(bundleData);
+			return false;
+		}
+	}
+
+	data = bundleData;
+	size = bundleSize;
+	header = bundleHeader;
+	entries = bundleEntries;
+	return true;
+}
+
+void AssetBundle::Release()
+{
+	free(data);
+	data = NULL;
+	size = 0;
+	header = NULL;
+	entries = NULL;
+}
+
+const void* AssetBundle::GetAsset(uint32_t index, size_t* sizeReturn) const
+{
+	if(index >= GetCount() || entries[index].status != 200) {
+		*sizeReturn = 0;
+		return NULL;
+	}
+
+	*sizeReturn = (size_t)entries[index].size;
+	return data + entries[index].offset;
+}
+
+uint32_t AssetBundle::GetStatus(uint32_t index) const
+{
+	return index < GetCount() ? entries[index].status : 0;
+}
+
+uint32_t AssetBundle_Fetch(AssetConnection* connection, const char** uris, uint32_t count, AssetCallback callback, void* userData)
+{
+	size_t bodySize;
+	char* body = BuildRequest(uris, count, &bodySize);
+	if(body == NULL)
+		return 0;
+
+	uint32_t id = connection->PostAsync(ASSET_BUNDLE_URI, body, bodySize, callback, userData);
+	free(body);
+	return id;
+}
+
+void AssetBundle_Benchmark(const char* host, const char* uri, uint32_t count)
+{
+	AssetConnection conn;
+	if(!conn.Initialize(host, 1)) {
+		printf("Bundle benchmark: couldn't initialize\n");
+		conn.Shutdown();
+		return;
+	}
+
+	//A distinct URI for each slot, so neither path can answer several slots with one asset
+	if(strlen(uri) + 16 > ASSET_MAX_URL) {
+		printf("Bundle benchmark: URI too long\n");
+		conn.Shutdown();
+		return;
+	}
+
+	char* names = new char[count * ASSET_MAX_URL];
+	const char** uris = new const char*[count];
+	const char* separator = strchr(uri, '?') != NULL ? "&" : "?";
+	for(uint32_t i=0; i<count; i++) {
+		sprintf(names + i * ASSET_MAX_URL, "%s%si=%u", uri, separator, i);
+		uris[i] = names + i * ASSET_MAX_URL;
+	}
+
+	//A request per asset
+	uint64_t pulledBytes = 0;
+	uint32_t failed = 0;
+	uint64_t start = SST_OS_GetMicroTime();
+
+	for(uint32_t i=0; i<count; i++)
+	{
+		void* asset;
+		size_t len;
+		if(conn.PullAsset(uris[i], &asset, &len)) {
+			pulledBytes += len;
+			free(asset);
+		} else {
+			failed++;
+		}
+	}
+
+	uint64_t pullMicros = SST_OS_GetMicroTime() - start;
+
+	//One request for all of them
+	AssetBundle bundle;
+	uint64_t bundleBytes = 0;
+	start = SST_OS_GetMicroTime();
+
+	bool bundleOk = bundle.Pull(&conn, uris, count);
+	if(bundleOk) {
+		for(uint32_t i=0; i<count; i++) {
+			size_t len;
+			if(bundle.GetAsset(i, &len) != NULL)
+				bundleBytes += len;
+		}
+	}
+
+	uint64_t bundleMicros = SST_OS_GetMicroTime() - start;
+
+	printf("Bundle benchmark: %u x %s%si=N (%.1f KB): PullAsset each %.1f ms, %.1f us per asset, %.1f KB of assets; "
+		"one bundle %.1f ms, %.1f us per asset, %.1f KB of assets in %.1f KB received%s\n",
+		count, uri, separator, count ? (double)pulledBytes / 1024.0 / count : 0.0,
+		(double)pullMicros / 1000.0, count ? (double)pullMicros / count : 0.0, (double)pulledBytes / 1024.0,
+		(double)bundleMicros / 1000.0, count ? (double)bundleMicros / count : 0.0, (double)bundleBytes / 1024.0,
+		(double)bundle.GetSize() / 1024.0,
+		failed || !bundleOk || bundleBytes != pulledBytes ? ", SOME FETCHES FAILED" : "");
+
+	bundle.Release();
+	delete[] uris;
+	delete[] names;
+	conn.Shutdown();
+}
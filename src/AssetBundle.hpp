@@ -0,0 +1,80 @@
+#pragma once
+
+#include <pstdint.h>
+
+#include "AssetConnection.hpp"
+
+//Where the asset server answers bundle requests
+#define ASSET_BUNDLE_URI "/bundle"
+
+#define ASSET_BUNDLE_MAGIC 0x425A4E4F		//"ONZB" read as a little-endian uint32_t
+#define ASSET_BUNDLE_VERSION 1
+
+//Blobs start on multiples of this, so data handed out is aligned for any vertex or index type
+#define ASSET_BUNDLE_ALIGNMENT 16
+
+/*
+Bundle container, little-endian:
+	AssetBundleHeader
+	AssetBundleEntry[count], in the order the URIs were asked for
+	blobs, each at an offset from the start of the container aligned to ASSET_BUNDLE_ALIGNMENT
+Entries for the same asset may share a blob. The request is a POST of the URIs, one per line.
+*/
+struct AssetBundleHeader
+{
+	uint32_t magic;
+	uint32_t version;
+	uint32_t count;
+	uint32_t reserved;
+};
+
+struct AssetBundleEntry
+{
+	uint64_t offset;
+	uint64_t size;
+	uint32_t status;			//HTTP status the asset would have had on its own; only 200 has a blob
+	uint32_t reserved;
+};
+
+/*
+A received bundle. Assets are handed out as pointers into the received buffer, which the
+bundle owns from Open until Release; nothing is copied out.
+*/
+class AssetBundle
+{
+	public:
+		AssetBundle();
+		~AssetBundle();
+
+		//Asks for every URI in one request on the calling thread, blocking until done
+		bool Pull(AssetConnection* connection, const char** uris, uint32_t count);
+
+		//Takes a malloc'd container, e.g. the data of a fetch queued with AssetBundle_Fetch (set the
+		//fetch's data to NULL to keep it). Checks the header and every entry; on failure data is freed.
+		bool Open(char* data, size_t size);
+
+		//Frees the buffer; pointers from GetAsset are invalid afterwards
+		void Release();
+
+		uint32_t GetCount() const { return header != NULL ? header->count : 0; }
+
+		//Bytes received, which is less than the assets add up to when entries share a blob
+		size_t GetSize() const { return size; }
+
+		//The asset asked for at index, or NULL if the server didn't have it. Valid until Release.
+		const void* GetAsset(uint32_t index, size_t* sizeReturn) const;
+		uint32_t GetStatus(uint32_t index) const;
+
+	private:
+		char* data;
+		size_t size;
+		const AssetBundleHeader* header;
+		const AssetBundleEntry* entries;
+};
+
+//Queues one request for every URI. The callback's fetch data is the container, for AssetBundle::Open.
+uint32_t AssetBundle_Fetch(AssetConnection* connection, const char** uris, uint32_t count, AssetCallback callback, void* userData);
+
+//Downloads 'count' distinct URIs, uri with an index query appended, with a PullAsset each and then as a
+//single bundle, and prints the time and the payload bytes of each
+void AssetBundle_Benchmark(const char* host, const char* uri, uint32_t count);
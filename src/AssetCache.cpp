@@ -0,0 +1,721 @@
+#include "AssetCache.hpp"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <SST/SST_FileSys.h>
+#include <SST/SST_SysMem.h>
+#include <SST/SST_Time.h>
+
+#define INDEX_MAGIC "ONZC 1"
+
+static void StripNewline(char* line)
+{
+	size_t len = strlen(line);
+	while(len > 0 && (line[len - 1] == '\n' || line[len - 1] == '\r'))
+		line[--len] = '\0';
+}
+
+//Writes through a temporary file so a crash never leaves a half-written file under the final name
+static bool ReplaceFile(const char* tempPath, const char* path)
+{
+	remove(path);
+	if(rename(tempPath, path) != 0) {
+		remove(tempPath);
+		return false;
+	}
+	return true;
+}
+
+static bool WriteBodyFile(const char* path, const void* data, size_t size)
+{
+	char tempPath[ASSET_CACHE_MAX_PATH + 4];
+	sprintf(tempPath, "%s.tmp", path);
+
+	SST_File file = SST_OS_OpenFile(tempPath, SST_OPEN_WRITE | SST_OPEN_HINTSEQ);
+	if(file == NULL)
+		return false;
+
+	bool ok = (size == 0 || SST_OS_WriteFile(file, data, size) == size);
+	SST_OS_CloseFile(file);
+
+	if(!ok) {
+		remove(tempPath);
+		return false;
+	}
+
+	return ReplaceFile(tempPath, path);
+}
+
+AssetCache::AssetCache()
+	: connection(NULL), compression(true), maxDiskBytes(ASSET_CACHE_MAX_DISK_BYTES), scanned(false), bodyBytes(0), hits(0), misses(0), staleHits(0), failures(0), fetchedBytes(0), servedBytes(0),
+	  storedBodies(0), compressedBodies(0), storedBytes(0), diskBytes(0), compressMicros(0), decompressedBytes(0), decompressMicros(0), decompressCoreMicros(0),
+	  evictedBodies(0), evictedBytes(0), orphanedBodies(0)
+{
+	directory[0] = '\0';
+	pinLock = NULL;
+}
+
+AssetCache::~AssetCache()
+{
+	if(pinLock != NULL)
+		SST_Concurrency_DestroyMutex(pinLock);
+}
+
+bool AssetCache::Initialize(AssetConnection* conn, const char* dir, uint64_t maxBytes)
+{
+	connection = conn;
+	maxDiskBytes = maxBytes;
+
+	if(pinLock == NULL)
+		pinLock = SST_Concurrency_CreateMutex();
+	if(pinLock == NULL)
+		return false;
+
+	strncpy(directory, dir, sizeof(directory) - 1);
+	directory[sizeof(directory) - 1] = '\0';
+
+	if(SST_OS_CreateDirectory(directory) < 0) {
+		printf("Couldn't create asset cache directory %s\n", directory);
+		return false;
+	}
+
+	return true;
+}
+
+void AssetCache::IndexPath(const char* uri, char* path) const
+{
+	char name[ASSET_HASH_STRING_LENGTH + 1];
+	AssetHash_ToString(AssetHash_Compute(uri, strlen(uri)), name);
+	sprintf(path, "%s/%s.idx", directory, name);
+}
+
+void AssetCache::BodyPath(const AssetHash& hash, bool compressed, char* path) const
+{
+	char name[ASSET_HASH_STRING_LENGTH + 1];
+	AssetHash_ToString(hash, name);
+	sprintf(path, "%s/%s.%s", directory, name, compressed ? "blz" : "bin");
+}
+
+void AssetCache::PartialPath(const char* uri, char* path) const
+{
+	char name[ASSET_HASH_STRING_LENGTH + 1];
+	AssetHash_ToString(AssetHash_Compute(uri, strlen(uri)), name);
+	sprintf(path, "%s/%s.part", directory, name);
+}
+
+bool AssetCache::ReadEntry(const char* uri, Entry* entryReturn) const
+{
+	char path[ASSET_CACHE_MAX_PATH];
+	IndexPath(uri, path);
+
+	return ReadIndexFile(path, uri, entryReturn);
+}
+
+bool AssetCache::ReadIndexFile(const char* path, const char* uri, Entry* entryReturn) const
+{
+	FILE* fp = fopen(path, "rb");
+	if(fp == NULL)
+		return false;
+
+	char magic[16];
+	char storedUri[ASSET_MAX_URL];
+	char hashLine[64];
+	bool ok = false;
+
+	if(fgets(magic, sizeof(magic), fp) != NULL && fgets(storedUri, sizeof(storedUri), fp) != NULL &&
+	   fgets(hashLine, sizeof(hashLine), fp) != NULL &&
+	   fgets(entryReturn->validators.etag, ASSET_MAX_VALIDATOR, fp) != NULL &&
+	   fgets(entryReturn->validators.lastModified, ASSET_MAX_VALIDATOR, fp) != NULL)
+	{
+		StripNewline(magic);
+		StripNewline(storedUri);
+		StripNewline(entryReturn->validators.etag);
+		StripNewline(entryReturn->validators.lastModified);
+
+		unsigned long long size;
+		ok = strcmp(magic, INDEX_MAGIC) == 0 && (uri == NULL || strcmp(storedUri, uri) == 0) &&
+			 AssetHash_FromString(hashLine, &entryReturn->hash) &&
+			 sscanf(hashLine + ASSET_HASH_STRING_LENGTH, "%llu", &size) == 1;
+		if(ok)
+			entryReturn->size = size;
+	}
+
+	fclose(fp);
+	return ok;
+}
+
+bool AssetCache::WriteEntry(const char* uri, const Entry& entry) const
+{
+	char path[ASSET_CACHE_MAX_PATH];
+	char tempPath[ASSET_CACHE_MAX_PATH + 4];
+	IndexPath(uri, path);
+	sprintf(tempPath, "%s.tmp", path);
+
+	FILE* fp = fopen(tempPath, "wb");
+	if(fp == NULL)
+		return false;
+
+	char hash[ASSET_HASH_STRING_LENGTH + 1];
+	AssetHash_ToString(entry.hash, hash);
+
+	fprintf(fp, "%s\n%s\n%s %llu\n%s\n%s\n", INDEX_MAGIC, uri, hash, (unsigned long long)entry.size,
+		entry.validators.etag, entry.validators.lastModified);
+
+	bool ok = (ferror(fp) == 0);
+	ok = (fclose(fp) == 0) && ok;
+
+	if(!ok) {
+		remove(tempPath);
+		return false;
+	}
+
+	return ReplaceFile(tempPath, path);
+}
+
+bool AssetCache::HasBody(const AssetHash& hash, uint64_t size) const
+{
+	char path[ASSET_CACHE_MAX_PATH];
+	BodyPath(hash, false, path);
+
+	SST_File file = SST_OS_OpenFile(path, SST_OPEN_READ);
+	if(file != NULL) {
+		uint64_t fileSize = SST_OS_GetFileSize(file);
+		SST_OS_CloseFile(file);
+		return fileSize == size;
+	}
+
+	//Compressed bodies say how big they were in their header
+	BodyPath(hash, true, path);
+	file = SST_OS_OpenFile(path, SST_OPEN_READ);
+	if(file == NULL)
+		return false;
+
+	AssetCompressHeader header;
+	uint64_t storedSize;
+	bool ok = SST_OS_ReadFile(file, &header, sizeof(header)) == sizeof(header) &&
+			  AssetCompress_GetSize(&header, sizeof(header), &storedSize) && storedSize == size;
+	SST_OS_CloseFile(file);
+	return ok;
+}
+
+bool AssetCache::StoreBody(const AssetHash& hash, const void* data, size_t size, bool compress)
+{
+	char path[ASSET_CACHE_MAX_PATH];
+
+	//Same hash, same bytes: another URI (or an earlier download) already stored it
+	if(HasBody(hash, size))
+		return true;
+
+	char* packed = NULL;
+	size_t packedSize = 0;
+
+	if(compress && size > 0)
+	{
+		packed = (char*)malloc(AssetCompress_Bound(size));
+		if(packed != NULL) {
+			uint64_t start = SST_OS_GetMicroTime();
+			packedSize = AssetCompress_Compress(data, size, packed);
+			compressMicros += SST_OS_GetMicroTime() - start;
+		}
+	}
+
+	//Too little saved isn't worth losing the zero-copy mapping for
+	bool compressed = (packed != NULL && packedSize <= size - size / ASSET_CACHE_MIN_SAVING);
+	BodyPath(hash, compressed, path);
+
+	bool ok = compressed ? WriteBodyFile(path, packed, packedSize) : WriteBodyFile(path, data, size);
+	free(packed);
+
+	if(ok) {
+		Body* body = GetBody(hash);
+		body->stored = true;
+		body->compressed = compressed;
+		body->diskSize = compressed ? packedSize : size;
+		bodyBytes += body->diskSize;
+
+		storedBodies++;
+		storedBytes += size;
+		diskBytes += body->diskSize;
+		if(compressed)
+			compressedBodies++;
+	}
+
+	return ok;
+}
+
+void AssetCache::ScanBodies()
+{
+	scanned = true;
+
+	SST_Dir dir = SST_OS_OpenDirectory(directory);
+	if(dir == NULL)
+		return;
+
+	//Files are <hash>.idx named after the URI's hash, or <hash>.bin / <hash>.blz named after the body's
+	SST_FileInfo info;
+	while(SST_OS_ReadNextDirectoryEntry(dir, &info))
+	{
+		AssetHash hash;
+		if(info.isDir || info.nameLen != ASSET_HASH_STRING_LENGTH + 4 || !AssetHash_FromString(info.name, &hash))
+			continue;
+
+		const char* ext = info.name + ASSET_HASH_STRING_LENGTH;
+		if(strcmp(ext, ".idx") == 0) {
+			char path[ASSET_CACHE_MAX_PATH + SST_FILENAME_MAX];
+			sprintf(path, "%s/%s", directory, info.name);
+
+			Entry entry;
+			if(ReadIndexFile(path, NULL, &entry))
+				GetBody(entry.hash)->refs++;
+		} else if(strcmp(ext, ".bin") == 0 || strcmp(ext, ".blz") == 0) {
+			Body* body = GetBody(hash);
+			body->stored = true;
+			body->compressed = (strcmp(ext, ".blz") == 0);
+			body->diskSize = info.size;
+			bodyBytes += info.size;
+		}
+	}
+
+	SST_OS_CloseDirectory(dir);
+
+	//Left behind by index files that moved on to other bodies while they were mapped
+	ZArray<uint64_t> orphans;
+	for(ZHashMap<uint64_t, Body>::Iterator itr = bodies.Begin(); itr != bodies.End(); ++itr)
+	{
+		if(itr.GetValue().refs == 0)
+			orphans.PushBack(itr.GetKey());
+	}
+
+	for(size_t i=0; i<orphans.Size(); i++) {
+		DeleteBody(&bodies.Get(orphans.Data()[i]));
+		bodies.Erase(orphans.Data()[i]);
+		orphanedBodies++;
+	}
+}
+
+AssetCache::Body* AssetCache::GetBody(const AssetHash& hash)
+{
+	ZHashMap<uint64_t, Body>::Iterator itr = bodies.Find(hash.lo);
+	if(itr != bodies.End())
+		return &itr.GetValue();
+
+	Body body;
+	body.hash = hash;
+	body.refs = 0;
+	body.stored = false;
+	body.compressed = false;
+	body.diskSize = 0;
+	body.lastUsed = 0;
+	bodies.Put(hash.lo, body);
+
+	return &bodies.Get(hash.lo);
+}
+
+void AssetCache::ReleaseBody(const AssetHash& hash)
+{
+	ZHashMap<uint64_t, Body>::Iterator itr = bodies.Find(hash.lo);
+	if(itr == bodies.End())
+		return;
+
+	Body* body = &itr.GetValue();
+	if(body->refs > 0)
+		body->refs--;
+	if(body->refs > 0)
+		return;
+
+	if(body->stored)
+		orphanedBodies++;
+	DeleteBody(body);
+	bodies.Erase(hash.lo);
+}
+
+void AssetCache::DeleteBody(Body* body)
+{
+	if(!body->stored)
+		return;
+
+	char path[ASSET_CACHE_MAX_PATH];
+	BodyPath(body->hash, body->compressed, path);
+	remove(path);
+
+	bodyBytes -= body->diskSize;
+	body->stored = false;
+	body->diskSize = 0;
+}
+
+void AssetCache::Trim(const AssetHash& keep)
+{
+	while(bodyBytes > maxDiskBytes)
+	{
+		Body* oldest = NULL;
+		for(ZHashMap<uint64_t, Body>::Iterator itr = bodies.Begin(); itr != bodies.End(); ++itr)
+		{
+			Body* body = &itr.GetValue();
+			if(body->stored && body->hash != keep && !IsPinned(body->hash) && (oldest == NULL || body->lastUsed < oldest->lastUsed))
+				oldest = body;
+		}
+
+		//Only the body just used is left, and it's allowed to be bigger than the cap on its own
+		if(oldest == NULL)
+			return;
+
+		//Index files naming it keep the record, so they count as not cached until it's downloaded again
+		evictedBodies++;
+		evictedBytes += oldest->diskSize;
+		DeleteBody(oldest);
+		if(oldest->refs == 0) {
+			uint64_t key = oldest->hash.lo;
+			bodies.Erase(key);
+		}
+	}
+}
+
+void AssetCache::PinBody(const AssetHash& hash)
+{
+	SST_Concurrency_LockMutex(pinLock);
+	ZHashMap<uint64_t, uint32_t>::Iterator itr = pins.Find(hash.lo);
+	if(itr != pins.End())
+		itr.GetValue()++;
+	else
+		pins.Put(hash.lo, 1);
+	SST_Concurrency_UnlockMutex(pinLock);
+}
+
+void AssetCache::UnpinBody(const AssetHash& hash)
+{
+	SST_Concurrency_LockMutex(pinLock);
+	ZHashMap<uint64_t, uint32_t>::Iterator itr = pins.Find(hash.lo);
+	if(itr != pins.End() && --itr.GetValue() == 0)
+		pins.Erase(hash.lo);
+	SST_Concurrency_UnlockMutex(pinLock);
+}
+
+bool AssetCache::IsPinned(const AssetHash& hash)
+{
+	SST_Concurrency_LockMutex(pinLock);
+	bool pinned = pins.Find(hash.lo) != pins.End();
+	SST_Concurrency_UnlockMutex(pinLock);
+	return pinned;
+}
+
+bool AssetCache::MapBody(const Entry& entry, AssetData* asset)
+{
+	char path[ASSET_CACHE_MAX_PATH];
+	BodyPath(entry.hash, false, path);
+
+	SST_File file = SST_OS_OpenFile(path, SST_OPEN_READ);
+	if(file == NULL)
+		return LoadCompressedBody(entry, asset);
+
+	if(SST_OS_GetFileSize(file) != entry.size) {
+		SST_OS_CloseFile(file);
+		return false;
+	}
+
+	//Empty files can't be mapped
+	SST_MemoryMap map = NULL;
+	if(entry.size > 0) {
+		map = SST_OS_CreateMmap(file, 0, 0, SST_PROTECT_READ);
+		if(map == NULL) {
+			SST_OS_CloseFile(file);
+			return false;
+		}
+	}
+
+	asset->file = file;
+	asset->map = map;
+	asset->data = map != NULL ? SST_OS_GetMmapBase(map) : NULL;
+	asset->size = (size_t)entry.size;
+	asset->hash = entry.hash;
+	return true;
+}
+
+bool AssetCache::LoadCompressedBody(const Entry& entry, AssetData* asset)
+{
+	char path[ASSET_CACHE_MAX_PATH];
+	BodyPath(entry.hash, true, path);
+
+	SST_File file = SST_OS_OpenFile(path, SST_OPEN_READ);
+	if(file == NULL)
+		return false;
+
+	size_t fileSize = (size_t)SST_OS_GetFileSize(file);
+	SST_MemoryMap map = fileSize > 0 ? SST_OS_CreateMmap(file, 0, 0, SST_PROTECT_READ) : NULL;
+	char* body = (char*)malloc(entry.size > 0 ? (size_t)entry.size : 1);
+
+	uint64_t start = SST_OS_GetMicroTime();
+	bool ok = map != NULL && body != NULL &&
+			  AssetCompress_Decompress(SST_OS_GetMmapBase(map), fileSize, body, (size_t)entry.size, ASSET_CACHE_DECOMPRESS_THREADS);
+	uint64_t micros = SST_OS_GetMicroTime() - start;
+
+	if(map != NULL)
+		SST_OS_DestroyMmap(map);
+	SST_OS_CloseFile(file);
+
+	if(!ok) {
+		printf("Compressed cache file %s is corrupt\n", path);
+		free(body);
+		return false;
+	}
+
+	//Small bodies have fewer blocks than threads to spread over
+	uint64_t blocks = (entry.size + ASSET_COMPRESS_BLOCK - 1) / ASSET_COMPRESS_BLOCK;
+	decompressedBytes += entry.size;
+	decompressMicros += micros;
+	decompressCoreMicros += micros * (blocks < ASSET_CACHE_DECOMPRESS_THREADS ? (blocks > 0 ? blocks : 1) : ASSET_CACHE_DECOMPRESS_THREADS);
+
+	asset->owned = body;
+	asset->data = entry.size > 0 ? body : NULL;
+	asset->size = (size_t)entry.size;
+	asset->hash = entry.hash;
+	return true;
+}
+
+uint32_t AssetCache::Fetch(const char* uri, AssetCacheCallback callback, void* userData, bool large)
+{
+	Request* request = new Request();
+	request->cache = this;
+	strncpy(request->uri, uri, ASSET_MAX_URL - 1);
+	request->uri[ASSET_MAX_URL - 1] = '\0';
+	request->callback = callback;
+	request->userData = userData;
+	request->compress = compression;
+	request->asset = NULL;
+	request->cached = false;
+
+	//Pinned before looking, so Trim can't delete the body between here and the answer
+	if(ReadEntry(uri, &request->entry)) {
+		PinBody(request->entry.hash);
+		request->cached = HasBody(request->entry.hash, request->entry.size);
+		if(!request->cached)
+			UnpinBody(request->entry.hash);
+	}
+
+	uint32_t id;
+	if(large && !request->cached) {
+		char resumePath[ASSET_CACHE_MAX_PATH];
+		PartialPath(uri, resumePath);
+		id = connection->FetchRanged(uri, OnFetchDone, request, NULL, 0, resumePath, ProcessFetch);
+	} else {
+		id = connection->FetchAsync(uri, OnFetchDone, request, request->cached ? &request->entry.validators : NULL, NULL, 0, ProcessFetch);
+	}
+	if(id == 0) {
+		if(request->cached)
+			UnpinBody(request->entry.hash);
+		delete request;
+	}
+
+	return id;
+}
+
+void AssetCache::ProcessFetch(AssetFetch* fetch, void* userData)
+{
+	Request* request = (Request*)userData;
+	AssetCache* self = request->cache;
+
+	if(!self->scanned)
+		self->ScanBodies();
+
+	AssetData* asset = new AssetData();
+	strcpy(asset->uri, request->uri);
+	asset->ok = false;
+	asset->fromCache = false;
+	asset->data = NULL;
+	asset->size = 0;
+	asset->file = NULL;
+	asset->map = NULL;
+	asset->owned = NULL;
+	request->asset = asset;
+
+	if(fetch->ok && !fetch->notModified)
+	{
+		Entry entry;
+		entry.validators = fetch->response;
+		entry.hash = AssetHash_Compute(fetch->data, fetch->size);
+		entry.size = fetch->size;
+
+		self->misses++;
+		self->fetchedBytes += fetch->size;
+
+		Entry previous;
+		bool replacing = self->ReadEntry(request->uri, &previous);
+
+		if(self->StoreBody(entry.hash, fetch->data, fetch->size, request->compress) && self->MapBody(entry, asset)) {
+			if(!self->WriteEntry(request->uri, entry)) {
+				printf("Couldn't write asset cache index for %s\n", request->uri);
+			} else if(!replacing || previous.hash != entry.hash) {
+				self->GetBody(entry.hash)->refs++;
+				if(replacing)
+					self->ReleaseBody(previous.hash);
+			}
+			asset->ok = true;
+		} else {
+			//Still hand out the download, just without the cache behind it
+			printf("Couldn't cache %s\n", request->uri);
+			asset->owned = fetch->data;
+			asset->data = fetch->data;
+			asset->size = fetch->size;
+			asset->hash = entry.hash;
+			asset->ok = true;
+			fetch->data = NULL;
+		}
+	}
+	else if(request->cached && (fetch->notModified || fetch->httpStatus == 0))
+	{
+		//Not modified, or the server couldn't be reached at all: the cached copy is the best there is
+		if(self->MapBody(request->entry, asset)) {
+			asset->ok = true;
+			asset->fromCache = true;
+			self->servedBytes += asset->size;
+			if(fetch->notModified)
+				self->hits++;
+			else
+				self->staleHits++;
+		}
+	}
+
+	if(request->cached)
+		self->UnpinBody(request->entry.hash);
+
+	if(!asset->ok) {
+		self->failures++;
+		return;
+	}
+
+	//A download that couldn't be stored has no record
+	ZHashMap<uint64_t, Body>::Iterator itr = self->bodies.Find(asset->hash.lo);
+	if(itr != self->bodies.End())
+		itr.GetValue().lastUsed = SST_OS_GetMicroTime();
+	self->Trim(asset->hash);
+}
+
+void AssetCache::OnFetchDone(AssetFetch* fetch, void* userData)
+{
+	Request* request = (Request*)userData;
+	AssetCache* self = request->cache;
+	(void)fetch;
+
+	if(request->callback != NULL)
+		request->callback(request->asset, request->userData);
+	else
+		self->Release(request->asset);
+
+	delete request;
+}
+
+void AssetCache::Release(AssetData* asset)
+{
+	if(asset == NULL)
+		return;
+
+	if(asset->map != NULL)
+		SST_OS_DestroyMmap(asset->map);
+	if(asset->file != NULL)
+		SST_OS_CloseFile(asset->file);
+	free(asset->owned);
+
+	delete asset;
+}
+
+void AssetCache::Clear()
+{
+	SST_Dir dir = SST_OS_OpenDirectory(directory);
+	if(dir == NULL)
+		return;
+
+	SST_FileInfo info;
+	while(SST_OS_ReadNextDirectoryEntry(dir, &info))
+	{
+		if(info.isDir || info.nameLen < 4)
+			continue;
+
+		//Interrupted ranged downloads leave <hash>.part.range and <hash>.part.<chunk>
+		const char* ext = info.name + info.nameLen - 4;
+		if(strcmp(ext, ".idx") == 0 || strcmp(ext, ".bin") == 0 || strcmp(ext, ".blz") == 0 || strcmp(ext, ".tmp") == 0 || strstr(info.name, ".part.") != NULL) {
+			char path[ASSET_CACHE_MAX_PATH + SST_FILENAME_MAX];
+			sprintf(path, "%s/%s", directory, info.name);
+			remove(path);
+		}
+	}
+
+	SST_OS_CloseDirectory(dir);
+
+	//Counted again from the directory by the next fetch
+	bodies.Clear();
+	bodyBytes = 0;
+	scanned = false;
+}
+
+void AssetCache::PrintStats() const
+{
+	printf("AssetCache: %u not modified, %u downloaded, %u served stale, %u failed; %.2f MB downloaded, %.2f MB served from disk\n",
+		hits, misses, staleHits, failures,
+		(double)fetchedBytes / (1024.0 * 1024.0), (double)servedBytes / (1024.0 * 1024.0));
+	printf("AssetCache: %u bodies stored (%u compressed), %.2f MB in %.2f MB on disk, compressed at %.1f MB/s; %.2f MB decompressed at %.1f MB/s, %.1f MB/s per core\n",
+		storedBodies, compressedBodies, (double)storedBytes / (1024.0 * 1024.0), (double)diskBytes / (1024.0 * 1024.0),
+		compressMicros ? (double)storedBytes / (1024.0 * 1024.0) / ((double)compressMicros / 1000000.0) : 0.0,
+		(double)decompressedBytes / (1024.0 * 1024.0),
+		decompressMicros ? (double)decompressedBytes / (1024.0 * 1024.0) / ((double)decompressMicros / 1000000.0) : 0.0,
+		decompressCoreMicros ? (double)decompressedBytes / (1024.0 * 1024.0) / ((double)decompressCoreMicros / 1000000.0) : 0.0);
+	printf("AssetCache: %.2f MB of bodies on disk of %.2f MB allowed, %u evicted (%.2f MB), %u deleted once no index named them\n",
+		(double)bodyBytes / (1024.0 * 1024.0), (double)maxDiskBytes / (1024.0 * 1024.0), evictedBodies,
+		(double)evictedBytes / (1024.0 * 1024.0), orphanedBodies);
+}
+
+struct AssetCacheBenchmarkState
+{
+	AssetCache* cache;
+	uint32_t done;
+	uint32_t failed;
+};
+
+static void AssetCacheBenchmarkCallback(AssetData* asset, void* userData)
+{
+	AssetCacheBenchmarkState* state = (AssetCacheBenchmarkState*)userData;
+
+	state->done++;
+	if(!asset->ok)
+		state->failed++;
+
+	state->cache->Release(asset);
+}
+
+void AssetCache_Benchmark(const char* host, const char** uris, uint32_t count)
+{
+	AssetConnection conn;
+	AssetCache cache;
+
+	if(!conn.Initialize(host) || !cache.Initialize(&conn, ASSET_CACHE_DIRECTORY "-benchmark")) {
+		printf("Asset cache benchmark: couldn't initialize\n");
+		conn.Shutdown();
+		return;
+	}
+
+	cache.Clear();
+
+	for(int pass=0; pass<2; pass++)
+	{
+		AssetCacheBenchmarkState state = { &cache, 0, 0 };
+		uint64_t bytesBefore = cache.GetFetchedBytes();
+		uint64_t start = SST_OS_GetMicroTime();
+
+		for(uint32_t i=0; i<count; i++)
+			cache.Fetch(uris[i], AssetCacheBenchmarkCallback, &state);
+
+		while(state.done < count) {
+			conn.Poll();
+			SST_Concurrency_SleepThread(1);
+		}
+
+		uint64_t micros = SST_OS_GetMicroTime() - start;
+
+		printf("Asset cache benchmark, %s: %u assets in %.1f ms, %.2f MB downloaded%s\n",
+			pass == 0 ? "cold" : "warm", count, (double)micros / 1000.0,
+			(double)(cache.GetFetchedBytes() - bytesBefore) / (1024.0 * 1024.0),
+			state.failed ? ", SOME FETCHES FAILED" : "");
+	}
+
+	cache.PrintStats();
+	cache.Clear();
+	conn.Shutdown();
+}
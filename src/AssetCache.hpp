@@ -0,0 +1,199 @@
+#pragma once
+
+#include <SST/SST_File.h>
+#include <SST/SST_Mmap.h>
+#include <ZSTL/ZHashMap.hpp>
+
+#include "AssetCompress.hpp"
+#include "AssetConnection.hpp"
+#include "AssetHash.hpp"
+
+//Where the app keeps its cache, relative to the working directory
+#define ASSET_CACHE_DIRECTORY "assetcache"
+
+#define ASSET_CACHE_MAX_PATH 512
+
+//Bodies are stored compressed when that saves at least 1/ASSET_CACHE_MIN_SAVING of them, and
+//decompressed on this many threads when loaded
+#define ASSET_CACHE_MIN_SAVING 8
+#define ASSET_CACHE_DECOMPRESS_THREADS 4
+
+//Disk the stored bodies may take before the least recently used ones are deleted
+#define ASSET_CACHE_MAX_DISK_BYTES (512ull * 1024 * 1024)
+
+//Asset bytes handed out by the cache. Mapped from the cache file, so they're read-only.
+//Compressed bodies are decompressed into an owned buffer instead, as is the downloaded buffer
+//handed out if the download couldn't be written to the cache.
+struct AssetData
+{
+	char uri[ASSET_MAX_URL];
+	bool ok;				//False if the asset couldn't be fetched and wasn't cached
+	bool fromCache;			//Served from disk without downloading the body
+	AssetHash hash;
+
+	const void* data;		//NULL if size is 0
+	size_t size;
+
+	SST_File file;
+	SST_MemoryMap map;
+	void* owned;
+};
+
+//Called from AssetConnection::Poll. The asset stays valid until passed to AssetCache::Release.
+typedef void (*AssetCacheCallback)(AssetData* asset, void* userData);
+
+/*
+On-disk asset cache in front of an AssetConnection. Each URI has a small index file
+naming the content hash of its body and the ETag / Last-Modified it came with; bodies
+are stored once per content hash. Every fetch of a cached URI is revalidated with a
+conditional request, and a 304 (or no answer at all) is served from the cached body.
+Bodies that compress well are stored as AssetCompress containers (<hash>.blz), the rest as is
+(<hash>.bin) so they can be mapped without a copy.
+
+Hashing, compressing, writing and mapping or decompressing bodies happen on the connection's
+decode thread, so Poll only hands out finished assets. A body is deleted once no index file
+names it any more, and the least recently used ones once they take more than maxDiskBytes.
+*/
+class AssetCache
+{
+	public:
+		AssetCache();
+		~AssetCache();
+
+		//Creates the directory if needed. The connection must outlive the cache.
+		bool Initialize(AssetConnection* connection, const char* directory = ASSET_CACHE_DIRECTORY,
+						uint64_t maxDiskBytes = ASSET_CACHE_MAX_DISK_BYTES);
+
+		//Fetches through the cache. Returns the fetch id, or 0 if it couldn't be queued. Large assets
+		//not yet cached are downloaded with FetchRanged, picking up where an interrupted download stopped.
+		uint32_t Fetch(const char* uri, AssetCacheCallback callback, void* userData, bool large = false);
+
+		void Release(AssetData* asset);
+
+		//Whether bodies stored from now on may be compressed. On by default; either kind is read back.
+		void SetCompression(bool enable) { compression = enable; }
+
+		//Deletes every cached file. Only while no fetches are outstanding, since the decode thread writes them.
+		void Clear();
+
+		uint64_t GetFetchedBytes() const { return fetchedBytes; }
+		void PrintStats() const;
+
+	private:
+		//What the index file of a URI records
+		struct Entry
+		{
+			AssetValidators validators;
+			AssetHash hash;
+			uint64_t size;
+		};
+
+		struct Request
+		{
+			AssetCache* cache;
+			char uri[ASSET_MAX_URL];
+			bool cached;
+			Entry entry;
+			bool compress;			//compression as of Fetch
+			AssetCacheCallback callback;
+			void* userData;
+			AssetData* asset;		//Made by ProcessFetch
+		};
+
+		//A body on disk or named by an index file, as the decode thread keeps count of them
+		struct Body
+		{
+			AssetHash hash;
+			uint32_t refs;			//Index files naming it
+			bool stored;			//False once evicted, or if it was never written
+			bool compressed;
+			uint64_t diskSize;
+			uint64_t lastUsed;		//Stored or served, in microseconds; 0 if neither since startup
+		};
+
+		//Decode thread: stores or maps the fetch's body into the request's asset
+		static void ProcessFetch(AssetFetch* fetch, void* userData);
+
+		//Poll: hands out the asset ProcessFetch made
+		static void OnFetchDone(AssetFetch* fetch, void* userData);
+
+		void IndexPath(const char* uri, char* path) const;
+		void BodyPath(const AssetHash& hash, bool compressed, char* path) const;
+		void PartialPath(const char* uri, char* path) const;
+
+		bool ReadEntry(const char* uri, Entry* entryReturn) const;
+		bool WriteEntry(const char* uri, const Entry& entry) const;
+
+		//Reads an index file. If uri isn't NULL, fails unless the file is the index of uri.
+		bool ReadIndexFile(const char* path, const char* uri, Entry* entryReturn) const;
+
+		bool HasBody(const AssetHash& hash, uint64_t size) const;
+
+		//Stores a downloaded body under its hash, compressed if compress is set and it's worth it; bodies already stored are left alone
+		bool StoreBody(const AssetHash& hash, const void* data, size_t size, bool compress);
+
+		//Decode thread: builds the body records from the directory the first time they're needed,
+		//deleting bodies no index file names
+		void ScanBodies();
+
+		//Decode thread: the record of a body, added if there isn't one yet
+		Body* GetBody(const AssetHash& hash);
+
+		//Decode thread: an index file stopped naming the body. Deletes it if no other one does.
+		void ReleaseBody(const AssetHash& hash);
+
+		//Decode thread: deletes a body's file, keeping its record. Where mapped files can't be deleted,
+		//one still mapped is left for the next ScanBodies to find.
+		void DeleteBody(Body* body);
+
+		//Decode thread: deletes the least recently used bodies other than keep until they fit in maxDiskBytes.
+		//Bodies a fetch is revalidating are kept too, so its 304 still finds them.
+		void Trim(const AssetHash& keep);
+
+		//Counts the fetches revalidating a body, from Fetch until their ProcessFetch is done with it
+		void PinBody(const AssetHash& hash);
+		void UnpinBody(const AssetHash& hash);
+		bool IsPinned(const AssetHash& hash);
+
+		//Maps a stored body into asset, or decompresses it. Fails if it's missing or not the expected size.
+		bool MapBody(const Entry& entry, AssetData* asset);
+		bool LoadCompressedBody(const Entry& entry, AssetData* asset);
+
+		AssetConnection* connection;
+		char directory[ASSET_CACHE_MAX_PATH];
+		bool compression;
+		uint64_t maxDiskBytes;
+
+		//Render thread, decode thread
+		SST_Mutex pinLock;
+		ZHashMap<uint64_t, uint32_t> pins;	//By hash.lo
+
+		//Decode thread only
+		ZHashMap<uint64_t, Body> bodies;	//By hash.lo
+		bool scanned;
+		uint64_t bodyBytes;			//diskSize of the stored bodies
+
+		//Written on the decode thread; PrintStats may see them slightly out of date
+		uint32_t hits;				//Revalidated with a 304
+		uint32_t misses;			//Downloaded
+		uint32_t staleHits;			//Server unreachable, served the cached copy
+		uint32_t failures;
+		uint64_t fetchedBytes;		//Bodies downloaded
+		uint64_t servedBytes;		//Bodies served from the cache
+
+		uint32_t storedBodies;
+		uint32_t compressedBodies;
+		uint64_t storedBytes;		//Size of the bodies written
+		uint64_t diskBytes;			//What they took on disk
+		uint64_t compressMicros;
+		uint64_t decompressedBytes;
+		uint64_t decompressMicros;
+		uint64_t decompressCoreMicros;	//Summed over the threads that took part
+		uint32_t evictedBodies;
+		uint64_t evictedBytes;
+		uint32_t orphanedBodies;	//Deleted once no index file named them
+};
+
+//Fetches 'count' URIs through an empty cache and then again through the filled cache, and
+//prints the time and downloaded bytes of each pass, then the cache's disk use. Uses its own cache directory.
+void AssetCache_Benchmark(const char* host, const char** uris, uint32_t count);
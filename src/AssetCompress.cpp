@@ -0,0 +1,457 @@
+#include "AssetCompress.hpp"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <SST/SST_Concurrency.h>
+#include <SST/SST_Time.h>
+#include <ZSTL/ZArray.hpp>
+
+#include "AssetConnection.hpp"
+
+#define HASH_BITS 14
+#define MIN_MATCH 4
+
+//The last bytes of a block are always literals, and no match starts this close to the end
+#define LAST_LITERALS 5
+#define MATCH_SEARCH_END 12
+
+//Fewest milliseconds each decompression benchmark repeats for
+#define BENCHMARK_MIN_MS 200
+
+static uint32_t Read32(const uint8_t* p)
+{
+	uint32_t v;
+	memcpy(&v, p, sizeof(v));
+	return v;
+}
+
+static uint32_t Hash(uint32_t v)
+{
+	return (v * 2654435761u) >> (32 - HASH_BITS);
+}
+
+//Continues a length that didn't fit its nibble
+static uint8_t* WriteLength(uint8_t* op, size_t len)
+{
+	len -= 15;
+	while(len >= 255) {
+		*op++ = 255;
+		len -= 255;
+	}
+	*op++ = (uint8_t)len;
+	return op;
+}
+
+static bool ReadLength(const uint8_t** ip, const uint8_t* ipEnd, size_t* len)
+{
+	uint8_t byte;
+	do {
+		if(*ip >= ipEnd)
+			return false;
+		byte = *(*ip)++;
+		*len += byte;
+	} while(byte == 255);
+
+	return true;
+}
+
+//Greedy single-probe matcher; table holds 1 << HASH_BITS positions
+static size_t CompressBlock(const uint8_t* src, size_t size, uint8_t* dst, uint32_t* table)
+{
+	const uint8_t* ip = src;
+	const uint8_t* anchor = src;
+	const uint8_t* end = src + size;
+	uint8_t* op = dst;
+
+	if(size > MATCH_SEARCH_END)
+	{
+		const uint8_t* searchEnd = end - MATCH_SEARCH_END;
+		const uint8_t* matchEnd = end - LAST_LITERALS;
+		uint32_t misses = 0;
+
+		//Zeroed entries point at the start of the block, which the checks below reject or match for real
+		memset(table, 0, sizeof(uint32_t) << HASH_BITS);
+
+		while(ip < searchEnd)
+		{
+			uint32_t h = Hash(Read32(ip));
+			const uint8_t* ref = src + table[h];
+			table[h] = (uint32_t)(ip - src);
+
+			if(ref >= ip || ip - ref > 65535 || Read32(ref) != Read32(ip)) {
+				//The longer nothing matches, the faster incompressible data is skipped
+				ip += 1 + (misses++ >> 6);
+				continue;
+			}
+			misses = 0;
+
+			while(ip > anchor && ref > src && ip[-1] == ref[-1]) {
+				ip--;
+				ref--;
+			}
+
+			const uint8_t* matchIp = ip + MIN_MATCH;
+			const uint8_t* matchRef = ref + MIN_MATCH;
+			while(matchIp < matchEnd && *matchIp == *matchRef) {
+				matchIp++;
+				matchRef++;
+			}
+
+			size_t literals = (size_t)(ip - anchor);
+			size_t matchLen = (size_t)(matchIp - ip) - MIN_MATCH;
+			size_t offset = (size_t)(ip - ref);
+
+			uint8_t* token = op++;
+			*token = (uint8_t)(((literals >= 15 ? 15 : literals) << 4) | (matchLen >= 15 ? 15 : matchLen));
+			if(literals >= 15)
+				op = WriteLength(op, literals);
+			memcpy(op, anchor, literals);
+			op += literals;
+			*op++ = (uint8_t)(offset & 0xFF);
+			*op++ = (uint8_t)(offset >> 8);
+			if(matchLen >= 15)
+				op = WriteLength(op, matchLen);
+
+			ip = matchIp;
+			anchor = ip;
+
+			//Runs often continue right where the match ended
+			if(ip < searchEnd)
+				table[Hash(Read32(ip - 2))] = (uint32_t)(ip - 2 - src);
+		}
+	}
+
+	size_t literals = (size_t)(end - anchor);
+	*op++ = (uint8_t)((literals >= 15 ? 15 : literals) << 4);
+	if(literals >= 15)
+		op = WriteLength(op, literals);
+	memcpy(op, anchor, literals);
+	op += literals;
+
+	return (size_t)(op - dst);
+}
+
+//Every length and offset is checked, so corrupt data fails instead of reading or writing out of bounds
+static bool DecompressBlock(const uint8_t* ip, size_t srcSize, uint8_t* dst, size_t dstSize)
+{
+	const uint8_t* ipEnd = ip + srcSize;
+	uint8_t* op = dst;
+	uint8_t* opEnd = dst + dstSize;
+
+	for(;;)
+	{
+		if(ip >= ipEnd)
+			return false;
+
+		uint32_t token = *ip++;
+
+		size_t literals = token >> 4;
+
+		//Short runs copy a fixed 16 bytes, which compiles to a couple of moves, whenever both sides have room past them
+		if(literals < 15 && ipEnd - ip >= 16 + 2 && opEnd - op >= 16) {
+			memcpy(op, ip, 16);
+			op += literals;
+			ip += literals;
+		} else {
+			if(literals == 15 && !ReadLength(&ip, ipEnd, &literals))
+				return false;
+			if(literals > (size_t)(ipEnd - ip) || literals > (size_t)(opEnd - op))
+				return false;
+
+			memcpy(op, ip, literals);
+			op += literals;
+			ip += literals;
+		}
+
+		if(ip == ipEnd)
+			return op == opEnd;
+
+		if(ipEnd - ip < 2)
+			return false;
+		size_t offset = ip[0] | ((size_t)ip[1] << 8);
+		ip += 2;
+		if(offset == 0 || offset > (size_t)(op - dst))
+			return false;
+
+		size_t matchLen = token & 15;
+		if(matchLen == 15 && !ReadLength(&ip, ipEnd, &matchLen))
+			return false;
+		matchLen += MIN_MATCH;
+		if(matchLen > (size_t)(opEnd - op))
+			return false;
+
+		const uint8_t* from = op - offset;
+		if(offset >= 16 && matchLen <= 16 && opEnd - op >= 16) {
+			memcpy(op, from, 16);
+		} else if(offset >= matchLen) {
+			memcpy(op, from, matchLen);
+		} else {
+			//Overlapping: the match repeats bytes it's writing. Eight at a time as long as that reads only written bytes.
+			size_t i = 0;
+			if(offset >= 8)
+				for(; i + 8 <= matchLen; i += 8)
+					memcpy(op + i, from + i, 8);
+			for(; i < matchLen; i++)
+				op[i] = from[i];
+		}
+		op += matchLen;
+	}
+}
+
+size_t AssetCompress_Bound(size_t size)
+{
+	size_t blocks = (size + ASSET_COMPRESS_BLOCK - 1) / ASSET_COMPRESS_BLOCK;
+	return sizeof(AssetCompressHeader) + blocks * sizeof(uint32_t) + size + size / 255 + blocks * 16;
+}
+
+size_t AssetCompress_Compress(const void* src, size_t size, void* dst)
+{
+	uint32_t blockCount = (uint32_t)((size + ASSET_COMPRESS_BLOCK - 1) / ASSET_COMPRESS_BLOCK);
+
+	AssetCompressHeader* header = (AssetCompressHeader*)dst;
+	header->magic = ASSET_COMPRESS_MAGIC;
+	header->version = ASSET_COMPRESS_VERSION;
+	header->size = size;
+	header->blockSize = ASSET_COMPRESS_BLOCK;
+	header->blockCount = blockCount;
+
+	uint32_t* blockSizes = (uint32_t*)(header + 1);
+	uint8_t* op = (uint8_t*)(blockSizes + blockCount);
+	uint32_t* table = new uint32_t[1 << HASH_BITS];
+
+	for(uint32_t i=0; i<blockCount; i++)
+	{
+		const uint8_t* block = (const uint8_t*)src + (size_t)i * ASSET_COMPRESS_BLOCK;
+		size_t n = size - (size_t)i * ASSET_COMPRESS_BLOCK;
+		if(n > ASSET_COMPRESS_BLOCK)
+			n = ASSET_COMPRESS_BLOCK;
+
+		size_t compressed = CompressBlock(block, n, op, table);
+		if(compressed >= n) {
+			memcpy(op, block, n);
+			blockSizes[i] = (uint32_t)n | ASSET_COMPRESS_STORED;
+			op += n;
+		} else {
+			blockSizes[i] = (uint32_t)compressed;
+			op += compressed;
+		}
+	}
+
+	delete[] table;
+	return (size_t)(op - (uint8_t*)dst);
+}
+
+bool AssetCompress_GetSize(const void* src, size_t srcSize, uint64_t* sizeReturn)
+{
+	const AssetCompressHeader* header = (const AssetCompressHeader*)src;
+	if(srcSize < sizeof(AssetCompressHeader) || header->magic != ASSET_COMPRESS_MAGIC ||
+	   header->version != ASSET_COMPRESS_VERSION || header->blockSize == 0 || header->blockSize > ASSET_COMPRESS_STORED ||
+	   header->blockCount != (header->size + header->blockSize - 1) / header->blockSize)
+	{
+		return false;
+	}
+
+	*sizeReturn = header->size;
+	return true;
+}
+
+//A contiguous run of blocks for one thread
+struct DecompressJob
+{
+	const AssetCompressHeader* header;
+	const uint32_t* blockSizes;
+	const uint8_t* base;		//Start of the compressed data
+	const uint64_t* offsets;	//Of each block from base
+	uint8_t* dst;
+	uint32_t first;
+	uint32_t count;
+	bool ok;
+};
+
+static void RunDecompressJob(DecompressJob* job)
+{
+	const AssetCompressHeader* header = job->header;
+	job->ok = true;
+
+	for(uint32_t i=job->first; job->ok && i<job->first + job->count; i++)
+	{
+		uint64_t start = (uint64_t)i * header->blockSize;
+		size_t n = (size_t)(header->size - start < header->blockSize ? header->size - start : header->blockSize);
+		const uint8_t* block = job->base + job->offsets[i];
+		uint32_t blockSize = job->blockSizes[i];
+
+		if(blockSize & ASSET_COMPRESS_STORED) {
+			if((blockSize & ~ASSET_COMPRESS_STORED) != n)
+				job->ok = false;
+			else
+				memcpy(job->dst + start, block, n);
+		} else {
+			job->ok = DecompressBlock(block, blockSize, job->dst + start, n);
+		}
+	}
+}
+
+static int DecompressThreadMain(void* arg)
+{
+	RunDecompressJob((DecompressJob*)arg);
+	return 0;
+}
+
+bool AssetCompress_Decompress(const void* src, size_t srcSize, void* dst, size_t dstSize, uint32_t threads)
+{
+	uint64_t size;
+	if(!AssetCompress_GetSize(src, srcSize, &size) || size != dstSize)
+		return false;
+
+	const AssetCompressHeader* header = (const AssetCompressHeader*)src;
+	if(header->blockCount > (srcSize - sizeof(AssetCompressHeader)) / sizeof(uint32_t))
+		return false;
+
+	const uint32_t* blockSizes = (const uint32_t*)(header + 1);
+	const uint8_t* base = (const uint8_t*)(blockSizes + header->blockCount);
+	uint64_t available = srcSize - (size_t)(base - (const uint8_t*)src);
+	uint32_t blockCount = header->blockCount;
+
+	//Where each block starts, checked against the end before any thread reads one
+	ZArray<uint64_t> offsets;
+	offsets.Resize(blockCount + 1);
+	offsets.Data()[0] = 0;
+	for(uint32_t i=0; i<blockCount; i++)
+		offsets.Data()[i + 1] = offsets.Data()[i] + (blockSizes[i] & ~ASSET_COMPRESS_STORED);
+	if(offsets.Data()[blockCount] > available)
+		return false;
+
+	if(threads > ASSET_COMPRESS_MAX_THREADS)
+		threads = ASSET_COMPRESS_MAX_THREADS;
+	if(threads > blockCount)
+		threads = blockCount;
+	if(threads == 0)
+		threads = 1;
+
+	DecompressJob jobs[ASSET_COMPRESS_MAX_THREADS];
+	SST_Thread workers[ASSET_COMPRESS_MAX_THREADS];
+	uint32_t first = 0;
+
+	for(uint32_t t=0; t<threads; t++)
+	{
+		DecompressJob& job = jobs[t];
+		job.header = header;
+		job.blockSizes = blockSizes;
+		job.base = base;
+		job.offsets = offsets.Data();
+		job.dst = (uint8_t*)dst;
+		job.first = first;
+		job.count = blockCount / threads + (t < blockCount % threads ? 1 : 0);
+		job.ok = false;
+		first += job.count;
+
+		//The calling thread takes the first run itself
+		workers[t] = t > 0 ? SST_Concurrency_CreateThread(DecompressThreadMain, &job) : NULL;
+		if(t > 0 && workers[t] == NULL)
+			RunDecompressJob(&job);
+	}
+
+	RunDecompressJob(&jobs[0]);
+
+	bool ok = true;
+	for(uint32_t t=0; t<threads; t++)
+	{
+		if(workers[t] != NULL) {
+			SST_Concurrency_WaitThread(workers[t], NULL);
+			SST_Concurrency_DestroyThread(workers[t]);
+		}
+		ok = ok && jobs[t].ok;
+	}
+
+	return ok;
+}
+
+static double MegabytesPerSecond(uint64_t bytes, uint64_t micros)
+{
+	return micros ? (double)bytes / (1024.0 * 1024.0) / ((double)micros / 1000000.0) : 0.0;
+}
+
+void AssetCompress_Benchmark(const char* host, const char* uri)
+{
+	AssetConnection conn;
+	if(!conn.Initialize(host, 1)) {
+		printf("Compression benchmark: couldn't initialize\n");
+		conn.Shutdown();
+		return;
+	}
+
+	//The same asset as is and with Accept-Encoding; the server decides whether to compress it
+	void* plain = NULL;
+	void* encoded = NULL;
+	size_t plainSize = 0;
+	size_t encodedSize = 0;
+
+	conn.SetCompression(false);
+	uint64_t wireBefore = conn.GetWireBytes();
+	bool ok = conn.PullAsset(uri, &plain, &plainSize);
+	uint64_t plainWire = conn.GetWireBytes() - wireBefore;
+
+	conn.SetCompression(true);
+	wireBefore = conn.GetWireBytes();
+	uint64_t inflatedBefore = conn.GetInflatedBytes();
+	uint64_t inflateMicrosBefore = conn.GetInflateMicros();
+	ok = conn.PullAsset(uri, &encoded, &encodedSize) && ok;
+	uint64_t encodedWire = conn.GetWireBytes() - wireBefore;
+	uint64_t inflated = conn.GetInflatedBytes() - inflatedBefore;
+	uint64_t inflateMicros = conn.GetInflateMicros() - inflateMicrosBefore;
+
+	if(!ok || plainSize != encodedSize || memcmp(plain, encoded, plainSize) != 0) {
+		printf("Compression benchmark: %s didn't download the same both ways\n", uri);
+		free(plain);
+		free(encoded);
+		conn.Shutdown();
+		return;
+	}
+
+	printf("Compression benchmark: %s is %.2f MB, %.2f MB on the wire as is, %.2f MB with Accept-Encoding",
+		uri, (double)plainSize / (1024.0 * 1024.0), (double)plainWire / (1024.0 * 1024.0), (double)encodedWire / (1024.0 * 1024.0));
+	if(inflated > 0)
+		printf(", inflated at %.1f MB/s on one core\n", MegabytesPerSecond(inflated, inflateMicros));
+	else
+		printf(" (the server didn't compress it)\n");
+
+	//The cache's format
+	char* packed = (char*)malloc(AssetCompress_Bound(plainSize));
+	char* unpacked = (char*)malloc(plainSize > 0 ? plainSize : 1);
+
+	uint64_t start = SST_OS_GetMicroTime();
+	size_t packedSize = AssetCompress_Compress(plain, plainSize, packed);
+	uint64_t compressMicros = SST_OS_GetMicroTime() - start;
+
+	printf("Compression benchmark: %.2f MB on disk (%.1f%%), compressed at %.1f MB/s\n",
+		(double)packedSize / (1024.0 * 1024.0), plainSize ? 100.0 * (double)packedSize / (double)plainSize : 0.0,
+		MegabytesPerSecond(plainSize, compressMicros));
+
+	for(uint32_t threads=1; threads<=ASSET_COMPRESS_MAX_THREADS; threads *= 2)
+	{
+		//Best of as many runs as fit in BENCHMARK_MIN_MS, so thread start-up noise doesn't dominate small assets
+		uint64_t best = 0;
+		uint64_t began = SST_OS_GetMicroTime();
+		bool decoded = true;
+		do {
+			memset(unpacked, 0, plainSize);
+			start = SST_OS_GetMicroTime();
+			decoded = AssetCompress_Decompress(packed, packedSize, unpacked, plainSize, threads) && decoded;
+			uint64_t micros = SST_OS_GetMicroTime() - start;
+			if(best == 0 || micros < best)
+				best = micros;
+		} while(SST_OS_GetMicroTime() - began < BENCHMARK_MIN_MS * 1000);
+
+		decoded = decoded && memcmp(unpacked, plain, plainSize) == 0;
+		double mbps = MegabytesPerSecond(plainSize, best);
+
+		printf("Compression benchmark: decompressed on %u threads in %.2f ms, %.1f MB/s, %.1f MB/s per core%s\n",
+			threads, (double)best / 1000.0, mbps, mbps / threads, decoded ? "" : ", OUTPUT DIFFERS");
+	}
+
+	free(packed);
+	free(unpacked);
+	free(plain);
+	free(encoded);
+	conn.Shutdown();
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <stddef.h>
+#include <pstdint.h>
+
+#define ASSET_COMPRESS_MAGIC 0x4C5A4E4F		//"ONZL" read as a little-endian uint32_t
+#define ASSET_COMPRESS_VERSION 1
+
+//Blocks are compressed independently, so each can be decompressed on any thread
+#define ASSET_COMPRESS_BLOCK (256 * 1024)
+
+#define ASSET_COMPRESS_MAX_THREADS 16
+
+//Block sizes with this bit set are stored as is, having not compressed
+#define ASSET_COMPRESS_STORED 0x80000000u
+
+/*
+Compressed container, little-endian:
+	AssetCompressHeader
+	uint32_t blockSizes[blockCount]
+	blocks, back to back
+Each block is the next ASSET_COMPRESS_BLOCK bytes (the last one may be shorter) as LZ4-style
+sequences: a token of literal length and match length nibbles, the literals, a 16-bit offset
+back into the block, with 15 in a nibble continued by bytes of up to 255. The last sequence
+is literals only. Made for decompression speed over ratio.
+*/
+struct AssetCompressHeader
+{
+	uint32_t magic;
+	uint32_t version;
+	uint64_t size;				//Uncompressed
+	uint32_t blockSize;
+	uint32_t blockCount;
+};
+
+//Room AssetCompress_Compress may need for size bytes
+size_t AssetCompress_Bound(size_t size);
+
+//Compresses into dst, which must hold AssetCompress_Bound(size) bytes. Returns the container's size.
+size_t AssetCompress_Compress(const void* src, size_t size, void* dst);
+
+//Uncompressed size of a container. Returns false if src doesn't start with a valid header; only the header is needed.
+bool AssetCompress_GetSize(const void* src, size_t srcSize, uint64_t* sizeReturn);
+
+//Decompresses a container into dst, which must hold its uncompressed size, splitting the blocks
+//between the calling thread and up to threads - 1 others. Returns false if it's corrupt.
+bool AssetCompress_Decompress(const void* src, size_t srcSize, void* dst, size_t dstSize, uint32_t threads);
+
+//Downloads uri, with and without Accept-Encoding, then compresses it for the cache and decompresses
+//it on 1 to ASSET_COMPRESS_MAX_THREADS threads. Prints wire bytes, disk bytes and MB/s per core.
+void AssetCompress_Benchmark(const char* host, const char* uri);
@@ -1,37 +1,718 @@
 #include "AssetConnection.hpp"
 
 #include <curl/curl.h>
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <SST/SST_File.h>
+#include <SST/SST_Time.h>
 
 
 #define ASSET_HOST "10.0.0.119:5000"
 
-struct MemoryStruct {
-	char *memory;
-	size_t size;
-};
+//Longest the fetch thread sleeps with nothing to do before checking for shutdown
+#define FETCH_IDLE_WAIT_MS 100
+
+//Longest the fetch thread waits on sockets, which bounds how long a newly submitted fetch waits to start
+#define FETCH_SELECT_MS 10
+
+//Decoded fetches hand their body to the decode thread in blocks of this size
+#define DECODE_BLOCK_SIZE (64 * 1024)
+
+//Smallest heap sink allocated when the body's length isn't known; curl hands over at most this much per write
+#define SINK_MIN_CAPACITY CURL_MAX_WRITE_SIZE
+
+//Requests in a row a ranged fetch lets end without receiving anything before it gives up
+#define RANGE_MAX_STALLS 8
+
+#define RANGE_MAX_PATH 512
+#define RANGE_RECORD_MAGIC "ONZR 1"
+
+#define ACCEPT_ENCODING_HEADER "Accept-Encoding: gzip, deflate"
 
-static size_t WriteMemoryCallback(void *contents, size_t size, size_t nmemb, void *userp)
+static void InitSink(AssetSink* sink, void* destination, size_t destinationSize)
 {
-	size_t realsize = size * nmemb;
-	struct MemoryStruct *mem = (struct MemoryStruct *)userp;
+	sink->data = (char*)destination;
+	sink->size = 0;
+	sink->capacity = destination != NULL ? destinationSize : 0;
+	sink->external = (destination != NULL);
+	sink->overflow = false;
+	sink->expected = 0;
+	sink->inflater = NULL;
+	sink->wireBytes = 0;
+	sink->inflateMicros = 0;
+	sink->writes = 0;
+	sink->allocations = 0;
+	sink->movedBytes = 0;
+}
+
+static void FreeSink(AssetSink* sink)
+{
+	if(!sink->external)
+		free(sink->data);
+	sink->data = NULL;
 
-	mem->memory = (char*)realloc(mem->memory, mem->size + realsize + 1);
-	if(mem->memory == NULL) {
-		/* out of memory! */ 
+	delete sink->inflater;
+	sink->inflater = NULL;
+}
+
+static bool ReserveSink(AssetSink* sink, size_t capacity)
+{
+	char* memory = (char*)realloc(sink->data, capacity);
+	if(memory == NULL) {
+		/* out of memory! */
 		printf("not enough memory (realloc returned NULL)\n");
+		return false;
+	}
+
+	if(memory != sink->data && sink->data != NULL)
+		sink->movedBytes += sink->size;
+
+	sink->allocations++;
+	sink->data = memory;
+	sink->capacity = capacity;
+	return true;
+}
+
+static bool AppendSink(AssetSink* sink, const void* contents, size_t realsize)
+{
+	sink->writes++;
+
+	if(sink->external)
+	{
+		if(realsize > sink->capacity - sink->size) {
+			sink->overflow = true;
+			return false;
+		}
+	}
+	else
+	{
+		//Heap bodies keep a NUL after the data, so there must be room for one more byte
+		size_t needed = sink->size + realsize + 1;
+		if(needed > sink->capacity)
+		{
+			size_t capacity;
+			//Content-Length of a compressed body says nothing about the inflated size
+			if(sink->data == NULL && sink->inflater == NULL && sink->expected + 1 >= needed)
+				capacity = (size_t)sink->expected + 1;
+			else
+				capacity = sink->capacity * 2;
+
+			if(capacity < SINK_MIN_CAPACITY)
+				capacity = SINK_MIN_CAPACITY;
+			if(capacity < needed)
+				capacity = needed;
+
+			if(!ReserveSink(sink, capacity))
+				return false;
+		}
+	}
+
+	memcpy(sink->data + sink->size, contents, realsize);
+	sink->size += realsize;
+	if(!sink->external)
+		sink->data[sink->size] = 0;
+
+	return true;
+}
+
+static bool InflateSinkOutput(const char* data, size_t len, void* userData)
+{
+	return AppendSink((AssetSink*)userData, data, len);
+}
+
+//Times the inflater on a chunk of a compressed body
+static bool InflateChunk(AssetSink* sink, const void* contents, size_t realsize, AssetInflateOutput output, void* userData)
+{
+	uint64_t start = SST_OS_GetMicroTime();
+	bool ok = sink->inflater->Inflate(contents, realsize, output, userData);
+	sink->inflateMicros += SST_OS_GetMicroTime() - start;
+	return ok;
+}
+
+static size_t WriteSinkCallback(void *contents, size_t size, size_t nmemb, void *userp)
+{
+	size_t realsize = size * nmemb;
+	AssetSink* sink = (AssetSink*)userp;
+
+	sink->wireBytes += realsize;
+
+	bool ok = sink->inflater != NULL ? InflateChunk(sink, contents, realsize, InflateSinkOutput, sink) : AppendSink(sink, contents, realsize);
+	if(!ok)
+		return 0;
+
+	return realsize;
+}
+
+//Copies the value of a "Name: value" header line if it has the given name
+static bool ParseHeader(const char* line, size_t len, const char* name, char* value, size_t valueSize)
+{
+	size_t nameLen = strlen(name);
+	if(len <= nameLen || line[nameLen] != ':')
+		return false;
+
+	for(size_t i=0; i<nameLen; i++)
+		if(tolower((unsigned char)line[i]) != tolower((unsigned char)name[i]))
+			return false;
+
+	const char* start = line + nameLen + 1;
+	const char* end = line + len;
+	while(start < end && (*start == ' ' || *start == '\t'))
+		start++;
+	while(end > start && (end[-1] == '\r' || end[-1] == '\n' || end[-1] == ' '))
+		end--;
+
+	size_t n = (size_t)(end - start);
+	if(n >= valueSize)
+		n = valueSize - 1;
+	memcpy(value, start, n);
+	value[n] = '\0';
+	return true;
+}
+
+//Picks the body length and encoding out of the headers. Returns false if it won't fit an external sink.
+static bool SinkHeader(AssetSink* sink, const char* line, size_t len)
+{
+	char value[32];
+
+	//A redirect or 100 Continue starts a new set of headers
+	if(len > 5 && memcmp(line, "HTTP/", 5) == 0) {
+		sink->expected = 0;
+		delete sink->inflater;
+		sink->inflater = NULL;
+	} else if(ParseHeader(line, len, "Content-Length", value, sizeof(value))) {
+		sink->expected = strtoull(value, NULL, 10);
+	} else if(ParseHeader(line, len, "Content-Encoding", value, sizeof(value)) && sink->inflater == NULL) {
+		//Only what was asked for; anything else (identity) is passed through as is
+		if(strcmp(value, "gzip") == 0 || strcmp(value, "x-gzip") == 0)
+			sink->inflater = new AssetInflater(AssetInflater::FORMAT_GZIP);
+		else if(strcmp(value, "deflate") == 0)
+			sink->inflater = new AssetInflater(AssetInflater::FORMAT_DEFLATE);
+	}
+
+	if(sink->external && sink->expected > sink->capacity) {
+		sink->overflow = true;
+		return false;
+	}
+
+	return true;
+}
+
+static size_t HeaderSinkCallback(void *contents, size_t size, size_t nmemb, void *userp)
+{
+	size_t realsize = size * nmemb;
+
+	if(!SinkHeader((AssetSink*)userp, (const char*)contents, realsize))
+		return 0;
+
+	return realsize;
+}
+
+static size_t HeaderFetchCallback(void *contents, size_t size, size_t nmemb, void *userp)
+{
+	size_t realsize = size * nmemb;
+	AssetFetch* fetch = (AssetFetch*)userp;
+	const char* line = (const char*)contents;
+
+	//A redirect or 100 Continue starts a new set of headers
+	if(realsize > 5 && memcmp(line, "HTTP/", 5) == 0) {
+		fetch->response.etag[0] = '\0';
+		fetch->response.lastModified[0] = '\0';
+	}
+
+	if(!ParseHeader(line, realsize, "ETag", fetch->response.etag, ASSET_MAX_VALIDATOR))
+		ParseHeader(line, realsize, "Last-Modified", fetch->response.lastModified, ASSET_MAX_VALIDATOR);
+
+	if(!SinkHeader(&fetch->sink, line, realsize))
+		return 0;
+
+	return realsize;
+}
+
+//What a ranged fetch knows about its body. Fetch thread only.
+struct AssetRanges
+{
+	char resumePath[RANGE_MAX_PATH];	//Empty if the download isn't kept for resuming
+	AssetValidators validators;			//Sent as If-Range, so chunks of two versions of the asset never mix
+
+	bool known;							//The server has said how long the body is
+	bool confirmed;						//The server has answered a request for this body
+	bool whole;							//The server ignores Range; one response carries the body
+	bool restart;						//The asset changed under the chunks already received
+	bool failed;
+	char error[CURL_ERROR_SIZE];
+
+	uint64_t total;
+	char* data;							//The fetch's sink
+	uint32_t chunkCount;
+	uint32_t chunksDone;
+	ZArray<uint64_t> received;			//Bytes of each chunk received, counted from its start
+	ZArray<uint32_t> pending;			//Chunks waiting for a request
+	ZArray<AssetRangeTransfer*> transfers;
+	uint32_t stalls;					//Requests in a row that ended without receiving anything
+	long httpStatus;
+};
+
+//One Range request of a ranged fetch
+struct AssetRangeTransfer
+{
+	AssetFetch* fetch;
+	uint32_t chunk;
+	CURL* handle;
+	curl_slist* headers;
+	char error[CURL_ERROR_SIZE];
+
+	long status;
+	uint64_t contentLength;
+	uint64_t contentStart;				//From Content-Range
+	uint64_t contentTotal;
+	bool checked;						//Response matched against what was asked for
+	uint64_t bytes;						//Received by this request
+};
+
+static AssetRanges* CreateRanges(const char* resumePath)
+{
+	AssetRanges* ranges = new AssetRanges();
+	ranges->resumePath[0] = '\0';
+	if(resumePath != NULL) {
+		strncpy(ranges->resumePath, resumePath, RANGE_MAX_PATH - 1);
+		ranges->resumePath[RANGE_MAX_PATH - 1] = '\0';
+	}
+	ranges->validators.etag[0] = '\0';
+	ranges->validators.lastModified[0] = '\0';
+	ranges->known = false;
+	ranges->confirmed = false;
+	ranges->whole = false;
+	ranges->restart = false;
+	ranges->failed = false;
+	ranges->error[0] = '\0';
+	ranges->total = 0;
+	ranges->data = NULL;
+	ranges->chunkCount = 0;
+	ranges->chunksDone = 0;
+	ranges->stalls = 0;
+	ranges->httpStatus = 0;
+	return ranges;
+}
+
+static bool FailRanges(AssetRanges* ranges, const char* error)
+{
+	ranges->failed = true;
+	strcpy(ranges->error, error);
+	return false;
+}
+
+static uint64_t ChunkStart(uint32_t chunk)
+{
+	return (uint64_t)chunk * ASSET_RANGE_CHUNK;
+}
+
+static uint64_t ChunkEnd(const AssetRanges* ranges, uint32_t chunk)
+{
+	if(ranges->whole)
+		return ranges->total;
+
+	uint64_t end = ChunkStart(chunk) + ASSET_RANGE_CHUNK;
+	return ranges->known && end > ranges->total ? ranges->total : end;
+}
+
+static void RangeRecordPath(const AssetRanges* ranges, char* path)
+{
+	sprintf(path, "%s.range", ranges->resumePath);
+}
+
+static void RangeChunkPath(const AssetRanges* ranges, uint32_t chunk, char* path)
+{
+	sprintf(path, "%s.%u", ranges->resumePath, chunk);
+}
+
+//The record says which download the chunk files belong to; they hold what each chunk received from its start
+static bool WriteRangeRecord(const AssetRanges* ranges, const char* url)
+{
+	char path[RANGE_MAX_PATH + 16];
+	RangeRecordPath(ranges, path);
+
+	FILE* fp = fopen(path, "wb");
+	if(fp == NULL)
+		return false;
+
+	fprintf(fp, "%s\n%s\n%llu %u\n%s\n%s\n", RANGE_RECORD_MAGIC, url, (unsigned long long)ranges->total, ASSET_RANGE_CHUNK,
+		ranges->validators.etag, ranges->validators.lastModified);
+
+	bool ok = (ferror(fp) == 0);
+	return (fclose(fp) == 0) && ok;
+}
+
+static bool ReadRangeRecord(const AssetRanges* ranges, const char* url, uint64_t* totalReturn, AssetValidators* validatorsReturn)
+{
+	char path[RANGE_MAX_PATH + 16];
+	RangeRecordPath(ranges, path);
+
+	FILE* fp = fopen(path, "rb");
+	if(fp == NULL)
+		return false;
+
+	char magic[16];
+	char storedUrl[ASSET_MAX_URL];
+	char sizes[64];
+	bool ok = false;
+
+	if(fgets(magic, sizeof(magic), fp) != NULL && fgets(storedUrl, sizeof(storedUrl), fp) != NULL &&
+	   fgets(sizes, sizeof(sizes), fp) != NULL &&
+	   fgets(validatorsReturn->etag, ASSET_MAX_VALIDATOR, fp) != NULL &&
+	   fgets(validatorsReturn->lastModified, ASSET_MAX_VALIDATOR, fp) != NULL)
+	{
+		magic[strcspn(magic, "\r\n")] = '\0';
+		storedUrl[strcspn(storedUrl, "\r\n")] = '\0';
+		validatorsReturn->etag[strcspn(validatorsReturn->etag, "\r\n")] = '\0';
+		validatorsReturn->lastModified[strcspn(validatorsReturn->lastModified, "\r\n")] = '\0';
+
+		unsigned long long total;
+		unsigned int chunkSize;
+		ok = strcmp(magic, RANGE_RECORD_MAGIC) == 0 && strcmp(storedUrl, url) == 0 &&
+			 sscanf(sizes, "%llu %u", &total, &chunkSize) == 2 && chunkSize == ASSET_RANGE_CHUNK;
+		if(ok)
+			*totalReturn = total;
+	}
+
+	fclose(fp);
+	return ok;
+}
+
+//A chunk file only ever holds a prefix of its chunk, so one cut short by a crash is still good
+static void SaveChunk(const AssetRanges* ranges, uint32_t chunk)
+{
+	uint64_t size = ranges->received.Data()[chunk];
+	if(ranges->resumePath[0] == '\0' || ranges->whole || size == 0)
+		return;
+
+	char path[RANGE_MAX_PATH + 16];
+	RangeChunkPath(ranges, chunk, path);
+
+	SST_File file = SST_OS_OpenFile(path, SST_OPEN_WRITE | SST_OPEN_HINTSEQ);
+	if(file == NULL)
+		return;
+
+	SST_OS_WriteFile(file, ranges->data + ChunkStart(chunk), size);
+	SST_OS_CloseFile(file);
+}
+
+//Returns the bytes of the chunk read back
+static uint64_t LoadChunk(const AssetRanges* ranges, uint32_t chunk)
+{
+	char path[RANGE_MAX_PATH + 16];
+	RangeChunkPath(ranges, chunk, path);
+
+	SST_File file = SST_OS_OpenFile(path, SST_OPEN_READ | SST_OPEN_HINTSEQ);
+	if(file == NULL)
 		return 0;
+
+	uint64_t size = SST_OS_GetFileSize(file);
+	uint64_t length = ChunkEnd(ranges, chunk) - ChunkStart(chunk);
+	if(size > length)
+		size = 0;
+
+	if(size > 0 && SST_OS_ReadFile(file, ranges->data + ChunkStart(chunk), size) != size)
+		size = 0;
+
+	SST_OS_CloseFile(file);
+	return size;
+}
+
+static void RemoveRangeFiles(const AssetRanges* ranges)
+{
+	if(ranges->resumePath[0] == '\0')
+		return;
+
+	char path[RANGE_MAX_PATH + 16];
+	RangeRecordPath(ranges, path);
+	remove(path);
+
+	for(uint32_t i=0; i<ranges->chunkCount; i++) {
+		RangeChunkPath(ranges, i, path);
+		remove(path);
+	}
+}
+
+//Sizes the fetch's sink for the whole body once the server has said how long it is
+static bool SetupRanges(AssetFetch* fetch, uint64_t total, bool whole)
+{
+	AssetRanges* ranges = fetch->ranges;
+	AssetSink* sink = &fetch->sink;
+
+	if(sink->external)
+	{
+		if(total > sink->capacity) {
+			sink->overflow = true;
+			return false;
+		}
+	}
+	else
+	{
+		if((uint64_t)(size_t)(total + 1) != total + 1)
+			return FailRanges(ranges, "Asset too large to download");
+
+		//Heap bodies keep a NUL after the data
+		if(!ReserveSink(sink, (size_t)total + 1))
+			return FailRanges(ranges, "Out of memory");
+		sink->data[total] = 0;
+	}
+
+	sink->expected = total;
+	ranges->data = sink->data;
+	ranges->total = total;
+	ranges->known = true;
+	ranges->whole = whole;
+	ranges->chunkCount = whole || total == 0 ? 1 : (uint32_t)((total + ASSET_RANGE_CHUNK - 1) / ASSET_RANGE_CHUNK);
+	ranges->received.Resize(ranges->chunkCount, 0);
+	return true;
+}
+
+//Picks up the chunks an interrupted download of the same URL left behind, if it recorded any
+static bool ResumeRanges(AssetFetch* fetch)
+{
+	AssetRanges* ranges = fetch->ranges;
+	uint64_t total;
+	AssetValidators validators;
+
+	if(!ReadRangeRecord(ranges, fetch->url, &total, &validators))
+		return true;
+
+	//Without a validator there's no asking the server whether it still has the same version
+	if(validators.etag[0] == '\0' && validators.lastModified[0] == '\0')
+		return true;
+
+	ranges->validators = validators;
+	fetch->response = validators;
+	if(!SetupRanges(fetch, total, false))
+		return false;
+
+	ranges->pending.Clear();
+	for(uint32_t i=0; i<ranges->chunkCount; i++)
+	{
+		uint64_t size = LoadChunk(ranges, i);
+		ranges->received.Data()[i] = size;
+		fetch->resumedBytes += size;
+
+		if(size == ChunkEnd(ranges, i) - ChunkStart(i))
+			ranges->chunksDone++;
+		else
+			ranges->pending.PushBack(i);
+	}
+
+	return true;
+}
+
+//Forgets everything received, for when the asset changed partway through
+static void ResetRanges(AssetFetch* fetch)
+{
+	AssetRanges* ranges = fetch->ranges;
+
+	RemoveRangeFiles(ranges);
+
+	ranges->validators.etag[0] = '\0';
+	ranges->validators.lastModified[0] = '\0';
+	ranges->known = false;
+	ranges->confirmed = false;
+	ranges->whole = false;
+	ranges->restart = false;
+	ranges->total = 0;
+	ranges->data = NULL;
+	ranges->chunkCount = 0;
+	ranges->chunksDone = 0;
+	ranges->received.Clear();
+	ranges->received.PushBack(0);
+	ranges->pending.Clear();
+	ranges->pending.PushBack(0);
+
+	if(!fetch->sink.external) {
+		FreeSink(&fetch->sink);
+		fetch->sink.capacity = 0;
+	}
+	fetch->sink.size = 0;
+	fetch->sink.expected = 0;
+	fetch->response.etag[0] = '\0';
+	fetch->response.lastModified[0] = '\0';
+	fetch->resumedBytes = 0;
+}
+
+//The first response of a ranged fetch: tells how long the body is and whether the server does ranges
+static bool ConfirmRanges(AssetRangeTransfer* transfer)
+{
+	AssetFetch* fetch = transfer->fetch;
+	AssetRanges* ranges = fetch->ranges;
+
+	if(transfer->status == 206)
+	{
+		if(transfer->contentTotal == 0)
+			return FailRanges(ranges, "Range response without the asset's length");
+
+		if(ranges->known)
+		{
+			//Resumed; If-Range only gets a range of the version the chunks already here came from
+			if(transfer->contentTotal != ranges->total) {
+				ranges->restart = true;
+				return false;
+			}
+		}
+		else
+		{
+			ranges->validators = fetch->response;
+			if(!SetupRanges(fetch, transfer->contentTotal, false))
+				return false;
+
+			//This request is chunk 0
+			for(uint32_t i=1; i<ranges->chunkCount; i++)
+				ranges->pending.PushBack(i);
+
+			if(ranges->resumePath[0] != '\0' &&
+			   ((ranges->validators.etag[0] == '\0' && ranges->validators.lastModified[0] == '\0') ||
+			    !WriteRangeRecord(ranges, fetch->url)))
+				ranges->resumePath[0] = '\0';
+		}
+	}
+	else
+	{
+		//The whole body: the server doesn't do ranges, or with If-Range, the asset changed
+		if(ranges->known) {
+			ranges->restart = true;
+			return false;
+		}
+
+		ranges->resumePath[0] = '\0';
+		if(transfer->contentLength != 0) {
+			if(!SetupRanges(fetch, transfer->contentLength, true))
+				return false;
+		} else {
+			//No length either; the body goes through the sink as FetchAsync's would
+			ranges->whole = true;
+		}
+	}
+
+	ranges->confirmed = true;
+	return true;
+}
+
+//Later responses must be the range asked for, of the same body
+static bool CheckRange(AssetRangeTransfer* transfer)
+{
+	AssetRanges* ranges = transfer->fetch->ranges;
+
+	if(ranges->whole)
+		return true;
+
+	if(transfer->status == 206) {
+		uint64_t start = ChunkStart(transfer->chunk) + ranges->received.Data()[transfer->chunk];
+		if(transfer->contentTotal == ranges->total && transfer->contentStart == start)
+			return true;
 	}
 
-	memcpy(&(mem->memory[mem->size]), contents, realsize);
-	mem->size += realsize;
-	mem->memory[mem->size] = 0;
+	//A whole body or a different length: the asset changed since the first response
+	ranges->restart = true;
+	return false;
+}
+
+static size_t HeaderRangeCallback(void *contents, size_t size, size_t nmemb, void *userp)
+{
+	size_t realsize = size * nmemb;
+	AssetRangeTransfer* transfer = (AssetRangeTransfer*)userp;
+	AssetFetch* fetch = transfer->fetch;
+	const char* line = (const char*)contents;
+	char value[64];
+
+	//A redirect or 100 Continue starts a new set of headers
+	if(realsize > 5 && memcmp(line, "HTTP/", 5) == 0)
+	{
+		size_t n = realsize < sizeof(value) ? realsize : sizeof(value) - 1;
+		memcpy(value, line, n);
+		value[n] = '\0';
+
+		const char* space = strchr(value, ' ');
+		transfer->status = space != NULL ? strtol(space + 1, NULL, 10) : 0;
+		transfer->contentLength = 0;
+		transfer->contentStart = 0;
+		transfer->contentTotal = 0;
+		if(!fetch->ranges->confirmed) {
+			fetch->response.etag[0] = '\0';
+			fetch->response.lastModified[0] = '\0';
+		}
+	}
+	else if(ParseHeader(line, realsize, "Content-Length", value, sizeof(value)))
+	{
+		transfer->contentLength = strtoull(value, NULL, 10);
+	}
+	else if(ParseHeader(line, realsize, "Content-Range", value, sizeof(value)))
+	{
+		//"bytes first-last/total"; the total may be "*" if the server doesn't know it
+		unsigned long long start, last, total;
+		if(sscanf(value, "bytes %llu-%llu/%llu", &start, &last, &total) == 3) {
+			transfer->contentStart = start;
+			transfer->contentTotal = total;
+		}
+	}
+	else if(!fetch->ranges->confirmed)
+	{
+		if(!ParseHeader(line, realsize, "ETag", fetch->response.etag, ASSET_MAX_VALIDATOR))
+			ParseHeader(line, realsize, "Last-Modified", fetch->response.lastModified, ASSET_MAX_VALIDATOR);
+	}
 
 	return realsize;
 }
 
-bool AssetConnection::Initialize()
+AssetConnection::AssetConnection()
+	: curlHandle(NULL), multiHandle(NULL), maxTransfers(ASSET_DEFAULT_TRANSFERS),
+	  fetchThread(NULL), running(0), wakeEvent(NULL), submitLock(NULL), bandwidthLimit(0), compression(true),
+	  decodeThread(NULL), decodeEvent(NULL), decodeLock(NULL), completeLock(NULL), pullLock(NULL), countLock(NULL), transferLimit(0),
+	  nextId(1), outstanding(0),
+	  completedFetches(0), failedFetches(0), cancelledFetches(0), fetchedBytes(0), queueToStartMicros(0), transferMicros(0), startMicros(0),
+	  sinkWrites(0), sinkAllocations(0), sinkMovedBytes(0), sinkPreallocated(0),
+	  decodedFetches(0), decodeTailMicros(0),
+	  rangedFetches(0), rangeRequests(0), rangeRetries(0), resumedBytes(0),
+	  wireBytes(0), inflatedFetches(0), inflatedBytes(0), inflateMicros(0)
+{
+	host[0] = '\0';
+
+#if ASSET_FAULT_INJECTION
+	dropRequests = 0;
+	dropRequestInterval = 0;
+	dropsLeft = 0;
+	dropInterval = 0;
+	dropCounter = 0;
+#endif
+}
+
+bool AssetConnection::Initialize(const char* assetHost, int transfers)
 {
+	strncpy(host, assetHost != NULL ? assetHost : ASSET_HOST, sizeof(host) - 1);
+	host[sizeof(host) - 1] = '\0';
+
 	curlHandle = curl_easy_init();
+	multiHandle = curl_multi_init();
+	if(curlHandle == NULL || multiHandle == NULL)
+		return false;
+
+	maxTransfers = transfers > 0 ? transfers : 1;
+
+	wakeEvent = SST_Concurrency_CreateEvent();
+	submitLock = SST_Concurrency_CreateMutex();
+	completeLock = SST_Concurrency_CreateMutex();
+	decodeEvent = SST_Concurrency_CreateEvent();
+	decodeLock = SST_Concurrency_CreateMutex();
+	pullLock = SST_Concurrency_CreateMutex();
+	countLock = SST_Concurrency_CreateMutex();
+	if(wakeEvent == NULL || submitLock == NULL || completeLock == NULL || decodeEvent == NULL || decodeLock == NULL ||
+	   pullLock == NULL || countLock == NULL)
+		return false;
+
+	startMicros = SST_OS_GetMicroTime();
+
+	//The multi handle belongs to the fetch thread from here on
+	running = 1;
+	fetchThread = SST_Concurrency_CreateThread(FetchThreadMain, this);
+	decodeThread = SST_Concurrency_CreateThread(DecodeThreadMain, this);
+	if(fetchThread == NULL || decodeThread == NULL)
+		return false;
 
 	/*
 	void* ptr = NULL;
@@ -42,31 +723,1506 @@ bool AssetConnection::Initialize()
 	return true;
 }
 
-bool AssetConnection::PullAsset(const char* uri, void** dataReturn, size_t* lenReturn)
+void AssetConnection::BuildUrl(const char* uri, char* url) const
 {
-	char fullUrl[1024];
+	strcpy(url, "http://");
+	strncat(url, host, ASSET_MAX_URL - strlen(url) - 1);
+	strncat(url, uri, ASSET_MAX_URL - strlen(url) - 1);
+}
+
+bool AssetConnection::Pull(const char* uri, AssetSink* sink, const void* body, size_t bodySize)
+{
+	char fullUrl[ASSET_MAX_URL];
 
-	strcpy(fullUrl, "http://" ASSET_HOST);
-	strcat(fullUrl, uri);
+	BuildUrl(uri, fullUrl);
 
-	struct MemoryStruct chunk = { NULL, 0 };
+	//One easy handle for every pull, which can come from the render thread or from work on the decode thread
+	SST_Concurrency_LockMutex(pullLock);
 
 	curl_easy_setopt(curlHandle, CURLOPT_URL, fullUrl);
-	curl_easy_setopt(curlHandle, CURLOPT_WRITEFUNCTION, WriteMemoryCallback);
-	curl_easy_setopt(curlHandle, CURLOPT_WRITEDATA, (void *)&chunk);
+	if(body != NULL) {
+		curl_easy_setopt(curlHandle, CURLOPT_POSTFIELDS, body);
+		curl_easy_setopt(curlHandle, CURLOPT_POSTFIELDSIZE_LARGE, (curl_off_t)bodySize);
+	} else {
+		curl_easy_setopt(curlHandle, CURLOPT_HTTPGET, 1L);
+	}
+	curl_easy_setopt(curlHandle, CURLOPT_WRITEFUNCTION, WriteSinkCallback);
+	curl_easy_setopt(curlHandle, CURLOPT_WRITEDATA, (void *)sink);
+	curl_easy_setopt(curlHandle, CURLOPT_HEADERFUNCTION, HeaderSinkCallback);
+	curl_easy_setopt(curlHandle, CURLOPT_WRITEHEADER, (void *)sink);
 	curl_easy_setopt(curlHandle, CURLOPT_USERAGENT, "libcurl-agent/1.0");
 
+	SST_Concurrency_LockMutex(submitLock);
+	bool acceptEncoding = compression;
+	SST_Concurrency_UnlockMutex(submitLock);
+
+	curl_slist* headers = acceptEncoding ? curl_slist_append(NULL, ACCEPT_ENCODING_HEADER) : NULL;
+	curl_easy_setopt(curlHandle, CURLOPT_HTTPHEADER, headers);
+
+	bool ok = (curl_easy_perform(curlHandle) == CURLE_OK);
+
+	curl_easy_setopt(curlHandle, CURLOPT_HTTPHEADER, NULL);
+	curl_slist_free_all(headers);
+
+	SST_Concurrency_UnlockMutex(pullLock);
 
-	if(curl_easy_perform(curlHandle) != CURLE_OK)
+	//Only the inflater knows whether a compressed body was all there
+	if(ok && sink->inflater != NULL && !sink->inflater->IsDone()) {
+		printf("%s: compressed body is corrupt or cut short\n", uri);
+		ok = false;
+	}
+
+	CountSink(*sink);
+	delete sink->inflater;
+	sink->inflater = NULL;
+
+	if(sink->overflow)
+		printf("%s doesn't fit its destination (%llu bytes)\n", uri, (unsigned long long)sink->capacity);
+
+	return ok;
+}
+
+bool AssetConnection::PullAsset(const char* uri, void** dataReturn, size_t* lenReturn)
+{
+	AssetSink sink;
+	InitSink(&sink, NULL, 0);
+
+	if(!Pull(uri, &sink)) {
+		FreeSink(&sink);
 		return false;
+	}
 
-	*dataReturn = chunk.memory;
-	*lenReturn = chunk.size;
+	*dataReturn = sink.data;
+	*lenReturn = sink.size;
 
 	return true;
 }
 
-void AssetConnection::Shutdown()
+bool AssetConnection::PullAssetInto(const char* uri, void* destination, size_t destinationSize, size_t* lenReturn)
+{
+	AssetSink sink;
+	InitSink(&sink, destination, destinationSize);
+
+	if(!Pull(uri, &sink))
+		return false;
+
+	*lenReturn = sink.size;
+	return true;
+}
+
+bool AssetConnection::PostAsset(const char* uri, const void* body, size_t bodySize, void** dataReturn, size_t* lenReturn)
+{
+	AssetSink sink;
+	InitSink(&sink, NULL, 0);
+
+	if(!Pull(uri, &sink, body, bodySize)) {
+		FreeSink(&sink);
+		return false;
+	}
+
+	*dataReturn = sink.data;
+	*lenReturn = sink.size;
+
+	return true;
+}
+
+void AssetConnection::CountSink(const AssetSink& sink)
 {
+	SST_Concurrency_LockMutex(countLock);
+
+	sinkWrites += sink.writes;
+	sinkAllocations += sink.allocations;
+	sinkMovedBytes += sink.movedBytes;
+	if(!sink.external && sink.expected != 0 && sink.allocations == 1)
+		sinkPreallocated++;
+
+	wireBytes += sink.wireBytes;
+	if(sink.inflater != NULL) {
+		inflatedFetches++;
+		inflatedBytes += sink.inflater->GetInflatedBytes();
+		inflateMicros += sink.inflateMicros;
+	}
+
+	SST_Concurrency_UnlockMutex(countLock);
+}
 
-}
\ No newline at end of file
+AssetFetch* AssetConnection::CreateFetch(const char* uri, AssetCallback callback, void* userData)
+{
+	AssetFetch* fetch = new AssetFetch();
+	fetch->id = nextId++;
+	BuildUrl(uri, fetch->url);
+	fetch->callback = callback;
+	fetch->userData = userData;
+	fetch->process = NULL;
+	fetch->work = false;
+	fetch->request.etag[0] = '\0';
+	fetch->request.lastModified[0] = '\0';
+	fetch->body = NULL;
+	fetch->bodySize = 0;
+	fetch->ok = false;
+	fetch->httpStatus = 0;
+	fetch->data = NULL;
+	fetch->size = 0;
+	fetch->error[0] = '\0';
+	fetch->notModified = false;
+	fetch->cancelled = false;
+	fetch->response.etag[0] = '\0';
+	fetch->response.lastModified[0] = '\0';
+	fetch->queueMicros = SST_OS_GetMicroTime();
+	fetch->startMicros = 0;
+	fetch->endMicros = 0;
+	fetch->decoder = NULL;
+	fetch->decoded = false;
+	fetch->readyMicros = 0;
+	fetch->rangeRequests = 0;
+	fetch->rangeRetries = 0;
+	fetch->resumedBytes = 0;
+	fetch->ranges = NULL;
+	fetch->handle = NULL;
+	fetch->headers = NULL;
+	InitSink(&fetch->sink, NULL, 0);
+	fetch->connection = this;
+	fetch->block = NULL;
+	fetch->blockSize = 0;
+	fetch->decodeFailed = false;
+	return fetch;
+}
+
+uint32_t AssetConnection::SubmitFetch(AssetFetch* fetch)
+{
+	SST_Concurrency_LockMutex(submitLock);
+	submitted.PushBack(fetch);
+	SST_Concurrency_UnlockMutex(submitLock);
+
+	SST_Concurrency_SignalEvent(wakeEvent);
+
+	outstanding++;
+	return fetch->id;
+}
+
+uint32_t AssetConnection::FetchAsync(const char* uri, AssetCallback callback, void* userData, const AssetValidators* validators,
+									 void* destination, size_t destinationSize, AssetCallback process)
+{
+	if(fetchThread == NULL)
+		return 0;
+
+	AssetFetch* fetch = CreateFetch(uri, callback, userData);
+	fetch->process = process;
+	if(validators != NULL)
+		fetch->request = *validators;
+	InitSink(&fetch->sink, destination, destinationSize);
+
+	return SubmitFetch(fetch);
+}
+
+uint32_t AssetConnection::PostAsync(const char* uri, const void* body, size_t bodySize, AssetCallback callback, void* userData)
+{
+	if(fetchThread == NULL)
+		return 0;
+
+	AssetFetch* fetch = CreateFetch(uri, callback, userData);
+	fetch->body = (char*)malloc(bodySize > 0 ? bodySize : 1);
+	if(fetch->body == NULL) {
+		delete fetch;
+		return 0;
+	}
+	memcpy(fetch->body, body, bodySize);
+	fetch->bodySize = bodySize;
+
+	return SubmitFetch(fetch);
+}
+
+uint32_t AssetConnection::FetchRanged(const char* uri, AssetCallback callback, void* userData, void* destination,
+									 size_t destinationSize, const char* resumePath, AssetCallback process)
+{
+	if(fetchThread == NULL)
+		return 0;
+
+	AssetFetch* fetch = CreateFetch(uri, callback, userData);
+	fetch->process = process;
+	InitSink(&fetch->sink, destination, destinationSize);
+	fetch->ranges = CreateRanges(resumePath);
+
+	return SubmitFetch(fetch);
+}
+
+void AssetConnection::Cancel(uint32_t id)
+{
+	if(fetchThread == NULL)
+		return;
+
+	SST_Concurrency_LockMutex(submitLock);
+	cancelRequests.PushBack(id);
+	SST_Concurrency_UnlockMutex(submitLock);
+
+	SST_Concurrency_SignalEvent(wakeEvent);
+}
+
+void AssetConnection::SetCompression(bool enable)
+{
+	SST_Concurrency_LockMutex(submitLock);
+	compression = enable;
+	SST_Concurrency_UnlockMutex(submitLock);
+}
+
+void AssetConnection::SetBandwidthLimit(uint64_t bytesPerSecond)
+{
+	SST_Concurrency_LockMutex(submitLock);
+	bandwidthLimit = bytesPerSecond;
+	SST_Concurrency_UnlockMutex(submitLock);
+
+	//So transfers already in flight get the new limit now rather than when something next happens
+	if(wakeEvent != NULL)
+		SST_Concurrency_SignalEvent(wakeEvent);
+}
+
+#if ASSET_FAULT_INJECTION
+void AssetConnection::InjectDrops(uint32_t count, uint64_t interval)
+{
+	SST_Concurrency_LockMutex(submitLock);
+	dropRequests = count;
+	dropRequestInterval = interval > 0 ? interval : 1;
+	SST_Concurrency_UnlockMutex(submitLock);
+}
+#endif
+
+uint32_t AssetConnection::RunAsync(AssetCallback process, AssetCallback callback, void* userData)
+{
+	if(decodeThread == NULL || process == NULL)
+		return 0;
+
+	//Nothing to transfer, so it goes straight to the decode thread as a fetch's last block would
+	AssetFetch* fetch = CreateFetch("", callback, userData);
+	fetch->process = process;
+	fetch->work = true;
+	SubmitDecodeBlock(fetch, true);
+
+	outstanding++;
+	return fetch->id;
+}
+
+uint32_t AssetConnection::FetchDecoded(const char* uri, AssetDecoder* decoder, AssetCallback callback, void* userData)
+{
+	if(fetchThread == NULL || decoder == NULL)
+		return 0;
+
+	AssetFetch* fetch = CreateFetch(uri, callback, userData);
+	fetch->decoder = decoder;
+
+	return SubmitFetch(fetch);
+}
+
+int AssetConnection::FetchThreadMain(void* arg)
+{
+	AssetConnection* self = (AssetConnection*)arg;
+
+	while(SST_Atomic_LoadAcquire(&self->running))
+	{
+		self->StartTransfers();
+
+		int stillRunning;
+		while(curl_multi_perform(self->multiHandle, &stillRunning) == CURLM_CALL_MULTI_PERFORM)
+			;
+
+		self->FinishTransfers();
+		self->WaitForActivity();
+	}
+
+	return 0;
+}
+
+void AssetConnection::StartTransfers()
+{
+	SST_Concurrency_LockMutex(submitLock);
+	incoming.Swap(submitted);
+	incomingCancels.Swap(cancelRequests);
+	transferLimit = bandwidthLimit;
+	bool acceptEncoding = compression;
+#if ASSET_FAULT_INJECTION
+	if(dropRequestInterval != 0) {
+		dropsLeft = dropRequests;
+		dropInterval = dropRequestInterval;
+		dropCounter = 0;
+		dropRequestInterval = 0;
+	}
+#endif
+	SST_Concurrency_UnlockMutex(submitLock);
+
+	for(size_t i=0; i<incoming.Size(); i++)
+		waiting.PushBack(incoming.Data()[i]);
+	incoming.Clear();
+
+	for(size_t i=0; i<incomingCancels.Size(); i++)
+		CancelTransfer(incomingCancels.Data()[i]);
+	incomingCancels.Clear();
+
+	while(active.Size() < (size_t)maxTransfers && !waiting.Empty())
+	{
+		AssetFetch* fetch = waiting.PopFront();
+
+		//Ranged fetches hold the slot while their Range requests come and go
+		if(fetch->ranges != NULL) {
+			active.PushBack(fetch);
+			StartRanged(fetch);
+			continue;
+		}
+
+		//Easy handles are kept around so later transfers reuse their connections
+		CURL* handle = idleHandles.Empty() ? curl_easy_init() : idleHandles.PopBack();
+		if(handle == NULL) {
+			strcpy(fetch->error, "curl_easy_init failed");
+			CompleteFetch(fetch);
+			continue;
+		}
+
+		curl_easy_setopt(handle, CURLOPT_URL, fetch->url);
+		if(fetch->body != NULL) {
+			curl_easy_setopt(handle, CURLOPT_POSTFIELDS, fetch->body);
+			curl_easy_setopt(handle, CURLOPT_POSTFIELDSIZE_LARGE, (curl_off_t)fetch->bodySize);
+		} else {
+			curl_easy_setopt(handle, CURLOPT_HTTPGET, 1L);
+		}
+		if(fetch->decoder != NULL) {
+			curl_easy_setopt(handle, CURLOPT_WRITEFUNCTION, WriteDecodeCallback);
+			curl_easy_setopt(handle, CURLOPT_WRITEDATA, (void*)fetch);
+		} else {
+			curl_easy_setopt(handle, CURLOPT_WRITEFUNCTION, WriteFetchCallback);
+			curl_easy_setopt(handle, CURLOPT_WRITEDATA, (void*)fetch);
+		}
+		curl_easy_setopt(handle, CURLOPT_PRIVATE, (void*)fetch);
+		curl_easy_setopt(handle, CURLOPT_ERRORBUFFER, fetch->error);
+		curl_easy_setopt(handle, CURLOPT_USERAGENT, "libcurl-agent/1.0");
+		curl_easy_setopt(handle, CURLOPT_NOSIGNAL, 1L);
+		curl_easy_setopt(handle, CURLOPT_HEADERFUNCTION, HeaderFetchCallback);
+		curl_easy_setopt(handle, CURLOPT_WRITEHEADER, (void*)fetch);
+
+		char header[ASSET_MAX_VALIDATOR + 32];
+		if(fetch->request.etag[0] != '\0') {
+			sprintf(header, "If-None-Match: %s", fetch->request.etag);
+			fetch->headers = curl_slist_append(fetch->headers, header);
+		}
+		if(fetch->request.lastModified[0] != '\0') {
+			sprintf(header, "If-Modified-Since: %s", fetch->request.lastModified);
+			fetch->headers = curl_slist_append(fetch->headers, header);
+		}
+		if(acceptEncoding)
+			fetch->headers = curl_slist_append(fetch->headers, ACCEPT_ENCODING_HEADER);
+		curl_easy_setopt(handle, CURLOPT_HTTPHEADER, fetch->headers);
+
+		fetch->handle = handle;
+		fetch->startMicros = SST_OS_GetMicroTime();
+
+		curl_multi_add_handle(multiHandle, handle);
+		active.PushBack(fetch);
+	}
+
+	//Backwards, since a ranged fetch that can't start a request leaves the list
+	for(size_t i=active.Size(); i-- > 0; )
+		if(active.Data()[i]->ranges != NULL)
+			StartChunks(active.Data()[i]);
+
+	ApplyBandwidthLimit();
+}
+
+void AssetConnection::FinishTransfers()
+{
+	CURLMsg* msg;
+	int msgsLeft;
+
+	while((msg = curl_multi_info_read(multiHandle, &msgsLeft)) != NULL)
+	{
+		if(msg->msg != CURLMSG_DONE)
+			continue;
+
+		CURL* handle = msg->easy_handle;
+		CURLcode result = msg->data.result;
+
+		AssetRangeTransfer* transfer = NULL;
+		for(size_t i=0; transfer == NULL && i<rangeTransfers.Size(); i++)
+			if(rangeTransfers.Data()[i]->handle == handle)
+				transfer = rangeTransfers.Data()[i];
+
+		if(transfer != NULL) {
+			FinishChunk(transfer, result);
+			continue;
+		}
+
+		AssetFetch* fetch;
+		curl_easy_getinfo(handle, CURLINFO_PRIVATE, (char**)&fetch);
+		curl_easy_getinfo(handle, CURLINFO_RESPONSE_CODE, &fetch->httpStatus);
+
+		fetch->ok = (result == CURLE_OK && fetch->httpStatus < 400);
+		fetch->notModified = (fetch->ok && fetch->httpStatus == 304);
+
+		//A compressed body that's corrupt fails the write callback, and one cut short only the inflater notices
+		bool truncated = (fetch->sink.inflater != NULL && !fetch->notModified && !fetch->sink.inflater->IsDone());
+		if(truncated && fetch->ok)
+			fetch->ok = false;
+
+		if(fetch->sink.overflow)
+			strcpy(fetch->error, "Asset doesn't fit its destination");
+		else if(truncated && (result == CURLE_OK || result == CURLE_WRITE_ERROR))
+			strcpy(fetch->error, "Compressed body is corrupt or cut short");
+		else if(result != CURLE_OK && fetch->error[0] == '\0')
+			strcpy(fetch->error, curl_easy_strerror(result));
+		fetch->data = fetch->sink.data;
+		fetch->size = fetch->sink.size;
+		fetch->endMicros = SST_OS_GetMicroTime();
+
+		curl_multi_remove_handle(multiHandle, handle);
+		ReleaseHandle(handle, fetch->headers);
+		fetch->handle = NULL;
+		fetch->headers = NULL;
+
+		for(size_t i=0; i<active.Size(); i++) {
+			if(active.Data()[i] == fetch) {
+				active.Erase(i);
+				break;
+			}
+		}
+
+		CompleteFetch(fetch);
+	}
+
+	//What's still in flight gets the finished transfers' share
+	ApplyBandwidthLimit();
+}
+
+void AssetConnection::ApplyBandwidthLimit()
+{
+	uint64_t transfers = rangeTransfers.Size();
+	for(size_t i=0; i<active.Size(); i++)
+		if(active.Data()[i]->handle != NULL)
+			transfers++;
+
+	if(transfers == 0)
+		return;
+
+	//libcurl checks the limit against each transfer's average speed as it goes, so a new share applies mid-transfer
+	curl_off_t share = (curl_off_t)(transferLimit / transfers);
+	for(size_t i=0; i<active.Size(); i++)
+		if(active.Data()[i]->handle != NULL)
+			curl_easy_setopt(active.Data()[i]->handle, CURLOPT_MAX_RECV_SPEED_LARGE, share);
+	for(size_t i=0; i<rangeTransfers.Size(); i++)
+		curl_easy_setopt(rangeTransfers.Data()[i]->handle, CURLOPT_MAX_RECV_SPEED_LARGE, share);
+}
+
+void AssetConnection::CancelTransfer(uint32_t id)
+{
+	AssetFetch* fetch = NULL;
+
+	for(ZList<AssetFetch*>::Iterator itr = waiting.Begin(); itr != waiting.End(); ++itr) {
+		if(itr.Get()->id == id) {
+			fetch = waiting.Erase(itr);
+			break;
+		}
+	}
+
+	for(size_t i=0; fetch == NULL && i<active.Size(); i++) {
+		if(active.Data()[i]->id == id) {
+			fetch = active.Erase(i);
+			if(fetch->ranges != NULL) {
+				StopChunks(fetch);
+			} else {
+				curl_multi_remove_handle(multiHandle, fetch->handle);
+				ReleaseHandle(fetch->handle, fetch->headers);
+				fetch->handle = NULL;
+				fetch->headers = NULL;
+			}
+		}
+	}
+
+	//Already finished
+	if(fetch == NULL)
+		return;
+
+	fetch->cancelled = true;
+	strcpy(fetch->error, "Cancelled");
+	fetch->data = fetch->sink.data;
+	fetch->size = fetch->sink.size;
+	fetch->endMicros = SST_OS_GetMicroTime();
+
+	CompleteFetch(fetch);
+}
+
+void AssetConnection::ReleaseHandle(CURL* handle, curl_slist* headers)
+{
+	curl_easy_setopt(handle, CURLOPT_ERRORBUFFER, NULL);
+	curl_easy_setopt(handle, CURLOPT_HTTPHEADER, NULL);
+	curl_slist_free_all(headers);
+	idleHandles.PushBack(handle);
+}
+
+void AssetConnection::CompleteFetch(AssetFetch* fetch)
+{
+	//Decoded fetches complete once the decode thread is through the last block, processed ones once it has processed them
+	if(fetch->decoder != NULL || fetch->process != NULL) {
+		SubmitDecodeBlock(fetch, true);
+		return;
+	}
+
+	SST_Concurrency_LockMutex(completeLock);
+	completed.PushBack(fetch);
+	SST_Concurrency_UnlockMutex(completeLock);
+}
+
+size_t AssetConnection::WriteFetchCallback(void *contents, size_t size, size_t nmemb, void *userp)
+{
+	AssetFetch* fetch = (AssetFetch*)userp;
+
+#if ASSET_FAULT_INJECTION
+	if(fetch->connection->DropInjected(size * nmemb))
+		return 0;
+#endif
+
+	return WriteSinkCallback(contents, size, nmemb, &fetch->sink);
+}
+
+size_t AssetConnection::WriteDecodeCallback(void *contents, size_t size, size_t nmemb, void *userp)
+{
+	size_t realsize = size * nmemb;
+	AssetFetch* fetch = (AssetFetch*)userp;
+
+#if ASSET_FAULT_INJECTION
+	if(fetch->connection->DropInjected(realsize))
+		return 0;
+#endif
+
+	fetch->sink.wireBytes += realsize;
+
+	bool ok;
+	if(fetch->sink.inflater != NULL)
+		ok = InflateChunk(&fetch->sink, contents, realsize, AppendDecodeBlocks, fetch);
+	else
+		ok = AppendDecodeBlocks((const char*)contents, realsize, fetch);
+
+	return ok ? realsize : 0;
+}
+
+bool AssetConnection::AppendDecodeBlocks(const char* bytes, size_t len, void* userData)
+{
+	AssetFetch* fetch = (AssetFetch*)userData;
+	size_t remaining = len;
+
+	fetch->sink.writes++;
+	fetch->sink.size += len;
+
+	while(remaining > 0)
+	{
+		if(fetch->block == NULL) {
+			fetch->block = (char*)malloc(DECODE_BLOCK_SIZE);
+			fetch->blockSize = 0;
+			if(fetch->block == NULL)
+				return false;
+			fetch->sink.allocations++;
+		}
+
+		size_t n = DECODE_BLOCK_SIZE - fetch->blockSize;
+		if(n > remaining)
+			n = remaining;
+
+		memcpy(fetch->block + fetch->blockSize, bytes, n);
+		fetch->blockSize += n;
+		bytes += n;
+		remaining -= n;
+
+		if(fetch->blockSize == DECODE_BLOCK_SIZE)
+			fetch->connection->SubmitDecodeBlock(fetch, false);
+	}
+
+	return true;
+}
+
+void AssetConnection::SubmitDecodeBlock(AssetFetch* fetch, bool last)
+{
+	DecodeBlock block;
+	block.fetch = fetch;
+	block.data = fetch->block;
+	block.size = fetch->blockSize;
+	block.last = last;
+
+	fetch->block = NULL;
+	fetch->blockSize = 0;
+
+	SST_Concurrency_LockMutex(decodeLock);
+	decodeQueue.PushBack(block);
+	SST_Concurrency_UnlockMutex(decodeLock);
+
+	SST_Concurrency_SignalEvent(decodeEvent);
+}
+
+int AssetConnection::DecodeThreadMain(void* arg)
+{
+	AssetConnection* self = (AssetConnection*)arg;
+
+	while(SST_Atomic_LoadAcquire(&self->running))
+	{
+		self->DecodeBlocks();
+
+		//A block queued since DecodeBlocks looked leaves the event signaled, so this returns at once
+		SST_Concurrency_WaitEvent(self->decodeEvent, FETCH_IDLE_WAIT_MS);
+		SST_Concurrency_ResetEvent(self->decodeEvent);
+	}
+
+	return 0;
+}
+
+void AssetConnection::DecodeBlocks()
+{
+	SST_Concurrency_LockMutex(decodeLock);
+	decodeBatch.Swap(decodeQueue);
+	SST_Concurrency_UnlockMutex(decodeLock);
+
+	for(size_t i=0; i<decodeBatch.Size(); i++)
+	{
+		const DecodeBlock& block = decodeBatch.Data()[i];
+		AssetFetch* fetch = block.fetch;
+
+		if(!fetch->decodeFailed && block.size > 0 && !fetch->decoder->Decode(block.data, block.size))
+			fetch->decodeFailed = true;
+		free(block.data);
+
+		if(block.last)
+		{
+			if(fetch->decoder != NULL) {
+				fetch->decoded = fetch->ok && !fetch->notModified && !fetch->decodeFailed && fetch->decoder->Finish();
+				fetch->readyMicros = SST_OS_GetMicroTime();
+			}
+
+			if(fetch->process != NULL)
+				fetch->process(fetch, fetch->userData);
+
+			SST_Concurrency_LockMutex(completeLock);
+			completed.PushBack(fetch);
+			SST_Concurrency_UnlockMutex(completeLock);
+		}
+	}
+
+	decodeBatch.Clear();
+}
+
+#if ASSET_FAULT_INJECTION
+bool AssetConnection::DropInjected(size_t bytes)
+{
+	if(dropsLeft == 0)
+		return false;
+
+	dropCounter += bytes;
+	if(dropCounter < dropInterval)
+		return false;
+
+	dropCounter = 0;
+	dropsLeft--;
+	return true;
+}
+#endif
+
+void AssetConnection::StartRanged(AssetFetch* fetch)
+{
+	AssetRanges* ranges = fetch->ranges;
+	fetch->startMicros = SST_OS_GetMicroTime();
+
+	//Chunk 0 doubles as the request that finds out how long the body is
+	ranges->received.PushBack(0);
+	ranges->pending.PushBack(0);
+
+	if(ranges->resumePath[0] != '\0')
+	{
+		if(!ResumeRanges(fetch)) {
+			FinishRanged(fetch, false, ranges->failed ? ranges->error : "Asset doesn't fit its destination");
+			return;
+		}
+
+		if(ranges->known && ranges->chunksDone == ranges->chunkCount)
+			FinishRanged(fetch, true, NULL);
+	}
+}
+
+void AssetConnection::StartChunks(AssetFetch* fetch)
+{
+	AssetRanges* ranges = fetch->ranges;
+
+	//Until the server has answered once there's no knowing whether it does ranges, or still has what's already here
+	size_t connections = ranges->confirmed ? ASSET_RANGE_CONNECTIONS : 1;
+
+	while(ranges->transfers.Size() < connections && !ranges->pending.Empty())
+	{
+		if(!StartChunk(fetch, ranges->pending.Erase(0))) {
+			FinishRanged(fetch, false, "curl_easy_init failed");
+			return;
+		}
+	}
+}
+
+bool AssetConnection::StartChunk(AssetFetch* fetch, uint32_t chunk)
+{
+	AssetRanges* ranges = fetch->ranges;
+
+	CURL* handle = idleHandles.Empty() ? curl_easy_init() : idleHandles.PopBack();
+	if(handle == NULL)
+		return false;
+
+	AssetRangeTransfer* transfer = new AssetRangeTransfer();
+	transfer->fetch = fetch;
+	transfer->chunk = chunk;
+	transfer->handle = handle;
+	transfer->headers = NULL;
+	transfer->error[0] = '\0';
+	transfer->status = 0;
+	transfer->contentLength = 0;
+	transfer->contentStart = 0;
+	transfer->contentTotal = 0;
+	transfer->checked = false;
+	transfer->bytes = 0;
+
+	if(ranges->whole)
+	{
+		//The server only sends the whole body, so a retry starts over
+		ranges->received.Data()[0] = 0;
+		fetch->sink.size = 0;
+	}
+	else
+	{
+		char header[ASSET_MAX_VALIDATOR + 32];
+		uint64_t start = ChunkStart(chunk) + ranges->received.Data()[chunk];
+		sprintf(header, "Range: bytes=%llu-%llu", (unsigned long long)start, (unsigned long long)(ChunkEnd(ranges, chunk) - 1));
+		transfer->headers = curl_slist_append(transfer->headers, header);
+
+		//Weak ETags aren't allowed in If-Range
+		if(ranges->validators.etag[0] != '\0' && strncmp(ranges->validators.etag, "W/", 2) != 0) {
+			sprintf(header, "If-Range: %s", ranges->validators.etag);
+			transfer->headers = curl_slist_append(transfer->headers, header);
+		} else if(ranges->validators.lastModified[0] != '\0') {
+			sprintf(header, "If-Range: %s", ranges->validators.lastModified);
+			transfer->headers = curl_slist_append(transfer->headers, header);
+		}
+	}
+
+	curl_easy_setopt(handle, CURLOPT_URL, fetch->url);
+	curl_easy_setopt(handle, CURLOPT_HTTPGET, 1L);
+	curl_easy_setopt(handle, CURLOPT_WRITEFUNCTION, WriteRangeCallback);
+	curl_easy_setopt(handle, CURLOPT_WRITEDATA, (void*)transfer);
+	curl_easy_setopt(handle, CURLOPT_PRIVATE, (void*)transfer);
+	curl_easy_setopt(handle, CURLOPT_ERRORBUFFER, transfer->error);
+	curl_easy_setopt(handle, CURLOPT_USERAGENT, "libcurl-agent/1.0");
+	curl_easy_setopt(handle, CURLOPT_NOSIGNAL, 1L);
+	curl_easy_setopt(handle, CURLOPT_HEADERFUNCTION, HeaderRangeCallback);
+	curl_easy_setopt(handle, CURLOPT_WRITEHEADER, (void*)transfer);
+	curl_easy_setopt(handle, CURLOPT_HTTPHEADER, transfer->headers);
+
+	curl_multi_add_handle(multiHandle, handle);
+	ranges->transfers.PushBack(transfer);
+	rangeTransfers.PushBack(transfer);
+	fetch->rangeRequests++;
+	return true;
+}
+
+size_t AssetConnection::WriteRangeCallback(void *contents, size_t size, size_t nmemb, void *userp)
+{
+	size_t realsize = size * nmemb;
+	AssetRangeTransfer* transfer = (AssetRangeTransfer*)userp;
+	AssetFetch* fetch = transfer->fetch;
+	AssetRanges* ranges = fetch->ranges;
+
+	//Error pages aren't the asset
+	if(transfer->status < 200 || transfer->status >= 300)
+		return realsize;
+
+	if(!transfer->checked) {
+		transfer->checked = true;
+		if(!(ranges->confirmed ? CheckRange(transfer) : ConfirmRanges(transfer)))
+			return 0;
+	}
+
+#if ASSET_FAULT_INJECTION
+	if(fetch->connection->DropInjected(realsize))
+		return 0;
+#endif
+
+	transfer->bytes += realsize;
+	fetch->sink.wireBytes += realsize;
+
+	if(!ranges->known)
+		return AppendSink(&fetch->sink, contents, realsize) ? realsize : 0;
+
+	fetch->sink.writes++;
+
+	uint32_t chunk = transfer->chunk;
+	uint64_t offset = ChunkStart(chunk) + ranges->received.Data()[chunk];
+	if(realsize > ChunkEnd(ranges, chunk) - offset) {
+		FailRanges(ranges, "Range response longer than asked for");
+		return 0;
+	}
+
+	memcpy(ranges->data + offset, contents, realsize);
+	ranges->received.Data()[chunk] += realsize;
+	return realsize;
+}
+
+void AssetConnection::FinishChunk(AssetRangeTransfer* transfer, CURLcode result)
+{
+	AssetFetch* fetch = transfer->fetch;
+	AssetRanges* ranges = fetch->ranges;
+	uint32_t chunk = transfer->chunk;
+
+	curl_multi_remove_handle(multiHandle, transfer->handle);
+	ReleaseHandle(transfer->handle, transfer->headers);
+
+	for(size_t i=0; i<rangeTransfers.Size(); i++) {
+		if(rangeTransfers.Data()[i] == transfer) {
+			rangeTransfers.Erase(i);
+			break;
+		}
+	}
+	for(size_t i=0; i<ranges->transfers.Size(); i++) {
+		if(ranges->transfers.Data()[i] == transfer) {
+			ranges->transfers.Erase(i);
+			break;
+		}
+	}
+
+	if(transfer->status != 0)
+		ranges->httpStatus = transfer->status;
+
+	//Empty bodies never reach the write callback
+	bool answered = (result == CURLE_OK && transfer->status >= 200 && transfer->status < 300);
+	if(answered && !transfer->checked) {
+		transfer->checked = true;
+		answered = ranges->confirmed ? CheckRange(transfer) : ConfirmRanges(transfer);
+	}
+
+	if(ranges->restart)
+	{
+		//What's here is of another version of the asset; start over from a single request
+		StopChunks(fetch);
+		ResetRanges(fetch);
+		fetch->rangeRetries++;
+	}
+	else if(ranges->failed || fetch->sink.overflow)
+	{
+		FinishRanged(fetch, false, ranges->failed ? ranges->error : "Asset doesn't fit its destination");
+	}
+	else if(result == CURLE_OK && transfer->status == 416 && !ranges->known)
+	{
+		//Nothing to ask a range of: the asset is empty
+		if(SetupRanges(fetch, 0, true))
+			FinishRanged(fetch, true, NULL);
+		else
+			FinishRanged(fetch, false, ranges->failed ? ranges->error : "Asset doesn't fit its destination");
+	}
+	else if(result == CURLE_OK && !answered)
+	{
+		char error[64];
+		sprintf(error, "HTTP status %ld", transfer->status);
+		FinishRanged(fetch, false, error);
+	}
+	else if(answered && (!ranges->known || ranges->received.Data()[chunk] == ChunkEnd(ranges, chunk) - ChunkStart(chunk)))
+	{
+		ranges->stalls = 0;
+		ranges->chunksDone++;
+		SaveChunk(ranges, chunk);
+
+		if(!ranges->known || ranges->chunksDone == ranges->chunkCount)
+			FinishRanged(fetch, true, NULL);
+	}
+	else
+	{
+		//Dropped or cut short: ask again for the rest of the chunk, ahead of the chunks not started yet
+		ranges->stalls = transfer->bytes > 0 ? 0 : ranges->stalls + 1;
+		if(ranges->stalls > RANGE_MAX_STALLS) {
+			FinishRanged(fetch, false, transfer->error[0] != '\0' ? transfer->error : curl_easy_strerror(result));
+		} else {
+			ranges->pending.PushFront(chunk);
+			fetch->rangeRetries++;
+		}
+	}
+
+	delete transfer;
+}
+
+void AssetConnection::StopChunks(AssetFetch* fetch)
+{
+	AssetRanges* ranges = fetch->ranges;
+
+	for(size_t i=0; i<ranges->transfers.Size(); i++)
+	{
+		AssetRangeTransfer* transfer = ranges->transfers.Data()[i];
+
+		curl_multi_remove_handle(multiHandle, transfer->handle);
+		ReleaseHandle(transfer->handle, transfer->headers);
+
+		for(size_t j=0; j<rangeTransfers.Size(); j++) {
+			if(rangeTransfers.Data()[j] == transfer) {
+				rangeTransfers.Erase(j);
+				break;
+			}
+		}
+
+		//Part of a chunk is worth keeping for a later fetch to resume from
+		if(!ranges->restart && ranges->known)
+			SaveChunk(ranges, transfer->chunk);
+
+		delete transfer;
+	}
+
+	ranges->transfers.Clear();
+}
+
+void AssetConnection::FinishRanged(AssetFetch* fetch, bool ok, const char* error)
+{
+	AssetRanges* ranges = fetch->ranges;
+
+	StopChunks(fetch);
+
+	if(ok) {
+		if(ranges->known)
+			fetch->sink.size = (size_t)ranges->total;
+		RemoveRangeFiles(ranges);
+	} else if(error != NULL) {
+		strncpy(fetch->error, error, CURL_ERROR_SIZE - 1);
+		fetch->error[CURL_ERROR_SIZE - 1] = '\0';
+	}
+
+	fetch->ok = ok;
+	fetch->httpStatus = ranges->httpStatus;
+	fetch->data = fetch->sink.data;
+	fetch->size = fetch->sink.size;
+	fetch->endMicros = SST_OS_GetMicroTime();
+
+	for(size_t i=0; i<active.Size(); i++) {
+		if(active.Data()[i] == fetch) {
+			active.Erase(i);
+			break;
+		}
+	}
+
+	CompleteFetch(fetch);
+}
+
+void AssetConnection::WaitForActivity()
+{
+	if(active.Empty()) {
+		//Nothing in flight; sleep until FetchAsync signals or it's time to check for shutdown
+		if(waiting.Empty())
+			SST_Concurrency_WaitEvent(wakeEvent, FETCH_IDLE_WAIT_MS);
+		SST_Concurrency_ResetEvent(wakeEvent);
+		return;
+	}
+
+	long timeoutMs = -1;
+	curl_multi_timeout(multiHandle, &timeoutMs);
+	if(timeoutMs < 0 || timeoutMs > FETCH_SELECT_MS)
+		timeoutMs = FETCH_SELECT_MS;
+	if(timeoutMs == 0)
+		return;
+
+	fd_set readSet, writeSet, errorSet;
+	FD_ZERO(&readSet);
+	FD_ZERO(&writeSet);
+	FD_ZERO(&errorSet);
+
+	int maxFd = -1;
+	curl_multi_fdset(multiHandle, &readSet, &writeSet, &errorSet, &maxFd);
+
+	//No sockets yet (e.g. still resolving); select() with no sockets fails on Windows, so just sleep
+	if(maxFd < 0) {
+		SST_Concurrency_SleepThread((uint32_t)timeoutMs);
+		return;
+	}
+
+	struct timeval timeout;
+	timeout.tv_sec = timeoutMs / 1000;
+	timeout.tv_usec = (timeoutMs % 1000) * 1000;
+	select(maxFd + 1, &readSet, &writeSet, &errorSet, &timeout);
+}
+
+void AssetConnection::Poll()
+{
+	//Try again next frame rather than wait while the fetch thread is adding to the list
+	if(completeLock == NULL || !SST_Concurrency_TryLockMutex(completeLock))
+		return;
+
+	finished.Swap(completed);
+	SST_Concurrency_UnlockMutex(completeLock);
+
+	for(size_t i=0; i<finished.Size(); i++)
+	{
+		AssetFetch* fetch = finished.Data()[i];
+
+		if(fetch->work) {
+			//Not a download, so not counted as one
+		} else if(fetch->ok) {
+			completedFetches++;
+			fetchedBytes += fetch->size;
+		} else if(fetch->cancelled) {
+			cancelledFetches++;
+		} else {
+			failedFetches++;
+		}
+
+		if(fetch->startMicros != 0) {
+			queueToStartMicros += fetch->startMicros - fetch->queueMicros;
+			transferMicros += fetch->endMicros - fetch->startMicros;
+		}
+
+		if(fetch->decoded) {
+			decodedFetches++;
+			decodeTailMicros += fetch->readyMicros - fetch->endMicros;
+		}
+
+		if(fetch->ranges != NULL) {
+			rangedFetches++;
+			rangeRequests += fetch->rangeRequests;
+			rangeRetries += fetch->rangeRetries;
+			resumedBytes += fetch->resumedBytes;
+		}
+
+		CountSink(fetch->sink);
+
+		if(fetch->callback != NULL)
+			fetch->callback(fetch, fetch->userData);
+
+		if(!fetch->sink.external)
+			free(fetch->data);
+		free(fetch->body);
+		delete fetch->sink.inflater;
+		delete fetch->ranges;
+		delete fetch;
+		outstanding--;
+	}
+
+	finished.Clear();
+}
+
+void AssetConnection::PrintStats() const
+{
+	double seconds = (double)(SST_OS_GetMicroTime() - startMicros) / 1000000.0;
+	uint32_t fetches = completedFetches + failedFetches + cancelledFetches;
+
+	printf("AssetConnection: %u fetches (%u failed, %u cancelled), %u outstanding, %.2f MB (%.2f MB/s since startup), %d transfers at once\n",
+		fetches, failedFetches, cancelledFetches, outstanding, (double)fetchedBytes / (1024.0 * 1024.0),
+		seconds > 0.0 ? (double)fetchedBytes / (1024.0 * 1024.0) / seconds : 0.0, maxTransfers);
+	printf("AssetConnection: %.1f ms queued, %.1f ms transferring per fetch\n",
+		fetches ? (double)queueToStartMicros / 1000.0 / fetches : 0.0,
+		fetches ? (double)transferMicros / 1000.0 / fetches : 0.0);
+	printf("AssetConnection: %llu writes, %llu allocations (%u sized from Content-Length), %.2f MB moved by realloc\n",
+		(unsigned long long)sinkWrites, (unsigned long long)sinkAllocations, sinkPreallocated,
+		(double)sinkMovedBytes / (1024.0 * 1024.0));
+	printf("AssetConnection: %u decoded while downloading, ready %.1f ms after the last byte\n",
+		decodedFetches, decodedFetches ? (double)decodeTailMicros / 1000.0 / decodedFetches : 0.0);
+	printf("AssetConnection: %u ranged fetches, %u range requests, %u after dropped connections, %.2f MB resumed from disk\n",
+		rangedFetches, rangeRequests, rangeRetries, (double)resumedBytes / (1024.0 * 1024.0));
+	printf("AssetConnection: %.2f MB received, %u compressed bodies inflated to %.2f MB at %.1f MB/s\n",
+		(double)wireBytes / (1024.0 * 1024.0), inflatedFetches, (double)inflatedBytes / (1024.0 * 1024.0),
+		inflateMicros ? (double)inflatedBytes / (1024.0 * 1024.0) / ((double)inflateMicros / 1000000.0) : 0.0);
+}
+
+void AssetConnection::Shutdown()
+{
+	SST_Atomic_StoreRelease(&running, 0);
+
+	if(fetchThread != NULL) {
+		SST_Concurrency_SignalEvent(wakeEvent);
+		SST_Concurrency_WaitThread(fetchThread, NULL);
+		SST_Concurrency_DestroyThread(fetchThread);
+		fetchThread = NULL;
+	}
+
+	if(decodeThread != NULL) {
+		SST_Concurrency_SignalEvent(decodeEvent);
+		SST_Concurrency_WaitThread(decodeThread, NULL);
+		SST_Concurrency_DestroyThread(decodeThread);
+		decodeThread = NULL;
+	}
+
+	//Blocks the decode thread didn't get to; a last block is the only reference to its fetch
+	for(size_t i=0; i<decodeQueue.Size(); i++) {
+		free(decodeQueue.Data()[i].data);
+		if(decodeQueue.Data()[i].last)
+			completed.PushBack(decodeQueue.Data()[i].fetch);
+	}
+	decodeQueue.Clear();
+
+	//Fetches that haven't been handed back are dropped without their callbacks
+	for(size_t i=0; i<active.Size(); i++) {
+		AssetFetch* fetch = active.Data()[i];
+		if(fetch->ranges != NULL) {
+			//Keeps what the Range requests got so far, if the fetch can be resumed
+			StopChunks(fetch);
+		} else {
+			curl_multi_remove_handle(multiHandle, fetch->handle);
+			curl_slist_free_all(fetch->headers);
+			idleHandles.PushBack(fetch->handle);
+		}
+		completed.PushBack(fetch);
+	}
+	active.Clear();
+
+	while(!waiting.Empty())
+		completed.PushBack(waiting.PopFront());
+
+	for(size_t i=0; i<submitted.Size(); i++)
+		completed.PushBack(submitted.Data()[i]);
+	submitted.Clear();
+
+	for(size_t i=0; i<completed.Size(); i++) {
+		FreeSink(&completed.Data()[i]->sink);
+		free(completed.Data()[i]->block);
+		free(completed.Data()[i]->body);
+		delete completed.Data()[i]->ranges;
+		delete completed.Data()[i];
+	}
+	completed.Clear();
+	outstanding = 0;
+
+	if(multiHandle != NULL) {
+		curl_multi_cleanup(multiHandle);
+		multiHandle = NULL;
+	}
+
+	for(size_t i=0; i<idleHandles.Size(); i++)
+		curl_easy_cleanup(idleHandles.Data()[i]);
+	idleHandles.Clear();
+
+	if(curlHandle != NULL) {
+		curl_easy_cleanup(curlHandle);
+		curlHandle = NULL;
+	}
+
+	if(wakeEvent != NULL) {
+		SST_Concurrency_DestroyEvent(wakeEvent);
+		wakeEvent = NULL;
+	}
+	if(submitLock != NULL) {
+		SST_Concurrency_DestroyMutex(submitLock);
+		submitLock = NULL;
+	}
+	if(completeLock != NULL) {
+		SST_Concurrency_DestroyMutex(completeLock);
+		completeLock = NULL;
+	}
+	if(decodeEvent != NULL) {
+		SST_Concurrency_DestroyEvent(decodeEvent);
+		decodeEvent = NULL;
+	}
+	if(decodeLock != NULL) {
+		SST_Concurrency_DestroyMutex(decodeLock);
+		decodeLock = NULL;
+	}
+	if(pullLock != NULL) {
+		SST_Concurrency_DestroyMutex(pullLock);
+		pullLock = NULL;
+	}
+	if(countLock != NULL) {
+		SST_Concurrency_DestroyMutex(countLock);
+		countLock = NULL;
+	}
+}
+
+struct AssetBenchmarkState
+{
+	uint32_t done;
+	uint32_t failed;
+	uint64_t bytes;
+};
+
+static void AssetBenchmarkCallback(AssetFetch* fetch, void* userData)
+{
+	AssetBenchmarkState* state = (AssetBenchmarkState*)userData;
+
+	state->done++;
+	if(fetch->ok)
+		state->bytes += fetch->size;
+	else
+		state->failed++;
+}
+
+void AssetConnection_Benchmark(const char* host, const char* smallUri, uint32_t smallCount,
+							   const char* largeUri, uint32_t largeCount, int maxTransfers)
+{
+	AssetConnection conn;
+	if(!conn.Initialize(host, maxTransfers)) {
+		printf("Asset benchmark: couldn't initialize\n");
+		conn.Shutdown();
+		return;
+	}
+
+	const char* uris[2] = { smallUri, largeUri };
+	uint32_t counts[2] = { smallCount, largeCount };
+
+	for(int set=0; set<2; set++)
+	{
+		//One after another on the calling thread, as PullAsset has always done it
+		uint64_t bytes = 0;
+		uint32_t failed = 0;
+		uint64_t start = SST_OS_GetMicroTime();
+
+		for(uint32_t i=0; i<counts[set]; i++)
+		{
+			void* data;
+			size_t len;
+			if(conn.PullAsset(uris[set], &data, &len)) {
+				bytes += len;
+				free(data);
+			} else {
+				failed++;
+			}
+		}
+
+		uint64_t serialMicros = SST_OS_GetMicroTime() - start;
+
+		//All queued at once, completions polled the way the frame loop does
+		AssetBenchmarkState state = { 0, 0, 0 };
+		start = SST_OS_GetMicroTime();
+
+		for(uint32_t i=0; i<counts[set]; i++)
+			conn.FetchAsync(uris[set], AssetBenchmarkCallback, &state);
+
+		while(state.done < counts[set]) {
+			conn.Poll();
+			SST_Concurrency_SleepThread(1);
+		}
+
+		uint64_t asyncMicros = SST_OS_GetMicroTime() - start;
+
+		printf("Asset benchmark: %u x %s (%.1f KB): serial %.1f ms, %.2f MB/s; async x%d %.1f ms, %.2f MB/s%s\n",
+			counts[set], uris[set], counts[set] ? (double)bytes / 1024.0 / counts[set] : 0.0,
+			(double)serialMicros / 1000.0, serialMicros ? (double)bytes / serialMicros : 0.0,
+			maxTransfers, (double)asyncMicros / 1000.0, asyncMicros ? (double)state.bytes / asyncMicros : 0.0,
+			failed || state.failed ? ", SOME FETCHES FAILED" : "");
+	}
+
+	conn.Shutdown();
+}
+
+//The sink PullAsset used to have: one realloc per chunk curl hands over. Kept only to compare against.
+struct PerChunkSink
+{
+	char* data;
+	size_t size;
+	uint32_t allocations;
+	uint64_t movedBytes;
+};
+
+static size_t WritePerChunkCallback(void *contents, size_t size, size_t nmemb, void *userp)
+{
+	size_t realsize = size * nmemb;
+	PerChunkSink* sink = (PerChunkSink*)userp;
+
+	char* memory = (char*)realloc(sink->data, sink->size + realsize + 1);
+	if(memory == NULL)
+		return 0;
+
+	if(memory != sink->data && sink->data != NULL)
+		sink->movedBytes += sink->size;
+
+	sink->allocations++;
+	sink->data = memory;
+	memcpy(sink->data + sink->size, contents, realsize);
+	sink->size += realsize;
+	sink->data[sink->size] = 0;
+
+	return realsize;
+}
+
+void AssetConnection_DownloadBenchmark(const char* host, const char** uris, uint32_t count)
+{
+	AssetConnection conn;
+	CURL* perChunkHandle = curl_easy_init();
+	if(perChunkHandle == NULL || !conn.Initialize(host, 1)) {
+		printf("Download benchmark: couldn't initialize\n");
+		if(perChunkHandle != NULL)
+			curl_easy_cleanup(perChunkHandle);
+		conn.Shutdown();
+		return;
+	}
+
+	for(uint32_t i=0; i<count; i++)
+	{
+		//Realloc per chunk
+		char url[ASSET_MAX_URL];
+		conn.BuildUrl(uris[i], url);
+
+		PerChunkSink perChunk = { NULL, 0, 0, 0 };
+		curl_easy_setopt(perChunkHandle, CURLOPT_URL, url);
+		curl_easy_setopt(perChunkHandle, CURLOPT_WRITEFUNCTION, WritePerChunkCallback);
+		curl_easy_setopt(perChunkHandle, CURLOPT_WRITEDATA, (void*)&perChunk);
+
+		uint64_t start = SST_OS_GetMicroTime();
+		bool perChunkOk = (curl_easy_perform(perChunkHandle) == CURLE_OK);
+		uint64_t perChunkMicros = SST_OS_GetMicroTime() - start;
+		free(perChunk.data);
+
+		//Heap sink
+		uint64_t allocationsBefore = conn.GetSinkAllocations();
+		uint64_t movedBefore = conn.GetSinkMovedBytes();
+		void* data = NULL;
+		size_t size = 0;
+
+		start = SST_OS_GetMicroTime();
+		bool heapOk = conn.PullAsset(uris[i], &data, &size);
+		uint64_t heapMicros = SST_OS_GetMicroTime() - start;
+		free(data);
+
+		uint64_t heapAllocations = conn.GetSinkAllocations() - allocationsBefore;
+		uint64_t heapMoved = conn.GetSinkMovedBytes() - movedBefore;
+
+		//Destination, allocated and touched up front like a staging buffer that gets reused
+		bool destinationOk = false;
+		uint64_t destinationMicros = 0;
+		void* destination = heapOk ? malloc(size + 1) : NULL;
+		if(destination != NULL) {
+			memset(destination, 0, size + 1);
+
+			size_t destinationSize;
+			start = SST_OS_GetMicroTime();
+			destinationOk = conn.PullAssetInto(uris[i], destination, size + 1, &destinationSize);
+			destinationMicros = SST_OS_GetMicroTime() - start;
+			free(destination);
+		}
+
+		printf("Download benchmark: %s (%.2f MB): realloc per chunk %.1f ms, %u allocations, %.2f MB moved; "
+			"heap sink %.1f ms, %llu allocations, %.2f MB moved; destination %.1f ms, no allocations%s\n",
+			uris[i], (double)size / (1024.0 * 1024.0),
+			(double)perChunkMicros / 1000.0, perChunk.allocations, (double)perChunk.movedBytes / (1024.0 * 1024.0),
+			(double)heapMicros / 1000.0, (unsigned long long)heapAllocations, (double)heapMoved / (1024.0 * 1024.0),
+			(double)destinationMicros / 1000.0,
+			perChunkOk && heapOk && destinationOk ? "" : ", SOME DOWNLOADS FAILED");
+	}
+
+	curl_easy_cleanup(perChunkHandle);
+	conn.Shutdown();
+}
+
+struct RangedBenchmarkState
+{
+	bool done;
+	bool ok;
+	size_t size;
+	uint32_t retries;
+	uint64_t resumedBytes;
+};
+
+static void RangedBenchmarkCallback(AssetFetch* fetch, void* userData)
+{
+	RangedBenchmarkState* state = (RangedBenchmarkState*)userData;
+
+	state->done = true;
+	state->ok = fetch->ok;
+	state->size = fetch->size;
+	state->retries = fetch->rangeRetries;
+	state->resumedBytes = fetch->resumedBytes;
+}
+
+//Fetches uri until it succeeds, starting over after each failure the way callers of FetchAsync have to.
+//Returns the time taken, or 0 if it never succeeded.
+static uint64_t RangedBenchmarkFetch(AssetConnection* conn, const char* uri, bool ranged, uint32_t maxAttempts,
+									 RangedBenchmarkState* state, uint32_t* attemptsReturn)
+{
+	uint64_t start = SST_OS_GetMicroTime();
+
+	for(uint32_t attempt=1; attempt<=maxAttempts; attempt++)
+	{
+		state->done = false;
+		if(ranged)
+			conn->FetchRanged(uri, RangedBenchmarkCallback, state);
+		else
+			conn->FetchAsync(uri, RangedBenchmarkCallback, state);
+
+		while(!state->done) {
+			conn->Poll();
+			SST_Concurrency_SleepThread(1);
+		}
+
+		*attemptsReturn = attempt;
+		if(state->ok)
+			return SST_OS_GetMicroTime() - start;
+	}
+
+	return 0;
+}
+
+void AssetConnection_RangedBenchmark(const char* host, const char* uri, uint32_t drops)
+{
+	AssetConnection conn;
+	if(!conn.Initialize(host, 1)) {
+		printf("Ranged benchmark: couldn't initialize\n");
+		conn.Shutdown();
+		return;
+	}
+
+	RangedBenchmarkState state = { false, false, 0, 0, 0 };
+	uint32_t attempts;
+
+	//Whole body over one connection, then as Range requests
+	uint64_t singleMicros = RangedBenchmarkFetch(&conn, uri, false, 1, &state, &attempts);
+	size_t size = state.size;
+	uint64_t rangedMicros = singleMicros != 0 ? RangedBenchmarkFetch(&conn, uri, true, 1, &state, &attempts) : 0;
+	if(singleMicros == 0 || rangedMicros == 0 || state.size != size) {
+		printf("Ranged benchmark: couldn't fetch %s\n", uri);
+		conn.Shutdown();
+		return;
+	}
+
+	printf("Ranged benchmark: %s (%.2f MB): one connection %.1f ms, %.2f MB/s; ranged over %d %.1f ms, %.2f MB/s\n",
+		uri, (double)size / (1024.0 * 1024.0),
+		(double)singleMicros / 1000.0, (double)size / singleMicros,
+		ASSET_RANGE_CONNECTIONS, (double)rangedMicros / 1000.0, (double)size / rangedMicros);
+
+#if ASSET_FAULT_INJECTION
+	//The same with connections dropped at even intervals along the way
+	uint64_t interval = size / (drops + 1) + 1;
+
+	conn.InjectDrops(drops, interval);
+	uint32_t singleAttempts = 0;
+	uint64_t singleDropMicros = RangedBenchmarkFetch(&conn, uri, false, drops + 1, &state, &singleAttempts);
+
+	conn.InjectDrops(drops, interval);
+	uint64_t rangedDropMicros = RangedBenchmarkFetch(&conn, uri, true, 1, &state, &attempts);
+	uint32_t retries = state.retries;
+
+	conn.InjectDrops(0, 1);
+
+	printf("Ranged benchmark: %u dropped connections: one connection starting over %.1f ms in %u attempts, %.1f ms lost per drop; "
+		"ranged %.1f ms with %u retried chunks, %.1f ms lost per drop%s\n",
+		drops, (double)singleDropMicros / 1000.0, singleAttempts,
+		drops ? ((double)singleDropMicros - (double)singleMicros) / 1000.0 / drops : 0.0,
+		(double)rangedDropMicros / 1000.0, retries,
+		drops ? ((double)rangedDropMicros - (double)rangedMicros) / 1000.0 / drops : 0.0,
+		singleDropMicros == 0 || rangedDropMicros == 0 ? ", SOME FETCHES FAILED" : "");
+#else
+	printf("Ranged benchmark: %u dropped connections skipped, build with ASSET_FAULT_INJECTION 1 to compare them\n", drops);
+#endif
+
+	//Cancelled halfway, then fetched again: only the missing chunks are downloaded
+	const char* resumePath = "ranged-benchmark.part";
+
+	state.done = false;
+	uint64_t start = SST_OS_GetMicroTime();
+	uint32_t id = conn.FetchRanged(uri, RangedBenchmarkCallback, &state, NULL, 0, resumePath);
+	while(!state.done && SST_OS_GetMicroTime() - start < rangedMicros / 2) {
+		conn.Poll();
+		SST_Concurrency_SleepThread(1);
+	}
+	conn.Cancel(id);
+	while(!state.done) {
+		conn.Poll();
+		SST_Concurrency_SleepThread(1);
+	}
+
+	state.done = false;
+	start = SST_OS_GetMicroTime();
+	conn.FetchRanged(uri, RangedBenchmarkCallback, &state, NULL, 0, resumePath);
+	while(!state.done) {
+		conn.Poll();
+		SST_Concurrency_SleepThread(1);
+	}
+	uint64_t resumeMicros = SST_OS_GetMicroTime() - start;
+
+	printf("Ranged benchmark: cancelled after %.1f ms and fetched again: %.2f MB read back from disk, %.1f ms to finish%s\n",
+		(double)rangedMicros / 2000.0, (double)state.resumedBytes / (1024.0 * 1024.0), (double)resumeMicros / 1000.0,
+		state.ok && state.size == size ? "" : ", FETCH FAILED");
+
+	conn.PrintStats();
+	conn.Shutdown();
+}
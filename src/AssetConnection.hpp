@@ -1,18 +1,382 @@
 #pragma once
 
 #include <curl/curl.h>
+#include <SST/SST_Concurrency.h>
+#include <ZSTL/ZArray.hpp>
+#include <ZSTL/ZList.hpp>
+
+#include "AssetDecoder.hpp"
+#include "AssetInflate.hpp"
+
+//Transfers the fetch thread runs at once unless told otherwise
+#define ASSET_DEFAULT_TRANSFERS 8
+
+#define ASSET_MAX_URL 1024
+#define ASSET_MAX_VALIDATOR 128
+
+//FetchRanged splits bodies into Range requests of this size, and runs this many of them at once per fetch
+#define ASSET_RANGE_CHUNK (1024 * 1024)
+#define ASSET_RANGE_CONNECTIONS 4
+
+//Set to 1 to build InjectDrops, which the ranged benchmark uses to compare dropped connections.
+//It adds a check to every chunk the fetch thread receives, so it stays out of normal builds.
+#ifndef ASSET_FAULT_INJECTION
+#define ASSET_FAULT_INJECTION 0
+#endif
+
+//HTTP cache validators, as received with a response or to send with a conditional request. Empty if absent.
+struct AssetValidators
+{
+	char etag[ASSET_MAX_VALIDATOR];
+	char lastModified[ASSET_MAX_VALIDATOR];
+};
+
+//Where a download's body is written. Heap sinks are sized from Content-Length when the server
+//sends one and double otherwise; external sinks write into memory the caller owns. Compressed
+//bodies are inflated on the way in, so the sink only ever holds the asset itself.
+struct AssetSink
+{
+	char* data;
+	size_t size;
+	size_t capacity;
+	bool external;			//data is the caller's; never reallocated or freed
+	bool overflow;			//External sink was too small for the body
+
+	uint64_t expected;		//Content-Length, 0 if the server didn't send one
+
+	AssetInflater* inflater;	//Set if the body came with Content-Encoding gzip or deflate
+	uint64_t wireBytes;		//Body bytes received, before inflating
+	uint64_t inflateMicros;
+
+	uint32_t writes;		//Chunks curl handed over
+	uint32_t allocations;	//malloc/realloc calls
+	uint64_t movedBytes;	//Copied by realloc when a block couldn't grow in place
+};
+
+struct AssetFetch;
+struct AssetRanges;
+struct AssetRangeTransfer;
+class AssetConnection;
+
+//Called from Poll when a fetch finishes, whether or not it succeeded
+typedef void (*AssetCallback)(AssetFetch* fetch, void* userData);
+
+struct AssetFetch
+{
+	uint32_t id;
+	char url[ASSET_MAX_URL];
+
+	AssetCallback callback;
+	void* userData;
+
+	//Runs on the decode thread once the fetch is over, before callback runs from Poll. Can keep data like callback can.
+	AssetCallback process;
+	bool work;				//Queued with RunAsync, so there was nothing to transfer
+
+	//Sent as If-None-Match / If-Modified-Since when set
+	AssetValidators request;
+
+	//POSTed when set, malloc'd; otherwise the fetch is a GET
+	char* body;
+	size_t bodySize;
+
+	//Result. data is malloc'd and NUL-terminated like PullAsset's; the callback can keep it
+	//by setting data to NULL, otherwise it's freed once the callback returns. Fetched into a
+	//destination, data points into it instead and isn't terminated.
+	bool ok;
+	long httpStatus;
+	char* data;
+	size_t size;
+	char error[CURL_ERROR_SIZE];
+	AssetValidators response;
+	bool notModified;		//304 to a conditional request; ok is set and there is no data
+	bool cancelled;			//Cancelled before it finished; ok isn't set
+
+	uint64_t queueMicros;	//FetchAsync called
+	uint64_t startMicros;	//Transfer started
+	uint64_t endMicros;		//Transfer finished
+
+	//Fetched with FetchDecoded. decoded is set if the decoder finished the asset, and the
+	//callback only runs once it has; there is no data, size is the length of the (inflated) body.
+	AssetDecoder* decoder;
+	bool decoded;
+	uint64_t readyMicros;	//Decoder finished
+
+	//Fetched with FetchRanged
+	uint32_t rangeRequests;	//Range requests made, retries included
+	uint32_t rangeRetries;	//Chunks picked up again after their connection dropped
+	uint64_t resumedBytes;	//Read back from an interrupted download instead of fetched
+	AssetRanges* ranges;	//Fetch thread only
+
+	CURL* handle;			//Fetch thread only
+	curl_slist* headers;
+	AssetSink sink;
+
+	AssetConnection* connection;	//Fetch thread only, for decoded fetches
+	char* block;			//Body not yet handed to the decode thread
+	size_t blockSize;
+	bool decodeFailed;		//Decode thread only
+};
 
 class AssetConnection {
 
 	public:
+		AssetConnection();
 
-		bool Initialize();
+		//If host is NULL the default asset server is used
+		bool Initialize(const char* host = NULL, int maxTransfers = ASSET_DEFAULT_TRANSFERS);
 
+		//Downloads on the calling thread, blocking until done. Pulls from different threads take turns.
 		bool PullAsset(const char* uri, void** dataReturn, size_t* lenReturn);
 
+		//Downloads on the calling thread straight into destination. Fails if the body doesn't fit.
+		bool PullAssetInto(const char* uri, void* destination, size_t destinationSize, size_t* lenReturn);
+
+		//POSTs body and downloads the response on the calling thread, blocking until done
+		bool PostAsset(const char* uri, const void* body, size_t bodySize, void** dataReturn, size_t* lenReturn);
+
+		//Queues a download for the fetch thread. Returns the fetch id, or 0 if it couldn't be queued.
+		//With validators the request is conditional and may finish with notModified instead of data.
+		//With a destination the body is written there and the fetch fails if it doesn't fit; the
+		//destination must stay valid until the callback has run. A process callback gets the finished fetch
+		//on the decode thread first, for work on the body that would otherwise hold up Poll.
+		uint32_t FetchAsync(const char* uri, AssetCallback callback, void* userData, const AssetValidators* validators = NULL,
+							void* destination = NULL, size_t destinationSize = 0, AssetCallback process = NULL);
+
+		//Queues a POST of body, which is copied, and a download of the response as for FetchAsync
+		uint32_t PostAsync(const char* uri, const void* body, size_t bodySize, AssetCallback callback, void* userData);
+
+		//Queues a download whose body is handed to decoder on the decode thread as it arrives, so the
+		//asset is decoded shortly after the last byte. The decoder must outlive the callback.
+		uint32_t FetchDecoded(const char* uri, AssetDecoder* decoder, AssetCallback callback, void* userData);
+
+		//Queues a download fetched as ASSET_RANGE_CHUNK sized Range requests over up to ASSET_RANGE_CONNECTIONS
+		//connections at once, each written straight to its place in the body. A dropped connection only
+		//costs the rest of its chunk, which is requested again from where it stopped. The fetch takes one
+		//transfer slot however many connections it uses. Servers that ignore Range send the whole body in
+		//one response. Destination works as for FetchAsync. With a resumePath, finished chunks are kept in
+		//files named after it until the fetch succeeds, and a later fetch of the same URL with the same
+		//resumePath only downloads what's missing, if the server still has the same version of the asset.
+		//Process works as for FetchAsync.
+		uint32_t FetchRanged(const char* uri, AssetCallback callback, void* userData, void* destination = NULL,
+							 size_t destinationSize = 0, const char* resumePath = NULL, AssetCallback process = NULL);
+
+		//Runs process on the decode thread and then callback from Poll, both with an empty fetch, for work that
+		//follows fetches and would otherwise hold up the render thread. Decoded fetches wait for it to finish.
+		//Returns an id as for a fetch, counted as outstanding until Poll has run callback; 0 if it couldn't be queued.
+		uint32_t RunAsync(AssetCallback process, AssetCallback callback, void* userData);
+
+		//Stops a queued or running fetch. Its callback still runs from Poll, with cancelled set,
+		//unless the fetch finished first.
+		void Cancel(uint32_t id);
+
+		//Whether requests from now on ask for gzip or deflate compressed bodies. On by default; ranged fetches never do,
+		//since their Range offsets are into the asset. The libcurl we ship can't inflate, so AssetInflater does.
+		void SetCompression(bool enable);
+
+		//Caps the combined download rate, split evenly between the transfers in flight, Range requests
+		//included, and re-split as they start and finish. 0 removes the cap.
+		void SetBandwidthLimit(uint64_t bytesPerSecond);
+
+#if ASSET_FAULT_INJECTION
+		//For benchmarks: drops the connection of whichever transfer is receiving when each 'interval' more
+		//bytes have arrived, 'count' times, as if the network had dropped it
+		void InjectDrops(uint32_t count, uint64_t interval);
+#endif
+
+		//Runs the callbacks of finished fetches. Never waits on the fetch thread; called once per frame from OnIdle.
+		void Poll();
+
+		//Fetches queued but not yet handed back by Poll
+		uint32_t GetOutstanding() const { return outstanding; }
+
+		//Download buffer allocations so far, and bytes realloc had to copy to grow them
+		uint64_t GetSinkAllocations() const { return sinkAllocations; }
+		uint64_t GetSinkMovedBytes() const { return sinkMovedBytes; }
+
+		//Body bytes received so far, before inflating, and how much and how fast compressed bodies inflated
+		uint64_t GetWireBytes() const { return wireBytes; }
+		uint64_t GetInflatedBytes() const { return inflatedBytes; }
+		uint64_t GetInflateMicros() const { return inflateMicros; }
+
+		//Full URL of a URI on the asset host; url must hold ASSET_MAX_URL characters
+		void BuildUrl(const char* uri, char* url) const;
+
+		void PrintStats() const;
+
 		void Shutdown();
 
 	private:
+		//Part of the body of a decoded fetch, in order. The last block is sent when the transfer finishes.
+		struct DecodeBlock
+		{
+			AssetFetch* fetch;
+			char* data;
+			size_t size;
+			bool last;
+		};
+
+		static int FetchThreadMain(void* arg);
+		static int DecodeThreadMain(void* arg);
+
+		static size_t WriteFetchCallback(void* contents, size_t size, size_t nmemb, void* userp);
+		static size_t WriteDecodeCallback(void* contents, size_t size, size_t nmemb, void* userp);
+		static size_t WriteRangeCallback(void* contents, size_t size, size_t nmemb, void* userp);
+
+		//Fetch thread: fills a decoded fetch's blocks, handing each full one to the decode thread. An AssetInflateOutput.
+		static bool AppendDecodeBlocks(const char* data, size_t len, void* userData);
+
+		AssetFetch* CreateFetch(const char* uri, AssetCallback callback, void* userData);
+		uint32_t SubmitFetch(AssetFetch* fetch);
+
+		//Fetch thread, or RunAsync: queues the fetch's current block for the decode thread
+		void SubmitDecodeBlock(AssetFetch* fetch, bool last);
+
+		//Decode thread
+		void DecodeBlocks();
+
+		//Fetch thread: moves submitted fetches onto the multi handle as transfer slots free up
+		void StartTransfers();
+
+		//Fetch thread: takes a fetch off the waiting list or the multi handle
+		void CancelTransfer(uint32_t id);
+
+		//Fetch thread: returns an easy handle that's off the multi handle to the idle pool
+		void ReleaseHandle(CURL* handle, curl_slist* headers);
+
+		//Fetch thread: sets up a ranged fetch, reading back what an interrupted download left
+		void StartRanged(AssetFetch* fetch);
+
+		//Fetch thread: starts Range requests for a ranged fetch's missing chunks, only the first until the server has answered one
+		void StartChunks(AssetFetch* fetch);
+		bool StartChunk(AssetFetch* fetch, uint32_t chunk);
+
+		//Fetch thread: a Range request finished; retries the rest of its chunk or completes the fetch
+		void FinishChunk(AssetRangeTransfer* transfer, CURLcode result);
+
+		//Fetch thread: takes a ranged fetch's requests off the multi handle, saving what they got if it can be resumed
+		void StopChunks(AssetFetch* fetch);
+
+		//Fetch thread: hands a ranged fetch to Poll
+		void FinishRanged(AssetFetch* fetch, bool ok, const char* error);
+
+#if ASSET_FAULT_INJECTION
+		//Fetch thread: whether the bytes just received trip an injected drop
+		bool DropInjected(size_t bytes);
+#endif
+
+		//Fetch thread: passes a fetch that won't transfer any more to Poll, by way of the decode thread if it has a decoder or process callback
+		void CompleteFetch(AssetFetch* fetch);
+
+		//Fetch thread: hands finished transfers to the completed list
+		void FinishTransfers();
+
+		//Fetch thread: splits the bandwidth limit evenly among the transfers on the multi handle. Called
+		//whenever transfers start or finish, so each gets its share of the limit of what's in flight.
+		void ApplyBandwidthLimit();
+
+		//Fetch thread: blocks until a socket is ready, curl wants a timeout serviced, or a fetch is submitted
+		void WaitForActivity();
+
+		//Blocking download into an initialized sink, shared by PullAsset, PullAssetInto and PostAsset
+		bool Pull(const char* uri, AssetSink* sink, const void* body = NULL, size_t bodySize = 0);
+
+		//Adds a finished sink to the download counters. Called from Poll and Pull, not the fetch thread.
+		void CountSink(const AssetSink& sink);
+
 		CURL* curlHandle;
-	
-};
\ No newline at end of file
+		char host[256];
+
+		CURLM* multiHandle;
+		int maxTransfers;
+
+		SST_Thread fetchThread;
+		volatile int running;
+		SST_Event wakeEvent;
+
+		//Render thread -> fetch thread
+		SST_Mutex submitLock;
+		ZArray<AssetFetch*> submitted;
+		ZArray<uint32_t> cancelRequests;
+		uint64_t bandwidthLimit;
+		bool compression;
+#if ASSET_FAULT_INJECTION
+		uint32_t dropRequests;
+		uint64_t dropRequestInterval;
+#endif
+
+		//Fetch thread -> decode thread, which also runs process callbacks and RunAsync work
+		SST_Thread decodeThread;
+		SST_Event decodeEvent;
+		SST_Mutex decodeLock;
+		ZArray<DecodeBlock> decodeQueue;
+		ZArray<DecodeBlock> decodeBatch;	//Decode thread only
+
+		//Fetch thread, decode thread -> render thread
+		SST_Mutex completeLock;
+		ZArray<AssetFetch*> completed;
+
+		//Held for a pull's use of curlHandle, and for CountSink, as work on the decode thread can pull too
+		SST_Mutex pullLock;
+		SST_Mutex countLock;
+
+		//Fetch thread only
+		ZList<AssetFetch*> waiting;
+		ZArray<AssetFetch*> incoming;
+		ZArray<uint32_t> incomingCancels;
+		ZArray<AssetFetch*> active;
+		ZArray<CURL*> idleHandles;
+		ZArray<AssetRangeTransfer*> rangeTransfers;
+		uint64_t transferLimit;		//bandwidthLimit as of the last StartTransfers
+#if ASSET_FAULT_INJECTION
+		uint32_t dropsLeft;
+		uint64_t dropInterval;
+		uint64_t dropCounter;
+#endif
+
+		//Render thread only
+		ZArray<AssetFetch*> finished;
+		uint32_t nextId;
+		uint32_t outstanding;
+
+		uint32_t completedFetches;
+		uint32_t failedFetches;
+		uint32_t cancelledFetches;
+		uint64_t fetchedBytes;
+		uint64_t queueToStartMicros;
+		uint64_t transferMicros;
+		uint64_t startMicros;
+
+		uint64_t sinkWrites;
+		uint64_t sinkAllocations;
+		uint64_t sinkMovedBytes;
+		uint32_t sinkPreallocated;		//Sized up front from Content-Length
+
+		uint32_t decodedFetches;
+		uint64_t decodeTailMicros;		//Last byte to decoded
+
+		uint32_t rangedFetches;
+		uint32_t rangeRequests;
+		uint32_t rangeRetries;
+		uint64_t resumedBytes;
+
+		uint64_t wireBytes;
+		uint32_t inflatedFetches;
+		uint64_t inflatedBytes;
+		uint64_t inflateMicros;
+};
+
+//Downloads each URI once into a growing heap buffer and once into a preallocated destination,
+//and prints time, allocations and copied bytes of each next to what a realloc per chunk would cost
+void AssetConnection_DownloadBenchmark(const char* host, const char** uris, uint32_t count);
+
+//Downloads uri with FetchAsync and with FetchRanged, first as is and then with 'drops' connections
+//dropped along the way, where FetchAsync starts over each time. Then cancels a resumable ranged
+//download halfway and resumes it. Prints the time and throughput of each. The dropped connections
+//are only compared when built with ASSET_FAULT_INJECTION.
+void AssetConnection_RangedBenchmark(const char* host, const char* uri, uint32_t drops);
+
+//Downloads smallCount copies of smallUri and largeCount of largeUri, once one after another with
+//PullAsset and once all at once with FetchAsync, and prints the throughput of each
+void AssetConnection_Benchmark(const char* host, const char* smallUri, uint32_t smallCount,
+							   const char* largeUri, uint32_t largeCount, int maxTransfers);
@@ -0,0 +1,19 @@
+#pragma once
+
+#include <stddef.h>
+
+/*
+Decodes one asset incrementally. AssetConnection::FetchDecoded feeds it the body in order,
+a block at a time on its decode thread, while the rest is still downloading.
+*/
+class AssetDecoder
+{
+	public:
+		virtual ~AssetDecoder() { }
+
+		//Decode thread. Returns false if the data is bad; the rest of the body is then skipped.
+		virtual bool Decode(const char* data, size_t len) = 0;
+
+		//Decode thread, after the last block of a successful download. Returns true if the asset is complete.
+		virtual bool Finish() = 0;
+};
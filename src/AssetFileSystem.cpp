@@ -0,0 +1,604 @@
+#include "AssetFileSystem.hpp"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <SST/SST_Concurrency.h>
+#include <SST/SST_Time.h>
+#include <assimp/material.h>
+#include <assimp/postprocess.h>
+#include <assimp/scene.h>
+
+AssetFileStream::AssetFileStream(const void* bytes, size_t len)
+	: data((const uint8_t*)bytes), size(len), pos(0)
+{
+}
+
+size_t AssetFileStream::Read(void* buffer, size_t itemSize, size_t count)
+{
+	if(itemSize == 0 || count == 0)
+		return 0;
+
+	//Whole items only, like fread
+	size_t items = (size - pos) / itemSize;
+	if(items > count)
+		items = count;
+
+	memcpy(buffer, data + pos, items * itemSize);
+	pos += items * itemSize;
+	return items;
+}
+
+aiReturn AssetFileStream::Seek(size_t offset, aiOrigin origin)
+{
+	size_t target;
+	switch(origin)
+	{
+		case aiOrigin_SET: target = offset; break;
+		case aiOrigin_CUR: target = pos + offset; break;
+		case aiOrigin_END: target = size - offset; break;
+		default: return aiReturn_FAILURE;
+	}
+
+	if(target > size)
+		return aiReturn_FAILURE;
+
+	pos = target;
+	return aiReturn_SUCCESS;
+}
+
+AssetFileSystem::AssetFileSystem(AssetMemoryCache* memoryCache, AssetConnection* conn)
+	: memory(memoryCache), connection(conn), bytes(0), pulledFiles(0), mappedFiles(0)
+{
+	base[0] = '\0';
+}
+
+AssetFileSystem::~AssetFileSystem()
+{
+	for(size_t i=0; i<files.Size(); i++)
+	{
+		File* file = files.Data()[i];
+
+		if(file->handle != NULL)
+			memory->Release(file->handle);
+		if(file->map != NULL)
+			SST_OS_DestroyMmap(file->map);
+		if(file->file != NULL)
+			SST_OS_CloseFile(file->file);
+		free(file->owned);
+
+		delete file;
+	}
+}
+
+void AssetFileSystem::SetBase(const char* path)
+{
+	strncpy(base, path, ASSET_MAX_URL - 1);
+	base[ASSET_MAX_URL - 1] = '\0';
+}
+
+void AssetFileSystem::Resolve(const char* from, const char* name, char* path)
+{
+	//Keep from's directory, up to and including its last slash
+	size_t dirLen = 0;
+	bool absolute = name[0] == '/' || name[0] == '\\' || (name[0] != '\0' && name[1] == ':');
+	if(!absolute) {
+		for(size_t i=0; from[i] != '\0'; i++) {
+			if(from[i] == '/' || from[i] == '\\')
+				dirLen = i + 1;
+		}
+	}
+
+	size_t nameLen = strlen(name);
+	if(dirLen + nameLen > ASSET_MAX_URL - 1)
+		nameLen = ASSET_MAX_URL - 1 - dirLen;
+
+	memcpy(path, from, dirLen);
+	memcpy(path + dirLen, name, nameLen);
+	path[dirLen + nameLen] = '\0';
+
+	for(char* p = path; *p != '\0'; p++) {
+		if(*p == '\\')
+			*p = '/';
+	}
+}
+
+AssetFileSystem::File* AssetFileSystem::Find(const char* path) const
+{
+	for(size_t i=0; i<files.Size(); i++) {
+		if(strcmp(files.Data()[i]->path, path) == 0)
+			return files.Data()[i];
+	}
+
+	return NULL;
+}
+
+void AssetFileSystem::Add(const char* path, AssetHandle* handle)
+{
+	File* file = Find(path);
+	if(file != NULL) {
+		memory->Release(handle);
+		return;
+	}
+
+	file = new File();
+	strncpy(file->path, path, ASSET_MAX_URL - 1);
+	file->path[ASSET_MAX_URL - 1] = '\0';
+	file->ok = handle->asset->ok;
+	file->data = handle->asset->data;
+	file->size = handle->asset->size;
+	file->handle = handle;
+	file->file = NULL;
+	file->map = NULL;
+	file->owned = NULL;
+
+	if(file->ok) {
+		bytes += file->size;
+	} else {
+		memory->Release(handle);
+		file->handle = NULL;
+		file->data = NULL;
+		file->size = 0;
+	}
+
+	files.PushBack(file);
+}
+
+AssetFileSystem::File* AssetFileSystem::LoadPath(const char* path)
+{
+	File* file = Find(path);
+	if(file != NULL)
+		return file;
+
+	file = new File();
+	strcpy(file->path, path);
+	file->ok = false;
+	file->data = NULL;
+	file->size = 0;
+	file->handle = NULL;
+	file->file = NULL;
+	file->map = NULL;
+	file->owned = NULL;
+
+	if(path[0] != '/')
+	{
+		//Local files are mapped in place; empty files can't be mapped
+		file->file = SST_OS_OpenFile(path, SST_OPEN_READ);
+		if(file->file != NULL) {
+			file->size = (size_t)SST_OS_GetFileSize(file->file);
+			file->map = file->size > 0 ? SST_OS_CreateMmap(file->file, 0, 0, SST_PROTECT_READ) : NULL;
+			file->ok = file->size == 0 || file->map != NULL;
+			file->data = file->map != NULL ? SST_OS_GetMmapBase(file->map) : NULL;
+			if(file->ok)
+				mappedFiles++;
+		}
+	}
+	else if(connection != NULL)
+	{
+		void* data;
+		size_t size;
+		if(connection->PullAsset(path, &data, &size)) {
+			file->owned = data;
+			file->data = data;
+			file->size = size;
+			file->ok = true;
+			pulledFiles++;
+		}
+	}
+
+	if(file->ok)
+		bytes += file->size;
+	else
+		file->size = 0;
+
+	files.PushBack(file);
+	return file;
+}
+
+AssetFileSystem::File* AssetFileSystem::Load(const char* name)
+{
+	char path[ASSET_MAX_URL];
+	Resolve("", name, path);
+
+	File* file = Find(path);
+	if(file != NULL && file->ok)
+		return file;
+
+	//Relative to the base, as importers that don't prefix their model's directory expect. Relative
+	//names never reach the local disk when the base is a URI.
+	char relative[ASSET_MAX_URL];
+	Resolve(base, name, relative);
+	if(base[0] == '/' || strcmp(relative, path) == 0)
+		return LoadPath(relative);
+
+	File* found = LoadPath(relative);
+	if(found->ok)
+		return found;
+
+	return LoadPath(path);
+}
+
+bool AssetFileSystem::GetFile(const char* path, const void** dataReturn, size_t* sizeReturn)
+{
+	char resolved[ASSET_MAX_URL];
+	Resolve("", path, resolved);
+
+	File* file = LoadPath(resolved);
+	if(!file->ok)
+		return false;
+
+	*dataReturn = file->data;
+	*sizeReturn = file->size;
+	return true;
+}
+
+bool AssetFileSystem::GetNamedFile(const char* name, const void** dataReturn, size_t* sizeReturn)
+{
+	File* file = Load(name);
+	if(!file->ok)
+		return false;
+
+	*dataReturn = file->data;
+	*sizeReturn = file->size;
+	return true;
+}
+
+uint32_t AssetFileSystem::GetFileCount() const
+{
+	//Not counting names looked up and not found
+	uint32_t count = 0;
+	for(size_t i=0; i<files.Size(); i++) {
+		if(files.Data()[i]->ok)
+			count++;
+	}
+
+	return count;
+}
+
+bool AssetFileSystem::Exists(const char* name) const
+{
+	//Assimp only asks before opening, so looking now saves nothing; a file loaded here is served by Open
+	return const_cast<AssetFileSystem*>(this)->Load(name)->ok;
+}
+
+Assimp::IOStream* AssetFileSystem::Open(const char* name, const char* mode)
+{
+	//Read-only
+	if(strchr(mode, 'w') != NULL || strchr(mode, 'a') != NULL || strchr(mode, '+') != NULL)
+		return NULL;
+
+	File* file = Load(name);
+	if(!file->ok)
+		return NULL;
+
+	return new AssetFileStream(file->data, file->size);
+}
+
+void AssetFileSystem::Close(Assimp::IOStream* stream)
+{
+	delete stream;
+}
+
+AssetScene::AssetScene(AssetMemoryCache* memoryCache, AssetConnection* conn)
+	: memory(memoryCache), connection(conn), scene(NULL), importFlags(0), callback(NULL), userData(NULL), started(false), prefetch(true),
+	  pending(0), requesting(false), startMicros(0), fetchMicros(0), importMicros(0)
+{
+	files = new AssetFileSystem(memoryCache, conn);
+	importer.SetIOHandler(files);
+	path[0] = '\0';
+}
+
+AssetScene::~AssetScene()
+{
+	for(size_t i=0; i<requested.Size(); i++)
+		free(requested.Data()[i]);
+}
+
+bool AssetScene::Load(const char* objPath, unsigned int flags, AssetSceneCallback cb, void* data, bool prefetchFiles)
+{
+	if(started)
+		return false;
+
+	AssetFileSystem::Resolve("", objPath, path);
+	files->SetBase(path);
+
+	started = true;
+	importFlags = flags;
+	callback = cb;
+	userData = data;
+	prefetch = prefetchFiles;
+	startMicros = SST_OS_GetMicroTime();
+
+	requesting = true;
+	Request(path, FILE_OBJ);
+	requesting = false;
+
+	if(pending == 0)
+		Finish(false);
+	return true;
+}
+
+void AssetScene::Request(const char* filePath, FileKind kind)
+{
+	for(size_t i=0; i<requested.Size(); i++) {
+		if(strcmp(requested.Data()[i], filePath) == 0)
+			return;
+	}
+	if(requested.Size() >= ASSET_SCENE_MAX_FILES)
+		return;
+
+	char* copy = (char*)malloc(strlen(filePath) + 1);
+	strcpy(copy, filePath);
+	requested.PushBack(copy);
+
+	//Local files are mapped now, and remote ones are pulled as the importer opens them without a memory cache
+	if(filePath[0] != '/' || memory == NULL)
+	{
+		const void* data;
+		size_t size;
+		if(filePath[0] != '/' && prefetch && files->GetFile(filePath, &data, &size)) {
+			if(kind == FILE_OBJ)
+				ScanObj(filePath, (const char*)data, size);
+			else if(kind == FILE_MTL)
+				ScanMtl(filePath, (const char*)data, size);
+		}
+		return;
+	}
+
+	FileRequest* request = new FileRequest();
+	request->scene = this;
+	request->kind = kind;
+	strcpy(request->path, filePath);
+
+	pending++;
+	if(!memory->Fetch(filePath, OnFileDone, request)) {
+		pending--;
+		delete request;
+	}
+}
+
+void AssetScene::OnFileDone(AssetHandle* handle, void* userData)
+{
+	FileRequest* request = (FileRequest*)userData;
+	AssetScene* self = request->scene;
+
+	self->pending--;
+
+	//Files named by this one may call back at once; only the outermost call finishes the scene
+	bool outer = !self->requesting;
+	self->requesting = true;
+
+	const AssetData* asset = handle->asset;
+	if(asset->ok && self->prefetch) {
+		if(request->kind == FILE_OBJ)
+			self->ScanObj(request->path, (const char*)asset->data, asset->size);
+		else if(request->kind == FILE_MTL)
+			self->ScanMtl(request->path, (const char*)asset->data, asset->size);
+	}
+
+	self->files->Add(request->path, handle);
+	delete request;
+
+	if(outer) {
+		self->requesting = false;
+		if(self->pending == 0)
+			self->Finish(true);
+	}
+}
+
+//Calls found(from, token) for each whitespace-separated token after the keyword on every line that
+//starts with one of keywords. With lastOnly, only the last token of the line, as texture options come first.
+static void ScanStatements(const char* data, size_t size, const char** keywords, bool lastOnly,
+						   void (*found)(void* context, const char* token, size_t len), void* context)
+{
+	const char* end = data + size;
+	const char* line = data;
+
+	while(line < end)
+	{
+		const char* eol = (const char*)memchr(line, '\n', end - line);
+		if(eol == NULL)
+			eol = end;
+
+		const char* p = line;
+		while(p < eol && (*p == ' ' || *p == '\t'))
+			p++;
+
+		const char* word = p;
+		while(p < eol && *p != ' ' && *p != '\t' && *p != '\r')
+			p++;
+		size_t wordLen = p - word;
+
+		//Skips the v, vt, vn and f lines that make up most of an OBJ without comparing
+		bool match = false;
+		if(wordLen > 2) {
+			for(size_t k=0; keywords[k] != NULL && !match; k++)
+				match = strlen(keywords[k]) == wordLen && memcmp(keywords[k], word, wordLen) == 0;
+		}
+
+		while(match && p < eol)
+		{
+			while(p < eol && (*p == ' ' || *p == '\t' || *p == '\r'))
+				p++;
+			const char* token = p;
+			while(p < eol && *p != ' ' && *p != '\t' && *p != '\r')
+				p++;
+
+			bool last = true;
+			for(const char* q = p; q < eol; q++) {
+				if(*q != ' ' && *q != '\t' && *q != '\r') {
+					last = false;
+					break;
+				}
+			}
+
+			if(p > token && (!lastOnly || last))
+				found(context, token, p - token);
+		}
+
+		line = eol + 1;
+	}
+}
+
+struct AssetSceneScan
+{
+	const char* from;
+	char paths[ASSET_SCENE_MAX_FILES][ASSET_MAX_URL];
+	uint32_t count;
+};
+
+static void AssetSceneFound(void* context, const char* token, size_t len)
+{
+	AssetSceneScan* scan = (AssetSceneScan*)context;
+	if(scan->count >= ASSET_SCENE_MAX_FILES || len >= ASSET_MAX_URL)
+		return;
+
+	char name[ASSET_MAX_URL];
+	memcpy(name, token, len);
+	name[len] = '\0';
+
+	AssetFileSystem::Resolve(scan->from, name, scan->paths[scan->count++]);
+}
+
+void AssetScene::ScanObj(const char* from, const char* data, size_t size)
+{
+	static const char* keywords[] = { "mtllib", NULL };
+
+	AssetSceneScan* scan = new AssetSceneScan();
+	scan->from = from;
+	scan->count = 0;
+	ScanStatements(data, size, keywords, false, AssetSceneFound, scan);
+
+	//Requested once the scan is done, as a resident file calls back from within Request
+	for(uint32_t i=0; i<scan->count; i++)
+		Request(scan->paths[i], FILE_MTL);
+	delete scan;
+}
+
+void AssetScene::ScanMtl(const char* from, const char* data, size_t size)
+{
+	static const char* keywords[] = {
+		"map_Ka", "map_Kd", "map_Ks", "map_Ke", "map_Ns", "map_d", "map_bump", "map_Bump",
+		"bump", "disp", "decal", "refl", "norm", NULL
+	};
+
+	AssetSceneScan* scan = new AssetSceneScan();
+	scan->from = from;
+	scan->count = 0;
+	ScanStatements(data, size, keywords, true, AssetSceneFound, scan);
+
+	for(uint32_t i=0; i<scan->count; i++)
+		Request(scan->paths[i], FILE_TEXTURE);
+	delete scan;
+}
+
+void AssetScene::Finish(bool fromPoll)
+{
+	fetchMicros = SST_OS_GetMicroTime() - startMicros;
+
+	//Importing and pulling what the scan missed would hold up the frame Poll runs in
+	if(fromPoll && connection != NULL && connection->RunAsync(ImportWork, OnImported, this) != 0)
+		return;
+
+	Import();
+
+	if(callback != NULL)
+		callback(this, userData);
+}
+
+void AssetScene::ImportWork(AssetFetch* fetch, void* userData)
+{
+	((AssetScene*)userData)->Import();
+}
+
+void AssetScene::OnImported(AssetFetch* fetch, void* userData)
+{
+	AssetScene* self = (AssetScene*)userData;
+
+	if(self->callback != NULL)
+		self->callback(self, self->userData);
+}
+
+void AssetScene::Import()
+{
+	uint64_t importStart = SST_OS_GetMicroTime();
+	scene = importer.ReadFile(path, importFlags);
+
+	//Textures the scan missed, or all of them without prefetching
+	if(scene != NULL) {
+		for(uint32_t m=0; m<scene->mNumMaterials; m++) {
+			const aiMaterial* material = scene->mMaterials[m];
+			for(int type=aiTextureType_DIFFUSE; type<=aiTextureType_UNKNOWN; type++) {
+				for(uint32_t t=0; t<material->GetTextureCount((aiTextureType)type); t++) {
+					aiString name;
+					const void* data;
+					size_t size;
+					if(material->GetTexture((aiTextureType)type, t, &name) == aiReturn_SUCCESS)
+						GetTexture(name.C_Str(), &data, &size);
+				}
+			}
+		}
+	} else {
+		printf("Couldn't import %s: %s\n", path, importer.GetErrorString());
+	}
+
+	importMicros = SST_OS_GetMicroTime() - importStart;
+}
+
+bool AssetScene::GetTexture(const char* name, const void** dataReturn, size_t* sizeReturn)
+{
+	return files->GetNamedFile(name, dataReturn, sizeReturn);
+}
+
+void AssetScene::PrintStats() const
+{
+	printf("AssetScene %s: %s, %u files, %.2f MB, %u pulled while importing; %.1f ms to fetch, %.1f ms to import\n",
+		path, scene != NULL ? "imported" : "not imported", files->GetFileCount(),
+		(double)files->GetBytes() / (1024.0 * 1024.0), files->GetPulledFiles(),
+		(double)fetchMicros / 1000.0, (double)importMicros / 1000.0);
+}
+
+static void AssetSceneBenchmarkCallback(AssetScene* scene, void* userData)
+{
+	*(bool*)userData = true;
+}
+
+void AssetScene_Benchmark(const char* host, const char* uri)
+{
+	for(int pass=0; pass<2; pass++)
+	{
+		AssetConnection conn;
+		AssetCache cache;
+		AssetMemoryCache memory;
+
+		if(!conn.Initialize(host) || !cache.Initialize(&conn, ASSET_CACHE_DIRECTORY "-scenebenchmark")) {
+			printf("Asset scene benchmark: couldn't initialize\n");
+			conn.Shutdown();
+			return;
+		}
+
+		cache.Clear();
+		memory.Initialize(&cache);
+
+		bool prefetch = pass == 1;
+		bool done = false;
+		uint64_t start = SST_OS_GetMicroTime();
+		{
+			AssetScene scene(&memory, &conn);
+			if(scene.Load(uri, aiProcess_Triangulate, AssetSceneBenchmarkCallback, &done, prefetch)) {
+				while(!done) {
+					conn.Poll();
+					SST_Concurrency_SleepThread(1);
+				}
+			}
+
+			printf("Asset scene benchmark, %s: %s in %.1f ms (%.1f ms fetching, %.1f ms importing), %u files, %.2f MB, %u pulled one at a time\n",
+				prefetch ? "prefetched" : "pulled on open", scene.GetScene() != NULL ? "imported" : "NOT IMPORTED",
+				(double)(SST_OS_GetMicroTime() - start) / 1000.0, (double)scene.GetFetchMicros() / 1000.0,
+				(double)scene.GetImportMicros() / 1000.0, scene.GetFileCount(),
+				(double)scene.GetBytes() / (1024.0 * 1024.0), scene.GetPulledFiles());
+		}
+
+		cache.Clear();
+		conn.Shutdown();
+	}
+}
@@ -0,0 +1,206 @@
+#pragma once
+
+#include <pstdint.h>
+#include <ZSTL/ZArray.hpp>
+#include <SST/SST_File.h>
+#include <SST/SST_Mmap.h>
+#include <assimp/IOStream.hpp>
+#include <assimp/IOSystem.hpp>
+#include <assimp/Importer.hpp>
+
+#include "AssetMemoryCache.hpp"
+
+//Read-only stream over bytes an AssetFileSystem holds
+class AssetFileStream : public Assimp::IOStream
+{
+	public:
+		AssetFileStream(const void* data, size_t size);
+
+		size_t Read(void* buffer, size_t size, size_t count);
+		size_t Write(const void* buffer, size_t size, size_t count) { return 0; }
+		aiReturn Seek(size_t offset, aiOrigin origin);
+		size_t Tell() const { return pos; }
+		size_t FileSize() const { return size; }
+		void Flush() { }
+
+	private:
+		const uint8_t* data;
+		size_t size;
+		size_t pos;
+};
+
+/*
+Assimp file system over assets already in memory, so an importer can open the files a model
+refers to without anything being written to disk. Paths starting with '/' are URIs on the asset
+server, served from handles added from an AssetMemoryCache; anything else is a local file, mapped
+read-only. Names that aren't found as given are looked up relative to the directory of the base
+path. A URI opened without being added is pulled on the calling thread, which is the slow path
+AssetScene's prefetching avoids.
+*/
+class AssetFileSystem : public Assimp::IOSystem
+{
+	public:
+		//memory may be NULL if only local files are read; connection may be NULL if nothing is to be pulled
+		AssetFileSystem(AssetMemoryCache* memory, AssetConnection* connection);
+		~AssetFileSystem();
+
+		void SetBase(const char* path);
+
+		//Serves path from a handle, taking over the reference. A handle whose fetch failed marks the path missing.
+		void Add(const char* path, AssetHandle* handle);
+
+		//Bytes of the file at path, loading it now if it wasn't added. Returns false if it doesn't exist.
+		bool GetFile(const char* path, const void** dataReturn, size_t* sizeReturn);
+
+		//Same for a name as a model refers to it, which is looked up as Open looks it up
+		bool GetNamedFile(const char* name, const void** dataReturn, size_t* sizeReturn);
+
+		//Assimp::IOSystem
+		bool Exists(const char* name) const;
+		char getOsSeparator() const { return '/'; }
+		Assimp::IOStream* Open(const char* name, const char* mode = "rb");
+		void Close(Assimp::IOStream* stream);
+
+		//Writes the path name refers to, relative to the directory of from unless name is absolute.
+		//Backslashes become slashes. path must hold ASSET_MAX_URL characters.
+		static void Resolve(const char* from, const char* name, char* path);
+
+		uint32_t GetFileCount() const;
+		uint64_t GetBytes() const { return bytes; }
+		uint32_t GetPulledFiles() const { return pulledFiles; }
+		uint32_t GetMappedFiles() const { return mappedFiles; }
+
+	private:
+		struct File
+		{
+			char path[ASSET_MAX_URL];
+			bool ok;				//False if it was looked for and doesn't exist
+			const void* data;
+			size_t size;
+
+			//Where the bytes live: a cache handle, a mapped local file or a pulled download
+			AssetHandle* handle;
+			SST_File file;
+			SST_MemoryMap map;
+			void* owned;
+		};
+
+		File* Find(const char* path) const;
+
+		//Finds name as given, then relative to the base, loading it if it hasn't been looked for yet
+		File* Load(const char* name);
+		File* LoadPath(const char* path);
+
+		AssetMemoryCache* memory;
+		AssetConnection* connection;
+		char base[ASSET_MAX_URL];
+
+		ZArray<File*> files;
+		uint64_t bytes;
+		uint32_t pulledFiles;
+		uint32_t mappedFiles;
+};
+
+class AssetScene;
+
+//Called once the scene has been imported or has failed to; GetScene() is NULL if it failed
+typedef void (*AssetSceneCallback)(AssetScene* scene, void* userData);
+
+//Bound on the files one scene can fetch, against material libraries naming each other in a loop
+#define ASSET_SCENE_MAX_FILES 256
+
+/*
+Loads an OBJ along with its material libraries and their textures. The OBJ is fetched through
+the memory cache and scanned for mtllib lines, every material library it names is fetched at
+once, and each is scanned for texture maps as it arrives, which are fetched at once in turn.
+Once everything is resident Assimp imports the OBJ through an AssetFileSystem and the textures
+stay resident with the scene. Local paths are mapped instead, and load before Load returns.
+Without prefetching, the importer pulls the files it opens one at a time, as do the textures
+after it. Once the last file arrives in Poll, the import and those pulls run on the connection's
+decode thread, and the scene isn't to be touched until the callback. The scene must outlive its
+load. Otherwise render thread only.
+*/
+class AssetScene
+{
+	public:
+		//memory may be NULL if only local files are loaded
+		AssetScene(AssetMemoryCache* memory, AssetConnection* connection);
+		~AssetScene();
+
+		//Returns false if the scene was already loaded. Calls back from AssetConnection::Poll, or
+		//before returning if everything was resident or local, in which case it imports on the calling thread.
+		bool Load(const char* path, unsigned int importFlags, AssetSceneCallback callback, void* userData, bool prefetch = true);
+
+		const aiScene* GetScene() const { return scene; }
+		const char* GetPath() const { return path; }
+
+		//A texture a material names, pulled now if it wasn't prefetched
+		bool GetTexture(const char* name, const void** dataReturn, size_t* sizeReturn);
+
+		uint32_t GetFileCount() const { return files->GetFileCount(); }
+		uint64_t GetBytes() const { return files->GetBytes(); }
+		uint32_t GetPulledFiles() const { return files->GetPulledFiles(); }
+		uint64_t GetFetchMicros() const { return fetchMicros; }
+		uint64_t GetImportMicros() const { return importMicros; }
+
+		void PrintStats() const;
+
+	private:
+		enum FileKind
+		{
+			FILE_OBJ,
+			FILE_MTL,
+			FILE_TEXTURE
+		};
+
+		struct FileRequest
+		{
+			AssetScene* scene;
+			FileKind kind;
+			char path[ASSET_MAX_URL];
+		};
+
+		static void OnFileDone(AssetHandle* handle, void* userData);
+
+		//RunAsync work and callback for an import started from Poll
+		static void ImportWork(AssetFetch* fetch, void* userData);
+		static void OnImported(AssetFetch* fetch, void* userData);
+
+		//Fetches path unless this scene already asked for it
+		void Request(const char* path, FileKind kind);
+
+		//Requests the material libraries an OBJ names and the textures a material library names
+		void ScanObj(const char* from, const char* data, size_t size);
+		void ScanMtl(const char* from, const char* data, size_t size);
+
+		//Imports once nothing is pending and calls back, on the decode thread if fromPoll and there's a connection to run it
+		void Finish(bool fromPoll);
+
+		//Imports, then pulls any texture the materials name that wasn't found
+		void Import();
+
+		AssetMemoryCache* memory;
+		AssetConnection* connection;
+		Assimp::Importer importer;
+		AssetFileSystem* files;			//Owned by the importer
+		const aiScene* scene;
+
+		char path[ASSET_MAX_URL];
+		unsigned int importFlags;
+		AssetSceneCallback callback;
+		void* userData;
+		bool started;
+		bool prefetch;
+
+		ZArray<char*> requested;
+		uint32_t pending;
+		bool requesting;				//Inside Request, where a resident file calls back at once
+
+		uint64_t startMicros;
+		uint64_t fetchMicros;			//Load to everything resident
+		uint64_t importMicros;
+};
+
+//Loads uri and everything it refers to twice through fresh caches, first letting the importer pull
+//each file as it opens it and then prefetching them all at once, and prints the time each took.
+void AssetScene_Benchmark(const char* host, const char* uri);
@@ -0,0 +1,123 @@
+#include "AssetHash.hpp"
+#include <stdio.h>
+#include <string.h>
+
+static inline uint64_t Rotl64(uint64_t x, int r)
+{
+	return (x << r) | (x >> (64 - r));
+}
+
+static inline uint64_t Fmix64(uint64_t k)
+{
+	k ^= k >> 33;
+	k *= 0xFF51AFD7ED558CCDULL;
+	k ^= k >> 33;
+	k *= 0xC4CEB9FE1A85EC53ULL;
+	k ^= k >> 33;
+	return k;
+}
+
+//Blocks are read with memcpy so unaligned data is fine; on x86 this compiles to plain loads
+static inline uint64_t ReadBlock64(const unsigned char* p)
+{
+	uint64_t v;
+	memcpy(&v, p, sizeof(v));
+	return v;
+}
+
+AssetHash AssetHash_Compute(const void* data, size_t len)
+{
+	const unsigned char* bytes = (const unsigned char*)data;
+	const size_t nblocks = len / 16;
+
+	const uint64_t c1 = 0x87C37B91114253D5ULL;
+	const uint64_t c2 = 0x4CF5AD432745937FULL;
+
+	uint64_t h1 = 0;
+	uint64_t h2 = 0;
+
+	for(size_t i=0; i<nblocks; i++)
+	{
+		uint64_t k1 = ReadBlock64(bytes + i*16);
+		uint64_t k2 = ReadBlock64(bytes + i*16 + 8);
+
+		k1 *= c1; k1 = Rotl64(k1, 31); k1 *= c2; h1 ^= k1;
+		h1 = Rotl64(h1, 27); h1 += h2; h1 = h1*5 + 0x52DCE729;
+
+		k2 *= c2; k2 = Rotl64(k2, 33); k2 *= c1; h2 ^= k2;
+		h2 = Rotl64(h2, 31); h2 += h1; h2 = h2*5 + 0x38495AB5;
+	}
+
+	const unsigned char* tail = bytes + nblocks*16;
+	uint64_t k1 = 0;
+	uint64_t k2 = 0;
+
+	switch(len & 15)
+	{
+		case 15: k2 ^= (uint64_t)tail[14] << 48;
+		case 14: k2 ^= (uint64_t)tail[13] << 40;
+		case 13: k2 ^= (uint64_t)tail[12] << 32;
+		case 12: k2 ^= (uint64_t)tail[11] << 24;
+		case 11: k2 ^= (uint64_t)tail[10] << 16;
+		case 10: k2 ^= (uint64_t)tail[ 9] << 8;
+		case  9: k2 ^= (uint64_t)tail[ 8];
+			k2 *= c2; k2 = Rotl64(k2, 33); k2 *= c1; h2 ^= k2;
+
+		case  8: k1 ^= (uint64_t)tail[ 7] << 56;
+		case  7: k1 ^= (uint64_t)tail[ 6] << 48;
+		case  6: k1 ^= (uint64_t)tail[ 5] << 40;
+		case  5: k1 ^= (uint64_t)tail[ 4] << 32;
+		case  4: k1 ^= (uint64_t)tail[ 3] << 24;
+		case  3: k1 ^= (uint64_t)tail[ 2] << 16;
+		case  2: k1 ^= (uint64_t)tail[ 1] << 8;
+		case  1: k1 ^= (uint64_t)tail[ 0];
+			k1 *= c1; k1 = Rotl64(k1, 31); k1 *= c2; h1 ^= k1;
+	}
+
+	h1 ^= (uint64_t)len;
+	h2 ^= (uint64_t)len;
+
+	h1 += h2;
+	h2 += h1;
+
+	h1 = Fmix64(h1);
+	h2 = Fmix64(h2);
+
+	h1 += h2;
+	h2 += h1;
+
+	AssetHash hash;
+	hash.lo = h1;
+	hash.hi = h2;
+	return hash;
+}
+
+void AssetHash_ToString(const AssetHash& hash, char* out)
+{
+	sprintf(out, "%016llx%016llx", (unsigned long long)hash.hi, (unsigned long long)hash.lo);
+}
+
+bool AssetHash_FromString(const char* str, AssetHash* hashReturn)
+{
+	uint64_t parts[2] = { 0, 0 };
+
+	for(int i=0; i<ASSET_HASH_STRING_LENGTH; i++)
+	{
+		char c = str[i];
+		int digit;
+		if(c >= '0' && c <= '9')
+			digit = c - '0';
+		else if(c >= 'a' && c <= 'f')
+			digit = c - 'a' + 10;
+		else if(c >= 'A' && c <= 'F')
+			digit = c - 'A' + 10;
+		else
+			return false;
+
+		parts[i / 16] = (parts[i / 16] << 4) | (uint64_t)digit;
+	}
+
+	hashReturn->hi = parts[0];
+	hashReturn->lo = parts[1];
+	return true;
+}
@@ -0,0 +1,25 @@
+#pragma once
+
+#include <stddef.h>
+#include <pstdint.h>
+
+//Characters in the hex form of a hash, not counting the terminator
+#define ASSET_HASH_STRING_LENGTH 32
+
+//128-bit content hash (MurmurHash3 x64). Not cryptographic; used to name and deduplicate cached content.
+struct AssetHash
+{
+	uint64_t lo;
+	uint64_t hi;
+
+	bool operator==(const AssetHash& other) const { return lo == other.lo && hi == other.hi; }
+	bool operator!=(const AssetHash& other) const { return !(*this == other); }
+};
+
+AssetHash AssetHash_Compute(const void* data, size_t len);
+
+//Writes ASSET_HASH_STRING_LENGTH hex digits and a terminator
+void AssetHash_ToString(const AssetHash& hash, char* out);
+
+//Returns false if str isn't ASSET_HASH_STRING_LENGTH hex digits
+bool AssetHash_FromString(const char* str, AssetHash* hashReturn);
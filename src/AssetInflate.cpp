@@ -0,0 +1,638 @@
+#include "AssetInflate.hpp"
+#include <string.h>
+
+#define INFLATE_WINDOW (32 * 1024)
+
+//Output is handed over each time the history buffer fills up, then the last INFLATE_WINDOW bytes slide down
+#define INFLATE_HISTORY (4 * INFLATE_WINDOW)
+
+#define GZIP_FHCRC 0x02
+#define GZIP_FEXTRA 0x04
+#define GZIP_FNAME 0x08
+#define GZIP_FCOMMENT 0x10
+
+static const uint16_t lengthBase[29] = {
+	3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+	35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+static const uint8_t lengthExtra[29] = {
+	0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+	3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+static const uint16_t distanceBase[30] = {
+	1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+	257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577 };
+static const uint8_t distanceExtra[30] = {
+	0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+	7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+
+//Order code length code lengths are sent in
+static const uint8_t codeLengthOrder[19] = { 16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15 };
+
+//CRC-32 a nibble at a time
+static const uint32_t crcNibble[16] = {
+	0x00000000, 0x1DB71064, 0x3B6E20C8, 0x26D930AC, 0x76DC4190, 0x6B6B51F4, 0x4DB26158, 0x5005713C,
+	0xEDB88320, 0xF00F9344, 0xD6D6A3E8, 0xCB61B38C, 0x9B64C2B0, 0x86D3D2D4, 0xA00AE278, 0xBDBDF21C };
+
+AssetInflater::AssetInflater(Format _format)
+	: format(_format), zlib(false), state(STATE_HEADER), lastBlock(false), storedLeft(0),
+	  inputPos(0), bitBuffer(0), bitCount(0), markPos(0), markBuffer(0), markCount(0),
+	  pos(0), flushed(0), inflatedBytes(0), output(NULL), userData(NULL),
+	  crc(0xFFFFFFFF), adlerA(1), adlerB(0)
+{
+	window.Resize(INFLATE_HISTORY);
+}
+
+bool AssetInflater::BuildHuffman(Huffman* huffman, const uint8_t* lengths, uint32_t n)
+{
+	memset(huffman->count, 0, sizeof(huffman->count));
+	memset(huffman->fast, 0, sizeof(huffman->fast));
+
+	for(uint32_t i=0; i<n; i++)
+		huffman->count[lengths[i]]++;
+
+	//Over-subscribed sets can't be decoded; incomplete ones can, e.g. a single distance code
+	int left = 1;
+	for(int len=1; len<16; len++) {
+		left <<= 1;
+		left -= huffman->count[len];
+		if(left < 0)
+			return false;
+	}
+
+	uint16_t offsets[16];
+	offsets[1] = 0;
+	for(int len=1; len<15; len++)
+		offsets[len + 1] = offsets[len] + huffman->count[len];
+
+	for(uint32_t i=0; i<n; i++)
+		if(lengths[i] != 0)
+			huffman->symbol[offsets[lengths[i]]++] = (uint16_t)i;
+
+	//Canonical codes are assigned in symbol order within each length; the table is indexed by them bit-reversed, as they arrive
+	uint32_t code = 0;
+	uint32_t index = 0;
+	for(uint32_t len=1; len<=ASSET_INFLATE_FAST_BITS; len++)
+	{
+		for(uint32_t i=0; i<huffman->count[len]; i++, code++, index++)
+		{
+			uint32_t reversed = 0;
+			for(uint32_t bit=0; bit<len; bit++)
+				reversed |= ((code >> bit) & 1) << (len - 1 - bit);
+
+			for(uint32_t fill=reversed; fill<(1u << ASSET_INFLATE_FAST_BITS); fill += 1u << len)
+				huffman->fast[fill] = (uint16_t)((len << 9) | huffman->symbol[index]);
+		}
+		code <<= 1;
+	}
+
+	return true;
+}
+
+bool AssetInflater::NeedBits(uint32_t n)
+{
+	while(bitCount < n)
+	{
+		if(inputPos >= input.Size())
+			return false;
+		bitBuffer |= (uint64_t)input.Data()[inputPos++] << bitCount;
+		bitCount += 8;
+	}
+	return true;
+}
+
+uint32_t AssetInflater::TakeBits(uint32_t n)
+{
+	uint32_t bits = (uint32_t)(bitBuffer & ((1ull << n) - 1));
+	bitBuffer >>= n;
+	bitCount -= n;
+	return bits;
+}
+
+void AssetInflater::Mark()
+{
+	markPos = inputPos;
+	markBuffer = bitBuffer;
+	markCount = bitCount;
+}
+
+void AssetInflater::Rewind()
+{
+	inputPos = markPos;
+	bitBuffer = markBuffer;
+	bitCount = markCount;
+}
+
+int AssetInflater::Decode(const Huffman& huffman)
+{
+	//Take what's there up to the longest code; near the end of the input that may be less
+	while(bitCount <= 56 - 8 && inputPos < input.Size()) {
+		bitBuffer |= (uint64_t)input.Data()[inputPos++] << bitCount;
+		bitCount += 8;
+	}
+
+	uint16_t entry = huffman.fast[bitBuffer & ((1 << ASSET_INFLATE_FAST_BITS) - 1)];
+	if(entry != 0 && (uint32_t)(entry >> 9) <= bitCount) {
+		TakeBits(entry >> 9);
+		return entry & 0x1FF;
+	}
+
+	//Longer codes, and short ones without enough bits for the table, a bit at a time
+	int code = 0;
+	int first = 0;
+	int index = 0;
+	for(uint32_t len=1; len<16; len++)
+	{
+		if(len > bitCount)
+			return -1;
+
+		code |= (int)((bitBuffer >> (len - 1)) & 1);
+		int count = huffman.count[len];
+		if(code - count < first) {
+			TakeBits(len);
+			return huffman.symbol[index + (code - first)];
+		}
+
+		index += count;
+		first += count;
+		first <<= 1;
+		code <<= 1;
+	}
+
+	return -2;
+}
+
+bool AssetInflater::ReadHeader()
+{
+	if(format == FORMAT_DEFLATE)
+	{
+		//zlib's two header bytes are a multiple of 31 with method 8; raw deflate almost never is
+		if(!NeedBits(16))
+			return false;
+
+		uint32_t cmf = (uint32_t)(bitBuffer & 0xFF);
+		uint32_t flg = (uint32_t)((bitBuffer >> 8) & 0xFF);
+		if((cmf & 0x0F) == 8 && (cmf >> 4) <= 7 && ((cmf << 8) | flg) % 31 == 0)
+		{
+			if(flg & 0x20) {
+				state = STATE_ERROR;		//Preset dictionaries aren't used over HTTP
+				return false;
+			}
+			TakeBits(16);
+			zlib = true;
+		}
+
+		state = STATE_BLOCK;
+		return true;
+	}
+
+	if(!NeedBits(32))
+		return false;
+
+	if(TakeBits(8) != 0x1F || TakeBits(8) != 0x8B || TakeBits(8) != 8) {
+		state = STATE_ERROR;
+		return false;
+	}
+
+	uint32_t flags = TakeBits(8);
+
+	//MTIME, XFL, OS
+	for(int i=0; i<6; i++) {
+		if(!NeedBits(8))
+			return false;
+		TakeBits(8);
+	}
+
+	if(flags & GZIP_FEXTRA)
+	{
+		if(!NeedBits(16))
+			return false;
+
+		uint32_t extra = TakeBits(16);
+		for(uint32_t i=0; i<extra; i++) {
+			if(!NeedBits(8))
+				return false;
+			TakeBits(8);
+		}
+	}
+
+	for(uint32_t flag=GZIP_FNAME; flag<=GZIP_FCOMMENT; flag <<= 1)
+	{
+		if((flags & flag) == 0)
+			continue;
+
+		do {
+			if(!NeedBits(8))
+				return false;
+		} while(TakeBits(8) != 0);
+	}
+
+	if(flags & GZIP_FHCRC) {
+		if(!NeedBits(16))
+			return false;
+		TakeBits(16);
+	}
+
+	state = STATE_BLOCK;
+	return true;
+}
+
+bool AssetInflater::ReadBlockHeader()
+{
+	if(!NeedBits(3))
+		return false;
+
+	bool last = TakeBits(1) != 0;
+	uint32_t type = TakeBits(2);
+
+	if(type == 0)
+	{
+		//Stored: the lengths start on the next byte
+		TakeBits(bitCount & 7);
+		if(!NeedBits(32))
+			return false;
+
+		uint32_t len = TakeBits(16);
+		uint32_t check = TakeBits(16);
+		if(len != (~check & 0xFFFF)) {
+			state = STATE_ERROR;
+			return false;
+		}
+
+		storedLeft = len;
+		state = STATE_STORED;
+	}
+	else if(type == 1)
+	{
+		uint8_t lengths[288 + 30];
+		memset(lengths, 8, 144);
+		memset(lengths + 144, 9, 112);
+		memset(lengths + 256, 7, 24);
+		memset(lengths + 280, 8, 8);
+		memset(lengths + 288, 5, 30);
+		BuildHuffman(&literals, lengths, 288);
+		BuildHuffman(&distances, lengths + 288, 30);
+		state = STATE_CODES;
+	}
+	else if(type == 2)
+	{
+		if(!ReadDynamicTables())
+			return false;
+		state = STATE_CODES;
+	}
+	else
+	{
+		state = STATE_ERROR;
+		return false;
+	}
+
+	lastBlock = last;
+	return true;
+}
+
+bool AssetInflater::ReadDynamicTables()
+{
+	if(!NeedBits(14))
+		return false;
+
+	uint32_t literalCount = TakeBits(5) + 257;
+	uint32_t distanceCount = TakeBits(5) + 1;
+	uint32_t codeLengthCount = TakeBits(4) + 4;
+	if(literalCount > 286 || distanceCount > 30) {
+		state = STATE_ERROR;
+		return false;
+	}
+
+	uint8_t codeLengths[19];
+	memset(codeLengths, 0, sizeof(codeLengths));
+	for(uint32_t i=0; i<codeLengthCount; i++) {
+		if(!NeedBits(3))
+			return false;
+		codeLengths[codeLengthOrder[i]] = (uint8_t)TakeBits(3);
+	}
+
+	//Borrow the literal code to read the lengths with
+	if(!BuildHuffman(&literals, codeLengths, 19)) {
+		state = STATE_ERROR;
+		return false;
+	}
+
+	uint8_t lengths[286 + 30];
+	uint32_t n = 0;
+	while(n < literalCount + distanceCount)
+	{
+		int symbol = Decode(literals);
+		if(symbol < 0) {
+			if(symbol == -2)
+				state = STATE_ERROR;
+			return false;
+		}
+
+		if(symbol < 16) {
+			lengths[n++] = (uint8_t)symbol;
+			continue;
+		}
+
+		uint8_t repeated = 0;
+		uint32_t repeat;
+		if(symbol == 16)
+		{
+			if(n == 0) {
+				state = STATE_ERROR;
+				return false;
+			}
+			if(!NeedBits(2))
+				return false;
+			repeated = lengths[n - 1];
+			repeat = 3 + TakeBits(2);
+		}
+		else if(symbol == 17)
+		{
+			if(!NeedBits(3))
+				return false;
+			repeat = 3 + TakeBits(3);
+		}
+		else
+		{
+			if(!NeedBits(7))
+				return false;
+			repeat = 11 + TakeBits(7);
+		}
+
+		if(n + repeat > literalCount + distanceCount) {
+			state = STATE_ERROR;
+			return false;
+		}
+
+		while(repeat--)
+			lengths[n++] = repeated;
+	}
+
+	//Without an end of block code nothing could be decoded
+	if(lengths[256] == 0 ||
+	   !BuildHuffman(&literals, lengths, literalCount) ||
+	   !BuildHuffman(&distances, lengths + literalCount, distanceCount))
+	{
+		state = STATE_ERROR;
+		return false;
+	}
+
+	return true;
+}
+
+bool AssetInflater::ReadTrailer()
+{
+	TakeBits(bitCount & 7);
+
+	if(format == FORMAT_GZIP)
+	{
+		if(!NeedBits(32))
+			return false;
+		uint32_t expectedCrc = TakeBits(32);
+		if(!NeedBits(32))
+			return false;
+		uint32_t expectedSize = TakeBits(32);
+
+		if(expectedCrc != ~crc || expectedSize != (uint32_t)inflatedBytes) {
+			state = STATE_ERROR;
+			return false;
+		}
+	}
+	else if(zlib)
+	{
+		if(!NeedBits(32))
+			return false;
+		uint32_t stored = TakeBits(32);
+		uint32_t expectedAdler = ((stored & 0xFF) << 24) | ((stored & 0xFF00) << 8) | ((stored >> 8) & 0xFF00) | (stored >> 24);
+
+		if(expectedAdler != ((adlerB << 16) | adlerA)) {
+			state = STATE_ERROR;
+			return false;
+		}
+	}
+
+	state = STATE_DONE;
+	return true;
+}
+
+void AssetInflater::Put(uint8_t byte)
+{
+	window.Data()[pos++] = byte;
+}
+
+bool AssetInflater::Flush()
+{
+	if(pos == flushed)
+		return true;
+
+	const uint8_t* data = window.Data() + flushed;
+	size_t len = pos - flushed;
+
+	if(format == FORMAT_GZIP)
+	{
+		for(size_t i=0; i<len; i++) {
+			crc ^= data[i];
+			crc = (crc >> 4) ^ crcNibble[crc & 15];
+			crc = (crc >> 4) ^ crcNibble[crc & 15];
+		}
+	}
+	else if(zlib)
+	{
+		//Sums stay in range for 5552 bytes between the modulos
+		for(size_t i=0; i<len; )
+		{
+			size_t end = i + 5552 < len ? i + 5552 : len;
+			for(; i<end; i++) {
+				adlerA += data[i];
+				adlerB += adlerA;
+			}
+			adlerA %= 65521;
+			adlerB %= 65521;
+		}
+	}
+
+	inflatedBytes += len;
+	flushed = pos;
+
+	return output((const char*)data, len, userData);
+}
+
+bool AssetInflater::Step()
+{
+	Mark();
+
+	switch(state)
+	{
+		case STATE_HEADER:
+			if(!ReadHeader()) {
+				Rewind();
+				return false;
+			}
+			return true;
+
+		case STATE_BLOCK:
+			if(!ReadBlockHeader()) {
+				Rewind();
+				return false;
+			}
+			return true;
+
+		case STATE_STORED:
+		{
+			//Whole bytes left in the bit buffer come first
+			while(storedLeft > 0 && bitCount >= 8 && pos < INFLATE_HISTORY) {
+				Put((uint8_t)TakeBits(8));
+				storedLeft--;
+			}
+
+			size_t available = input.Size() - inputPos;
+			size_t room = INFLATE_HISTORY - pos;
+			size_t len = storedLeft;
+			if(len > available)
+				len = available;
+			if(len > room)
+				len = room;
+
+			memcpy(window.Data() + pos, input.Data() + inputPos, len);
+			pos += len;
+			inputPos += len;
+			storedLeft -= (uint32_t)len;
+
+			if(storedLeft == 0) {
+				state = lastBlock ? STATE_TRAILER : STATE_BLOCK;
+				return true;
+			}
+			return pos == INFLATE_HISTORY;
+		}
+
+		case STATE_CODES:
+		{
+			//One symbol, or one length and distance pair, per step
+			while(pos + 258 <= INFLATE_HISTORY)
+			{
+				Mark();
+
+				int symbol = Decode(literals);
+				if(symbol < 0) {
+					if(symbol == -2)
+						state = STATE_ERROR;
+					Rewind();
+					return false;
+				}
+
+				if(symbol < 256) {
+					Put((uint8_t)symbol);
+					continue;
+				}
+
+				if(symbol == 256) {
+					state = lastBlock ? STATE_TRAILER : STATE_BLOCK;
+					return true;
+				}
+
+				symbol -= 257;
+				if(symbol >= 29) {
+					state = STATE_ERROR;
+					return false;
+				}
+
+				if(!NeedBits(lengthExtra[symbol])) {
+					Rewind();
+					return false;
+				}
+				uint32_t len = lengthBase[symbol] + TakeBits(lengthExtra[symbol]);
+
+				int distanceSymbol = Decode(distances);
+				if(distanceSymbol < 0 || distanceSymbol >= 30) {
+					if(distanceSymbol != -1)
+						state = STATE_ERROR;
+					Rewind();
+					return false;
+				}
+
+				if(!NeedBits(distanceExtra[distanceSymbol])) {
+					Rewind();
+					return false;
+				}
+				uint32_t distance = distanceBase[distanceSymbol] + TakeBits(distanceExtra[distanceSymbol]);
+
+				if(distance > pos) {
+					state = STATE_ERROR;
+					return false;
+				}
+
+				//Overlapping copies repeat the bytes just written, so this goes a byte at a time
+				uint8_t* out = window.Data() + pos;
+				const uint8_t* from = out - distance;
+				for(uint32_t i=0; i<len; i++)
+					out[i] = from[i];
+				pos += len;
+			}
+
+			//Out of room; the caller flushes and slides the window
+			return true;
+		}
+
+		case STATE_TRAILER:
+			//The checksums cover what's been handed over
+			if(!Flush()) {
+				state = STATE_ERROR;
+				return false;
+			}
+			if(!ReadTrailer()) {
+				Rewind();
+				return false;
+			}
+			return true;
+
+		default:
+			return false;
+	}
+}
+
+bool AssetInflater::Inflate(const void* data, size_t len, AssetInflateOutput _output, void* _userData)
+{
+	if(state == STATE_ERROR)
+		return false;
+
+	output = _output;
+	userData = _userData;
+
+	//Drop what earlier calls consumed, then queue the new bytes behind what they couldn't
+	if(inputPos > 0) {
+		size_t left = input.Size() - inputPos;
+		memmove(input.Data(), input.Data() + inputPos, left);
+		input.Resize(left);
+		inputPos = 0;
+	}
+
+	size_t queued = input.Size();
+	input.Resize(queued + len);
+	memcpy(input.Data() + queued, data, len);
+
+	while(state != STATE_DONE && state != STATE_ERROR)
+	{
+		bool progressed = Step();
+
+		if(pos + 258 > INFLATE_HISTORY)
+		{
+			if(!Flush()) {
+				state = STATE_ERROR;
+				return false;
+			}
+
+			memmove(window.Data(), window.Data() + pos - INFLATE_WINDOW, INFLATE_WINDOW);
+			pos = INFLATE_WINDOW;
+			flushed = INFLATE_WINDOW;
+			continue;
+		}
+
+		if(!progressed)
+			break;
+	}
+
+	if(state == STATE_ERROR || !Flush()) {
+		state = STATE_ERROR;
+		return false;
+	}
+
+	return true;
+}
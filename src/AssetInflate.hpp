@@ -0,0 +1,109 @@
+#pragma once
+
+#include <stddef.h>
+#include <pstdint.h>
+#include <ZSTL/ZArray.hpp>
+
+//Inflated bytes are handed over as they're decoded. Returning false stops inflating.
+typedef bool (*AssetInflateOutput)(const char* data, size_t len, void* userData);
+
+//Huffman codes up to this long decode with one table lookup
+#define ASSET_INFLATE_FAST_BITS 10
+
+/*
+Streaming DEFLATE decoder for gzip and deflate Content-Encodings, which the libcurl we ship
+was built without. Compressed bytes can arrive in pieces of any size; whatever can't be
+decoded yet waits for the next piece. Keeps the last 32 KB of output for back-references, so
+the output can go anywhere, a block at a time.
+*/
+class AssetInflater
+{
+	public:
+		enum Format
+		{
+			FORMAT_GZIP,
+			FORMAT_DEFLATE			//zlib-wrapped as HTTP specifies, or raw as some servers send it
+		};
+
+		AssetInflater(Format format);
+
+		//Returns false if the data is corrupt or output returned false
+		bool Inflate(const void* data, size_t len, AssetInflateOutput output, void* userData);
+
+		//The whole stream and its checksum have been read
+		bool IsDone() const { return state == STATE_DONE; }
+
+		uint64_t GetInflatedBytes() const { return inflatedBytes; }
+
+	private:
+		enum State
+		{
+			STATE_HEADER,
+			STATE_BLOCK,
+			STATE_STORED,
+			STATE_CODES,
+			STATE_TRAILER,
+			STATE_DONE,
+			STATE_ERROR
+		};
+
+		//Canonical Huffman code, with a lookup table for codes up to ASSET_INFLATE_FAST_BITS long
+		struct Huffman
+		{
+			uint16_t count[16];
+			uint16_t symbol[320];
+			uint16_t fast[1 << ASSET_INFLATE_FAST_BITS];		//(length << 9) | symbol, 0 if the code is longer
+		};
+
+		static bool BuildHuffman(Huffman* huffman, const uint8_t* lengths, uint32_t n);
+
+		//Bit reader over the compressed bytes not consumed yet. A step that runs out restores the mark and waits for more.
+		bool NeedBits(uint32_t n);
+		uint32_t TakeBits(uint32_t n);
+		void Mark();
+		void Rewind();
+
+		//Symbol of the next code, -1 if more input is needed, -2 if the code is invalid
+		int Decode(const Huffman& huffman);
+
+		bool ReadHeader();
+		bool ReadBlockHeader();
+		bool ReadDynamicTables();
+		bool ReadTrailer();
+
+		//Returns false when waiting on input; sets state to STATE_ERROR on corrupt data
+		bool Step();
+
+		void Put(uint8_t byte);
+		bool Flush();
+
+		Format format;
+		bool zlib;
+		State state;
+		bool lastBlock;
+		uint32_t storedLeft;
+
+		ZArray<uint8_t> input;
+		size_t inputPos;
+		uint64_t bitBuffer;
+		uint32_t bitCount;
+		size_t markPos;
+		uint64_t markBuffer;
+		uint32_t markCount;
+
+		Huffman literals;
+		Huffman distances;
+
+		//Output history; bytes from flushed up to pos haven't been handed over yet
+		ZArray<uint8_t> window;
+		size_t pos;
+		size_t flushed;
+		uint64_t inflatedBytes;
+
+		AssetInflateOutput output;
+		void* userData;
+
+		uint32_t crc;
+		uint32_t adlerA;
+		uint32_t adlerB;
+};
@@ -0,0 +1,389 @@
+#include "AssetMemoryCache.hpp"
+#include <stdio.h>
+#include <string.h>
+#include <SST/SST_Concurrency.h>
+#include <SST/SST_Time.h>
+
+AssetMemoryCache::AssetMemoryCache()
+	: cache(NULL), budget(ASSET_MEMORY_CACHE_BUDGET), lruHead(NULL), lruTail(NULL), residentBytes(0), peakResidentBytes(0),
+	  hits(0), joined(0), misses(0), failures(0), collisions(0), evictions(0), evictedBytes(0), servedBytes(0)
+{
+}
+
+AssetMemoryCache::~AssetMemoryCache()
+{
+	Shutdown();
+}
+
+void AssetMemoryCache::Initialize(AssetCache* diskCache, uint64_t bytes)
+{
+	cache = diskCache;
+	budget = bytes;
+}
+
+bool AssetMemoryCache::Fetch(const char* uri, AssetMemoryCallback callback, void* userData, bool large)
+{
+	if(cache == NULL)
+		return false;
+
+	AssetHandle::Waiter waiter;
+	waiter.callback = callback;
+	waiter.userData = userData;
+
+	uint64_t key = AssetHash_Compute(uri, strlen(uri)).lo;
+	bool collided = false;
+
+	ZHashMap<uint64_t, AssetHandle*>::Iterator itr = handles.Find(key);
+	if(itr != handles.End())
+	{
+		AssetHandle* handle = itr.GetValue();
+		if(strncmp(handle->uri, uri, ASSET_MAX_URL - 1) == 0)
+		{
+			handle->refs++;
+
+			if(handle->loading) {
+				joined++;
+				handle->waiters.PushBack(waiter);
+				return true;
+			}
+
+			if(handle->refs == 1)
+				LruRemove(handle);
+			hits++;
+			servedBytes += handle->asset->size;
+			callback(handle, userData);
+			return true;
+		}
+
+		//Two URIs with the same 64-bit hash; the second is fetched but not kept
+		collided = true;
+		collisions++;
+	}
+
+	AssetHandle* handle = new AssetHandle();
+	handle->asset = NULL;
+	handle->refs = 1;
+	handle->cache = this;
+	handle->key = key;
+	strncpy(handle->uri, uri, ASSET_MAX_URL - 1);
+	handle->uri[ASSET_MAX_URL - 1] = '\0';
+	handle->loading = true;
+	handle->indexed = !collided;
+	handle->waiters.PushBack(waiter);
+	handle->lruPrev = NULL;
+	handle->lruNext = NULL;
+
+	if(handle->indexed)
+		handles.Put(key, handle);
+
+	if(cache->Fetch(uri, OnFetchDone, handle, large) == 0) {
+		if(handle->indexed)
+			handles.Erase(key);
+		delete handle;
+		return false;
+	}
+
+	misses++;
+	return true;
+}
+
+void AssetMemoryCache::OnFetchDone(AssetData* asset, void* userData)
+{
+	AssetHandle* handle = (AssetHandle*)userData;
+	AssetMemoryCache* self = handle->cache;
+
+	handle->asset = asset;
+	handle->loading = false;
+
+	if(!asset->ok) {
+		//Not kept, so the next fetch tries again
+		self->failures++;
+		if(handle->indexed) {
+			self->handles.Erase(handle->key);
+			handle->indexed = false;
+		}
+	} else if(handle->indexed) {
+		self->residentBytes += asset->size;
+		if(self->residentBytes > self->peakResidentBytes)
+			self->peakResidentBytes = self->residentBytes;
+		self->Trim();
+	}
+
+	//Each waiter holds a reference, so the handle lives until the last one is released
+	ZArray<AssetHandle::Waiter> waiters;
+	waiters.Swap(handle->waiters);
+
+	for(size_t i=0; i<waiters.Size(); i++)
+		waiters.Data()[i].callback(handle, waiters.Data()[i].userData);
+}
+
+void AssetMemoryCache::Retain(AssetHandle* handle)
+{
+	handle->refs++;
+}
+
+void AssetMemoryCache::Release(AssetHandle* handle)
+{
+	if(handle == NULL || handle->refs == 0)
+		return;
+
+	if(--handle->refs > 0)
+		return;
+
+	if(handle->indexed) {
+		//Stays resident until evicted
+		LruPushBack(handle);
+		Trim();
+	} else {
+		Free(handle);
+	}
+}
+
+void AssetMemoryCache::SetBudget(uint64_t bytes)
+{
+	budget = bytes;
+	Trim();
+}
+
+void AssetMemoryCache::LruRemove(AssetHandle* handle)
+{
+	if(handle->lruPrev != NULL)
+		handle->lruPrev->lruNext = handle->lruNext;
+	else
+		lruHead = handle->lruNext;
+
+	if(handle->lruNext != NULL)
+		handle->lruNext->lruPrev = handle->lruPrev;
+	else
+		lruTail = handle->lruPrev;
+
+	handle->lruPrev = NULL;
+	handle->lruNext = NULL;
+}
+
+void AssetMemoryCache::LruPushBack(AssetHandle* handle)
+{
+	handle->lruPrev = lruTail;
+	handle->lruNext = NULL;
+
+	if(lruTail != NULL)
+		lruTail->lruNext = handle;
+	else
+		lruHead = handle;
+	lruTail = handle;
+}
+
+void AssetMemoryCache::Trim()
+{
+	while(residentBytes > budget && lruHead != NULL)
+	{
+		AssetHandle* handle = lruHead;
+		LruRemove(handle);
+
+		evictions++;
+		evictedBytes += handle->asset->size;
+		Free(handle);
+	}
+}
+
+void AssetMemoryCache::Free(AssetHandle* handle)
+{
+	if(handle->indexed) {
+		handles.Erase(handle->key);
+		if(handle->asset != NULL && handle->asset->ok)
+			residentBytes -= handle->asset->size;
+	}
+
+	if(handle->asset != NULL)
+		cache->Release(handle->asset);
+	delete handle;
+}
+
+void AssetMemoryCache::Shutdown()
+{
+	for(ZHashMap<uint64_t, AssetHandle*>::Iterator itr = handles.Begin(); itr != handles.End(); ++itr)
+	{
+		AssetHandle* handle = itr.GetValue();
+		if(handle->asset != NULL)
+			cache->Release(handle->asset);
+		delete handle;
+	}
+	handles.Clear();
+
+	lruHead = NULL;
+	lruTail = NULL;
+	residentBytes = 0;
+}
+
+void AssetMemoryCache::PrintStats() const
+{
+	uint32_t requests = hits + joined + misses;
+
+	printf("AssetMemoryCache: %u hits, %u joined a running fetch, %u fetched (%.1f%% hit rate), %u failed, %u hash collisions\n",
+		hits, joined, misses, requests ? 100.0 * (double)(hits + joined) / requests : 0.0, failures, collisions);
+	printf("AssetMemoryCache: %u resident, %.2f MB of %.2f MB budget (%.2f MB peak); %u evicted, %.2f MB; %.2f MB served from memory\n",
+		(uint32_t)handles.Size(), (double)residentBytes / (1024.0 * 1024.0), (double)budget / (1024.0 * 1024.0),
+		(double)peakResidentBytes / (1024.0 * 1024.0), evictions, (double)evictedBytes / (1024.0 * 1024.0),
+		(double)servedBytes / (1024.0 * 1024.0));
+}
+
+struct AssetMemoryBenchmarkState
+{
+	ZArray<AssetHandle*> held;
+	ZArray<AssetData*> heldData;
+	uint32_t done;
+	uint32_t failed;
+	uint64_t size;
+};
+
+static void AssetMemoryBenchmarkCallback(AssetHandle* handle, void* userData)
+{
+	AssetMemoryBenchmarkState* state = (AssetMemoryBenchmarkState*)userData;
+
+	state->done++;
+	if(!handle->asset->ok)
+		state->failed++;
+	state->size = handle->asset->size;
+	state->held.PushBack(handle);
+}
+
+static void AssetMemoryBenchmarkDiskCallback(AssetData* asset, void* userData)
+{
+	AssetMemoryBenchmarkState* state = (AssetMemoryBenchmarkState*)userData;
+
+	state->done++;
+	if(!asset->ok)
+		state->failed++;
+	state->heldData.PushBack(asset);
+}
+
+static void AssetMemoryBenchmarkWait(AssetConnection* conn, AssetMemoryBenchmarkState* state, uint32_t count)
+{
+	while(state->done < count) {
+		conn->Poll();
+		SST_Concurrency_SleepThread(1);
+	}
+}
+
+//Runs the frames through the memory cache, or straight through the disk cache if memory is NULL.
+//Each frame fetches its window and then lets go of the previous frame's.
+static uint64_t AssetMemoryBenchmarkWalk(AssetConnection* conn, AssetCache* cache, AssetMemoryCache* memory,
+										 const char* uri, uint32_t copies, uint32_t window, uint32_t* failedReturn)
+{
+	AssetMemoryBenchmarkState state;
+	state.done = 0;
+	state.failed = 0;
+	state.size = 0;
+
+	uint32_t step = window / 4 > 0 ? window / 4 : 1;
+	uint32_t last = copies - window;
+	uint32_t requested = 0;
+	uint64_t start = SST_OS_GetMicroTime();
+
+	//Walks the window forward to the end and back again
+	for(uint32_t frame=0; ; frame++)
+	{
+		uint32_t forward = frame * step;
+		if(forward > 2 * last)
+			break;
+		uint32_t first = forward <= last ? forward : 2 * last - forward;
+
+		size_t previous = memory != NULL ? state.held.Size() : state.heldData.Size();
+
+		for(uint32_t i=first; i<first+window; i++)
+		{
+			char copy[ASSET_MAX_URL];
+			sprintf(copy, "%s?copy=%u", uri, i);
+
+			if(memory != NULL)
+				memory->Fetch(copy, AssetMemoryBenchmarkCallback, &state);
+			else
+				cache->Fetch(copy, AssetMemoryBenchmarkDiskCallback, &state);
+			requested++;
+		}
+
+		AssetMemoryBenchmarkWait(conn, &state, requested);
+
+		for(size_t i=0; i<previous; i++) {
+			if(memory != NULL)
+				memory->Release(state.held.Erase(0));
+			else
+				cache->Release(state.heldData.Erase(0));
+		}
+	}
+
+	while(state.held.Size() > 0)
+		memory->Release(state.held.PopBack());
+	while(state.heldData.Size() > 0)
+		cache->Release(state.heldData.PopBack());
+
+	*failedReturn = state.failed;
+	return SST_OS_GetMicroTime() - start;
+}
+
+void AssetMemoryCache_Benchmark(const char* host, const char* uri, uint32_t count)
+{
+	AssetConnection conn;
+	AssetCache cache;
+	AssetMemoryCache memory;
+
+	if(count < 8 || strlen(uri) + 16 > ASSET_MAX_URL || !conn.Initialize(host) || !cache.Initialize(&conn, ASSET_CACHE_DIRECTORY "-memorybenchmark")) {
+		printf("Asset memory cache benchmark: couldn't initialize\n");
+		conn.Shutdown();
+		return;
+	}
+
+	cache.Clear();
+	memory.Initialize(&cache);
+
+	//Everyone asking for the same asset at once
+	AssetMemoryBenchmarkState state;
+	state.done = 0;
+	state.failed = 0;
+	state.size = 0;
+
+	uint64_t bytesBefore = cache.GetFetchedBytes();
+	uint64_t start = SST_OS_GetMicroTime();
+
+	for(uint32_t i=0; i<count; i++)
+		memory.Fetch(uri, AssetMemoryBenchmarkCallback, &state);
+	AssetMemoryBenchmarkWait(&conn, &state, count);
+
+	printf("Asset memory cache benchmark: %u fetches of one asset in %.1f ms, %u download(s), %.2f MB downloaded, %u references held%s\n",
+		count, (double)(SST_OS_GetMicroTime() - start) / 1000.0, memory.GetMisses(),
+		(double)(cache.GetFetchedBytes() - bytesBefore) / (1024.0 * 1024.0),
+		count > 0 ? state.held.Data()[0]->refs : 0, state.failed ? ", SOME FETCHES FAILED" : "");
+
+	while(state.held.Size() > 0)
+		memory.Release(state.held.PopBack());
+
+	//A window of copies walked forward and back, with a budget of half of them
+	uint32_t copies = count;
+	uint32_t window = count / 8;
+	memory.Shutdown();
+	memory.SetBudget(state.size * copies / 2);
+
+	//Fill the disk cache so both walks revalidate rather than download
+	uint32_t failed = 0;
+	AssetMemoryBenchmarkWalk(&conn, &cache, NULL, uri, copies, copies, &failed);
+
+	uint64_t diskMicros = AssetMemoryBenchmarkWalk(&conn, &cache, NULL, uri, copies, window, &failed);
+	uint32_t diskFailed = failed;
+
+	uint32_t hitsBefore = memory.GetHits();
+	uint32_t missesBefore = memory.GetMisses();
+	uint64_t memoryMicros = AssetMemoryBenchmarkWalk(&conn, &cache, &memory, uri, copies, window, &failed);
+
+	uint32_t hits = memory.GetHits() - hitsBefore;
+	uint32_t misses = memory.GetMisses() - missesBefore;
+	printf("Asset memory cache benchmark: %u copies, %u held per frame: disk cache %.1f ms, memory cache %.1f ms, %.1f%% hits, %u evictions, %.2f MB resident of %.2f MB budget%s\n",
+		copies, window, (double)diskMicros / 1000.0, (double)memoryMicros / 1000.0,
+		hits + misses ? 100.0 * (double)hits / (hits + misses) : 0.0, memory.GetEvictions(),
+		(double)memory.GetResidentBytes() / (1024.0 * 1024.0), (double)(state.size * copies / 2) / (1024.0 * 1024.0),
+		diskFailed || failed ? ", SOME FETCHES FAILED" : "");
+
+	memory.PrintStats();
+	memory.Shutdown();
+	cache.Clear();
+	conn.Shutdown();
+}
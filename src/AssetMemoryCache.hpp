@@ -0,0 +1,118 @@
+#pragma once
+
+#include <pstdint.h>
+#include <ZSTL/ZArray.hpp>
+#include <ZSTL/ZHashMap.hpp>
+
+#include "AssetCache.hpp"
+
+//Bytes of asset data kept resident by default
+#define ASSET_MEMORY_CACHE_BUDGET (256 * 1024 * 1024)
+
+struct AssetHandle;
+class AssetMemoryCache;
+
+//Called from AssetConnection::Poll, or from within AssetMemoryCache::Fetch if the asset is already
+//resident. The handle carries one reference for the caller, to be given back with AssetMemoryCache::Release.
+typedef void (*AssetMemoryCallback)(AssetHandle* handle, void* userData);
+
+//An asset shared by everyone who fetched its URI. Owned by the AssetMemoryCache; read asset only.
+struct AssetHandle
+{
+	AssetData* asset;			//ok is false if the fetch failed
+	uint32_t refs;
+
+	//Cache bookkeeping
+	struct Waiter
+	{
+		AssetMemoryCallback callback;
+		void* userData;
+	};
+
+	AssetMemoryCache* cache;
+	uint64_t key;
+	char uri[ASSET_MAX_URL];
+	bool loading;
+	bool indexed;				//Found by later fetches; failed and colliding URIs aren't
+	ZArray<Waiter> waiters;
+
+	//Unreferenced resident handles, least recently released first
+	AssetHandle* lruPrev;
+	AssetHandle* lruNext;
+};
+
+/*
+In-memory asset cache in front of an AssetCache. Every URI is fetched once while it stays
+resident: fetches of a URI already loading wait on the same download, and fetches of a
+resident URI are answered at once from the same bytes. Handles are reference counted, and once
+nothing holds a handle it stays resident until evicted, least recently released first, to keep
+the resident bytes under the budget. Referenced handles are never evicted, so the budget can be
+exceeded while they're held. Failed fetches aren't kept. Render thread only.
+*/
+class AssetMemoryCache
+{
+	public:
+		AssetMemoryCache();
+		~AssetMemoryCache();
+
+		//The disk cache must outlive this one
+		void Initialize(AssetCache* cache, uint64_t budget = ASSET_MEMORY_CACHE_BUDGET);
+
+		//Returns false if the asset isn't resident and the disk cache couldn't queue the fetch
+		bool Fetch(const char* uri, AssetMemoryCallback callback, void* userData, bool large = false);
+
+		//Another reference to a handle already held
+		void Retain(AssetHandle* handle);
+		void Release(AssetHandle* handle);
+
+		//Evicts down to the new budget if it's lower
+		void SetBudget(uint64_t bytes);
+
+		//Frees every handle, held or not. Call after AssetConnection::Shutdown, which drops the
+		//fetches still running.
+		void Shutdown();
+
+		uint64_t GetResidentBytes() const { return residentBytes; }
+		uint32_t GetResidentCount() const { return (uint32_t)handles.Size(); }
+		uint32_t GetHits() const { return hits; }
+		uint32_t GetMisses() const { return misses; }
+		uint32_t GetEvictions() const { return evictions; }
+
+		void PrintStats() const;
+
+	private:
+		static void OnFetchDone(AssetData* asset, void* userData);
+
+		void LruRemove(AssetHandle* handle);
+		void LruPushBack(AssetHandle* handle);
+
+		//Evicts unreferenced handles, least recently released first, until the resident bytes fit the budget
+		void Trim();
+
+		void Free(AssetHandle* handle);
+
+		AssetCache* cache;
+		uint64_t budget;
+
+		ZHashMap<uint64_t, AssetHandle*> handles;
+		AssetHandle* lruHead;
+		AssetHandle* lruTail;
+
+		uint64_t residentBytes;		//Loaded handles, held or not
+		uint64_t peakResidentBytes;
+
+		uint32_t hits;				//Resident already
+		uint32_t joined;			//Waited on a fetch already running
+		uint32_t misses;			//Fetched from the disk cache
+		uint32_t failures;
+		uint32_t collisions;		//URI hashed like another resident URI, fetched without caching
+		uint32_t evictions;
+		uint64_t evictedBytes;
+		uint64_t servedBytes;		//Bytes handed out on hits
+};
+
+//Fetches uri 'count' times at once to show they share one download, then walks a frame-by-frame
+//working set of copies of uri, each frame holding a window of them, through a memory cache whose
+//budget holds about half of the working set. Prints the hit rate, evictions and resident bytes,
+//and the time taken against going to the disk cache for every request.
+void AssetMemoryCache_Benchmark(const char* host, const char* uri, uint32_t count);
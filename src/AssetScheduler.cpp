@@ -0,0 +1,395 @@
+#include "AssetScheduler.hpp"
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <SST/SST_Time.h>
+
+AssetScheduler::AssetScheduler()
+	: connection(NULL), maxInFlight(ASSET_DEFAULT_TRANSFERS), cancelDistance(ASSET_SCHEDULER_CANCEL_DISTANCE), nextId(1),
+	  started(0), finished(0), cancelledWaiting(0), cancelledInFlight(0), waitMicros(0)
+{
+	eye[0] = eye[1] = eye[2] = 0.0f;
+	view[0] = 0.0f; view[1] = 0.0f; view[2] = -1.0f;
+}
+
+void AssetScheduler::Initialize(AssetConnection* conn, uint32_t inFlight, float distance)
+{
+	connection = conn;
+	maxInFlight = inFlight > 0 ? inFlight : 1;
+	cancelDistance = distance;
+}
+
+uint32_t AssetScheduler::Request(const char* uri, const float pos[3], float radius, AssetScheduleCallback callback, void* userData)
+{
+	if(connection == NULL)
+		return 0;
+
+	ScheduledRequest* request = new ScheduledRequest();
+	request->scheduler = this;
+	request->id = nextId++;
+	strncpy(request->uri, uri, ASSET_MAX_URL - 1);
+	request->uri[ASSET_MAX_URL - 1] = '\0';
+	request->pos[0] = pos[0];
+	request->pos[1] = pos[1];
+	request->pos[2] = pos[2];
+	request->radius = radius;
+	request->callback = callback;
+	request->userData = userData;
+	request->score = 0.0f;
+	request->fetchId = 0;
+	request->cancelled = false;
+	request->requestMicros = SST_OS_GetMicroTime();
+
+	//Scored and started on the next Update
+	waiting.PushBack(request);
+	return request->id;
+}
+
+void AssetScheduler::Cancel(uint32_t id)
+{
+	for(size_t i=0; i<waiting.Size(); i++) {
+		if(waiting.Data()[i]->id == id) {
+			delete waiting.Erase(i);
+			return;
+		}
+	}
+
+	//Freed once the connection hands the fetch back
+	for(size_t i=0; i<inFlight.Size(); i++) {
+		ScheduledRequest* request = inFlight.Data()[i];
+		if(request->id == id) {
+			request->callback = NULL;
+			if(!request->cancelled) {
+				request->cancelled = true;
+				connection->Cancel(request->fetchId);
+			}
+			return;
+		}
+	}
+}
+
+float AssetScheduler::Score(const ScheduledRequest* request, float* distanceReturn) const
+{
+	float d[3] = { request->pos[0] - eye[0], request->pos[1] - eye[1], request->pos[2] - eye[2] };
+	float centerDistance = sqrtf(d[0]*d[0] + d[1]*d[1] + d[2]*d[2]);
+
+	float distance = centerDistance - request->radius;
+	if(distance < 0.0f)
+		distance = 0.0f;
+	*distanceReturn = distance;
+
+	//1 straight ahead, -1 straight behind
+	float facing = centerDistance > 0.0f ? (d[0]*view[0] + d[1]*view[1] + d[2]*view[2]) / centerDistance : 1.0f;
+
+	return distance * (1.0f + (ASSET_SCHEDULER_BEHIND_WEIGHT - 1.0f) * (1.0f - facing) * 0.5f);
+}
+
+void AssetScheduler::Update(const float eyePos[3], const float viewDir[3])
+{
+	eye[0] = eyePos[0];
+	eye[1] = eyePos[1];
+	eye[2] = eyePos[2];
+
+	float length = sqrtf(viewDir[0]*viewDir[0] + viewDir[1]*viewDir[1] + viewDir[2]*viewDir[2]);
+	if(length > 0.0f) {
+		view[0] = viewDir[0] / length;
+		view[1] = viewDir[1] / length;
+		view[2] = viewDir[2] / length;
+	}
+
+	//Out of range while downloading; OnFetchDone reports it once the connection lets go
+	for(size_t i=0; i<inFlight.Size(); i++)
+	{
+		ScheduledRequest* request = inFlight.Data()[i];
+		float distance;
+		Score(request, &distance);
+
+		if(!request->cancelled && distance > cancelDistance) {
+			request->cancelled = true;
+			connection->Cancel(request->fetchId);
+			cancelledInFlight++;
+		}
+	}
+
+	//Callbacks run after the list is settled, so they can make new requests
+	ZArray<ScheduledRequest*> dropped;
+
+	for(size_t i=0; i<waiting.Size(); )
+	{
+		ScheduledRequest* request = waiting.Data()[i];
+		float distance;
+		request->score = Score(request, &distance);
+
+		if(distance > cancelDistance) {
+			dropped.PushBack(waiting.Erase(i));
+			cancelledWaiting++;
+			continue;
+		}
+
+		i++;
+	}
+
+	while(inFlight.Size() < maxInFlight && !waiting.Empty())
+	{
+		size_t best = 0;
+		for(size_t i=1; i<waiting.Size(); i++)
+			if(waiting.Data()[i]->score < waiting.Data()[best]->score)
+				best = i;
+
+		Start(best);
+	}
+
+	for(size_t i=0; i<dropped.Size(); i++) {
+		ScheduledRequest* request = dropped.Data()[i];
+		if(request->callback != NULL)
+			request->callback(request->id, NULL, request->userData);
+		delete request;
+	}
+}
+
+void AssetScheduler::Start(size_t waitingIndex)
+{
+	ScheduledRequest* request = waiting.Erase(waitingIndex);
+
+	request->fetchId = connection->FetchAsync(request->uri, OnFetchDone, request);
+	if(request->fetchId == 0) {
+		if(request->callback != NULL)
+			request->callback(request->id, NULL, request->userData);
+		delete request;
+		return;
+	}
+
+	started++;
+	waitMicros += SST_OS_GetMicroTime() - request->requestMicros;
+	inFlight.PushBack(request);
+}
+
+void AssetScheduler::OnFetchDone(AssetFetch* fetch, void* userData)
+{
+	ScheduledRequest* request = (ScheduledRequest*)userData;
+	AssetScheduler* self = request->scheduler;
+
+	for(size_t i=0; i<self->inFlight.Size(); i++) {
+		if(self->inFlight.Data()[i] == request) {
+			self->inFlight.Erase(i);
+			break;
+		}
+	}
+
+	if(!fetch->cancelled)
+		self->finished++;
+
+	//Finished before the cancel reached the fetch thread: hand it over anyway
+	if(request->callback != NULL)
+		request->callback(request->id, fetch->cancelled ? NULL : fetch, request->userData);
+
+	delete request;
+}
+
+void AssetScheduler::Shutdown()
+{
+	for(size_t i=0; i<waiting.Size(); i++)
+		delete waiting.Data()[i];
+	waiting.Clear();
+
+	for(size_t i=0; i<inFlight.Size(); i++)
+		delete inFlight.Data()[i];
+	inFlight.Clear();
+}
+
+void AssetScheduler::PrintStats() const
+{
+	printf("AssetScheduler: %u waiting, %u in flight, %u started (%.1f ms wait each), %u finished, %u cancelled waiting, %u cancelled in flight\n",
+		(uint32_t)waiting.Size(), (uint32_t)inFlight.Size(), started,
+		started ? (double)waitMicros / 1000.0 / started : 0.0,
+		finished, cancelledWaiting, cancelledInFlight);
+}
+
+//Simulation: assets scattered over a disc around the eye, "in view" within this distance and angle
+#define SIM_WORLD_RADIUS 100.0f
+#define SIM_VIEW_DISTANCE 40.0f
+#define SIM_VIEW_COS 0.7071f
+#define SIM_CANCEL_DISTANCE 100.0f
+#define SIM_TIMEOUT_MICROS 60000000
+
+//When the eye turns around and steps back, in the runs that do
+#define SIM_TURN_MICROS 250000
+
+struct SimAsset
+{
+	float pos[3];
+	uint64_t residentMicros;	//0 until downloaded
+	bool cancelled;
+};
+
+static void SimFetchCallback(AssetFetch* fetch, void* userData)
+{
+	SimAsset* asset = (SimAsset*)userData;
+	if(fetch->ok)
+		asset->residentMicros = SST_OS_GetMicroTime();
+}
+
+static void SimScheduleCallback(uint32_t request, AssetFetch* fetch, void* userData)
+{
+	(void)request;
+	SimAsset* asset = (SimAsset*)userData;
+	if(fetch == NULL)
+		asset->cancelled = true;
+	else if(fetch->ok)
+		asset->residentMicros = SST_OS_GetMicroTime();
+}
+
+static bool SimInView(const SimAsset& asset, const float eye[3], const float view[3])
+{
+	float d[3] = { asset.pos[0] - eye[0], asset.pos[1] - eye[1], asset.pos[2] - eye[2] };
+	float distance = sqrtf(d[0]*d[0] + d[1]*d[1] + d[2]*d[2]);
+	if(distance > SIM_VIEW_DISTANCE)
+		return false;
+	return distance == 0.0f || (d[0]*view[0] + d[1]*view[1] + d[2]*view[2]) / distance >= SIM_VIEW_COS;
+}
+
+//Runs frames until every asset in view is resident. Returns false on timeout.
+static bool SimWaitForView(AssetConnection* conn, AssetScheduler* scheduler, SimAsset* assets, uint32_t count,
+						   const float eye[3], const float view[3], uint32_t* inViewReturn, uint64_t* allReturn, uint64_t* meanReturn)
+{
+	uint64_t start = SST_OS_GetMicroTime();
+
+	for(;;)
+	{
+		conn->Poll();
+		if(scheduler != NULL)
+			scheduler->Update(eye, view);
+
+		uint64_t now = SST_OS_GetMicroTime();
+		uint32_t inView = 0;
+		uint64_t total = 0;
+		bool done = true;
+
+		for(uint32_t i=0; i<count; i++)
+		{
+			if(!SimInView(assets[i], eye, view))
+				continue;
+
+			inView++;
+			if(assets[i].residentMicros == 0)
+				done = false;
+			else if(assets[i].residentMicros > start)
+				total += assets[i].residentMicros - start;
+		}
+
+		if(done) {
+			*inViewReturn = inView;
+			*allReturn = now - start;
+			*meanReturn = inView ? total / inView : 0;
+			return true;
+		}
+
+		if(now - start > SIM_TIMEOUT_MICROS)
+			return false;
+
+		SST_Concurrency_SleepThread(1);
+	}
+}
+
+//Fetches every asset with or without a scheduler, looking one way and, if turning, turning around
+//and stepping back after a while. Returns false if the assets in view never all arrived.
+static bool SimRun(const char* host, const char* uri, SimAsset* assets, uint32_t count, uint64_t bandwidthLimit,
+				   bool scheduled, bool turn, uint32_t* inViewReturn, uint64_t* allReturn, uint64_t* meanReturn, uint32_t* cancelledReturn)
+{
+	static const float eyes[2][3] = { { 0.0f, 0.0f, 0.0f }, { 0.0f, 0.0f, -60.0f } };
+	static const float views[2][3] = { { 0.0f, 0.0f, 1.0f }, { 0.0f, 0.0f, -1.0f } };
+
+	for(uint32_t i=0; i<count; i++) {
+		assets[i].residentMicros = 0;
+		assets[i].cancelled = false;
+	}
+
+	AssetConnection conn;
+	AssetScheduler scheduler;
+
+	if(!conn.Initialize(host)) {
+		conn.Shutdown();
+		return false;
+	}
+	conn.SetBandwidthLimit(bandwidthLimit);
+	scheduler.Initialize(&conn, ASSET_DEFAULT_TRANSFERS, SIM_CANCEL_DISTANCE);
+
+	for(uint32_t i=0; i<count; i++) {
+		if(scheduled)
+			scheduler.Request(uri, assets[i].pos, 1.0f, SimScheduleCallback, &assets[i]);
+		else
+			conn.FetchAsync(uri, SimFetchCallback, &assets[i]);
+	}
+
+	if(turn) {
+		uint64_t start = SST_OS_GetMicroTime();
+		while(SST_OS_GetMicroTime() - start < SIM_TURN_MICROS) {
+			conn.Poll();
+			if(scheduled)
+				scheduler.Update(eyes[0], views[0]);
+			SST_Concurrency_SleepThread(1);
+		}
+	}
+
+	int phase = turn ? 1 : 0;
+	bool ok = SimWaitForView(&conn, scheduled ? &scheduler : NULL, assets, count, eyes[phase], views[phase],
+							 inViewReturn, allReturn, meanReturn);
+
+	*cancelledReturn = 0;
+	for(uint32_t i=0; i<count; i++)
+		*cancelledReturn += assets[i].cancelled ? 1 : 0;
+
+	conn.Shutdown();
+	scheduler.Shutdown();
+	return ok;
+}
+
+void AssetScheduler_Simulate(const char* host, const char* uri, uint32_t assetCount, uint64_t bandwidthLimit)
+{
+	SimAsset* assets = new SimAsset[assetCount];
+
+	//Same layout every run
+	uint32_t seed = 12345;
+	for(uint32_t i=0; i<assetCount; i++)
+	{
+		seed = seed * 1664525 + 1013904223;
+		float r = SIM_WORLD_RADIUS * sqrtf((float)(seed >> 8) / 16777216.0f);
+		seed = seed * 1664525 + 1013904223;
+		float angle = 6.2831853f * (float)(seed >> 8) / 16777216.0f;
+
+		assets[i].pos[0] = r * cosf(angle);
+		assets[i].pos[1] = 0.0f;
+		assets[i].pos[2] = r * sinf(angle);
+	}
+
+	printf("Scheduler simulation: %u assets, %.1f KB/s cap, %d transfers\n", assetCount, (double)bandwidthLimit / 1024.0, ASSET_DEFAULT_TRANSFERS);
+
+	for(int turn=0; turn<2; turn++)
+	{
+		uint32_t inView[2], cancelled[2];
+		uint64_t all[2], mean[2];
+		bool ok = true;
+
+		for(int scheduled=0; scheduled<2; scheduled++)
+			ok &= SimRun(host, uri, assets, assetCount, bandwidthLimit, scheduled != 0, turn != 0,
+						 &inView[scheduled], &all[scheduled], &mean[scheduled], &cancelled[scheduled]);
+
+		if(!ok) {
+			printf("Scheduler simulation: timed out waiting for assets in view\n");
+			break;
+		}
+
+		char scenario[64];
+		if(turn)
+			sprintf(scenario, "turning around after %u ms", SIM_TURN_MICROS / 1000);
+		else
+			strcpy(scenario, "looking ahead");
+
+		printf("Scheduler simulation: %s, %u in view: in request order %.1f ms until all resident (%.1f ms mean), "
+			"scheduled %.1f ms (%.1f ms mean), %u cancelled out of range\n",
+			scenario, inView[0],
+			(double)all[0] / 1000.0, (double)mean[0] / 1000.0, (double)all[1] / 1000.0, (double)mean[1] / 1000.0, cancelled[1]);
+	}
+
+	delete[] assets;
+}
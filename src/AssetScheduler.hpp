@@ -0,0 +1,99 @@
+#pragma once
+
+#include <pstdint.h>
+#include <ZSTL/ZArray.hpp>
+
+#include "AssetConnection.hpp"
+
+//Requests further than this from the eye are cancelled
+#define ASSET_SCHEDULER_CANCEL_DISTANCE 200.0f
+
+//How many times further away something directly behind the eye counts as something directly ahead
+#define ASSET_SCHEDULER_BEHIND_WEIGHT 4.0f
+
+//Called from AssetConnection::Poll when a scheduled request finishes. fetch is NULL if the request
+//was cancelled for being too far away; explicitly cancelled requests aren't called back at all.
+typedef void (*AssetScheduleCallback)(uint32_t request, AssetFetch* fetch, void* userData);
+
+/*
+Orders asset requests by how soon the player is likely to see them. Requests wait here and
+are handed to the AssetConnection a few at a time, nearest to the eye and closest to the
+view direction first, so an asset in front of the player doesn't queue behind one behind
+them. Scores are recomputed every Update, and requests that have fallen out of range are
+cancelled, including ones already downloading. Render thread only.
+*/
+class AssetScheduler
+{
+	public:
+		AssetScheduler();
+
+		//The connection must outlive the scheduler. maxInFlight caps the fetches handed to the
+		//connection at once; more than its transfer slots only queues them there unordered.
+		void Initialize(AssetConnection* connection, uint32_t maxInFlight = ASSET_DEFAULT_TRANSFERS,
+						float cancelDistance = ASSET_SCHEDULER_CANCEL_DISTANCE);
+
+		//Asks for an asset needed at pos, with a bounding sphere of the given radius.
+		//Returns the request id, or 0 if the scheduler hasn't been initialized.
+		uint32_t Request(const char* uri, const float pos[3], float radius, AssetScheduleCallback callback, void* userData);
+
+		//Drops a request without calling it back
+		void Cancel(uint32_t request);
+
+		//Once per frame: rescores waiting requests from the eye, cancels those out of range and starts the best
+		void Update(const float eyePos[3], const float viewDir[3]);
+
+		//Frees every request without calling it back. Call after AssetConnection::Shutdown, which
+		//drops the fetches still running.
+		void Shutdown();
+
+		uint32_t GetWaiting() const { return (uint32_t)waiting.Size(); }
+		uint32_t GetInFlight() const { return (uint32_t)inFlight.Size(); }
+
+		void PrintStats() const;
+
+	private:
+		struct ScheduledRequest
+		{
+			AssetScheduler* scheduler;
+			uint32_t id;
+			char uri[ASSET_MAX_URL];
+			float pos[3];
+			float radius;
+			AssetScheduleCallback callback;		//NULL once explicitly cancelled
+			void* userData;
+
+			float score;
+			uint32_t fetchId;
+			bool cancelled;
+			uint64_t requestMicros;
+		};
+
+		static void OnFetchDone(AssetFetch* fetch, void* userData);
+
+		//Distance from the eye to the asset's bounds, weighted up the further it is from the view direction
+		float Score(const ScheduledRequest* request, float* distanceReturn) const;
+
+		void Start(size_t waitingIndex);
+
+		AssetConnection* connection;
+		uint32_t maxInFlight;
+		float cancelDistance;
+
+		float eye[3];
+		float view[3];
+
+		ZArray<ScheduledRequest*> waiting;
+		ZArray<ScheduledRequest*> inFlight;
+		uint32_t nextId;
+
+		uint32_t started;
+		uint32_t finished;
+		uint32_t cancelledWaiting;			//Out of range before starting
+		uint32_t cancelledInFlight;			//Out of range while downloading
+		uint64_t waitMicros;				//Request to start, summed over started requests
+};
+
+//Scatters assetCount copies of uri around the eye and fetches them all, once in the order they
+//were asked for and once through an AssetScheduler, with the eye looking one way and then turning
+//around and stepping back. Prints how long each took to get every asset in view resident.
+void AssetScheduler_Simulate(const char* host, const char* uri, uint32_t assetCount, uint64_t bandwidthLimit);
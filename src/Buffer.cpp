@@ -9,6 +9,7 @@ bool Buffer::Data(int use, const void *buffer, size_t size)
 {
 		 	if (D3DBuffer && Size >= size)
 	{
+		Use = use;
 		if (Dynamic)
 		{
 			if (!buffer)
@@ -30,6 +31,7 @@ bool Buffer::Data(int use, const void *buffer, size_t size)
 	}
 	if (D3DBuffer)
 	{
+		D3DBuffer->Release();
 		D3DBuffer = NULL;
 		Size = 0;
 		Use = 0;
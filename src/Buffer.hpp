@@ -14,8 +14,12 @@ public:
 	bool			Dynamic;
 
 public:
-	Buffer(ID3D10Device* _dev) : d3d10device(_dev), Size(0), Use(0) {}
-	~Buffer() {}
+	Buffer(ID3D10Device* _dev) : d3d10device(_dev), D3DBuffer(NULL), Size(0), Use(0), Dynamic(false) {}
+	~Buffer()
+	{
+		if (D3DBuffer)
+			D3DBuffer->Release();
+	}
 
 	ID3D10Buffer* GetBuffer()
 	{
@@ -0,0 +1,62 @@
+#include "LatencyHistogram.hpp"
+#include <stdio.h>
+
+void LatencyHistogram::Add(uint64_t micros)
+{
+	int bucket = 0;
+	while(bucket < LATENCY_BUCKET_COUNT - 1 && (micros >> (bucket + 1)) != 0)
+		bucket++;
+
+	buckets[bucket]++;
+	count++;
+	totalMicros += micros;
+	if(micros > maxMicros)
+		maxMicros = micros;
+}
+
+void LatencyHistogram::Clear()
+{
+	for(int i=0; i<LATENCY_BUCKET_COUNT; i++)
+		buckets[i] = 0;
+
+	count = 0;
+	totalMicros = 0;
+	maxMicros = 0;
+}
+
+uint64_t LatencyHistogram::Percentile(double fraction) const
+{
+	uint32_t target = (uint32_t)(fraction * count);
+	uint32_t seen = 0;
+
+	for(int i=0; i<LATENCY_BUCKET_COUNT - 1; i++) {
+		seen += buckets[i];
+		if(seen > target)
+			return (uint64_t)1 << (i + 1);
+	}
+
+	return maxMicros;
+}
+
+void LatencyHistogram::Print(const char* name) const
+{
+	if(count == 0) {
+		printf("%s: no samples\n", name);
+		return;
+	}
+
+	printf("%s: %u samples, mean %.0f us, p50 < %llu us, p90 < %llu us, p99 < %llu us, max %llu us\n",
+		name, count, (double)totalMicros / count,
+		(unsigned long long)Percentile(0.5), (unsigned long long)Percentile(0.9),
+		(unsigned long long)Percentile(0.99), (unsigned long long)maxMicros);
+
+	for(int i=0; i<LATENCY_BUCKET_COUNT; i++) {
+		if(buckets[i] == 0)
+			continue;
+
+		if(i == LATENCY_BUCKET_COUNT - 1)
+			printf("    >= %8llu us: %u\n", (unsigned long long)1 << i, buckets[i]);
+		else
+			printf("    < %9llu us: %u\n", (unsigned long long)1 << (i + 1), buckets[i]);
+	}
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <pstdint.h>
+
+//Bucket i counts samples in [2^i, 2^(i+1)) microseconds (bucket 0 also takes 0); the last bucket takes everything above
+#define LATENCY_BUCKET_COUNT 25
+
+/*
+Log2-bucketed latency histogram. Cheap enough to update per entity per frame.
+Not synchronized: only one thread may call Add, reads from other threads may be slightly stale.
+*/
+class LatencyHistogram
+{
+	public:
+		LatencyHistogram() { Clear(); }
+
+		void Add(uint64_t micros);
+		void Clear();
+
+		uint32_t GetCount() const { return count; }
+
+		//Upper bound of the bucket holding the given fraction (0..1) of samples
+		uint64_t Percentile(double fraction) const;
+
+		void Print(const char* name) const;
+
+	private:
+		volatile uint32_t buckets[LATENCY_BUCKET_COUNT];
+		volatile uint32_t count;
+		uint64_t totalMicros;
+		uint64_t maxMicros;
+};
@@ -1,34 +1,24 @@
 
 #include "OnizukaApp.h"
 #include "Mesh.hpp"
+#include "MeshFile.hpp"
 #include <curl/curl.h>
+#include <string.h>
 
 
-char* LoadFile(const char* path, size_t* len) {
-	FILE* fp = fopen(path, "rb");
-
-	fseek(fp, 0, SEEK_END);
-	uint32_t size = (uint32_t)ftell(fp);
-	fseek(fp, 0, SEEK_SET);
-
-	char* buf = (char*)malloc(size+1);
-
-	fread(buf, 1, size, fp);
-	buf[size] = 0;
-	fclose(fp);
-
-	*len = size;
-	return buf;
-}
-
 #include "Mesh.hpp"
-int main()
+int main(int argc, char** argv)
 {
 	int exitCode = 0;
 
-	size_t len;
-	char* ptr = LoadFile("../model/test2.obj", &len);
-
+	// Offline tools: convert a model into a mesh container, or benchmark loading containers against Assimp.
+	if (argc == 4 && strcmp(argv[1], "--convert-mesh") == 0)
+		return MeshFile_Convert(argv[2], argv[3]) ? 0 : 1;
+	if (argc == 3 && strcmp(argv[1], "--mesh-benchmark") == 0)
+	{
+		MeshFile_Benchmark(argv[2]);
+		return 0;
+	}
 
 	curl_global_init(CURL_GLOBAL_WIN32);
 
@@ -45,7 +35,13 @@ int main()
 		exitCode = app.OnStartup(NULL);
 		if (!exitCode)
 		{
-			testMesh.LoadFromOBJ(app.GetRenderDevice(), ptr, len);
+			//The converted container if there is one, else the OBJ mapped in place, with the material library it names opened next to it
+			if(!testMesh.LoadFromFile(app.GetRenderDevice(), "../model/test2.onzm"))
+			{
+				AssetScene scene(NULL, NULL);
+				scene.Load("../model/test2.obj", MESH_IMPORT_FLAGS, NULL, NULL);
+				testMesh.LoadFromScene(app.GetRenderDevice(), scene.GetScene());
+			}
 			// Processes messages and calls OnIdle() to do rendering.
 			exitCode = app.Run();
 		}
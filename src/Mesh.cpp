@@ -1,52 +1,126 @@
 
 #include "Mesh.hpp"
+#include <math.h>
+#include <stdio.h>
+#include <SST/SST_Time.h>
 #include <assimp/Importer.hpp>
-#include <assimp/postprocess.h>
 #include <assimp/scene.h>
 
+#include "AssetFileSystem.hpp"
+#include "MeshOptimizer.hpp"
+
 Mesh testMesh;
 
+Mesh::Mesh()
+	: vb(NULL), ib(NULL), indexSize(sizeof(uint16_t)), nrFaces(0), packed(false)
+{
+}
+
 bool Mesh::LoadFromOBJ(OVR::RenderTiny::RenderDevice* device, const void* mem, size_t len)
 {
 	Assimp::Importer importer;
 	
-	const aiScene* scene = importer.ReadFileFromMemory(mem, len,
-		aiProcess_Triangulate | aiProcess_GenSmoothNormals | aiProcess_FlipUVs | aiProcess_JoinIdenticalVertices | aiProcess_OptimizeMeshes|aiProcess_MakeLeftHanded, "obj");
+	const aiScene* scene = importer.ReadFileFromMemory(mem, len, MESH_IMPORT_FLAGS, "obj");
 	if(scene == NULL)
 		return false;
 
-	const aiMesh* mesh = scene->mMeshes[0];
+	return LoadFromScene(device, scene);
+}
 
+bool Mesh::LoadFromScene(OVR::RenderTiny::RenderDevice* device, const aiScene* scene)
+{
 	ZArray<OVR::RenderTiny::Vertex> Vertices;
-	ZArray<uint16_t> Indices;
+	ZArray<uint32_t> Indices;
+	ZArray<MeshRange> Ranges;
+
+	if(!ConvertScene(scene, &Vertices, &Indices, &Ranges))
+		return false;
 
-	//Copy vertices
-	Vertices.Resize(mesh->mNumVertices);
-	for(uint32_t i=0; i<mesh->mNumVertices; i++)
+	MeshOptimizer_Optimize(&Vertices, &Indices, Ranges, MESH_OPTIMIZE_OVERDRAW != 0);
+
+	return CreateBuffers(device, Vertices, Indices, Ranges.Data(), Ranges.Size());
+}
+
+bool Mesh::ConvertScene(const aiScene* scene, ZArray<OVR::RenderTiny::Vertex>* verticesReturn, ZArray<uint32_t>* indicesReturn,
+						ZArray<MeshRange>* rangesReturn)
+{
+	if(scene == NULL || scene->mNumMeshes == 0)
+		return false;
+
+	ZArray<OVR::RenderTiny::Vertex>& Vertices = *verticesReturn;
+	ZArray<uint32_t>& Indices = *indicesReturn;
+	ZArray<MeshRange>& Ranges = *rangesReturn;
+
+	size_t vertexCount = 0;
+	size_t indexCount = 0;
+	for(uint32_t m=0; m<scene->mNumMeshes; m++) {
+		vertexCount += scene->mMeshes[m]->mNumVertices;
+		indexCount += scene->mMeshes[m]->mNumFaces * 3;
+	}
+
+	Vertices.Resize(vertexCount);
+	Indices.Resize(indexCount);
+	Ranges.Clear();
+
+	uint32_t vertexBase = 0;
+	uint32_t indexBase = 0;
+	for(uint32_t m=0; m<scene->mNumMeshes; m++)
 	{
-		Vertices[i].Pos.x = mesh->mVertices[i].x;
-		Vertices[i].Pos.y = mesh->mVertices[i].y;
-		Vertices[i].Pos.z = mesh->mVertices[i].z;
+		const aiMesh* mesh = scene->mMeshes[m];
+
+		//Copy vertices. OBJ has no vertex colour; white leaves the fill as is.
+		for(uint32_t i=0; i<mesh->mNumVertices; i++)
+		{
+			OVR::RenderTiny::Vertex& v = Vertices[vertexBase + i];
+
+			v.Pos.x = mesh->mVertices[i].x;
+			v.Pos.y = mesh->mVertices[i].y;
+			v.Pos.z = mesh->mVertices[i].z;
+			v.C = OVR::RenderTiny::Color(255, 255, 255, 255);
 
-		if(mesh->HasTextureCoords(0)) {
+			if(mesh->HasNormals())
+				v.Norm = OVR::Vector3f(mesh->mNormals[i].x, mesh->mNormals[i].y, mesh->mNormals[i].z);
+			else
+				v.Norm = OVR::Vector3f(0, 0, 0);
 
-			Vertices[i].U = mesh->mTextureCoords[0]->x;
-			Vertices[i].V = mesh->mTextureCoords[0]->y;
-		} else {
-			Vertices[i].U = 0;
-			Vertices[i].V = 0;
+			if(mesh->HasTextureCoords(0)) {
+
+				v.U = mesh->mTextureCoords[0][i].x;
+				v.V = mesh->mTextureCoords[0][i].y;
+			} else {
+				v.U = 0;
+				v.V = 0;
+			}
 		}
-	}
 
-	//Copy face data
-	Indices.Resize(mesh->mNumFaces*3);
-	for(uint32_t i=0; i<mesh->mNumFaces; i++) {
+		//Copy face data, relative to the mesh's first vertex. Points and lines left over from
+		//triangulation aren't drawn.
+		MeshRange range;
+		range.indexOffset = indexBase;
+		range.vertexOffset = vertexBase;
+		range.vertexCount = mesh->mNumVertices;
+		range.material = mesh->mMaterialIndex;
+
+		for(uint32_t i=0; i<mesh->mNumFaces; i++) {
+
+			if(mesh->mFaces[i].mNumIndices != 3)
+				continue;
+
+			Indices[indexBase+0] = mesh->mFaces[i].mIndices[0];
+			Indices[indexBase+1] = mesh->mFaces[i].mIndices[1];
+			Indices[indexBase+2] = mesh->mFaces[i].mIndices[2];
+			indexBase += 3;
+		}
+
+		range.indexCount = indexBase - range.indexOffset;
+		if(range.indexCount > 0)
+			Ranges.PushBack(range);
 
-		Indices[i*3+0] = (uint16_t)mesh->mFaces[i].mIndices[0];
-		Indices[i*3+1] = (uint16_t)mesh->mFaces[i].mIndices[1];
-		Indices[i*3+2] = (uint16_t)mesh->mFaces[i].mIndices[2];
+		vertexBase += mesh->mNumVertices;
 	}
 
+	Indices.Resize(indexBase);
+
 #if 0
 	if(scene->HasMaterials()) {
 
@@ -65,11 +139,490 @@ bool Mesh::LoadFromOBJ(OVR::RenderTiny::RenderDevice* device, const void* mem, s
 	}
 #endif
 
+	return true;
+}
+
+bool Mesh::LoadFromDecoder(OVR::RenderTiny::RenderDevice* device, const ObjDecoder& decoder)
+{
+	MeshRange range;
+	range.indexOffset = 0;
+	range.indexCount = (uint32_t)decoder.GetIndices().Size();
+	range.vertexOffset = 0;
+	range.vertexCount = (uint32_t)decoder.GetVertices().Size();
+	range.material = 0;
+
+	return CreateBuffers(device, decoder.GetVertices(), decoder.GetIndices(), &range, 1);
+}
+
+bool Mesh::LoadFromArrays(OVR::RenderTiny::RenderDevice* device, const ZArray<OVR::RenderTiny::Vertex>& vertices,
+						  const ZArray<uint32_t>& indices, const ZArray<MeshRange>& ranges)
+{
+	return CreateBuffers(device, vertices, indices, ranges.Data(), ranges.Size());
+}
+
+bool Mesh::LoadFromFile(OVR::RenderTiny::RenderDevice* device, const char* path)
+{
+	MeshFile file;
+	if(!file.Open(path))
+		return false;
+
+	//Straight from the mapping, with the index size MeshFile_Convert fitted; the file is unmapped once the buffers have their copy.
+	//Only vertices stored in the other layout, e.g. by a version 2 container, are converted on the way.
+	const MeshFileHeader* header = file.GetHeader();
+	if(file.GetPackedVertices() != NULL) {
+		return UploadBuffers(device, file.GetPackedVertices(), header->quantization, header->vertexCount, file.GetIndices(), header->indexCount,
+							 header->indexSize, file.GetRanges(), header->rangeCount);
+	}
+
+	return UploadBuffers(device, file.GetVertices(), header->vertexCount, file.GetIndices(), header->indexCount, header->indexSize,
+						 file.GetRanges(), header->rangeCount);
+}
+
+bool Mesh::CreateBuffers(OVR::RenderTiny::RenderDevice* device, const ZArray<OVR::RenderTiny::Vertex>& vertices,
+						 const ZArray<uint32_t>& indices, const MeshRange* ranges, size_t rangeCount)
+{
+	ZArray<OVR::RenderTiny::Vertex> splitVertices;
+	ZArray<uint32_t> splitIndices;
+	ZArray<MeshRange> splitRanges;
+	bool split;
+
+	uint32_t size = FitIndices(vertices, indices, ranges, rangeCount, &splitVertices, &splitIndices, &splitRanges, &split);
+
+	const ZArray<OVR::RenderTiny::Vertex>& drawVertices = split ? splitVertices : vertices;
+	const ZArray<uint32_t>& drawIndices = split ? splitIndices : indices;
+	const MeshRange* drawRanges = split ? splitRanges.Data() : ranges;
+	size_t drawRangeCount = split ? splitRanges.Size() : rangeCount;
+
+	if(size == sizeof(uint32_t))
+		return UploadBuffers(device, drawVertices.Data(), drawVertices.Size(), drawIndices.Data(), drawIndices.Size(), size, drawRanges, drawRangeCount);
+
+	ZArray<uint16_t> Indices;
+	Indices.Resize(drawIndices.Size());
+	for(size_t i=0; i<drawIndices.Size(); i++)
+		Indices[i] = (uint16_t)drawIndices.Data()[i];
+
+	return UploadBuffers(device, drawVertices.Data(), drawVertices.Size(), Indices.Data(), Indices.Size(), size, drawRanges, drawRangeCount);
+}
+
+bool Mesh::UploadBuffers(OVR::RenderTiny::RenderDevice* device, const OVR::RenderTiny::Vertex* vertices, size_t vertexCount,
+						 const void* indices, size_t indexCount, uint32_t indexSize, const MeshRange* ranges, size_t rangeCount)
+{
+#if MESH_PACK_VERTICES
+	ZArray<PackedVertex> Packed;
+	MeshQuantization bounds;
+	Packed.Resize(vertexCount);
+	MeshQuantize_ComputeBounds(vertices, vertexCount, &bounds);
+	MeshQuantize_Encode(vertices, vertexCount, bounds, Packed.Data());
+	return UploadBuffers(device, Packed.Data(), bounds, vertexCount, indices, indexCount, indexSize, ranges, rangeCount);
+#else
+	return UploadBuffers(device, vertices, vertexCount * sizeof(OVR::RenderTiny::Vertex), NULL, indices, indexCount, indexSize, ranges, rangeCount);
+#endif
+}
+
+bool Mesh::UploadBuffers(OVR::RenderTiny::RenderDevice* device, const PackedVertex* vertices, const MeshQuantization& bounds, size_t vertexCount,
+						 const void* indices, size_t indexCount, uint32_t indexSize, const MeshRange* ranges, size_t rangeCount)
+{
+#if MESH_PACK_VERTICES
+	return UploadBuffers(device, vertices, vertexCount * sizeof(PackedVertex), &bounds, indices, indexCount, indexSize, ranges, rangeCount);
+#else
+	ZArray<OVR::RenderTiny::Vertex> Full;
+	Full.Resize(vertexCount);
+	MeshQuantize_Decode(vertices, vertexCount, bounds, Full.Data());
+	return UploadBuffers(device, Full.Data(), vertexCount * sizeof(OVR::RenderTiny::Vertex), NULL, indices, indexCount, indexSize, ranges, rangeCount);
+#endif
+}
+
+bool Mesh::UploadBuffers(OVR::RenderTiny::RenderDevice* device, const void* vertices, size_t vertexBytes, const MeshQuantization* bounds,
+						 const void* indices, size_t indexCount, uint32_t indexSize, const MeshRange* ranges, size_t rangeCount)
+{
+	Release();
+
 	vb = device->CreateBuffer();
 	ib = device->CreateBuffer();
 
-	vb->Data(OVR::RenderTiny::Buffer_Vertex, Vertices.Data(), Vertices.Size()* sizeof(OVR::RenderTiny::Vertex));
-	ib->Data(OVR::RenderTiny::Buffer_Index, Indices.Data(), Indices.Size() * sizeof(uint16_t));
-	nrFaces = Indices.Size()/3;
+	vb->Data(OVR::RenderTiny::Buffer_Vertex, vertices, vertexBytes);
+	if(bounds != NULL) {
+		quantization = *bounds;
+		packed = true;
+	}
+
+	//The buffer remembers its index size, which picks the index format it's drawn with
+	ib->Data(indexSize == sizeof(uint32_t) ? OVR::RenderTiny::Buffer_Index | OVR::RenderTiny::Buffer_Index32 : OVR::RenderTiny::Buffer_Index,
+			 indices, indexCount * indexSize);
+	this->indexSize = indexSize;
+
+	this->ranges.Resize(rangeCount);
+	for(size_t i=0; i<rangeCount; i++)
+		this->ranges[i] = ranges[i];
+
+	nrFaces = (uint32_t)(indexCount / 3);
 	return true;
 }
+
+void Mesh::Release()
+{
+	delete vb;
+	delete ib;
+
+	vb = NULL;
+	ib = NULL;
+	ranges.Clear();
+	nrFaces = 0;
+	packed = false;
+}
+
+bool Mesh::SplitRanges(const ZArray<OVR::RenderTiny::Vertex>& vertices, const ZArray<uint32_t>& indices, const MeshRange* ranges,
+					   size_t rangeCount, uint32_t maxVertices, ZArray<OVR::RenderTiny::Vertex>* verticesReturn,
+					   ZArray<uint32_t>* indicesReturn, ZArray<MeshRange>* rangesReturn, int64_t* addedReturn)
+{
+	static const uint32_t NONE = 0xFFFFFFFFu;
+
+	ZArray<OVR::RenderTiny::Vertex>& Vertices = *verticesReturn;
+	ZArray<uint32_t>& Indices = *indicesReturn;
+	ZArray<MeshRange>& Ranges = *rangesReturn;
+
+	Vertices.Clear();
+	Indices.Clear();
+	Ranges.Clear();
+	Vertices.Reserve(vertices.Size());
+	Indices.Reserve(indices.Size());
+
+	//Where each vertex of the range being split went in the current chunk, and which vertices those are
+	//so only they are reset for the next chunk
+	ZArray<uint32_t> remap;
+	ZArray<uint32_t> chunkSources;
+
+	for(size_t r=0; r<rangeCount; r++)
+	{
+		const MeshRange& range = ranges[r];
+
+		if(range.vertexCount <= maxVertices) {
+			MeshRange copy = range;
+			copy.indexOffset = (uint32_t)Indices.Size();
+			copy.vertexOffset = (uint32_t)Vertices.Size();
+			for(uint32_t i=0; i<range.vertexCount; i++)
+				Vertices.PushBack(vertices.Data()[range.vertexOffset + i]);
+			for(uint32_t i=0; i<range.indexCount; i++)
+				Indices.PushBack(indices.Data()[range.indexOffset + i]);
+			Ranges.PushBack(copy);
+			continue;
+		}
+
+		remap.Resize(range.vertexCount);
+		for(uint32_t i=0; i<range.vertexCount; i++)
+			remap[i] = NONE;
+		chunkSources.Clear();
+
+		//Triangles go into chunks in order, a new chunk starting when a triangle's new vertices won't fit
+		MeshRange chunk = range;
+		chunk.indexOffset = (uint32_t)Indices.Size();
+		chunk.vertexOffset = (uint32_t)Vertices.Size();
+
+		for(uint32_t t=0; t+2<range.indexCount; t+=3)
+		{
+			const uint32_t* triangle = &indices.Data()[range.indexOffset + t];
+
+			uint32_t added = 0;
+			for(int k=0; k<3; k++) {
+				if(triangle[k] >= range.vertexCount)
+					return false;
+				if(remap[triangle[k]] == NONE && (k == 0 || triangle[k] != triangle[0]) && (k < 2 || triangle[k] != triangle[1]))
+					added++;
+			}
+
+			if(chunkSources.Size() + added > maxVertices) {
+				chunk.indexCount = (uint32_t)Indices.Size() - chunk.indexOffset;
+				chunk.vertexCount = (uint32_t)chunkSources.Size();
+				Ranges.PushBack(chunk);
+
+				for(size_t i=0; i<chunkSources.Size(); i++)
+					remap[chunkSources[i]] = NONE;
+				chunkSources.Clear();
+
+				chunk.indexOffset = (uint32_t)Indices.Size();
+				chunk.vertexOffset = (uint32_t)Vertices.Size();
+			}
+
+			for(int k=0; k<3; k++) {
+				uint32_t source = triangle[k];
+				if(remap[source] == NONE) {
+					remap[source] = (uint32_t)chunkSources.Size();
+					chunkSources.PushBack(source);
+					Vertices.PushBack(vertices.Data()[range.vertexOffset + source]);
+				}
+				Indices.PushBack(remap[source]);
+			}
+		}
+
+		chunk.indexCount = (uint32_t)Indices.Size() - chunk.indexOffset;
+		chunk.vertexCount = (uint32_t)chunkSources.Size();
+		if(chunk.indexCount > 0)
+			Ranges.PushBack(chunk);
+	}
+
+	if(addedReturn != NULL)
+		*addedReturn = (int64_t)Vertices.Size() - (int64_t)vertices.Size();
+	return true;
+}
+
+uint32_t Mesh::FitIndices(const ZArray<OVR::RenderTiny::Vertex>& vertices, const ZArray<uint32_t>& indices, const MeshRange* ranges,
+						  size_t rangeCount, ZArray<OVR::RenderTiny::Vertex>* verticesReturn, ZArray<uint32_t>* indicesReturn,
+						  ZArray<MeshRange>* rangesReturn, bool* splitReturn)
+{
+	*splitReturn = false;
+
+	bool fits = true;
+	for(size_t i=0; i<rangeCount; i++) {
+		if(ranges[i].vertexCount > MESH_MAX_RANGE_VERTICES)
+			fits = false;
+	}
+	if(fits)
+		return sizeof(uint16_t);
+
+	//Each vertex is fetched at least once and each index exactly once a draw, so bytes held are
+	//also the least bytes read a frame. Vertices cost what they're uploaded as.
+	const uint64_t vertexSize = MESH_VERTEX_SIZE;
+	if(SplitRanges(vertices, indices, ranges, rangeCount, MESH_MAX_RANGE_VERTICES, verticesReturn, indicesReturn, rangesReturn, NULL)) {
+		uint64_t splitBytes = verticesReturn->Size() * vertexSize + indicesReturn->Size() * sizeof(uint16_t);
+		uint64_t wideBytes = vertices.Size() * vertexSize + indices.Size() * sizeof(uint32_t);
+		if(splitBytes < wideBytes) {
+			*splitReturn = true;
+			return sizeof(uint16_t);
+		}
+	}
+
+	verticesReturn->Clear();
+	indicesReturn->Clear();
+	rangesReturn->Clear();
+	return sizeof(uint32_t);
+}
+
+//One small grid per part, each with a material of its own so the importer keeps them apart
+static bool WritePartsModel(const char* objPath, const char* mtlPath, const char* mtlName, uint32_t parts)
+{
+	FILE* mtl = fopen(mtlPath, "wb");
+	if(mtl == NULL)
+		return false;
+	for(uint32_t i=0; i<parts; i++)
+		fprintf(mtl, "newmtl part%u\nKd %.3f %.3f %.3f\n", i, (float)(i % 7) / 7.0f, (float)(i % 11) / 11.0f, (float)(i % 13) / 13.0f);
+	bool ok = ferror(mtl) == 0;
+	fclose(mtl);
+
+	FILE* obj = fopen(objPath, "wb");
+	if(obj == NULL)
+		return false;
+
+	const uint32_t size = 8;
+	fprintf(obj, "mtllib %s\n", mtlName);
+	for(uint32_t i=0; i<parts; i++) {
+		fprintf(obj, "o part%u\nusemtl part%u\n", i, i);
+
+		float x0 = (float)(i % 20) * (size + 1);
+		float z0 = (float)(i / 20) * (size + 1);
+		for(uint32_t y=0; y<=size; y++) {
+			for(uint32_t x=0; x<=size; x++)
+				fprintf(obj, "v %.2f 0 %.2f\n", x0 + x, z0 + y);
+		}
+
+		uint32_t base = i * (size + 1) * (size + 1) + 1;
+		for(uint32_t y=0; y<size; y++) {
+			for(uint32_t x=0; x<size; x++) {
+				uint32_t a = base + y * (size + 1) + x;
+				uint32_t c = a + size + 1;
+				fprintf(obj, "f %u %u %u\nf %u %u %u\n", a, c, a + 1, a + 1, c, c + 1);
+			}
+		}
+	}
+	ok = ok && ferror(obj) == 0;
+	fclose(obj);
+
+	return ok;
+}
+
+void Mesh_Benchmark(OVR::RenderTiny::RenderDevice* device, const char* directory, uint32_t submeshes)
+{
+	char objPath[MESH_FILE_MAX_PATH];
+	char mtlPath[MESH_FILE_MAX_PATH];
+	sprintf(objPath, "%s/parts%u.obj", directory, submeshes);
+	sprintf(mtlPath, "%s/parts%u.mtl", directory, submeshes);
+
+	char mtlName[64];
+	sprintf(mtlName, "parts%u.mtl", submeshes);
+
+	if(!WritePartsModel(objPath, mtlPath, mtlName, submeshes)) {
+		printf("Mesh benchmark: couldn't write %s\n", objPath);
+		remove(objPath);
+		remove(mtlPath);
+		return;
+	}
+
+	AssetScene scene(NULL, NULL);
+	scene.Load(objPath, MESH_IMPORT_FLAGS, NULL, NULL);
+	remove(objPath);
+	remove(mtlPath);
+
+	ZArray<OVR::RenderTiny::Vertex> vertices;
+	ZArray<uint32_t> indices;
+	ZArray<MeshRange> ranges;
+	if(!Mesh::ConvertScene(scene.GetScene(), &vertices, &indices, &ranges)) {
+		printf("Mesh benchmark: couldn't import %s\n", objPath);
+		return;
+	}
+
+	//Both paths create their buffers from the arrays converted above, through the same Mesh code, so they
+	//differ only in how many buffers the model is put in. Each part's arrays are copied out untimed.
+	size_t partCount = ranges.Size();
+	ZArray<OVR::RenderTiny::Vertex>* partVertices = new ZArray<OVR::RenderTiny::Vertex>[partCount];
+	ZArray<uint32_t>* partIndices = new ZArray<uint32_t>[partCount];
+	ZArray<MeshRange>* partRanges = new ZArray<MeshRange>[partCount];
+	for(size_t r=0; r<partCount; r++) {
+		const MeshRange& range = ranges[r];
+		partVertices[r].Resize(range.vertexCount);
+		for(uint32_t i=0; i<range.vertexCount; i++)
+			partVertices[r][i] = vertices[range.vertexOffset + i];
+		partIndices[r].Resize(range.indexCount);
+		for(uint32_t i=0; i<range.indexCount; i++)
+			partIndices[r][i] = indices[range.indexOffset + i];
+
+		MeshRange part = range;
+		part.indexOffset = 0;
+		part.vertexOffset = 0;
+		partRanges[r].PushBack(part);
+	}
+
+	OVR::Matrix4f matrix;
+
+	//A buffer pair per mesh, as each object used to need a file and a Mesh of its own
+	Mesh* parts = new Mesh[partCount];
+	uint64_t start = SST_OS_GetMicroTime();
+	for(size_t r=0; r<partCount; r++)
+		parts[r].LoadFromArrays(device, partVertices[r], partIndices[r], partRanges[r]);
+	uint64_t separateCreateMicros = SST_OS_GetMicroTime() - start;
+
+	start = SST_OS_GetMicroTime();
+	for(uint32_t frame=0; frame<MESH_BENCHMARK_FRAMES; frame++) {
+		for(size_t r=0; r<partCount; r++)
+			device->Render(matrix, &parts[r]);
+	}
+	uint64_t separateDrawMicros = SST_OS_GetMicroTime() - start;
+
+	for(size_t r=0; r<partCount; r++)
+		parts[r].Release();
+	delete[] parts;
+	delete[] partVertices;
+	delete[] partIndices;
+	delete[] partRanges;
+
+	//Everything in one pair
+	Mesh mesh;
+	start = SST_OS_GetMicroTime();
+	mesh.LoadFromArrays(device, vertices, indices, ranges);
+	uint64_t sharedCreateMicros = SST_OS_GetMicroTime() - start;
+
+	start = SST_OS_GetMicroTime();
+	for(uint32_t frame=0; frame<MESH_BENCHMARK_FRAMES; frame++)
+		device->Render(matrix, &mesh);
+	uint64_t sharedDrawMicros = SST_OS_GetMicroTime() - start;
+
+	mesh.Release();
+
+	printf("Mesh benchmark, %u meshes, %u vertices, %u triangles, created from the same converted arrays:\n", (uint32_t)partCount,
+		(uint32_t)vertices.Size(), (uint32_t)(indices.Size() / 3));
+	printf("  Buffer per mesh: %u buffers, created in %.2f ms, draws set up in %.3f ms per frame\n", (uint32_t)(partCount * 2),
+		(double)separateCreateMicros / 1000.0, (double)separateDrawMicros / (1000.0 * MESH_BENCHMARK_FRAMES));
+	printf("  Shared buffers:  2 buffers, created in %.2f ms, draws set up in %.3f ms per frame\n",
+		(double)sharedCreateMicros / 1000.0, (double)sharedDrawMicros / (1000.0 * MESH_BENCHMARK_FRAMES));
+}
+
+void Mesh_IndexBenchmark(uint32_t vertexCount)
+{
+	uint32_t w = (uint32_t)ceil(sqrt((double)vertexCount));
+	uint32_t h = vertexCount / w;
+	if(w < 2 || h < 2)
+		return;
+
+	ZArray<OVR::RenderTiny::Vertex> vertices;
+	ZArray<uint32_t> indices;
+	vertices.Resize(w * h);
+	indices.Reserve((w - 1) * (h - 1) * 6);
+
+	for(uint32_t y=0; y<h; y++) {
+		for(uint32_t x=0; x<w; x++) {
+			OVR::RenderTiny::Vertex& v = vertices[y * w + x];
+			v.Pos = OVR::Vector3f((float)x, 0, (float)y);
+			v.C = OVR::RenderTiny::Color(255, 255, 255, 255);
+			v.U = (float)x / w;
+			v.V = (float)y / h;
+			v.Norm = OVR::Vector3f(0, 1, 0);
+		}
+	}
+
+	for(uint32_t y=0; y+1<h; y++) {
+		for(uint32_t x=0; x+1<w; x++) {
+			uint32_t a = y * w + x;
+			uint32_t c = a + w;
+			indices.PushBack(a); indices.PushBack(c); indices.PushBack(a + 1);
+			indices.PushBack(a + 1); indices.PushBack(c); indices.PushBack(c + 1);
+		}
+	}
+
+	MeshRange range;
+	range.indexOffset = 0;
+	range.indexCount = (uint32_t)indices.Size();
+	range.vertexOffset = 0;
+	range.vertexCount = (uint32_t)vertices.Size();
+	range.material = 0;
+
+	ZArray<OVR::RenderTiny::Vertex> splitVertices;
+	ZArray<uint32_t> splitIndices;
+	ZArray<MeshRange> splitRanges;
+
+	uint64_t start = SST_OS_GetMicroTime();
+	int64_t added = 0;
+	bool ok = Mesh::SplitRanges(vertices, indices, &range, 1, MESH_MAX_RANGE_VERTICES, &splitVertices, &splitIndices, &splitRanges, &added);
+	uint64_t splitMicros = SST_OS_GetMicroTime() - start;
+
+	//The split has to draw the same triangles in the same order, each range within 16 bits
+	ok = ok && splitIndices.Size() == indices.Size();
+	size_t t = 0;
+	for(size_t r=0; ok && r<splitRanges.Size(); r++) {
+		const MeshRange& chunk = splitRanges[r];
+		ok = chunk.vertexCount <= MESH_MAX_RANGE_VERTICES && chunk.indexOffset == t;
+		for(uint32_t i=0; ok && i<chunk.indexCount; i++, t++) {
+			uint32_t index = splitIndices[chunk.indexOffset + i];
+			const OVR::Vector3f& a = splitVertices[chunk.vertexOffset + index].Pos;
+			const OVR::Vector3f& b = vertices[indices[t]].Pos;
+			ok = index < chunk.vertexCount && a.x == b.x && a.y == b.y && a.z == b.z;
+		}
+	}
+	ok = ok && t == indices.Size();
+
+	//Every index is read once a draw and every vertex at least once, so what's held is also the least read a frame
+	//Vertices are counted as uploaded, as FitIndices weighs them
+	double wideVertexMB = (double)(vertices.Size() * MESH_VERTEX_SIZE) / (1024.0 * 1024.0);
+	double wideIndexMB = (double)(indices.Size() * sizeof(uint32_t)) / (1024.0 * 1024.0);
+	double splitVertexMB = (double)(splitVertices.Size() * MESH_VERTEX_SIZE) / (1024.0 * 1024.0);
+	double splitIndexMB = (double)(splitIndices.Size() * sizeof(uint16_t)) / (1024.0 * 1024.0);
+	uint32_t splitDraws = (uint32_t)splitRanges.Size();
+
+	//FitIndices splits again, so free this split first rather than hold two copies of the mesh at once
+	splitVertices.Clear(0);
+	splitIndices.Clear(0);
+
+	bool split;
+	uint32_t indexSize;
+	{
+		ZArray<OVR::RenderTiny::Vertex> fitVertices;
+		ZArray<uint32_t> fitIndices;
+		ZArray<MeshRange> fitRanges;
+		indexSize = Mesh::FitIndices(vertices, indices, &range, 1, &fitVertices, &fitIndices, &fitRanges, &split);
+	}
+
+	printf("Mesh index benchmark, %u vertices, %u triangles:\n", (uint32_t)vertices.Size(), (uint32_t)(indices.Size() / 3));
+	printf("  32-bit indices: 1 draw, %.2f MB vertices + %.2f MB indices = %.2f MB held and read a frame\n",
+		wideVertexMB, wideIndexMB, wideVertexMB + wideIndexMB);
+	printf("  16-bit split:   %u draws, %.2f MB vertices (%lld copied) + %.2f MB indices = %.2f MB held and read a frame, split in %.1f ms%s\n",
+		splitDraws, splitVertexMB, (long long)added, splitIndexMB, splitVertexMB + splitIndexMB,
+		(double)splitMicros / 1000.0, ok ? "" : ", SPLIT DOESN'T MATCH");
+	printf("  Mesh draws it %s\n", indexSize == sizeof(uint32_t) ? "with 32-bit indices" : split ? "split" : "with 16-bit indices as is");
+}
@@ -1,30 +1,128 @@
 #pragma once
 
 #include <ZSTL/ZArray.hpp>
+#include <assimp/postprocess.h>
 #include "RenderTiny_Device.h"
 
 #include "Vertex.hpp"
 #include "Buffer.hpp"
+#include "ObjDecoder.hpp"
+#include "MeshFile.hpp"
+#include "MeshQuantize.hpp"
 
+//Post-processing every Assimp import gets before its meshes become buffers
+#define MESH_IMPORT_FLAGS (aiProcess_Triangulate | aiProcess_GenSmoothNormals | aiProcess_FlipUVs | aiProcess_JoinIdenticalVertices | \
+						   aiProcess_OptimizeMeshes | aiProcess_MakeLeftHanded)
+
+//Whether imports also reorder triangles against overdraw, which costs a little vertex cache locality
+#define MESH_OPTIMIZE_OVERDRAW 0
+
+//Whether meshes are uploaded as 16-byte PackedVertex rather than full 36-byte vertices
+#define MESH_PACK_VERTICES 1
+
+//Bytes a vertex takes in a vertex buffer, so what drawing one fetches
+#define MESH_VERTEX_SIZE (MESH_PACK_VERTICES ? sizeof(PackedVertex) : sizeof(OVR::RenderTiny::Vertex))
+
+struct aiScene;
+
+//Vertices a range can reach with 16-bit indices
+#define MESH_MAX_RANGE_VERTICES 0x10000
+
+//Times of the draw setup Mesh_Benchmark measures, each repeated this often
+#define MESH_BENCHMARK_FRAMES 100
+
+/*
+Every mesh of a model in one vertex buffer and one index buffer, drawn as a range per source
+mesh with the buffers bound once. Indices are relative to their range's first vertex, and
+16-bit unless some range reaches more vertices than that; such a mesh is either split into
+ranges that don't or drawn with 32-bit indices, whichever takes fewer bytes. With
+MESH_PACK_VERTICES the vertices are quantized against the mesh's bounds as they're uploaded,
+or already were when the mesh's container was written.
+*/
 class Mesh
 {
 	public:
+		Mesh();
+
 		bool LoadFromOBJ(OVR::RenderTiny::RenderDevice* device, const void* mem, size_t len);
 
+		//Creates the buffers from a scene imported with MESH_IMPORT_FLAGS, e.g. by an AssetScene
+		bool LoadFromScene(OVR::RenderTiny::RenderDevice* device, const aiScene* scene);
+
+		//Creates the buffers from a MeshFile container, mapped rather than read
+		bool LoadFromFile(OVR::RenderTiny::RenderDevice* device, const char* path);
+
+		//The vertices, triangle indices and draw ranges LoadFromScene makes buffers of, a range per mesh of the scene
+		static bool ConvertScene(const aiScene* scene, ZArray<OVR::RenderTiny::Vertex>* verticesReturn, ZArray<uint32_t>* indicesReturn,
+								 ZArray<MeshRange>* rangesReturn);
+
+		//Creates the buffers from a decoder that has finished, e.g. one fetched with AssetConnection::FetchDecoded
+		bool LoadFromDecoder(OVR::RenderTiny::RenderDevice* device, const ObjDecoder& decoder);
+
+		//Creates the buffers from arrays ConvertScene made
+		bool LoadFromArrays(OVR::RenderTiny::RenderDevice* device, const ZArray<OVR::RenderTiny::Vertex>& vertices,
+							const ZArray<uint32_t>& indices, const ZArray<MeshRange>& ranges);
+
+
+		//Splits every range reaching more than maxVertices vertices into ranges that don't, in triangle order,
+		//copying the vertices neighbouring chunks share. *addedReturn (if not NULL) gets the vertices added,
+		//negative if ranges left vertices unused. Returns false with the arrays incomplete if an index is out of its range.
+		static bool SplitRanges(const ZArray<OVR::RenderTiny::Vertex>& vertices, const ZArray<uint32_t>& indices, const MeshRange* ranges,
+								size_t rangeCount, uint32_t maxVertices, ZArray<OVR::RenderTiny::Vertex>* verticesReturn,
+								ZArray<uint32_t>* indicesReturn, ZArray<MeshRange>* rangesReturn, int64_t* addedReturn);
+
+		//The index size to draw a mesh with. If splitting is cheaper than 32-bit indices, the split mesh is
+		//returned in the arrays and *splitReturn set.
+		static uint32_t FitIndices(const ZArray<OVR::RenderTiny::Vertex>& vertices, const ZArray<uint32_t>& indices, const MeshRange* ranges,
+								   size_t rangeCount, ZArray<OVR::RenderTiny::Vertex>* verticesReturn, ZArray<uint32_t>* indicesReturn,
+								   ZArray<MeshRange>* rangesReturn, bool* splitReturn);
+
+		//Frees the buffers, e.g. of a mesh loaded only to be measured
+		void Release();
 
 		Buffer* GetVertexBuffer() const { return vb; }
 		Buffer* GetIndexBuffer() const { return ib; }
+		const ZArray<MeshRange>& GetRanges() const { return ranges; }
 
+		//The bounds the vertex buffer is quantized against, or NULL if it holds full vertices
+		const MeshQuantization* GetQuantization() const { return packed ? &quantization : NULL; }
+
+		uint32_t GetIndexSize() const { return indexSize; }
 		uint32_t GetNumFaces() const { return nrFaces; }
 
 	private:
+		bool CreateBuffers(OVR::RenderTiny::RenderDevice* device, const ZArray<OVR::RenderTiny::Vertex>& vertices,
+						   const ZArray<uint32_t>& indices, const MeshRange* ranges, size_t rangeCount);
+		//Packs or unpacks the vertices first if MESH_PACK_VERTICES wants the other layout
+		bool UploadBuffers(OVR::RenderTiny::RenderDevice* device, const OVR::RenderTiny::Vertex* vertices, size_t vertexCount,
+						   const void* indices, size_t indexCount, uint32_t indexSize, const MeshRange* ranges, size_t rangeCount);
+		bool UploadBuffers(OVR::RenderTiny::RenderDevice* device, const PackedVertex* vertices, const MeshQuantization& bounds, size_t vertexCount,
+						   const void* indices, size_t indexCount, uint32_t indexSize, const MeshRange* ranges, size_t rangeCount);
+
+		//Uploads the vertices as they are, packed against bounds unless it's NULL
+		bool UploadBuffers(OVR::RenderTiny::RenderDevice* device, const void* vertices, size_t vertexBytes, const MeshQuantization* bounds,
+						   const void* indices, size_t indexCount, uint32_t indexSize, const MeshRange* ranges, size_t rangeCount);
+
 		Buffer* vb;
 		Buffer* ib;
+		ZArray<MeshRange> ranges;
+		uint32_t indexSize;
 		uint32_t nrFaces;
+		bool packed;
+		MeshQuantization quantization;
 
 		//PrimitiveType     Type;
 		//Ptr<ShaderFill>   Fill;
 
 };
 
-extern Mesh testMesh;
\ No newline at end of file
+extern Mesh testMesh;
+
+//Writes a model of submeshes meshes, each with a material of its own, into directory, converts it once
+//and creates one buffer pair per mesh and one shared pair from the same arrays, and prints the buffers
+//each took, the time to create them and the time to set up the draws of a frame
+void Mesh_Benchmark(OVR::RenderTiny::RenderDevice* device, const char* directory, uint32_t submeshes);
+
+//Fits a generated grid of vertexCount vertices both with 32-bit indices and by splitting into 16-bit
+//ranges, checks the split draws the same triangles, and prints the bytes each holds and reads a frame
+void Mesh_IndexBenchmark(uint32_t vertexCount);
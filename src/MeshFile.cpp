@@ -0,0 +1,378 @@
+#include "MeshFile.hpp"
+#include <math.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include <SST/SST_Time.h>
+#include <assimp/Importer.hpp>
+#include <assimp/scene.h>
+
+#include "AssetFileSystem.hpp"
+#include "Mesh.hpp"
+#include "MeshOptimizer.hpp"
+
+static uint64_t AlignOffset(uint64_t offset)
+{
+	return (offset + MESH_FILE_ALIGNMENT - 1) & ~(uint64_t)(MESH_FILE_ALIGNMENT - 1);
+}
+
+MeshFile::MeshFile()
+	: file(NULL), map(NULL), data(NULL), size(0), header(NULL)
+{
+}
+
+MeshFile::~MeshFile()
+{
+	Close();
+}
+
+bool MeshFile::Open(const char* path)
+{
+	Close();
+
+	file = SST_OS_OpenFile(path, SST_OPEN_READ);
+	if(file == NULL)
+		return false;
+
+	//A version 2 header is the current one up to the quantization
+	const size_t unpackedHeaderSize = offsetof(MeshFileHeader, quantization);
+
+	size = (size_t)SST_OS_GetFileSize(file);
+	if(size < unpackedHeaderSize) {
+		printf("%s is too small to be a mesh file\n", path);
+		Close();
+		return false;
+	}
+
+	map = SST_OS_CreateMmap(file, 0, 0, SST_PROTECT_READ);
+	if(map == NULL) {
+		Close();
+		return false;
+	}
+	data = (const uint8_t*)SST_OS_GetMmapBase(map);
+
+	const MeshFileHeader* h = (const MeshFileHeader*)data;
+	if(h->magic != MESH_FILE_MAGIC || (h->version != MESH_FILE_VERSION && h->version != MESH_FILE_VERSION_UNPACKED)) {
+		printf("%s isn't a version %u or %u mesh file\n", path, MESH_FILE_VERSION_UNPACKED, MESH_FILE_VERSION);
+		Close();
+		return false;
+	}
+
+	const size_t headerSize = h->version == MESH_FILE_VERSION_UNPACKED ? unpackedHeaderSize : sizeof(MeshFileHeader);
+	const bool packedVertices = h->version != MESH_FILE_VERSION_UNPACKED && h->vertexSize == sizeof(PackedVertex);
+	if(size < headerSize) {
+		printf("%s is too small to be a mesh file\n", path);
+		Close();
+		return false;
+	}
+
+	if((h->vertexSize != sizeof(OVR::RenderTiny::Vertex) && !packedVertices) || (h->indexSize != 2 && h->indexSize != 4) ||
+	   h->indexCount % 3 != 0 || h->rangeSize != sizeof(MeshRange)) {
+		printf("%s was written for a different vertex layout or is corrupt\n", path);
+		Close();
+		return false;
+	}
+
+	//Counts are 32-bit, so these can't overflow
+	uint64_t vertexBytes = (uint64_t)h->vertexCount * h->vertexSize;
+	uint64_t indexBytes = (uint64_t)h->indexCount * h->indexSize;
+	uint64_t rangeBytes = (uint64_t)h->rangeCount * h->rangeSize;
+	if(h->vertexOffset % MESH_FILE_ALIGNMENT != 0 || h->indexOffset % MESH_FILE_ALIGNMENT != 0 || h->rangeOffset % MESH_FILE_ALIGNMENT != 0 ||
+	   h->vertexOffset < headerSize || h->indexOffset < headerSize || h->rangeOffset < headerSize ||
+	   h->vertexOffset > size || vertexBytes > size - h->vertexOffset ||
+	   h->indexOffset > size || indexBytes > size - h->indexOffset ||
+	   h->rangeOffset > size || rangeBytes > size - h->rangeOffset) {
+		printf("%s is cut short or corrupt\n", path);
+		Close();
+		return false;
+	}
+
+	//Ranges are few, so they're all checked here rather than trusted at draw time
+	const MeshRange* ranges = (const MeshRange*)(data + h->rangeOffset);
+	for(uint32_t i=0; i<h->rangeCount; i++) {
+		const MeshRange& range = ranges[i];
+		if(range.indexCount % 3 != 0 || range.indexOffset > h->indexCount || range.indexCount > h->indexCount - range.indexOffset ||
+		   range.vertexOffset > h->vertexCount || range.vertexCount > h->vertexCount - range.vertexOffset ||
+		   (h->indexSize == 2 && range.vertexCount > 0x10000)) {
+			printf("%s has a range outside its buffers\n", path);
+			Close();
+			return false;
+		}
+	}
+
+	header = h;
+	return true;
+}
+
+void MeshFile::Close()
+{
+	if(map != NULL)
+		SST_OS_DestroyMmap(map);
+	if(file != NULL)
+		SST_OS_CloseFile(file);
+
+	file = NULL;
+	map = NULL;
+	data = NULL;
+	size = 0;
+	header = NULL;
+}
+
+const OVR::RenderTiny::Vertex* MeshFile::GetVertices() const
+{
+	return header != NULL && header->vertexSize == sizeof(OVR::RenderTiny::Vertex) ? (const OVR::RenderTiny::Vertex*)(data + header->vertexOffset) : NULL;
+}
+
+const PackedVertex* MeshFile::GetPackedVertices() const
+{
+	return header != NULL && header->vertexSize == sizeof(PackedVertex) ? (const PackedVertex*)(data + header->vertexOffset) : NULL;
+}
+
+const void* MeshFile::GetIndices() const
+{
+	return header != NULL ? data + header->indexOffset : NULL;
+}
+
+const MeshRange* MeshFile::GetRanges() const
+{
+	return header != NULL ? (const MeshRange*)(data + header->rangeOffset) : NULL;
+}
+
+bool MeshFile_Write(const char* path, const ZArray<OVR::RenderTiny::Vertex>& vertices, const ZArray<uint32_t>& indices,
+					const ZArray<MeshRange>& ranges)
+{
+	if(vertices.Size() > 0xFFFFFFFFu || indices.Size() > 0xFFFFFFFFu || indices.Size() % 3 != 0)
+		return false;
+
+	uint32_t largestRange = 0;
+	for(size_t i=0; i<ranges.Size(); i++) {
+		if(ranges.Data()[i].vertexCount > largestRange)
+			largestRange = ranges.Data()[i].vertexCount;
+	}
+
+	MeshFileHeader header;
+	memset(&header, 0, sizeof(header));
+	header.magic = MESH_FILE_MAGIC;
+	header.version = MESH_FILE_VERSION;
+	header.vertexCount = (uint32_t)vertices.Size();
+	header.vertexSize = (uint32_t)MESH_VERTEX_SIZE;
+	header.indexCount = (uint32_t)indices.Size();
+	header.indexSize = largestRange <= 0x10000 ? 2 : 4;
+	header.rangeCount = (uint32_t)ranges.Size();
+	header.rangeSize = sizeof(MeshRange);
+	header.vertexOffset = AlignOffset(sizeof(MeshFileHeader));
+	header.indexOffset = AlignOffset(header.vertexOffset + (uint64_t)header.vertexCount * header.vertexSize);
+	header.rangeOffset = AlignOffset(header.indexOffset + (uint64_t)header.indexCount * header.indexSize);
+
+	for(int axis=0; axis<3; axis++) {
+		header.boundsMin[axis] = vertices.Size() > 0 ? 1e30f : 0.0f;
+		header.boundsMax[axis] = vertices.Size() > 0 ? -1e30f : 0.0f;
+	}
+	for(size_t i=0; i<vertices.Size(); i++) {
+		const OVR::Vector3f& pos = vertices.Data()[i].Pos;
+		const float p[3] = { pos.x, pos.y, pos.z };
+		for(int axis=0; axis<3; axis++) {
+			if(p[axis] < header.boundsMin[axis]) header.boundsMin[axis] = p[axis];
+			if(p[axis] > header.boundsMax[axis]) header.boundsMax[axis] = p[axis];
+		}
+	}
+
+	//Packed here once so loading uploads the vertices as they're mapped
+	const void* vertexData = vertices.Data();
+#if MESH_PACK_VERTICES
+	ZArray<PackedVertex> packed;
+	packed.Resize(vertices.Size());
+	MeshQuantize_ComputeBounds(vertices.Data(), vertices.Size(), &header.quantization);
+	MeshQuantize_Encode(vertices.Data(), vertices.Size(), header.quantization, packed.Data());
+	vertexData = packed.Data();
+#endif
+
+	char tempPath[MESH_FILE_MAX_PATH + 4];
+	if(strlen(path) >= MESH_FILE_MAX_PATH)
+		return false;
+	sprintf(tempPath, "%s.tmp", path);
+
+	SST_File file = SST_OS_OpenFile(tempPath, SST_OPEN_WRITE | SST_OPEN_HINTSEQ);
+	if(file == NULL)
+		return false;
+
+	static const uint8_t padding[MESH_FILE_ALIGNMENT] = { 0 };
+	uint64_t vertexEnd = header.vertexOffset + (uint64_t)header.vertexCount * header.vertexSize;
+	size_t vertexBytes = (size_t)(vertexEnd - header.vertexOffset);
+	size_t indexBytes = (size_t)header.indexCount * header.indexSize;
+	size_t rangeBytes = (size_t)header.rangeCount * header.rangeSize;
+
+	bool ok = SST_OS_WriteFile(file, &header, sizeof(header)) == sizeof(header);
+	ok = ok && SST_OS_WriteFile(file, padding, (size_t)(header.vertexOffset - sizeof(header))) == header.vertexOffset - sizeof(header);
+	ok = ok && (vertexBytes == 0 || SST_OS_WriteFile(file, vertexData, vertexBytes) == vertexBytes);
+	ok = ok && SST_OS_WriteFile(file, padding, (size_t)(header.indexOffset - vertexEnd)) == header.indexOffset - vertexEnd;
+
+	if(header.indexSize == 4) {
+		ok = ok && (indexBytes == 0 || SST_OS_WriteFile(file, indices.Data(), indexBytes) == indexBytes);
+	} else {
+		ZArray<uint16_t> narrow;
+		narrow.Resize(indices.Size());
+		for(size_t i=0; i<indices.Size(); i++)
+			narrow.Data()[i] = (uint16_t)indices.Data()[i];
+		ok = ok && (indexBytes == 0 || SST_OS_WriteFile(file, narrow.Data(), indexBytes) == indexBytes);
+	}
+
+	uint64_t indexEnd = header.indexOffset + indexBytes;
+	ok = ok && SST_OS_WriteFile(file, padding, (size_t)(header.rangeOffset - indexEnd)) == header.rangeOffset - indexEnd;
+	ok = ok && (rangeBytes == 0 || SST_OS_WriteFile(file, ranges.Data(), rangeBytes) == rangeBytes);
+
+	SST_OS_CloseFile(file);
+
+	//Written under a temporary name so a failed conversion never leaves a half-written mesh behind
+	remove(path);
+	if(!ok || rename(tempPath, path) != 0) {
+		remove(tempPath);
+		return false;
+	}
+
+	return true;
+}
+
+bool MeshFile_Convert(const char* sourcePath, const char* path)
+{
+	AssetScene scene(NULL, NULL);
+	scene.Load(sourcePath, MESH_IMPORT_FLAGS, NULL, NULL);
+
+	ZArray<OVR::RenderTiny::Vertex> vertices;
+	ZArray<uint32_t> indices;
+	ZArray<MeshRange> ranges;
+	if(!Mesh::ConvertScene(scene.GetScene(), &vertices, &indices, &ranges)) {
+		printf("Couldn't import a mesh from %s\n", sourcePath);
+		return false;
+	}
+
+	//Stored as Mesh would draw it, so loading never has to optimise or split
+	MeshOptimizer_Optimize(&vertices, &indices, ranges, MESH_OPTIMIZE_OVERDRAW != 0);
+
+	ZArray<OVR::RenderTiny::Vertex> splitVertices;
+	ZArray<uint32_t> splitIndices;
+	ZArray<MeshRange> splitRanges;
+	bool split;
+	Mesh::FitIndices(vertices, indices, ranges.Data(), ranges.Size(), &splitVertices, &splitIndices, &splitRanges, &split);
+
+	const ZArray<OVR::RenderTiny::Vertex>& fitVertices = split ? splitVertices : vertices;
+	const ZArray<uint32_t>& fitIndices = split ? splitIndices : indices;
+	const ZArray<MeshRange>& fitRanges = split ? splitRanges : ranges;
+
+	if(!MeshFile_Write(path, fitVertices, fitIndices, fitRanges)) {
+		printf("Couldn't write %s\n", path);
+		return false;
+	}
+
+	printf("%s: %u vertices, %u triangles in %u ranges%s\n", path, (uint32_t)fitVertices.Size(), (uint32_t)(fitIndices.Size() / 3),
+		(uint32_t)fitRanges.Size(), split ? ", split for 16-bit indices" : "");
+	return true;
+}
+
+//A flat grid of at least 'triangles' triangles, as an OBJ with texture coordinates
+static bool WriteGridObj(const char* path, uint32_t triangles)
+{
+	uint32_t quads = (triangles + 1) / 2;
+	uint32_t w = (uint32_t)ceil(sqrt((double)quads));
+	uint32_t h = (quads + w - 1) / w;
+
+	FILE* fp = fopen(path, "wb");
+	if(fp == NULL)
+		return false;
+
+	for(uint32_t y=0; y<=h; y++) {
+		for(uint32_t x=0; x<=w; x++)
+			fprintf(fp, "v %.4f %.4f %.4f\nvt %.4f %.4f\n", (float)x, 0.01f * (float)((x * 7 + y * 13) % 17), (float)y,
+					(float)x / w, (float)y / h);
+	}
+
+	for(uint32_t y=0; y<h; y++) {
+		for(uint32_t x=0; x<w; x++) {
+			uint32_t a = y * (w + 1) + x + 1;
+			uint32_t b = a + 1;
+			uint32_t c = a + w + 1;
+			uint32_t d = c + 1;
+			fprintf(fp, "f %u/%u %u/%u %u/%u\nf %u/%u %u/%u %u/%u\n", a, a, c, c, b, b, b, b, c, c, d, d);
+		}
+	}
+
+	bool ok = ferror(fp) == 0;
+	fclose(fp);
+	return ok;
+}
+
+void MeshFile_Benchmark(const char* directory)
+{
+	static const uint32_t triangleCounts[] = { 1000, 10000, 100000, 1000000, 5000000 };
+
+	for(size_t t=0; t<sizeof(triangleCounts) / sizeof(triangleCounts[0]); t++)
+	{
+		char objPath[MESH_FILE_MAX_PATH];
+		char meshPath[MESH_FILE_MAX_PATH];
+		sprintf(objPath, "%s/grid%u.obj", directory, triangleCounts[t]);
+		sprintf(meshPath, "%s/grid%u.onzm", directory, triangleCounts[t]);
+
+		if(!WriteGridObj(objPath, triangleCounts[t])) {
+			printf("Mesh file benchmark: couldn't write %s\n", objPath);
+			remove(objPath);
+			return;
+		}
+
+		if(!MeshFile_Convert(objPath, meshPath)) {
+			remove(objPath);
+			return;
+		}
+
+		//Everything Assimp does every launch without the container, up to vertices and indices ready for Buffer::Data
+		uint64_t start = SST_OS_GetMicroTime();
+		uint64_t importPeak = 0;
+		uint64_t objSize = 0;
+		uint32_t vertexCount = 0;
+		{
+			Assimp::Importer importer;
+			const aiScene* scene = importer.ReadFile(objPath, MESH_IMPORT_FLAGS);
+
+			ZArray<OVR::RenderTiny::Vertex> vertices;
+			ZArray<uint32_t> indices;
+			ZArray<MeshRange> ranges;
+			Mesh::ConvertScene(scene, &vertices, &indices, &ranges);
+			vertexCount = (uint32_t)vertices.Size();
+
+			//Assimp reads the whole OBJ into memory and holds it while building the scene, and the scene while
+			//it's converted; what its post-processing allocates along the way isn't counted
+			aiMemoryInfo memory;
+			importer.GetMemoryRequirements(memory);
+
+			SST_File obj = SST_OS_OpenFile(objPath, SST_OPEN_READ);
+			if(obj != NULL) {
+				objSize = SST_OS_GetFileSize(obj);
+				SST_OS_CloseFile(obj);
+			}
+			importPeak = objSize + memory.total + vertices.Size() * sizeof(OVR::RenderTiny::Vertex) + indices.Size() * sizeof(uint32_t);
+		}
+		uint64_t importMicros = SST_OS_GetMicroTime() - start;
+
+		//Mapped, with every page touched as the upload would touch it
+		start = SST_OS_GetMicroTime();
+		MeshFile file;
+		volatile uint32_t touched = 0;
+		size_t mappedSize = 0;
+		if(file.Open(meshPath)) {
+			const uint8_t* bytes = (const uint8_t*)file.GetHeader();
+			mappedSize = file.GetSize();
+			for(size_t i=0; i<mappedSize; i+=4096)
+				touched += bytes[i];
+			file.Close();
+		}
+		uint64_t mapMicros = SST_OS_GetMicroTime() - start;
+
+		printf("Mesh file benchmark, %u triangles, %u vertices: Assimp %.1f ms, at least %.2f MB peak (%.2f MB OBJ); "
+			   "mapped container %.2f ms, %.2f MB mapped, nothing on the heap (%.0fx faster)%s\n",
+			triangleCounts[t], vertexCount, (double)importMicros / 1000.0, (double)importPeak / (1024.0 * 1024.0),
+			(double)objSize / (1024.0 * 1024.0), (double)mapMicros / 1000.0, (double)mappedSize / (1024.0 * 1024.0),
+			mapMicros ? (double)importMicros / mapMicros : 0.0, mappedSize == 0 ? ", COULDN'T MAP" : "");
+
+		remove(objPath);
+		remove(meshPath);
+	}
+}
@@ -0,0 +1,103 @@
+#pragma once
+
+#include <stddef.h>
+#include <pstdint.h>
+#include <ZSTL/ZArray.hpp>
+#include <SST/SST_File.h>
+#include <SST/SST_Mmap.h>
+#include "RenderTiny_Device.h"
+#include "MeshQuantize.hpp"
+
+#define MESH_FILE_MAGIC 0x4D5A4E4F		//"ONZM" read as a little-endian uint32_t
+#define MESH_FILE_VERSION 3
+
+//Version 2 containers, which always hold full vertices and end their header before the quantization, still load
+#define MESH_FILE_VERSION_UNPACKED 2
+
+//Blobs start on multiples of this, so the mapping can be handed to Buffer::Data as is
+#define MESH_FILE_ALIGNMENT 16
+
+#define MESH_FILE_MAX_PATH 512
+
+//One draw of a mesh's shared buffers: indexCount indices from indexOffset, each relative to
+//vertexOffset, so each range needs only as wide an index as its own vertices do
+struct MeshRange
+{
+	uint32_t indexOffset;
+	uint32_t indexCount;
+	uint32_t vertexOffset;
+	uint32_t vertexCount;
+	uint32_t material;		//Index into the source scene's materials
+};
+
+/*
+Mesh container, little-endian:
+	MeshFileHeader
+	vertexCount vertices of vertexSize bytes at vertexOffset
+	indexCount indices of indexSize bytes at indexOffset, three per triangle
+	rangeCount MeshRange at rangeOffset, covering the indices in order
+Blobs are aligned to MESH_FILE_ALIGNMENT from the start of the file. Vertices are stored in the
+layout the renderer uploads, PackedVertex against quantization if MESH_PACK_VERTICES was set
+when written and OVR::RenderTiny::Vertex otherwise, so a mesh loads without converting them.
+*/
+struct MeshFileHeader
+{
+	uint32_t magic;
+	uint32_t version;
+	uint32_t vertexCount;
+	uint32_t vertexSize;		//sizeof(PackedVertex) or sizeof(OVR::RenderTiny::Vertex) when written
+	uint32_t indexCount;
+	uint32_t indexSize;			//2, or 4 if 16-bit indices can't reach every vertex of a range
+	uint32_t rangeCount;
+	uint32_t rangeSize;			//sizeof(MeshRange) when written
+	float boundsMin[3];
+	float boundsMax[3];
+	uint64_t vertexOffset;
+	uint64_t indexOffset;
+	uint64_t rangeOffset;
+	MeshQuantization quantization;	//What the packed vertices map back through; zero for full vertices. Since version 3.
+};
+
+/*
+A mapped mesh container. Vertices and indices are handed out as pointers into the mapping,
+valid from Open until Close; nothing is read into memory or copied out.
+*/
+class MeshFile
+{
+	public:
+		MeshFile();
+		~MeshFile();
+
+		//Maps the file and checks its header, that every blob lies within it and every range within the blobs
+		bool Open(const char* path);
+		void Close();
+
+		const MeshFileHeader* GetHeader() const { return header; }
+
+		//Only one of these is not NULL, depending on what the file holds
+		const OVR::RenderTiny::Vertex* GetVertices() const;
+		const PackedVertex* GetPackedVertices() const;
+
+		const void* GetIndices() const;
+		const MeshRange* GetRanges() const;
+
+		size_t GetSize() const { return size; }
+
+	private:
+		SST_File file;
+		SST_MemoryMap map;
+		const uint8_t* data;
+		size_t size;
+		const MeshFileHeader* header;
+};
+
+//Writes a container, with 16-bit indices if they reach every vertex of every range, packing the vertices if MESH_PACK_VERTICES is set
+bool MeshFile_Write(const char* path, const ZArray<OVR::RenderTiny::Vertex>& vertices, const ZArray<uint32_t>& indices,
+					const ZArray<MeshRange>& ranges);
+
+//Imports anything Assimp reads, with MESH_IMPORT_FLAGS and its sidecar files mapped next to it, and writes every mesh of it as a container
+bool MeshFile_Convert(const char* sourcePath, const char* path);
+
+//Writes grid meshes of 1k to 5M triangles into directory as OBJ files and converts them, then loads each
+//through Assimp and as a mapped container, and prints the load time and peak memory of each
+void MeshFile_Benchmark(const char* directory);
@@ -0,0 +1,658 @@
+#include "MeshOptimizer.hpp"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <SST/SST_Time.h>
+
+#include "AssetFileSystem.hpp"
+#include "Mesh.hpp"
+
+//Forsyth's tuning: how fast a vertex's score falls off down the cache, what the last triangle's vertices
+//score, and how much vertices with few triangles left are boosted so they're finished off
+#define FORSYTH_CACHE_DECAY_POWER 1.5f
+#define FORSYTH_LAST_TRIANGLE_SCORE 0.75f
+#define FORSYTH_VALENCE_BOOST_SCALE 2.0f
+#define FORSYTH_VALENCE_BOOST_POWER 0.5f
+
+//Remaining triangle counts the valence boost is tabled for; beyond this it's next to nothing anyway
+#define FORSYTH_MAX_VALENCE 64
+
+#define MESH_OPTIMIZER_NONE 0xFFFFFFFFu
+
+struct ForsythTables
+{
+	float cache[MESH_OPTIMIZER_CACHE_SIZE];
+	float valence[FORSYTH_MAX_VALENCE];
+
+	ForsythTables()
+	{
+		for(int i=0; i<MESH_OPTIMIZER_CACHE_SIZE; i++) {
+			if(i < 3)
+				cache[i] = FORSYTH_LAST_TRIANGLE_SCORE;
+			else
+				cache[i] = powf(1.0f - (float)(i - 3) / (float)(MESH_OPTIMIZER_CACHE_SIZE - 3), FORSYTH_CACHE_DECAY_POWER);
+		}
+
+		valence[0] = 0.0f;
+		for(int i=1; i<FORSYTH_MAX_VALENCE; i++)
+			valence[i] = FORSYTH_VALENCE_BOOST_SCALE * powf((float)i, -FORSYTH_VALENCE_BOOST_POWER);
+	}
+
+	float Score(int cachePos, uint32_t remaining) const
+	{
+		//A vertex with no triangles left can't make a triangle worth drawing
+		if(remaining == 0)
+			return -1.0f;
+
+		float score = cachePos >= 0 ? cache[cachePos] : 0.0f;
+		return score + valence[remaining < FORSYTH_MAX_VALENCE ? remaining : FORSYTH_MAX_VALENCE - 1];
+	}
+};
+
+void MeshOptimizer_OptimizeVertexCache(uint32_t* indices, size_t indexCount, uint32_t vertexCount)
+{
+	static const ForsythTables tables;
+
+	size_t triangleCount = indexCount / 3;
+	if(triangleCount < 2 || vertexCount == 0)
+		return;
+
+	//Each vertex's triangles not yet drawn, packed per vertex from first[v]
+	ZArray<uint32_t> remaining;
+	ZArray<uint32_t> first;
+	ZArray<uint32_t> adjacency;
+	remaining.Resize(vertexCount, 0);
+	first.Resize(vertexCount + 1);
+	adjacency.Resize(triangleCount * 3);
+
+	for(size_t i=0; i<triangleCount * 3; i++)
+		remaining[indices[i]]++;
+
+	first[0] = 0;
+	for(uint32_t v=0; v<vertexCount; v++)
+		first[v + 1] = first[v] + remaining[v];
+
+	for(uint32_t v=0; v<vertexCount; v++)
+		remaining[v] = 0;
+	for(size_t i=0; i<triangleCount * 3; i++) {
+		uint32_t v = indices[i];
+		adjacency[first[v] + remaining[v]++] = (uint32_t)(i / 3);
+	}
+
+	ZArray<int32_t> cachePos;
+	ZArray<float> vertexScore;
+	cachePos.Resize(vertexCount, -1);
+	vertexScore.Resize(vertexCount);
+	for(uint32_t v=0; v<vertexCount; v++)
+		vertexScore[v] = tables.Score(-1, remaining[v]);
+
+	ZArray<uint8_t> drawn;
+	drawn.Resize(triangleCount, 0);
+
+	uint32_t best = MESH_OPTIMIZER_NONE;
+	float bestScore = -1.0f;
+	for(size_t t=0; t<triangleCount; t++) {
+		float score = vertexScore[indices[t*3+0]] + vertexScore[indices[t*3+1]] + vertexScore[indices[t*3+2]];
+		if(score > bestScore) {
+			bestScore = score;
+			best = (uint32_t)t;
+		}
+	}
+
+	ZArray<uint32_t> output;
+	output.Resize(triangleCount * 3);
+
+	uint32_t cache[MESH_OPTIMIZER_CACHE_SIZE + 3];
+	uint32_t newCache[MESH_OPTIMIZER_CACHE_SIZE + 3];
+	uint32_t cacheCount = 0;
+	size_t cursor = 0;
+
+	for(size_t out=0; out<triangleCount; out++)
+	{
+		//Nothing in the cache has a triangle left, so start again from the next one not drawn
+		if(best == MESH_OPTIMIZER_NONE) {
+			while(drawn[cursor])
+				cursor++;
+			best = (uint32_t)cursor;
+		}
+
+		const uint32_t* triangle = &indices[best * 3];
+		output[out*3+0] = triangle[0];
+		output[out*3+1] = triangle[1];
+		output[out*3+2] = triangle[2];
+		drawn[best] = 1;
+
+		uint32_t newCount = 0;
+		for(int k=0; k<3; k++) {
+			uint32_t v = triangle[k];
+
+			uint32_t* list = &adjacency[first[v]];
+			for(uint32_t i=0; i<remaining[v]; i++) {
+				if(list[i] == best) {
+					list[i] = list[remaining[v] - 1];
+					remaining[v]--;
+					break;
+				}
+			}
+
+			if(newCount == 0 || (newCache[0] != v && (newCount < 2 || newCache[1] != v)))
+				newCache[newCount++] = v;
+		}
+
+		for(uint32_t i=0; i<cacheCount; i++) {
+			uint32_t v = cache[i];
+			if(v != triangle[0] && v != triangle[1] && v != triangle[2])
+				newCache[newCount++] = v;
+		}
+
+		//Everything that moved in the cache or fell out of it rescores, and so do its triangles
+		best = MESH_OPTIMIZER_NONE;
+		bestScore = -1.0f;
+
+		for(uint32_t i=0; i<newCount; i++) {
+			uint32_t v = newCache[i];
+			cachePos[v] = i < MESH_OPTIMIZER_CACHE_SIZE ? (int32_t)i : -1;
+			vertexScore[v] = tables.Score(cachePos[v], remaining[v]);
+		}
+
+		for(uint32_t i=0; i<newCount; i++) {
+			uint32_t v = newCache[i];
+			const uint32_t* list = &adjacency[first[v]];
+			for(uint32_t j=0; j<remaining[v]; j++) {
+				uint32_t t = list[j];
+				float score = vertexScore[indices[t*3+0]] + vertexScore[indices[t*3+1]] + vertexScore[indices[t*3+2]];
+				if(score > bestScore) {
+					bestScore = score;
+					best = t;
+				}
+			}
+		}
+
+		cacheCount = newCount < MESH_OPTIMIZER_CACHE_SIZE ? newCount : MESH_OPTIMIZER_CACHE_SIZE;
+		memcpy(cache, newCache, cacheCount * sizeof(uint32_t));
+	}
+
+	memcpy(indices, output.Data(), triangleCount * 3 * sizeof(uint32_t));
+}
+
+struct OverdrawCluster
+{
+	float key;
+	uint32_t start;				//First triangle
+	uint32_t count;
+};
+
+static int CompareClusters(const void* a, const void* b)
+{
+	const OverdrawCluster* x = (const OverdrawCluster*)a;
+	const OverdrawCluster* y = (const OverdrawCluster*)b;
+
+	if(x->key != y->key)
+		return x->key > y->key ? -1 : 1;
+	return x->start < y->start ? -1 : (x->start > y->start ? 1 : 0);
+}
+
+//Vertices of a triangle the FIFO cache misses, putting them in it. A vertex is in the cache if fewer
+//than MESH_OPTIMIZER_SIMULATED_CACHE others have gone in since it did.
+static uint32_t CacheMisses(const uint32_t* triangle, uint32_t* stamps, uint32_t* time)
+{
+	uint32_t misses = 0;
+	for(int k=0; k<3; k++) {
+		uint32_t v = triangle[k];
+		if(*time - stamps[v] > MESH_OPTIMIZER_SIMULATED_CACHE) {
+			stamps[v] = (*time)++;
+			misses++;
+		}
+	}
+	return misses;
+}
+
+static void PushCluster(ZArray<OverdrawCluster>* clusters, uint32_t start, uint32_t count)
+{
+	OverdrawCluster cluster;
+	cluster.key = 0.0f;
+	cluster.start = start;
+	cluster.count = count;
+	clusters->PushBack(cluster);
+}
+
+void MeshOptimizer_OptimizeOverdraw(uint32_t* indices, size_t indexCount, const OVR::RenderTiny::Vertex* vertices, uint32_t vertexCount)
+{
+	size_t triangleCount = indexCount / 3;
+	if(triangleCount < 2 || vertexCount == 0)
+		return;
+
+	//Runs end where a triangle misses the cache on all three vertices, which is where the cache
+	//order jumped somewhere new
+	ZArray<uint32_t> stamps;
+	stamps.Resize(vertexCount, 0);
+	uint32_t time = MESH_OPTIMIZER_SIMULATED_CACHE + 1;
+
+	ZArray<uint32_t> runs;
+	for(size_t t=0; t<triangleCount; t++) {
+		if(CacheMisses(&indices[t*3], stamps.Data(), &time) == 3 || t == 0)
+			runs.PushBack((uint32_t)t);
+	}
+	runs.PushBack((uint32_t)triangleCount);
+
+	//A run is mostly a few clusters' worth of one surface, so it's split again wherever the ACMR of
+	//what's been taken of it is near the run's own: each cluster starts with a cold cache once
+	//reordered, and ending one there costs little locality. Bumping the time empties the cache.
+	ZArray<OverdrawCluster> clusters;
+	for(size_t r=0; r+1<runs.Size(); r++) {
+		uint32_t start = runs[r];
+		uint32_t end = runs[r + 1];
+
+		time += MESH_OPTIMIZER_SIMULATED_CACHE + 1;
+		uint32_t runMisses = 0;
+		for(uint32_t t=start; t<end; t++)
+			runMisses += CacheMisses(&indices[t*3], stamps.Data(), &time);
+		float threshold = MESH_OPTIMIZER_OVERDRAW_THRESHOLD * (float)runMisses / (float)(end - start);
+
+		time += MESH_OPTIMIZER_SIMULATED_CACHE + 1;
+		uint32_t clusterStart = start;
+		uint32_t misses = 0;
+		for(uint32_t t=start; t<end; t++) {
+			misses += CacheMisses(&indices[t*3], stamps.Data(), &time);
+			if((float)misses <= threshold * (float)(t + 1 - clusterStart)) {
+				PushCluster(&clusters, clusterStart, t + 1 - clusterStart);
+				clusterStart = t + 1;
+				misses = 0;
+				time += MESH_OPTIMIZER_SIMULATED_CACHE + 1;
+			}
+		}
+
+		//What's left never got down to the threshold, so it's the tail of the last cluster rather than one of its own
+		if(clusterStart < end) {
+			if(clusterStart > start)
+				clusters[clusters.Size() - 1].count += end - clusterStart;
+			else
+				PushCluster(&clusters, start, end - start);
+		}
+	}
+
+	OVR::Vector3f meshCentroid(0, 0, 0);
+	float meshArea = 0.0f;
+
+	//Area-weighted centres, of the mesh and of each cluster, and the direction each cluster faces
+	ZArray<OVR::Vector3f> centroids;
+	ZArray<OVR::Vector3f> normals;
+	centroids.Resize(clusters.Size(), OVR::Vector3f(0, 0, 0));
+	normals.Resize(clusters.Size(), OVR::Vector3f(0, 0, 0));
+
+	for(size_t c=0; c<clusters.Size(); c++) {
+		float area = 0.0f;
+		for(uint32_t t=clusters[c].start; t<clusters[c].start + clusters[c].count; t++) {
+			const OVR::Vector3f& a = vertices[indices[t*3+0]].Pos;
+			const OVR::Vector3f& b = vertices[indices[t*3+1]].Pos;
+			const OVR::Vector3f& d = vertices[indices[t*3+2]].Pos;
+
+			OVR::Vector3f normal = (b - a).Cross(d - a);
+			float triangleArea = normal.Length() * 0.5f;
+			OVR::Vector3f centre = (a + b + d) * (1.0f / 3.0f);
+
+			normals[c] += normal;
+			centroids[c] += centre * triangleArea;
+			area += triangleArea;
+		}
+
+		meshCentroid += centroids[c];
+		meshArea += area;
+		if(area > 0.0f)
+			centroids[c] *= 1.0f / area;
+	}
+
+	if(meshArea > 0.0f)
+		meshCentroid *= 1.0f / meshArea;
+
+	for(size_t c=0; c<clusters.Size(); c++) {
+		float length = normals[c].Length();
+		clusters[c].key = length > 0.0f ? (centroids[c] - meshCentroid).Dot(normals[c]) / length : 0.0f;
+	}
+
+	qsort(clusters.Data(), clusters.Size(), sizeof(OverdrawCluster), CompareClusters);
+
+	ZArray<uint32_t> output;
+	output.Reserve(triangleCount * 3);
+	for(size_t c=0; c<clusters.Size(); c++) {
+		for(uint32_t i=clusters[c].start * 3; i<(clusters[c].start + clusters[c].count) * 3; i++)
+			output.PushBack(indices[i]);
+	}
+
+	memcpy(indices, output.Data(), triangleCount * 3 * sizeof(uint32_t));
+}
+
+void MeshOptimizer_OptimizeVertexFetch(OVR::RenderTiny::Vertex* vertices, uint32_t vertexCount, uint32_t* indices, size_t indexCount)
+{
+	ZArray<uint32_t> remap;
+	remap.Resize(vertexCount, MESH_OPTIMIZER_NONE);
+
+	uint32_t next = 0;
+	for(size_t i=0; i<indexCount; i++) {
+		uint32_t v = indices[i];
+		if(remap[v] == MESH_OPTIMIZER_NONE)
+			remap[v] = next++;
+		indices[i] = remap[v];
+	}
+
+	for(uint32_t v=0; v<vertexCount; v++) {
+		if(remap[v] == MESH_OPTIMIZER_NONE)
+			remap[v] = next++;
+	}
+
+	ZArray<OVR::RenderTiny::Vertex> reordered;
+	reordered.Resize(vertexCount);
+	for(uint32_t v=0; v<vertexCount; v++)
+		reordered[remap[v]] = vertices[v];
+
+	memcpy(vertices, reordered.Data(), vertexCount * sizeof(OVR::RenderTiny::Vertex));
+}
+
+void MeshOptimizer_Optimize(ZArray<OVR::RenderTiny::Vertex>* vertices, ZArray<uint32_t>* indices, const ZArray<MeshRange>& ranges,
+							bool overdraw)
+{
+	for(size_t r=0; r<ranges.Size(); r++)
+	{
+		const MeshRange& range = ranges.Data()[r];
+		if(range.indexCount == 0 || range.vertexCount == 0)
+			continue;
+
+		uint32_t* rangeIndices = &(*indices)[range.indexOffset];
+		OVR::RenderTiny::Vertex* rangeVertices = &(*vertices)[range.vertexOffset];
+
+		MeshOptimizer_OptimizeVertexCache(rangeIndices, range.indexCount, range.vertexCount);
+		if(overdraw)
+			MeshOptimizer_OptimizeOverdraw(rangeIndices, range.indexCount, rangeVertices, range.vertexCount);
+		MeshOptimizer_OptimizeVertexFetch(rangeVertices, range.vertexCount, rangeIndices, range.indexCount);
+	}
+}
+
+void MeshOptimizer_Simulate(const ZArray<uint32_t>& indices, const ZArray<MeshRange>& ranges, uint32_t cacheSize, MeshCacheStats* statsReturn)
+{
+	memset(statsReturn, 0, sizeof(MeshCacheStats));
+
+	//Direct-mapped fetch cache, tagged by line; the vertex buffer is taken to start on a line
+	uint64_t lineTags[MESH_OPTIMIZER_FETCH_LINES];
+	for(int i=0; i<MESH_OPTIMIZER_FETCH_LINES; i++)
+		lineTags[i] = ~(uint64_t)0;
+	uint64_t fetchedBytes = 0;
+
+	ZArray<uint32_t> stamps;
+	for(size_t r=0; r<ranges.Size(); r++)
+	{
+		const MeshRange& range = ranges.Data()[r];
+
+		//A vertex is in the FIFO if fewer than cacheSize others have gone in since it did
+		stamps.Resize(range.vertexCount);
+		for(uint32_t v=0; v<range.vertexCount; v++)
+			stamps[v] = 0;
+		uint32_t time = cacheSize + 1;
+
+		for(uint32_t i=0; i<range.indexCount; i++) {
+			uint32_t v = indices.Data()[range.indexOffset + i];
+			if(time - stamps[v] <= cacheSize)
+				continue;
+
+			stamps[v] = time++;
+			statsReturn->transformed++;
+
+			//Strided as the vertex buffer is uploaded
+			uint64_t address = (uint64_t)(range.vertexOffset + v) * MESH_VERTEX_SIZE;
+			for(uint64_t line = address / 64; line <= (address + MESH_VERTEX_SIZE - 1) / 64; line++) {
+				uint64_t& tag = lineTags[line % MESH_OPTIMIZER_FETCH_LINES];
+				if(tag != line) {
+					tag = line;
+					fetchedBytes += 64;
+				}
+			}
+		}
+
+		statsReturn->triangles += range.indexCount / 3;
+		statsReturn->vertices += range.vertexCount;
+	}
+
+	if(statsReturn->triangles > 0)
+		statsReturn->acmr = (float)statsReturn->transformed / statsReturn->triangles;
+	if(statsReturn->vertices > 0) {
+		statsReturn->atvr = (float)statsReturn->transformed / statsReturn->vertices;
+		statsReturn->overfetch = (float)((double)fetchedBytes / ((double)statsReturn->vertices * MESH_VERTEX_SIZE));
+	}
+}
+
+static inline float Min3(float a, float b, float c)
+{
+	float m = a < b ? a : b;
+	return m < c ? m : c;
+}
+
+static inline float Max3(float a, float b, float c)
+{
+	float m = a > b ? a : b;
+	return m > c ? m : c;
+}
+
+//Position of a vertex in one of the six views: x and y on the depth buffer, z the depth
+static void ProjectOverdraw(const OVR::Vector3f& pos, int view, const float* boundsMin, float scale, float* out)
+{
+	const float p[3] = { pos.x, pos.y, pos.z };
+	int axis = view / 2;
+	int u = (axis + 1) % 3;
+	int v = (axis + 2) % 3;
+
+	//Even views look down the axis and odd ones up it. The even ones are mirrored so a triangle
+	//facing the viewer winds the same way on the buffer from every view.
+	float depth = p[axis] - boundsMin[axis];
+	float x = (p[u] - boundsMin[u]) * scale;
+	out[0] = view & 1 ? x : (float)(MESH_OPTIMIZER_OVERDRAW_GRID - 1) - x;
+	out[1] = (p[v] - boundsMin[v]) * scale;
+	out[2] = view & 1 ? -depth : depth;
+}
+
+float MeshOptimizer_SimulateOverdraw(const ZArray<OVR::RenderTiny::Vertex>& vertices, const ZArray<uint32_t>& indices,
+									 const ZArray<MeshRange>& ranges)
+{
+	if(vertices.Size() == 0)
+		return 0.0f;
+
+	float boundsMin[3], boundsMax[3];
+	for(int k=0; k<3; k++)
+		boundsMin[k] = boundsMax[k] = (&vertices.Data()[0].Pos.x)[k];
+	for(size_t i=1; i<vertices.Size(); i++) {
+		const float* p = &vertices.Data()[i].Pos.x;
+		for(int k=0; k<3; k++) {
+			if(p[k] < boundsMin[k]) boundsMin[k] = p[k];
+			if(p[k] > boundsMax[k]) boundsMax[k] = p[k];
+		}
+	}
+
+	//One scale for every axis, so the mesh keeps its shape on the buffer
+	float extent = 0.0f;
+	for(int k=0; k<3; k++) {
+		if(boundsMax[k] - boundsMin[k] > extent)
+			extent = boundsMax[k] - boundsMin[k];
+	}
+	float scale = extent > 0.0f ? (float)(MESH_OPTIMIZER_OVERDRAW_GRID - 1) / extent : 1.0f;
+
+	ZArray<float> depth;
+	depth.Resize(MESH_OPTIMIZER_OVERDRAW_GRID * MESH_OPTIMIZER_OVERDRAW_GRID);
+	uint64_t shaded = 0;
+	uint64_t covered = 0;
+
+	for(int view=0; view<6; view++)
+	{
+		for(size_t i=0; i<depth.Size(); i++)
+			depth[i] = 1e30f;
+
+		for(size_t r=0; r<ranges.Size(); r++)
+		{
+			const MeshRange& range = ranges.Data()[r];
+			for(uint32_t t=0; t+2<range.indexCount; t+=3)
+			{
+				float a[3], b[3], c[3];
+				ProjectOverdraw(vertices.Data()[range.vertexOffset + indices.Data()[range.indexOffset + t + 0]].Pos, view, boundsMin, scale, a);
+				ProjectOverdraw(vertices.Data()[range.vertexOffset + indices.Data()[range.indexOffset + t + 1]].Pos, view, boundsMin, scale, b);
+				ProjectOverdraw(vertices.Data()[range.vertexOffset + indices.Data()[range.indexOffset + t + 2]].Pos, view, boundsMin, scale, c);
+
+				//Faces towards the viewer wind the same way OptimizeOverdraw takes to be outwards
+				float area = (b[0] - a[0]) * (c[1] - a[1]) - (b[1] - a[1]) * (c[0] - a[0]);
+				if(area <= 0.0f)
+					continue;
+
+				int minX = (int)floorf(Min3(a[0], b[0], c[0]));
+				int maxX = (int)ceilf(Max3(a[0], b[0], c[0]));
+				int minY = (int)floorf(Min3(a[1], b[1], c[1]));
+				int maxY = (int)ceilf(Max3(a[1], b[1], c[1]));
+				minX = minX < 0 ? 0 : minX;
+				minY = minY < 0 ? 0 : minY;
+				maxX = maxX > MESH_OPTIMIZER_OVERDRAW_GRID - 1 ? MESH_OPTIMIZER_OVERDRAW_GRID - 1 : maxX;
+				maxY = maxY > MESH_OPTIMIZER_OVERDRAW_GRID - 1 ? MESH_OPTIMIZER_OVERDRAW_GRID - 1 : maxY;
+
+				//Pixel centres inside all three edges are drawn
+				for(int y=minY; y<=maxY; y++) {
+					for(int x=minX; x<=maxX; x++) {
+						float px = (float)x + 0.5f, py = (float)y + 0.5f;
+						float wa = (c[0] - b[0]) * (py - b[1]) - (c[1] - b[1]) * (px - b[0]);
+						float wb = (a[0] - c[0]) * (py - c[1]) - (a[1] - c[1]) * (px - c[0]);
+						float wc = (b[0] - a[0]) * (py - a[1]) - (b[1] - a[1]) * (px - a[0]);
+						if(wa < 0.0f || wb < 0.0f || wc < 0.0f)
+							continue;
+
+						float z = (wa * a[2] + wb * b[2] + wc * c[2]) / area;
+						float& stored = depth[y * MESH_OPTIMIZER_OVERDRAW_GRID + x];
+						if(z < stored) {
+							if(stored == 1e30f)
+								covered++;
+							stored = z;
+							shaded++;
+						}
+					}
+				}
+			}
+		}
+	}
+
+	return covered > 0 ? (float)((double)shaded / (double)covered) : 0.0f;
+}
+
+static void PrintStage(const char* stage, const ZArray<OVR::RenderTiny::Vertex>& vertices, const ZArray<uint32_t>& indices,
+					   const ZArray<MeshRange>& ranges, uint64_t micros)
+{
+	MeshCacheStats stats;
+	MeshOptimizer_Simulate(indices, ranges, MESH_OPTIMIZER_SIMULATED_CACHE, &stats);
+
+	MeshCacheStats large;
+	MeshOptimizer_Simulate(indices, ranges, MESH_OPTIMIZER_CACHE_SIZE, &large);
+
+	float overdraw = MeshOptimizer_SimulateOverdraw(vertices, indices, ranges);
+
+	printf("  %-18s ACMR %.3f (%.3f at %u), ATVR %.3f (%.3f at %u), overfetch %.2f, overdraw %.3f, %.1f ms\n", stage,
+		stats.acmr, large.acmr, MESH_OPTIMIZER_CACHE_SIZE, stats.atvr, large.atvr, MESH_OPTIMIZER_CACHE_SIZE, stats.overfetch,
+		overdraw, (double)micros / 1000.0);
+}
+
+//Runs a mesh through each pass in turn, each on the output of the one before, printing what the
+//simulated caches and depth buffer make of it after each
+static void BenchmarkMesh(const char* name, ZArray<OVR::RenderTiny::Vertex>& vertices, ZArray<uint32_t>& indices, const ZArray<MeshRange>& ranges)
+{
+	printf("Mesh optimizer benchmark, %s: %u vertices, %u triangles in %u ranges, cache of %u\n", name, (uint32_t)vertices.Size(),
+		(uint32_t)(indices.Size() / 3), (uint32_t)ranges.Size(), MESH_OPTIMIZER_SIMULATED_CACHE);
+
+	PrintStage("As imported", vertices, indices, ranges, 0);
+
+	uint64_t start = SST_OS_GetMicroTime();
+	for(size_t r=0; r<ranges.Size(); r++)
+		MeshOptimizer_OptimizeVertexCache(&indices[ranges[r].indexOffset], ranges[r].indexCount, ranges[r].vertexCount);
+	PrintStage("Vertex cache", vertices, indices, ranges, SST_OS_GetMicroTime() - start);
+
+	start = SST_OS_GetMicroTime();
+	for(size_t r=0; r<ranges.Size(); r++)
+		MeshOptimizer_OptimizeOverdraw(&indices[ranges[r].indexOffset], ranges[r].indexCount, &vertices[ranges[r].vertexOffset], ranges[r].vertexCount);
+	PrintStage("+ overdraw", vertices, indices, ranges, SST_OS_GetMicroTime() - start);
+
+	start = SST_OS_GetMicroTime();
+	for(size_t r=0; r<ranges.Size(); r++)
+		MeshOptimizer_OptimizeVertexFetch(&vertices[ranges[r].vertexOffset], ranges[r].vertexCount, &indices[ranges[r].indexOffset], ranges[r].indexCount);
+	PrintStage("+ vertex fetch", vertices, indices, ranges, SST_OS_GetMicroTime() - start);
+}
+
+void MeshOptimizer_Benchmark(const char* path, uint32_t gridVertices)
+{
+	ZArray<OVR::RenderTiny::Vertex> vertices;
+	ZArray<uint32_t> indices;
+	ZArray<MeshRange> ranges;
+
+	{
+		AssetScene scene(NULL, NULL);
+		scene.Load(path, MESH_IMPORT_FLAGS, NULL, NULL);
+		if(Mesh::ConvertScene(scene.GetScene(), &vertices, &indices, &ranges))
+			BenchmarkMesh(path, vertices, indices, ranges);
+		else
+			printf("Mesh optimizer benchmark: couldn't import %s\n", path);
+	}
+
+	//A grid with its triangles and vertices shuffled, which is about as badly as a scanned mesh arrives
+	uint32_t w = (uint32_t)ceil(sqrt((double)gridVertices));
+	uint32_t h = gridVertices / w;
+	if(w < 2 || h < 2)
+		return;
+
+	ZArray<uint32_t> order;
+	order.Resize(w * h);
+	for(uint32_t v=0; v<w * h; v++)
+		order[v] = v;
+
+	uint32_t seed = 12345;
+	for(uint32_t v=w * h - 1; v>0; v--) {
+		seed = seed * 1664525u + 1013904223u;
+		uint32_t other = seed % (v + 1);
+		uint32_t swap = order[v]; order[v] = order[other]; order[other] = swap;
+	}
+
+	vertices.Resize(w * h);
+	for(uint32_t y=0; y<h; y++) {
+		for(uint32_t x=0; x<w; x++) {
+			OVR::RenderTiny::Vertex& v = vertices[order[y * w + x]];
+			v.Pos = OVR::Vector3f((float)x, 0.01f * (float)((x * 7 + y * 13) % 17), (float)y);
+			v.C = OVR::RenderTiny::Color(255, 255, 255, 255);
+			v.U = (float)x / w;
+			v.V = (float)y / h;
+			v.Norm = OVR::Vector3f(0, 1, 0);
+		}
+	}
+
+	uint32_t triangleCount = (w - 1) * (h - 1) * 2;
+	indices.Resize(triangleCount * 3);
+	for(uint32_t y=0; y+1<h; y++) {
+		for(uint32_t x=0; x+1<w; x++) {
+			uint32_t* quad = &indices[(y * (w - 1) + x) * 6];
+			uint32_t a = order[y * w + x];
+			uint32_t b = order[y * w + x + 1];
+			uint32_t c = order[(y + 1) * w + x];
+			uint32_t d = order[(y + 1) * w + x + 1];
+			quad[0] = a; quad[1] = c; quad[2] = b;
+			quad[3] = b; quad[4] = c; quad[5] = d;
+		}
+	}
+
+	for(uint32_t t=triangleCount - 1; t>0; t--) {
+		seed = seed * 1664525u + 1013904223u;
+		uint32_t other = seed % (t + 1);
+		for(int k=0; k<3; k++) {
+			uint32_t swap = indices[t*3+k]; indices[t*3+k] = indices[other*3+k]; indices[other*3+k] = swap;
+		}
+	}
+
+	MeshRange range;
+	range.indexOffset = 0;
+	range.indexCount = triangleCount * 3;
+	range.vertexOffset = 0;
+	range.vertexCount = w * h;
+	range.material = 0;
+	ranges.Clear();
+	ranges.PushBack(range);
+
+	char name[64];
+	sprintf(name, "shuffled %ux%u grid", w, h);
+	BenchmarkMesh(name, vertices, indices, ranges);
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <stddef.h>
+#include <pstdint.h>
+#include <ZSTL/ZArray.hpp>
+#include "RenderTiny_Device.h"
+
+#include "MeshFile.hpp"
+
+//Post-transform cache the triangle order is scored against, in vertices
+#define MESH_OPTIMIZER_CACHE_SIZE 32
+
+//FIFO cache MeshOptimizer_Simulate models by default, about what current GPUs keep after transform
+#define MESH_OPTIMIZER_SIMULATED_CACHE 16
+
+//Vertex fetch cache MeshOptimizer_Simulate models, in 64-byte lines
+#define MESH_OPTIMIZER_FETCH_LINES 256
+
+//The overdraw pass also ends a cluster wherever its ACMR so far comes within this factor of the ACMR
+//of the run of cache order it's in, after Sander, Nehab and Barczak, so there are clusters to sort
+#define MESH_OPTIMIZER_OVERDRAW_THRESHOLD 1.05f
+
+//Side of the depth buffer MeshOptimizer_SimulateOverdraw rasterizes each view into, in pixels
+#define MESH_OPTIMIZER_OVERDRAW_GRID 256
+
+//What a triangle order costs on a simulated GPU
+struct MeshCacheStats
+{
+	uint32_t triangles;
+	uint32_t vertices;
+	uint32_t transformed;		//Vertices the post-transform cache missed
+	float acmr;					//Average cache miss ratio, transformed per triangle; 0.5 at best, 3 at worst
+	float atvr;					//Average transformed vertex ratio, transformed per vertex; 1 at best
+	float overfetch;			//Bytes of vertex buffer fetched per byte of it; 1 at best
+};
+
+//Reorders the triangles of one range for post-transform cache locality, after Tom Forsyth's
+//linear-speed vertex cache optimisation. Indices are relative to the range's vertices.
+void MeshOptimizer_OptimizeVertexCache(uint32_t* indices, size_t indexCount, uint32_t vertexCount);
+
+//Reorders clusters of an already cache-optimised range so the ones facing out from its centre draw
+//first, which cuts overdraw from most views. Clusters break where the cache starts over and where a
+//cluster's ACMR is within MESH_OPTIMIZER_OVERDRAW_THRESHOLD of its run's, so the cache order within
+//them is kept at about the cost it had.
+void MeshOptimizer_OptimizeOverdraw(uint32_t* indices, size_t indexCount, const OVR::RenderTiny::Vertex* vertices, uint32_t vertexCount);
+
+//Reorders the vertices of one range into the order the triangles first use them, so fetching them
+//walks the vertex buffer forwards. Vertices nothing uses go last.
+void MeshOptimizer_OptimizeVertexFetch(OVR::RenderTiny::Vertex* vertices, uint32_t vertexCount, uint32_t* indices, size_t indexCount);
+
+//Optimises every range of a mesh: cache order, then overdraw if asked for, then fetch order
+void MeshOptimizer_Optimize(ZArray<OVR::RenderTiny::Vertex>* vertices, ZArray<uint32_t>* indices, const ZArray<MeshRange>& ranges,
+							bool overdraw);
+
+//Runs every range of a mesh through a FIFO post-transform cache of cacheSize vertices and a vertex
+//fetch cache, so a triangle order can be judged without a GPU
+void MeshOptimizer_Simulate(const ZArray<uint32_t>& indices, const ZArray<MeshRange>& ranges, uint32_t cacheSize, MeshCacheStats* statsReturn);
+
+//Draws every range of a mesh in order, with a depth test and back faces culled, from the six axis
+//directions, and returns the fragments shaded per pixel covered; 1 at best
+float MeshOptimizer_SimulateOverdraw(const ZArray<OVR::RenderTiny::Vertex>& vertices, const ZArray<uint32_t>& indices,
+									 const ZArray<MeshRange>& ranges);
+
+//Loads path, and a grid of gridVertices vertices with its triangles shuffled as a scanned mesh's tend to be,
+//and prints ACMR, ATVR, overfetch and overdraw as imported and after each pass in turn: cache, overdraw, fetch
+void MeshOptimizer_Benchmark(const char* path, uint32_t gridVertices);
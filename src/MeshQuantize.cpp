@@ -0,0 +1,226 @@
+#include "MeshQuantize.hpp"
+#include <math.h>
+#include <stdio.h>
+#include <SST/SST_Time.h>
+
+#include "AssetFileSystem.hpp"
+#include "Mesh.hpp"
+
+static uint16_t EncodeUnorm(float value, float offset, float scale)
+{
+	float f = (value - offset) / scale;
+	f = f < 0.0f ? 0.0f : (f > 1.0f ? 1.0f : f);
+	return (uint16_t)(f * 65535.0f + 0.5f);
+}
+
+static int16_t EncodeSnorm(float value)
+{
+	value = value < -1.0f ? -1.0f : (value > 1.0f ? 1.0f : value);
+	return (int16_t)floorf(value * 32767.0f + 0.5f);
+}
+
+//As the input assembler converts them
+static float DecodeSnorm(int16_t value)
+{
+	float f = (float)value / 32767.0f;
+	return f < -1.0f ? -1.0f : f;
+}
+
+//Folds the unit octahedron's lower half over its upper half, so a direction is two coordinates in [-1, 1]
+static void EncodeOctahedral(const OVR::Vector3f& normal, int16_t* encoded)
+{
+	float length = fabsf(normal.x) + fabsf(normal.y) + fabsf(normal.z);
+	if(length == 0.0f) {
+		encoded[0] = 0;
+		encoded[1] = 0;
+		return;
+	}
+
+	float x = normal.x / length;
+	float y = normal.y / length;
+	if(normal.z < 0.0f) {
+		float foldedX = (1.0f - fabsf(y)) * (x >= 0.0f ? 1.0f : -1.0f);
+		float foldedY = (1.0f - fabsf(x)) * (y >= 0.0f ? 1.0f : -1.0f);
+		x = foldedX;
+		y = foldedY;
+	}
+
+	encoded[0] = EncodeSnorm(x);
+	encoded[1] = EncodeSnorm(y);
+}
+
+//Same as DecodeOctahedral in the packed vertex shader
+static OVR::Vector3f DecodeOctahedral(const int16_t* encoded)
+{
+	float x = DecodeSnorm(encoded[0]);
+	float y = DecodeSnorm(encoded[1]);
+	float z = 1.0f - fabsf(x) - fabsf(y);
+	if(z < 0.0f) {
+		float unfoldedX = (1.0f - fabsf(y)) * (x >= 0.0f ? 1.0f : -1.0f);
+		float unfoldedY = (1.0f - fabsf(x)) * (y >= 0.0f ? 1.0f : -1.0f);
+		x = unfoldedX;
+		y = unfoldedY;
+	}
+
+	float length = sqrtf(x * x + y * y + z * z);
+	return OVR::Vector3f(x / length, y / length, z / length);
+}
+
+void MeshQuantize_ComputeBounds(const OVR::RenderTiny::Vertex* vertices, size_t count, MeshQuantization* quantizationReturn)
+{
+	float posMin[3] = { 0, 0, 0 }, posMax[3] = { 0, 0, 0 };
+	float uvMin[2] = { 0, 0 }, uvMax[2] = { 0, 0 };
+
+	for(size_t i=0; i<count; i++) {
+		const float pos[3] = { vertices[i].Pos.x, vertices[i].Pos.y, vertices[i].Pos.z };
+		const float uv[2] = { vertices[i].U, vertices[i].V };
+		for(int k=0; k<3; k++) {
+			if(i == 0 || pos[k] < posMin[k]) posMin[k] = pos[k];
+			if(i == 0 || pos[k] > posMax[k]) posMax[k] = pos[k];
+		}
+		for(int k=0; k<2; k++) {
+			if(i == 0 || uv[k] < uvMin[k]) uvMin[k] = uv[k];
+			if(i == 0 || uv[k] > uvMax[k]) uvMax[k] = uv[k];
+		}
+	}
+
+	//A flat axis still needs a scale to divide by; every vertex encodes to 0 on it
+	for(int k=0; k<3; k++) {
+		quantizationReturn->posOffset[k] = posMin[k];
+		quantizationReturn->posScale[k] = posMax[k] > posMin[k] ? posMax[k] - posMin[k] : 1.0f;
+	}
+	for(int k=0; k<2; k++) {
+		quantizationReturn->uvOffset[k] = uvMin[k];
+		quantizationReturn->uvScale[k] = uvMax[k] > uvMin[k] ? uvMax[k] - uvMin[k] : 1.0f;
+	}
+}
+
+void MeshQuantize_Encode(const OVR::RenderTiny::Vertex* vertices, size_t count, const MeshQuantization& quantization, PackedVertex* packedReturn)
+{
+	for(size_t i=0; i<count; i++) {
+		const OVR::RenderTiny::Vertex& v = vertices[i];
+		PackedVertex& p = packedReturn[i];
+
+		p.Pos[0] = EncodeUnorm(v.Pos.x, quantization.posOffset[0], quantization.posScale[0]);
+		p.Pos[1] = EncodeUnorm(v.Pos.y, quantization.posOffset[1], quantization.posScale[1]);
+		p.Pos[2] = EncodeUnorm(v.Pos.z, quantization.posOffset[2], quantization.posScale[2]);
+		p.Pos[3] = 65535;
+		EncodeOctahedral(v.Norm, p.Norm);
+		p.UV[0] = EncodeUnorm(v.U, quantization.uvOffset[0], quantization.uvScale[0]);
+		p.UV[1] = EncodeUnorm(v.V, quantization.uvOffset[1], quantization.uvScale[1]);
+	}
+}
+
+void MeshQuantize_Decode(const PackedVertex* packed, size_t count, const MeshQuantization& quantization, OVR::RenderTiny::Vertex* verticesReturn)
+{
+	for(size_t i=0; i<count; i++) {
+		const PackedVertex& p = packed[i];
+		OVR::RenderTiny::Vertex& v = verticesReturn[i];
+
+		v.Pos.x = quantization.posOffset[0] + (float)p.Pos[0] / 65535.0f * quantization.posScale[0];
+		v.Pos.y = quantization.posOffset[1] + (float)p.Pos[1] / 65535.0f * quantization.posScale[1];
+		v.Pos.z = quantization.posOffset[2] + (float)p.Pos[2] / 65535.0f * quantization.posScale[2];
+		v.C = OVR::RenderTiny::Color(255, 255, 255, 255);
+		v.U = quantization.uvOffset[0] + (float)p.UV[0] / 65535.0f * quantization.uvScale[0];
+		v.V = quantization.uvOffset[1] + (float)p.UV[1] / 65535.0f * quantization.uvScale[1];
+		v.Norm = DecodeOctahedral(p.Norm);
+	}
+}
+
+void MeshQuantize_Measure(const OVR::RenderTiny::Vertex* vertices, const PackedVertex* packed, size_t count,
+						  const MeshQuantization& quantization, MeshQuantizeError* errorReturn)
+{
+	double position = 0.0, normal = 0.0, uv = 0.0;
+	size_t normals = 0;
+	MeshQuantizeError& error = *errorReturn;
+	error.maxPosition = error.maxNormalDegrees = error.maxUV = 0.0f;
+
+	for(size_t i=0; i<count; i++) {
+		OVR::RenderTiny::Vertex decoded;
+		MeshQuantize_Decode(&packed[i], 1, quantization, &decoded);
+		const OVR::RenderTiny::Vertex& v = vertices[i];
+
+		float dx = decoded.Pos.x - v.Pos.x, dy = decoded.Pos.y - v.Pos.y, dz = decoded.Pos.z - v.Pos.z;
+		float d = sqrtf(dx * dx + dy * dy + dz * dz);
+		position += (double)d * d;
+		if(d > error.maxPosition) error.maxPosition = d;
+
+		float du = decoded.U - v.U, dv = decoded.V - v.V;
+		d = sqrtf(du * du + dv * dv);
+		uv += (double)d * d;
+		if(d > error.maxUV) error.maxUV = d;
+
+		float length = v.Norm.Length();
+		if(length > 0.0f) {
+			float cosine = v.Norm.Dot(decoded.Norm) / length;
+			cosine = cosine > 1.0f ? 1.0f : (cosine < -1.0f ? -1.0f : cosine);
+			float degrees = acosf(cosine) * (180.0f / 3.14159265f);
+			normal += (double)degrees * degrees;
+			normals++;
+			if(degrees > error.maxNormalDegrees) error.maxNormalDegrees = degrees;
+		}
+	}
+
+	error.rmsPosition = count > 0 ? (float)sqrt(position / count) : 0.0f;
+	error.rmsUV = count > 0 ? (float)sqrt(uv / count) : 0.0f;
+	error.rmsNormalDegrees = normals > 0 ? (float)sqrt(normal / normals) : 0.0f;
+}
+
+void MeshQuantize_Benchmark(const char* const* paths, uint32_t count)
+{
+	uint64_t fullBytes = 0;
+	uint64_t packedBytes = 0;
+
+	for(uint32_t m=0; m<count; m++)
+	{
+		ZArray<OVR::RenderTiny::Vertex> vertices;
+		ZArray<uint32_t> indices;
+		ZArray<MeshRange> ranges;
+
+		AssetScene scene(NULL, NULL);
+		scene.Load(paths[m], MESH_IMPORT_FLAGS, NULL, NULL);
+		if(!Mesh::ConvertScene(scene.GetScene(), &vertices, &indices, &ranges) || vertices.Size() == 0) {
+			printf("Mesh quantize benchmark: couldn't import %s\n", paths[m]);
+			continue;
+		}
+
+		MeshQuantization quantization;
+		ZArray<PackedVertex> packed;
+		ZArray<OVR::RenderTiny::Vertex> decoded;
+		packed.Resize(vertices.Size());
+		decoded.Resize(vertices.Size());
+
+		uint64_t start = SST_OS_GetMicroTime();
+		MeshQuantize_ComputeBounds(vertices.Data(), vertices.Size(), &quantization);
+		MeshQuantize_Encode(vertices.Data(), vertices.Size(), quantization, packed.Data());
+		uint64_t encodeMicros = SST_OS_GetMicroTime() - start;
+
+		start = SST_OS_GetMicroTime();
+		MeshQuantize_Decode(packed.Data(), packed.Size(), quantization, decoded.Data());
+		uint64_t decodeMicros = SST_OS_GetMicroTime() - start;
+
+		MeshQuantizeError error;
+		MeshQuantize_Measure(vertices.Data(), packed.Data(), vertices.Size(), quantization, &error);
+
+		float extent = sqrtf(quantization.posScale[0] * quantization.posScale[0] + quantization.posScale[1] * quantization.posScale[1] +
+							 quantization.posScale[2] * quantization.posScale[2]);
+
+		uint64_t full = vertices.Size() * sizeof(OVR::RenderTiny::Vertex);
+		uint64_t compact = packed.Size() * sizeof(PackedVertex);
+		fullBytes += full;
+		packedBytes += compact;
+
+		printf("Mesh quantize benchmark, %s: %u vertices, %.2f MB as %u-byte vertices, %.2f MB packed into %u bytes (%.0f%%)\n",
+			paths[m], (uint32_t)vertices.Size(), (double)full / (1024.0 * 1024.0), (uint32_t)sizeof(OVR::RenderTiny::Vertex),
+			(double)compact / (1024.0 * 1024.0), (uint32_t)sizeof(PackedVertex), 100.0 * (double)compact / (double)full);
+		printf("  Position error max %.6f, rms %.6f (%.5f%% of the bounds' diagonal)\n", error.maxPosition, error.rmsPosition,
+			extent > 0.0f ? 100.0f * error.maxPosition / extent : 0.0f);
+		printf("  Normal error max %.4f, rms %.4f degrees; UV error max %.6f, rms %.6f\n", error.maxNormalDegrees, error.rmsNormalDegrees,
+			error.maxUV, error.rmsUV);
+		printf("  Encoded in %.2f ms, decoded in %.2f ms\n", (double)encodeMicros / 1000.0, (double)decodeMicros / 1000.0);
+	}
+
+	if(fullBytes > 0)
+		printf("Mesh quantize benchmark: %.2f MB of vertices in all, %.2f MB packed\n", (double)fullBytes / (1024.0 * 1024.0),
+			(double)packedBytes / (1024.0 * 1024.0));
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <stddef.h>
+#include <pstdint.h>
+#include "RenderTiny_Device.h"
+
+/*
+Compact vertex, 16 bytes against OVR::RenderTiny::Vertex's 36. Positions are 16-bit unsigned
+fractions of the mesh's bounds (w is always 1), normals are octahedral-encoded into two signed
+16-bit fractions, and texture coordinates are 16-bit unsigned fractions of the mesh's UV bounds.
+Colour isn't kept; meshes are drawn white, as imports always make them. The renderer reads it
+as R16G16B16A16_UNORM, R16G16_SNORM and R16G16_UNORM and dequantizes in the vertex shader.
+*/
+struct PackedVertex
+{
+	uint16_t Pos[4];
+	int16_t Norm[2];
+	uint16_t UV[2];
+};
+
+//What maps a mesh's packed vertices back: value = offset + fraction * scale, per component
+struct MeshQuantization
+{
+	float posOffset[3];
+	float posScale[3];
+	float uvOffset[2];
+	float uvScale[2];
+};
+
+//How far packing moved a mesh's vertices
+struct MeshQuantizeError
+{
+	float maxPosition;			//In mesh units
+	float rmsPosition;
+	float maxNormalDegrees;		//Over vertices that had a normal
+	float rmsNormalDegrees;
+	float maxUV;
+	float rmsUV;
+};
+
+//Bounds of the positions and texture coordinates of count vertices
+void MeshQuantize_ComputeBounds(const OVR::RenderTiny::Vertex* vertices, size_t count, MeshQuantization* quantizationReturn);
+
+void MeshQuantize_Encode(const OVR::RenderTiny::Vertex* vertices, size_t count, const MeshQuantization& quantization, PackedVertex* packedReturn);
+
+//Unpacks into full vertices, as the vertex shader does, with colour white
+void MeshQuantize_Decode(const PackedVertex* packed, size_t count, const MeshQuantization& quantization, OVR::RenderTiny::Vertex* verticesReturn);
+
+//Compares count vertices against what they pack to and unpack as
+void MeshQuantize_Measure(const OVR::RenderTiny::Vertex* vertices, const PackedVertex* packed, size_t count,
+						  const MeshQuantization& quantization, MeshQuantizeError* errorReturn);
+
+//Loads each model, packs its vertices, and prints the bytes they take each way, the error packing
+//makes and the time encoding and decoding take
+void MeshQuantize_Benchmark(const char* const* paths, uint32_t count);
@@ -0,0 +1,483 @@
+#include "ObjDecoder.hpp"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <SST/SST_Time.h>
+
+#include "AssetConnection.hpp"
+
+using namespace OVR;
+using namespace OVR::RenderTiny;
+
+//Vertex table slots to start with; always a power of two
+#define VERTEX_TABLE_MIN 1024
+
+#define VERTEX_TABLE_EMPTY 0xFFFFFFFFFFFFFFFFULL
+
+//Faces without texture coordinates
+#define NO_TEX_COORD 0xFFFFFFFF
+
+static const double powersOf10[] = {
+	1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+	1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+static inline bool IsSpace(char c)
+{
+	return c == ' ' || c == '\t';
+}
+
+static inline bool IsDigit(char c)
+{
+	return c >= '0' && c <= '9';
+}
+
+static inline const char* SkipSpace(const char* p, const char* end)
+{
+	while(p < end && IsSpace(*p))
+		p++;
+	return p;
+}
+
+//Lines are parsed in place in the download blocks, which aren't terminated, so strtof can't be used
+static bool ParseFloat(const char** cursor, const char* end, float* valueReturn)
+{
+	const char* p = SkipSpace(*cursor, end);
+
+	bool negative = false;
+	if(p < end && (*p == '-' || *p == '+')) {
+		negative = (*p == '-');
+		p++;
+	}
+
+	double mantissa = 0.0;
+	int exponent = 0;
+	bool digits = false;
+
+	while(p < end && IsDigit(*p)) {
+		mantissa = mantissa * 10.0 + (*p - '0');
+		digits = true;
+		p++;
+	}
+
+	if(p < end && *p == '.') {
+		p++;
+		while(p < end && IsDigit(*p)) {
+			mantissa = mantissa * 10.0 + (*p - '0');
+			exponent--;
+			digits = true;
+			p++;
+		}
+	}
+
+	if(!digits)
+		return false;
+
+	if(p < end && (*p == 'e' || *p == 'E')) {
+		p++;
+
+		bool exponentNegative = false;
+		if(p < end && (*p == '-' || *p == '+')) {
+			exponentNegative = (*p == '-');
+			p++;
+		}
+
+		int e = 0;
+		while(p < end && IsDigit(*p)) {
+			if(e < 1000)
+				e = e * 10 + (*p - '0');
+			p++;
+		}
+
+		exponent += exponentNegative ? -e : e;
+	}
+
+	double value;
+	if(exponent >= 0)
+		value = exponent <= 22 ? mantissa * powersOf10[exponent] : mantissa * pow(10.0, exponent);
+	else
+		value = exponent >= -22 ? mantissa / powersOf10[-exponent] : mantissa * pow(10.0, exponent);
+
+	*valueReturn = (float)(negative ? -value : value);
+	*cursor = p;
+	return true;
+}
+
+//OBJ indices count from 1, or back from the last element if negative
+static bool ParseIndex(const char** cursor, const char* end, uint32_t count, uint32_t* indexReturn)
+{
+	const char* p = *cursor;
+
+	bool negative = false;
+	if(p < end && *p == '-') {
+		negative = true;
+		p++;
+	}
+
+	uint64_t n = 0;
+	const char* start = p;
+	while(p < end && IsDigit(*p)) {
+		if(n <= 0xFFFFFFFF)
+			n = n * 10 + (uint64_t)(*p - '0');
+		p++;
+	}
+
+	if(p == start || n == 0 || n > count)
+		return false;
+
+	*indexReturn = negative ? (uint32_t)(count - n) : (uint32_t)(n - 1);
+	*cursor = p;
+	return true;
+}
+
+static inline uint64_t HashVertexKey(uint64_t k)
+{
+	//Murmur3 finalizer
+	k ^= k >> 33;
+	k *= 0xFF51AFD7ED558CCDULL;
+	k ^= k >> 33;
+	k *= 0xC4CEB9FE1A85EC53ULL;
+	k ^= k >> 33;
+	return k;
+}
+
+ObjDecoder::ObjDecoder()
+	: lineNumber(0)
+{
+	vertexKeys.Resize(VERTEX_TABLE_MIN, VERTEX_TABLE_EMPTY);
+	vertexValues.Resize(VERTEX_TABLE_MIN, 0);
+}
+
+bool ObjDecoder::Decode(const char* data, size_t len)
+{
+	const char* p = data;
+	const char* end = data + len;
+
+	//Finish the line the last block ended in the middle of
+	if(!partial.Empty())
+	{
+		const char* newline = (const char*)memchr(p, '\n', len);
+		const char* stop = newline != NULL ? newline : end;
+
+		for(const char* c = p; c < stop; c++)
+			partial.PushBack(*c);
+
+		if(newline == NULL)
+			return true;
+
+		bool ok = ParseLine(partial.Data(), partial.Data() + partial.Size());
+		partial.Clear();
+		if(!ok)
+			return false;
+
+		p = newline + 1;
+	}
+
+	while(p < end)
+	{
+		const char* newline = (const char*)memchr(p, '\n', (size_t)(end - p));
+		if(newline == NULL) {
+			for(const char* c = p; c < end; c++)
+				partial.PushBack(*c);
+			break;
+		}
+
+		if(!ParseLine(p, newline))
+			return false;
+
+		p = newline + 1;
+	}
+
+	return true;
+}
+
+bool ObjDecoder::Finish()
+{
+	if(!partial.Empty()) {
+		bool ok = ParseLine(partial.Data(), partial.Data() + partial.Size());
+		partial.Clear();
+		if(!ok)
+			return false;
+	}
+
+	//Assimp fails on a file without faces too
+	return !indices.Empty();
+}
+
+bool ObjDecoder::ParseLine(const char* line, const char* end)
+{
+	lineNumber++;
+
+	const char* p = SkipSpace(line, end);
+	if(end > p && end[-1] == '\r')
+		end--;
+
+	if(end - p < 2 || !IsSpace(p[1]))
+	{
+		//"vt", or something that's ignored
+		if(end - p >= 3 && p[0] == 'v' && p[1] == 't' && IsSpace(p[2]))
+		{
+			float uv[2];
+			p += 2;
+			if(!ParseFloat(&p, end, &uv[0]))
+				return BadLine();
+
+			//A missing V is 0
+			if(!ParseFloat(&p, end, &uv[1]))
+				uv[1] = 0.0f;
+
+			texCoords.PushBack(uv[0]);
+			texCoords.PushBack(uv[1]);
+		}
+		return true;
+	}
+
+	if(p[0] == 'v')
+	{
+		float xyz[3];
+		p++;
+		if(!ParseFloat(&p, end, &xyz[0]) || !ParseFloat(&p, end, &xyz[1]) || !ParseFloat(&p, end, &xyz[2]))
+			return BadLine();
+
+		positions.PushBack(xyz[0]);
+		positions.PushBack(xyz[1]);
+		positions.PushBack(xyz[2]);
+		return true;
+	}
+
+	if(p[0] == 'f') {
+		if(!ParseFace(p + 1, end))
+			return BadLine();
+		return true;
+	}
+
+	return true;
+}
+
+bool ObjDecoder::BadLine() const
+{
+	printf("ObjDecoder: can't parse line %u\n", lineNumber);
+	return false;
+}
+
+bool ObjDecoder::ParseFace(const char* p, const char* end)
+{
+	uint32_t positionCount = (uint32_t)(positions.Size() / 3);
+	uint32_t texCoordCount = (uint32_t)(texCoords.Size() / 2);
+
+	uint32_t first = 0;
+	uint32_t previous = 0;
+	uint32_t corners = 0;
+
+	for(;;)
+	{
+		p = SkipSpace(p, end);
+		if(p >= end)
+			break;
+
+		uint32_t position;
+		uint32_t texCoord = NO_TEX_COORD;
+
+		//v, v/vt, v//vn or v/vt/vn
+		if(!ParseIndex(&p, end, positionCount, &position))
+			return false;
+
+		if(p < end && *p == '/') {
+			p++;
+			if(p < end && *p != '/' && !ParseIndex(&p, end, texCoordCount, &texCoord))
+				return false;
+
+			if(p < end && *p == '/') {
+				p++;
+				while(p < end && (*p == '-' || IsDigit(*p)))
+					p++;
+			}
+		}
+
+		if(p < end && !IsSpace(*p))
+			return false;
+
+		uint32_t index = AddVertex(position, texCoord);
+
+		//Fan from the first corner, like aiProcess_Triangulate
+		if(corners == 0)
+			first = index;
+		else if(corners >= 2) {
+			indices.PushBack(first);
+			indices.PushBack(previous);
+			indices.PushBack(index);
+		}
+
+		previous = index;
+		corners++;
+	}
+
+	return true;
+}
+
+uint32_t ObjDecoder::AddVertex(uint32_t position, uint32_t texCoord)
+{
+	uint64_t key = ((uint64_t)position << 32) | (texCoord == NO_TEX_COORD ? 0 : (uint64_t)texCoord + 1);
+
+	size_t mask = vertexKeys.Size() - 1;
+	size_t slot = (size_t)HashVertexKey(key) & mask;
+
+	while(vertexKeys.Data()[slot] != VERTEX_TABLE_EMPTY)
+	{
+		if(vertexKeys.Data()[slot] == key)
+			return vertexValues.Data()[slot];
+		slot = (slot + 1) & mask;
+	}
+
+	uint32_t index = (uint32_t)vertices.Size();
+	vertexKeys.Data()[slot] = key;
+	vertexValues.Data()[slot] = index;
+
+	//Same conversion as aiProcess_MakeLeftHanded and aiProcess_FlipUVs
+	const float* xyz = positions.Data() + position * 3;
+	Vertex v(Vector3f(xyz[0], xyz[1], -xyz[2]), Color(255, 255, 255, 255), 0.0f, 0.0f, Vector3f(0, 0, 0));
+	if(texCoord != NO_TEX_COORD) {
+		v.U = texCoords.Data()[texCoord * 2];
+		v.V = 1.0f - texCoords.Data()[texCoord * 2 + 1];
+	}
+	vertices.PushBack(v);
+
+	//Keep the table at most half full
+	if(vertices.Size() * 2 > vertexKeys.Size())
+		GrowVertexTable();
+
+	return index;
+}
+
+void ObjDecoder::GrowVertexTable()
+{
+	ZArray<uint64_t> oldKeys;
+	ZArray<uint32_t> oldValues;
+	oldKeys.Swap(vertexKeys);
+	oldValues.Swap(vertexValues);
+
+	size_t capacity = oldKeys.Size() * 2;
+	vertexKeys.Resize(capacity, VERTEX_TABLE_EMPTY);
+	vertexValues.Resize(capacity, 0);
+
+	size_t mask = capacity - 1;
+	for(size_t i=0; i<oldKeys.Size(); i++)
+	{
+		uint64_t key = oldKeys.Data()[i];
+		if(key == VERTEX_TABLE_EMPTY)
+			continue;
+
+		size_t slot = (size_t)HashVertexKey(key) & mask;
+		while(vertexKeys.Data()[slot] != VERTEX_TABLE_EMPTY)
+			slot = (slot + 1) & mask;
+
+		vertexKeys.Data()[slot] = key;
+		vertexValues.Data()[slot] = oldValues.Data()[i];
+	}
+}
+
+struct ObjBenchmarkState
+{
+	bool done;
+	bool ok;
+	char* data;
+	size_t size;
+	uint64_t lastByteMicros;
+	uint64_t readyMicros;
+};
+
+//Download then decode: keeps the body to decode after the transfer
+static void ObjBenchmarkBodyCallback(AssetFetch* fetch, void* userData)
+{
+	ObjBenchmarkState* state = (ObjBenchmarkState*)userData;
+
+	state->done = true;
+	state->ok = fetch->ok;
+	state->data = fetch->data;
+	state->size = fetch->size;
+	state->lastByteMicros = fetch->endMicros;
+	fetch->data = NULL;
+}
+
+//Decode while downloading
+static void ObjBenchmarkDecodedCallback(AssetFetch* fetch, void* userData)
+{
+	ObjBenchmarkState* state = (ObjBenchmarkState*)userData;
+
+	state->done = true;
+	state->ok = fetch->decoded;
+	state->size = fetch->size;
+	state->lastByteMicros = fetch->endMicros;
+	state->readyMicros = fetch->readyMicros;
+}
+
+void ObjDecoder_Benchmark(const char* host, const char* uri, uint32_t count)
+{
+	AssetConnection conn;
+	if(!conn.Initialize(host, 1)) {
+		printf("Decode benchmark: couldn't initialize\n");
+		conn.Shutdown();
+		return;
+	}
+
+	uint64_t serialMicros = 0, serialDownloadMicros = 0;
+	uint64_t streamMicros = 0, streamTailMicros = 0;
+	uint64_t bytes = 0;
+	uint32_t vertexCount = 0, triangleCount = 0;
+	bool failed = false;
+
+	for(uint32_t i=0; i<count; i++)
+	{
+		ObjBenchmarkState state;
+		memset(&state, 0, sizeof(state));
+
+		//Download, then decode
+		uint64_t start = SST_OS_GetMicroTime();
+		conn.FetchAsync(uri, ObjBenchmarkBodyCallback, &state);
+
+		while(!state.done) {
+			conn.Poll();
+			SST_Concurrency_SleepThread(1);
+		}
+
+		ObjDecoder serial;
+		failed |= !(state.ok && serial.Decode(state.data, state.size) && serial.Finish());
+		state.readyMicros = SST_OS_GetMicroTime();
+		free(state.data);
+
+		serialMicros += state.readyMicros - start;
+		serialDownloadMicros += state.lastByteMicros - start;
+		bytes = state.size;
+		vertexCount = (uint32_t)serial.GetVertices().Size();
+		triangleCount = (uint32_t)serial.GetIndices().Size() / 3;
+
+		//Decode while downloading
+		memset(&state, 0, sizeof(state));
+		ObjDecoder streamed;
+
+		start = SST_OS_GetMicroTime();
+		conn.FetchDecoded(uri, &streamed, ObjBenchmarkDecodedCallback, &state);
+
+		while(!state.done) {
+			conn.Poll();
+			SST_Concurrency_SleepThread(1);
+		}
+
+		failed |= !state.ok || streamed.GetIndices().Size() != serial.GetIndices().Size();
+		streamMicros += state.readyMicros - start;
+		streamTailMicros += state.readyMicros - state.lastByteMicros;
+	}
+
+	if(count == 0)
+		count = 1;
+
+	printf("Decode benchmark: %s (%.2f MB, %u vertices, %u triangles): download then decode %.1f ms (last byte at %.1f ms); "
+		"decode while downloading %.1f ms (ready %.1f ms after the last byte)%s\n",
+		uri, (double)bytes / (1024.0 * 1024.0), vertexCount, triangleCount,
+		(double)serialMicros / 1000.0 / count, (double)serialDownloadMicros / 1000.0 / count,
+		(double)streamMicros / 1000.0 / count, (double)streamTailMicros / 1000.0 / count,
+		failed ? ", SOME DECODES FAILED" : "");
+
+	conn.Shutdown();
+}
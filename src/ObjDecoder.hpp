@@ -0,0 +1,53 @@
+#pragma once
+
+#include <pstdint.h>
+#include <ZSTL/ZArray.hpp>
+#include "RenderTiny_Device.h"
+
+#include "AssetDecoder.hpp"
+
+/*
+Incremental Wavefront OBJ decoder. Reads positions, texture coordinates and faces as the
+text arrives and builds the same vertices Mesh::LoadFromOBJ gets from Assimp: polygons
+fanned into triangles, identical position/UV pairs shared, z mirrored and V flipped.
+Every object and group goes into the one mesh; normals, materials and the rest are ignored.
+*/
+class ObjDecoder : public AssetDecoder
+{
+	public:
+		ObjDecoder();
+
+		virtual bool Decode(const char* data, size_t len);
+		virtual bool Finish();
+
+		//Valid once Finish has returned true
+		const ZArray<OVR::RenderTiny::Vertex>& GetVertices() const { return vertices; }
+		const ZArray<uint32_t>& GetIndices() const { return indices; }
+
+	private:
+		bool ParseLine(const char* line, const char* end);
+		bool ParseFace(const char* p, const char* end);
+		bool BadLine() const;
+
+		//Index of the vertex for an OBJ position/UV pair, adding it the first time the pair is seen
+		uint32_t AddVertex(uint32_t position, uint32_t texCoord);
+		void GrowVertexTable();
+
+		ZArray<float> positions;		//xyz
+		ZArray<float> texCoords;		//uv
+
+		//Open addressing from packed position/UV pair to vertex index; ZHashMap allocates a node per entry
+		ZArray<uint64_t> vertexKeys;
+		ZArray<uint32_t> vertexValues;
+
+		ZArray<OVR::RenderTiny::Vertex> vertices;
+		ZArray<uint32_t> indices;
+
+		//Start of a line that ran past the end of the last block
+		ZArray<char> partial;
+		uint32_t lineNumber;
+};
+
+//Downloads uri 'count' times, once waiting for the whole body and then decoding it and once
+//decoding as it downloads, and prints the time until the mesh is ready for each
+void ObjDecoder_Benchmark(const char* host, const char* uri, uint32_t count);
@@ -24,6 +24,66 @@ limitations under the License.
 #include "OnizukaApp.h"
 #include "RenderTiny_D3D1X_Device.h"
 
+// Set to 1 to feed the sim connection from a local synthetic publisher instead of the sim server.
+#define SIM_LOCAL_TEST_PUBLISHER 0
+
+// Cells around the player the sim connection subscribes to when using the test publisher.
+#define SIM_TEST_INTEREST_RADIUS 2
+
+// Set to a path to record the received sim stream to a log there.
+#define SIM_RECORD_LOG NULL
+
+// Set to the path of a recorded log to replay it instead of connecting to the sim server,
+// at SIM_REPLAY_SPEED times the recorded rate (0 = as fast as it decodes).
+#define SIM_REPLAY_LOG NULL
+#define SIM_REPLAY_SPEED 1.0f
+
+// Message sizes the 'B' benchmark pushes through a sim connection, and how much of each.
+#define SIM_BENCHMARK_MESSAGE_SIZES { 1024, 65536, 4194304 }
+#define SIM_BENCHMARK_BYTES (256 * 1024 * 1024)
+
+// Assets the 'N' benchmark downloads from the asset server, one small and one large.
+#define ASSET_BENCHMARK_SMALL_URI "/files/1"
+#define ASSET_BENCHMARK_LARGE_URI "/files/2"
+
+// Copies of the small asset the 'N' benchmark fetches one at a time and as one bundle.
+#define ASSET_BENCHMARK_BUNDLE_COUNT 500
+
+// Copies of the small asset the 'N' benchmark walks through the in-memory cache.
+#define ASSET_BENCHMARK_MEMORY_COUNT 64
+
+// Bandwidth cap for the 'N' scheduler simulation, in bytes per second.
+#define ASSET_BENCHMARK_BANDWIDTH (1024 * 1024)
+
+// Assets of 1 MB up to 500 MB the 'M' benchmark downloads to compare download buffers.
+#define ASSET_BENCHMARK_DOWNLOAD_URIS { "/bytes/1048576", "/bytes/16777216", "/bytes/134217728", "/bytes/524288000" }
+
+// Large OBJ mesh the 'M' benchmark decodes after downloading and while downloading, and
+// downloads compressed and compresses for the cache.
+#define ASSET_BENCHMARK_MESH_URI "/files/3"
+
+// Large asset the 'M' benchmark downloads over one connection and as parallel ranges,
+// with this many connections dropped along the way.
+#define ASSET_BENCHMARK_RANGED_URI "/files/3"
+#define ASSET_BENCHMARK_RANGED_DROPS 4
+
+// OBJ the 'M' benchmark imports with its material libraries and textures, pulled as opened and prefetched.
+#define ASSET_BENCHMARK_SCENE_URI "/model/test2.obj"
+
+// Directory the 'G' benchmark writes its generated models to, and the meshes in its multi-part model.
+#define MESH_BENCHMARK_DIRECTORY "."
+#define MESH_BENCHMARK_SUBMESHES 200
+
+// Vertices of the grid the 'G' benchmark fits with 32-bit indices and by splitting into 16-bit ranges.
+#define MESH_BENCHMARK_INDEX_VERTICES 4000000
+
+// Model the 'G' benchmark runs through the import-time optimizer, along with a shuffled grid of this many vertices.
+#define MESH_BENCHMARK_OPTIMIZER_MODEL "../model/test2.obj"
+#define MESH_BENCHMARK_OPTIMIZER_VERTICES 1000000
+
+// Models the 'G' benchmark packs into quantized vertices, reporting their size and error.
+#define MESH_BENCHMARK_QUANTIZE_MODELS { "../model/test2.obj" }
+
 //-------------------------------------------------------------------------------------
 // ***** OculusRoomTiny Class
 
@@ -64,6 +124,12 @@ OnizukaApp::OnizukaApp(HINSTANCE hinst)
 
 OnizukaApp::~OnizukaApp()
 {
+	simConnection.Shutdown();
+	simTestPublisher.Stop();
+	assetConnection.Shutdown();
+	assetScheduler.Shutdown();
+	assetMemoryCache.Shutdown();
+
 	RemoveHandlerFromDevices();
     pSensor.Clear();
     pHMD.Clear();
@@ -85,12 +151,31 @@ int OnizukaApp::OnStartup(const char* args)
     }
 
 
-	if(!simConnection.Initialize())
+#if SIM_LOCAL_TEST_PUBLISHER
+	if(!simTestPublisher.Start(SIM_TEST_PUBLISHER_ENDPOINT, 50000, 0.05f, 20, true, 30, true))
+		return 1;
+
+	if(!simConnection.Initialize(SIM_TEST_PUBLISHER_ENDPOINT, SimWire_Binary, SIM_TEST_INTEREST_RADIUS, SIM_RECORD_LOG))
 		return 1;
+#else
+	const char* replayLog = SIM_REPLAY_LOG;
+	if(replayLog != NULL) {
+		if(!simConnection.InitializeReplay(replayLog, SIM_REPLAY_SPEED))
+			return 1;
+	} else if(!simConnection.Initialize(NULL, SimWire_Json, 0, SIM_RECORD_LOG)) {
+		return 1;
+	}
+#endif
 
 	if(!assetConnection.Initialize())
 		return 1;
 
+	if(!assetCache.Initialize(&assetConnection))
+		return 1;
+
+	assetMemoryCache.Initialize(&assetCache);
+	assetScheduler.Initialize(&assetConnection);
+
     // *** Oculus HMD & Sensor Initialization
 
     // Create DeviceManager and first available HMDDevice from it.
@@ -312,7 +397,80 @@ void OnizukaApp::OnKey(unsigned vk, bool down)
     case 'R':
         SFusion.Reset();
         break;
+
+    case 'I':
+        if (down)
+        {
+            simConnection.PrintStats();
+            assetConnection.PrintStats();
+            assetCache.PrintStats();
+            assetMemoryCache.PrintStats();
+            assetScheduler.PrintStats();
+#if SIM_LOCAL_TEST_PUBLISHER
+            simTestPublisher.PrintStats();
+#endif
+        }
+        break;
+
+    case 'B':
+        if (down)
+        {
+            SimInterpolator_Benchmark(50000, 100);
+            SimTestPublisher_Benchmark(50000, 0.05f, 200, 30);
+            SimCodec_Benchmark(10000, 50);
+            SimTestPublisher_InterestBenchmark(50000, 200, SIM_TEST_INTEREST_RADIUS);
+
+            const uint32_t sizes[] = SIM_BENCHMARK_MESSAGE_SIZES;
+            SimConnection_Benchmark(sizes, sizeof(sizes) / sizeof(sizes[0]), SIM_BENCHMARK_BYTES);
+        }
+        break;
+
+    case 'N':
+        if (down)
+        {
+            AssetConnection_Benchmark(NULL, ASSET_BENCHMARK_SMALL_URI, 100, ASSET_BENCHMARK_LARGE_URI, 10, ASSET_DEFAULT_TRANSFERS);
+
+            const char* uris[] = { ASSET_BENCHMARK_SMALL_URI, ASSET_BENCHMARK_LARGE_URI };
+            AssetCache_Benchmark(NULL, uris, 2);
+
+            AssetMemoryCache_Benchmark(NULL, ASSET_BENCHMARK_SMALL_URI, ASSET_BENCHMARK_MEMORY_COUNT);
+
+            AssetBundle_Benchmark(NULL, ASSET_BENCHMARK_SMALL_URI, ASSET_BENCHMARK_BUNDLE_COUNT);
+
+            AssetScheduler_Simulate(NULL, ASSET_BENCHMARK_SMALL_URI, 400, ASSET_BENCHMARK_BANDWIDTH);
+        }
+        break;
     
+    case 'M':
+        if (down)
+        {
+            const char* uris[] = ASSET_BENCHMARK_DOWNLOAD_URIS;
+            AssetConnection_DownloadBenchmark(NULL, uris, sizeof(uris) / sizeof(uris[0]));
+
+            ObjDecoder_Benchmark(NULL, ASSET_BENCHMARK_MESH_URI, 3);
+
+            AssetCompress_Benchmark(NULL, ASSET_BENCHMARK_MESH_URI);
+
+            AssetConnection_RangedBenchmark(NULL, ASSET_BENCHMARK_RANGED_URI, ASSET_BENCHMARK_RANGED_DROPS);
+
+            AssetScene_Benchmark(NULL, ASSET_BENCHMARK_SCENE_URI);
+        }
+        break;
+
+    case 'G':
+        if (down)
+        {
+            Mesh_Benchmark(pRender, MESH_BENCHMARK_DIRECTORY, MESH_BENCHMARK_SUBMESHES);
+
+            Mesh_IndexBenchmark(MESH_BENCHMARK_INDEX_VERTICES);
+
+            MeshOptimizer_Benchmark(MESH_BENCHMARK_OPTIMIZER_MODEL, MESH_BENCHMARK_OPTIMIZER_VERTICES);
+
+            const char* models[] = MESH_BENCHMARK_QUANTIZE_MODELS;
+            MeshQuantize_Benchmark(models, sizeof(models) / sizeof(models[0]));
+        }
+        break;
+
     case 'P':
         if (down)
         {
@@ -377,6 +535,7 @@ void OnizukaApp::OnIdle()
 
 
 	simConnection.ProcessMessages();
+	assetConnection.Poll();
 
     // Handle Sensor motion.
     // We extract Yaw, Pitch, Roll instead of directly using the orientation
@@ -443,6 +602,8 @@ void OnizukaApp::OnIdle()
         EyePos += orientationVector;
     }
 
+	//Only receive sim updates for the cells around the player
+	simConnection.SetInterestPosition(EyePos.x, EyePos.z);
 
     // Rotate and position View Camera, using YawPitchRoll in BodyFrame coordinates.
     // 
@@ -451,6 +612,9 @@ void OnizukaApp::OnIdle()
     Vector3f up      = rollPitchYaw.Transform(UpVector);
     Vector3f forward = rollPitchYaw.Transform(ForwardVector);
 
+	//Fetch what's nearest and in view first
+	assetScheduler.Update(&EyePos.x, &forward.x);
+
     
     // Minimal head modelling.
     float headBaseToEyeHeight     = 0.15f;  // Vertical height of eye from base of head
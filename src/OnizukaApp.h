@@ -32,7 +32,17 @@ limitations under the License.
 #include "RenderTiny_D3D1X_Device.h"
 
 #include "SimConnection.hpp"
+#include "SimTestPublisher.hpp"
 #include "AssetConnection.hpp"
+#include "AssetCache.hpp"
+#include "AssetCompress.hpp"
+#include "AssetBundle.hpp"
+#include "AssetScheduler.hpp"
+#include "AssetMemoryCache.hpp"
+#include "AssetFileSystem.hpp"
+#include "ObjDecoder.hpp"
+#include "MeshOptimizer.hpp"
+#include "MeshQuantize.hpp"
 
 using namespace OVR;
 using namespace OVR::RenderTiny;
@@ -48,6 +58,19 @@ using namespace OVR::RenderTiny;
 // The following keys work:
 //
 //  'W', 'S', 'A', 'D' - Move forward, back; strafe left/right.
+//  'I'                - Print sim and asset connection statistics.
+//  'B'                - Benchmark sim entity interpolation, delta updates and interest cells (50k entities),
+//                       binary against JSON decoding, and sim connection throughput with 1 KB, 64 KB
+//                       and 4 MB messages.
+//  'N'                - Benchmark serial against concurrent asset downloads, cold against warm asset cache,
+//                       shared in-memory assets against the disk cache, and asset requests in request
+//                       order against scheduled by view.
+//  'M'                - Benchmark download buffers on assets of 1 MB to 500 MB, decoding a mesh while it downloads,
+//                       and importing a model with its materials and textures prefetched.
+//  'G'                - Benchmark buffers and draw setup of a 200-part model, a buffer pair per part against shared,
+//                       a 4M-vertex mesh with 32-bit indices against split into 16-bit ranges, the simulated
+//                       vertex cache and overdraw before and after the import-time optimizer, and the
+//                       size and error of our models' vertices packed into the quantized format.
 //  F1 - No stereo, no distortion.
 //  F2 - Stereo, no distortion.
 //  F3 - Stereo and distortion.
@@ -129,7 +152,11 @@ protected:
 
 	// *** Network
 	SimConnection simConnection;
+	SimTestPublisher simTestPublisher;	//Only started with SIM_LOCAL_TEST_PUBLISHER
 	AssetConnection assetConnection;
+	AssetCache assetCache;
+	AssetMemoryCache assetMemoryCache;
+	AssetScheduler assetScheduler;
 
     // *** Rendering Variables
     Ptr<RenderDevice>   pRender;
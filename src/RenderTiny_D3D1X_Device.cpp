@@ -41,6 +41,14 @@ static D3D1x_(INPUT_ELEMENT_DESC) ModelVertexDesc[] =
     {"Normal",   0, DXGI_FORMAT_R32G32B32_FLOAT, 0, offsetof(Vertex, Norm),  D3D1x_(INPUT_PER_VERTEX_DATA), 0},
 };
 
+// Quantized vertex format of packed meshes; see PackedVertex.
+static D3D1x_(INPUT_ELEMENT_DESC) PackedVertexDesc[] =
+{
+    {"Position", 0, DXGI_FORMAT_R16G16B16A16_UNORM, 0, offsetof(PackedVertex, Pos),  D3D1x_(INPUT_PER_VERTEX_DATA), 0},
+    {"Normal",   0, DXGI_FORMAT_R16G16_SNORM,       0, offsetof(PackedVertex, Norm), D3D1x_(INPUT_PER_VERTEX_DATA), 0},
+    {"TexCoord", 0, DXGI_FORMAT_R16G16_UNORM,       0, offsetof(PackedVertex, UV),   D3D1x_(INPUT_PER_VERTEX_DATA), 0},
+};
+
 // These shaders are used to render the world, including lit vertex-colored and textured geometry.
 
 // Used for world geometry; has projection matrix.
@@ -66,6 +74,40 @@ static const char* StdVertexShaderSrc =
     "   ov.Color = Color;\n"
     "}\n";
 
+// Used for packed meshes; dequantizes against the mesh's bounds, then does what the world shader does.
+// The vertices have no color, so it's white.
+static const char* PackedVertexShaderSrc =
+    "float4x4 Proj;\n"
+    "float4x4 View;\n"
+    "float4 PosOffset;\n"
+    "float4 PosScale;\n"
+    "float4 UvOffsetScale;\n"
+    "struct Varyings\n"
+    "{\n"
+    "   float4 Position : SV_Position;\n"
+    "   float4 Color    : COLOR0;\n"
+    "   float2 TexCoord : TEXCOORD0;\n"
+    "   float3 Normal   : NORMAL;\n"
+    "   float3 VPos     : TEXCOORD4;\n"
+    "};\n"
+    "float3 DecodeOctahedral(float2 e)\n"
+    "{\n"
+    "   float3 n = float3(e.x, e.y, 1 - abs(e.x) - abs(e.y));\n"
+    "   if (n.z < 0)\n"
+    "       n.xy = (1 - abs(n.yx)) * (n.xy >= 0 ? 1 : -1);\n"
+    "   return normalize(n);\n"
+    "}\n"
+    "void main(in float4 Position : POSITION, in float2 Normal : NORMAL, in float2 TexCoord : TEXCOORD0,\n"
+    "          out Varyings ov)\n"
+    "{\n"
+    "   float4 pos = float4(PosOffset.xyz + Position.xyz * PosScale.xyz, 1);\n"
+    "   ov.Position = mul(Proj, mul(View, pos));\n"
+    "   ov.Normal = mul(View, DecodeOctahedral(Normal));\n"
+    "   ov.VPos = mul(View, pos);\n"
+    "   ov.TexCoord = UvOffsetScale.xy + TexCoord * UvOffsetScale.zw;\n"
+    "   ov.Color = float4(1, 1, 1, 1);\n"
+    "}\n";
+
 // Used for text/clearing; no projection.
 static const char* DirectVertexShaderSrc =
     "float4x4 View : register(c4);\n"
@@ -266,7 +308,8 @@ static const char* VShaderSrcs[VShader_Count] =
 {
     DirectVertexShaderSrc,
     StdVertexShaderSrc,
-    PostProcessVertexShaderSrc
+    PostProcessVertexShaderSrc,
+    PackedVertexShaderSrc
 };
 static const char* FShaderSrcs[FShader_Count] =
 {
@@ -487,9 +530,13 @@ RenderDevice::RenderDevice(const RendererParams& p, HWND window)
 
     ID3D10Blob* vsData = CompileShader("vs_4_0", DirectVertexShaderSrc);
     VertexShaders[VShader_MV] = *new VertexShader(this, vsData);
+    ID3D10Blob* packedVsData = NULL;
     for(int i = 1; i < VShader_Count; i++)
     {
-        VertexShaders[i] = *new VertexShader(this, CompileShader("vs_4_0", VShaderSrcs[i]));
+        ID3D10Blob* data = CompileShader("vs_4_0", VShaderSrcs[i]);
+        VertexShaders[i] = *new VertexShader(this, data);
+        if (i == VShader_Packed)
+            packedVsData = data;
     }
 
     for(int i = 0; i < FShader_Count; i++)
@@ -505,11 +552,24 @@ RenderDevice::RenderDevice(const RendererParams& p, HWND window)
                                                  buffer, bufferSize, objRef);
     OVR_UNUSED(validate);
 
+    if (packedVsData)
+    {
+        validate = Device->CreateInputLayout(PackedVertexDesc, sizeof(PackedVertexDesc)/sizeof(D3D1x_(INPUT_ELEMENT_DESC)),
+                                             packedVsData->GetBufferPointer(), packedVsData->GetBufferSize(),
+                                             &PackedVertexIL.GetRawRef());
+        OVR_UNUSED(validate);
+    }
+
     Ptr<ShaderSet> gouraudShaders = *new ShaderSet();
     gouraudShaders->SetShader(VertexShaders[VShader_MVP]);
     gouraudShaders->SetShader(PixelShaders[FShader_Gouraud]);
     DefaultFill = *new ShaderFill(gouraudShaders);
 
+    Ptr<ShaderSet> packedShaders = *new ShaderSet();
+    packedShaders->SetShader(VertexShaders[VShader_Packed]);
+    packedShaders->SetShader(PixelShaders[FShader_Gouraud]);
+    PackedFill = *new ShaderFill(packedShaders);
+
     D3D1x_(BLEND_DESC) bm;
     memset(&bm, 0, sizeof(bm));
     bm.BlendEnable[0] = true;
@@ -1116,7 +1176,8 @@ void RenderDevice::Render(const Matrix4f& matrix, Model* model)
     if (!model->IndexBuffer)
     {
         Buffer* ib = CreateBuffer();
-        ib->Data(Buffer_Index, &model->Indices[0], model->Indices.GetSize() * 2);
+        // Models are built through UInt16 indices, so always fit 16-bit index buffers.
+        ib->Data(Buffer_Index, &model->Indices[0], model->Indices.GetSize() * sizeof(UInt16));
         model->IndexBuffer = ib;
     }
 
@@ -1127,20 +1188,63 @@ void RenderDevice::Render(const Matrix4f& matrix, Model* model)
 
 void RenderDevice::Render(const Matrix4f& matrix, Mesh* mesh)
 {
-	Render(DefaultFill, mesh->GetVertexBuffer(), mesh->GetIndexBuffer(), matrix, 0, mesh->GetNumFaces()*3, Prim_Triangles);
+	const ZArray<MeshRange>& ranges = mesh->GetRanges();
+	if(ranges.Size() == 0)
+		return;
+
+	//A packed mesh is drawn with the packed layout and the bounds its vertices were quantized against
+	const MeshQuantization* quantization = mesh->GetQuantization();
+	const ShaderFill* fill = DefaultFill;
+	ID3D1xInputLayout* layout = ModelVertexIL;
+	unsigned stride = sizeof(Vertex);
+	if(quantization) {
+		ShaderSet* shaders = PackedFill->GetShaders();
+		shaders->SetUniform4f("PosOffset", quantization->posOffset[0], quantization->posOffset[1], quantization->posOffset[2], 0);
+		shaders->SetUniform4f("PosScale", quantization->posScale[0], quantization->posScale[1], quantization->posScale[2], 0);
+		shaders->SetUniform4f("UvOffsetScale", quantization->uvOffset[0], quantization->uvOffset[1], quantization->uvScale[0], quantization->uvScale[1]);
+
+		fill = PackedFill;
+		layout = PackedVertexIL;
+		stride = sizeof(PackedVertex);
+	}
+
+	//The shared buffers are bound once, and each range drawn from them
+	if(!SetupDraw(fill, mesh->GetVertexBuffer(), mesh->GetIndexBuffer(), matrix, 0, Prim_Triangles, layout, stride))
+		return;
+
+	for(size_t i=0; i<ranges.Size(); i++)
+		Context->DrawIndexed(ranges.Data()[i].indexCount, ranges.Data()[i].indexOffset, ranges.Data()[i].vertexOffset);
 }
 
 void RenderDevice::Render(const ShaderFill* fill,Buffer* vertices, Buffer* indices,
                           const Matrix4f& matrix, int offset, int count, PrimitiveType rprim)
 {
-    Context->IASetInputLayout(ModelVertexIL);
+    if (!SetupDraw(fill, vertices, indices, matrix, offset, rprim))
+        return;
+
+    if (indices)
+    {
+        Context->DrawIndexed(count, 0, 0);
+    }
+    else
+    {
+        Context->Draw(count, 0);
+    }
+}
+
+bool RenderDevice::SetupDraw(const ShaderFill* fill, Buffer* vertices, Buffer* indices,
+                             const Matrix4f& matrix, int offset, PrimitiveType rprim,
+                             ID3D1xInputLayout* layout, unsigned stride)
+{
+    Context->IASetInputLayout(layout ? layout : ModelVertexIL.GetPtr());
     if (indices)
     {
-        Context->IASetIndexBuffer(((Buffer*)indices)->GetBuffer(), DXGI_FORMAT_R16_UINT, 0);
+        DXGI_FORMAT format = (indices->Use & Buffer_Index32) ? DXGI_FORMAT_R32_UINT : DXGI_FORMAT_R16_UINT;
+        Context->IASetIndexBuffer(((Buffer*)indices)->GetBuffer(), format, 0);
     }
 
     ID3D1xBuffer* vertexBuffer = ((Buffer*)vertices)->GetBuffer();
-    UINT vertexStride = sizeof(Vertex);
+    UINT vertexStride = stride;
     UINT vertexOffset = offset;
     Context->IASetVertexBuffers(0, 1, &vertexBuffer, &vertexStride, &vertexOffset);
 
@@ -1178,20 +1282,12 @@ void RenderDevice::Render(const ShaderFill* fill,Buffer* vertices, Buffer* indic
         break;
     default:
         assert(0);
-        return;
+        return false;
     }
     Context->IASetPrimitiveTopology(prim);
 
     fill->Set(rprim);
-
-    if (indices)
-    {
-        Context->DrawIndexed(count, 0, 0);
-    }
-    else
-    {
-        Context->Draw(count, 0);
-    }
+    return true;
 }
 
 
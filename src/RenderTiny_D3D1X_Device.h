@@ -175,6 +175,7 @@ public:
     Ptr<ID3D1xDepthStencilState> DepthStates[1 + 2 * Compare_Count];
     Ptr<ID3D1xDepthStencilState> CurDepthState;
     Ptr<ID3D1xInputLayout>      ModelVertexIL;
+    Ptr<ID3D1xInputLayout>      PackedVertexIL;
 
     Ptr<ID3D1xSamplerState>     SamplerStates[Sample_Count];
 
@@ -190,6 +191,7 @@ public:
     Ptr<PixelShader>         PixelShaders[FShader_Count];  
    Buffer*             CommonUniforms[8];
     Ptr<ShaderFill>          DefaultFill;
+    Ptr<ShaderFill>          PackedFill;
 
     Buffer*              QuadVertexBuffer;
 
@@ -231,6 +233,12 @@ public:
     virtual void Render(const ShaderFill* fill, Buffer* vertices, Buffer* indices,
                         const Matrix4f& matrix, int offset, int count, PrimitiveType prim = Prim_Triangles);
 
+    // Binds everything Render binds, leaving only the draw call; false if prim isn't supported.
+    // The vertices are read through layout with stride, by default as Vertex.
+    bool SetupDraw(const ShaderFill* fill, Buffer* vertices, Buffer* indices,
+                   const Matrix4f& matrix, int offset, PrimitiveType prim,
+                   ID3D1xInputLayout* layout = NULL, unsigned stride = sizeof(Vertex));
+
     virtual ShaderFill *CreateSimpleFill() { return DefaultFill; }
 
     virtual RenderTiny::Shader *LoadBuiltinShader(ShaderStage stage, int shader);
@@ -70,7 +70,8 @@ enum BuiltinShaders
     VShader_MV                      = 0,
     VShader_MVP                     = 1,
     VShader_PostProcess             = 2,
-    VShader_Count                   = 3,
+    VShader_Packed                  = 3,
+    VShader_Count                   = 4,
 
     FShader_Solid                   = 0,
     FShader_Gouraud                 = 1,
@@ -98,6 +99,7 @@ enum BufferUsage
     Buffer_Uniform  = 4,
     Buffer_TypeMask = 0xff,
     Buffer_ReadOnly = 0x100, // Buffer must be created with Data().
+    Buffer_Index32  = 0x200, // With Buffer_Index, indices are 32-bit rather than 16-bit.
 };
 
 enum TextureFormat
@@ -0,0 +1,723 @@
+#include "SimCodec.hpp"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <jansson.h>
+#include <SST/SST_Endian.h>
+#include <SST/SST_Time.h>
+#include <SST/SST_Atomic.h>
+#include <SST/SST_Once.h>
+#include <SST/SST_TLS.h>
+
+//Wire data may not be aligned, so everything goes through memcpy
+static inline uint32_t ReadLE32(const unsigned char* p)
+{
+	uint32_t v;
+	memcpy(&v, p, sizeof(v));
+	return SST_OS_LEToHost32(v);
+}
+
+static inline uint16_t ReadLE16(const unsigned char* p)
+{
+	uint16_t v;
+	memcpy(&v, p, sizeof(v));
+	return SST_OS_LEToHost16(v);
+}
+
+static inline float ReadLEFloat(const unsigned char* p)
+{
+	uint32_t bits = ReadLE32(p);
+	float f;
+	memcpy(&f, &bits, sizeof(f));
+	return f;
+}
+
+static inline uint64_t ReadLE64(const unsigned char* p)
+{
+	uint64_t v;
+	memcpy(&v, p, sizeof(v));
+	return SST_OS_LEToHost64(v);
+}
+
+static inline void WriteLE64(unsigned char* p, uint64_t v)
+{
+	v = SST_OS_HostToLE64(v);
+	memcpy(p, &v, sizeof(v));
+}
+
+static inline void WriteLE32(unsigned char* p, uint32_t v)
+{
+	v = SST_OS_HostToLE32(v);
+	memcpy(p, &v, sizeof(v));
+}
+
+static inline void WriteLE16(unsigned char* p, uint16_t v)
+{
+	v = SST_OS_HostToLE16(v);
+	memcpy(p, &v, sizeof(v));
+}
+
+static inline void WriteLEFloat(unsigned char* p, float f)
+{
+	uint32_t bits;
+	memcpy(&bits, &f, sizeof(bits));
+	WriteLE32(p, bits);
+}
+
+int SimCodec_CellCoord(float v)
+{
+	return (int)floorf(v / SIM_CELL_SIZE);
+}
+
+void SimCodec_CellTopic(int cellX, int cellZ, char* out)
+{
+	static const char hex[] = "0123456789ABCDEF";
+
+	unsigned x = (unsigned)(cellX + 0x8000) & 0xFFFF;
+	unsigned z = (unsigned)(cellZ + 0x8000) & 0xFFFF;
+
+	out[0] = 'C';
+	for(int i=0; i<4; i++) {
+		out[1 + i] = hex[(x >> (12 - i*4)) & 0xF];
+		out[5 + i] = hex[(z >> (12 - i*4)) & 0xF];
+	}
+	out[SIM_CELL_TOPIC_LENGTH] = '\0';
+}
+
+size_t SimCodec_BinarySize(uint32_t count)
+{
+	return SIM_BINARY_HEADER_SIZE + (size_t)count * SIM_BINARY_ENTITY_SIZE;
+}
+
+size_t SimCodec_EncodeBinary(const SimMessageInfo& info, const SimEntityState* states, uint32_t count, void* out, size_t outSize)
+{
+	size_t size = SimCodec_BinarySize(count);
+	if(outSize < size)
+		return 0;
+
+	unsigned char* p = (unsigned char*)out;
+
+	WriteLE32(p, SIM_BINARY_MAGIC);
+	WriteLE16(p + 4, SIM_BINARY_VERSION);
+	WriteLE16(p + 6, (uint16_t)info.publisher);
+	WriteLE32(p + 8, count);
+	WriteLE32(p + 12, info.seq);
+	WriteLE64(p + 16, info.publishMicros);
+	p += SIM_BINARY_HEADER_SIZE;
+
+	for(uint32_t i=0; i<count; i++, p += 4)
+		WriteLE32(p, states[i].id);
+
+	for(uint32_t i=0; i<count; i++)
+		for(int j=0; j<3; j++, p += 4)
+			WriteLEFloat(p, states[i].pos[j]);
+
+	for(uint32_t i=0; i<count; i++)
+		for(int j=0; j<4; j++, p += 4)
+			WriteLEFloat(p, states[i].rot[j]);
+
+	for(uint32_t i=0; i<count; i++, p += 4)
+		WriteLE32(p, states[i].flags);
+
+	return size;
+}
+
+static void AppendText(ZArray<char>* out, const char* text, size_t len)
+{
+	size_t at = out->Size();
+	out->Resize(at + len);
+	memcpy(out->Data() + at, text, len);
+}
+
+void SimCodec_EncodeJson(const SimMessageInfo& info, const SimEntityState* states, uint32_t count, ZArray<char>* out)
+{
+	//Every field is bounded, so an entity always fits
+	char text[256];
+	int len;
+
+	out->Clear();
+	out->Reserve(64 + (size_t)count * 160);
+
+	len = sprintf(text, "{\"pub\":%u,\"seq\":%u,\"time\":%llu,\"entities\":[", info.publisher, info.seq,
+				  (unsigned long long)info.publishMicros);
+	AppendText(out, text, len);
+
+	for(uint32_t i=0; i<count; i++)
+	{
+		const SimEntityState& e = states[i];
+		len = sprintf(text, "%s{\"id\":%u,\"pos\":[%.9g,%.9g,%.9g],\"rot\":[%.9g,%.9g,%.9g,%.9g],\"flags\":%u}", i > 0 ? "," : "",
+					  e.id, e.pos[0], e.pos[1], e.pos[2], e.rot[0], e.rot[1], e.rot[2], e.rot[3], e.flags);
+		AppendText(out, text, len);
+	}
+
+	AppendText(out, "]}", 2);
+}
+
+size_t SimCodec_BinaryDeltaSize(const uint8_t* masks, uint32_t count)
+{
+	size_t size = SIM_DELTA_HEADER_SIZE + (size_t)count * 4 + (((size_t)count + 3) & ~(size_t)3);
+
+	for(uint32_t i=0; i<count; i++) {
+		if(masks[i] & SIM_FIELD_POS)
+			size += 3*4;
+		if(masks[i] & SIM_FIELD_ROT)
+			size += 4*4;
+		if(masks[i] & SIM_FIELD_FLAGS)
+			size += 4;
+	}
+
+	return size;
+}
+
+size_t SimCodec_EncodeBinaryDelta(const SimMessageInfo& info, const SimEntityState* states, const uint8_t* masks, uint32_t count, void* out, size_t outSize)
+{
+	size_t size = SimCodec_BinaryDeltaSize(masks, count);
+	if(outSize < size)
+		return 0;
+
+	unsigned char* p = (unsigned char*)out;
+
+	WriteLE32(p, SIM_DELTA_MAGIC);
+	WriteLE16(p + 4, SIM_BINARY_VERSION);
+	WriteLE16(p + 6, (uint16_t)info.publisher);
+	WriteLE32(p + 8, count);
+	WriteLE32(p + 12, info.seq);
+	WriteLE64(p + 16, info.publishMicros);
+	WriteLE32(p + 24, info.baselineSeq);
+	p += SIM_DELTA_HEADER_SIZE;
+
+	for(uint32_t i=0; i<count; i++, p += 4)
+		WriteLE32(p, states[i].id);
+
+	size_t maskBytes = ((size_t)count + 3) & ~(size_t)3;
+	memcpy(p, masks, count);
+	memset(p + count, 0, maskBytes - count);
+	p += maskBytes;
+
+	for(uint32_t i=0; i<count; i++)
+		if(masks[i] & SIM_FIELD_POS)
+			for(int j=0; j<3; j++, p += 4)
+				WriteLEFloat(p, states[i].pos[j]);
+
+	for(uint32_t i=0; i<count; i++)
+		if(masks[i] & SIM_FIELD_ROT)
+			for(int j=0; j<4; j++, p += 4)
+				WriteLEFloat(p, states[i].rot[j]);
+
+	for(uint32_t i=0; i<count; i++)
+		if(masks[i] & SIM_FIELD_FLAGS) {
+			WriteLE32(p, states[i].flags);
+			p += 4;
+		}
+
+	return size;
+}
+
+SimEntityState SimCodec_DefaultState(uint32_t id)
+{
+	SimEntityState state;
+	state.id = id;
+	state.pos[0] = state.pos[1] = state.pos[2] = 0.0f;
+	state.rot[0] = state.rot[1] = state.rot[2] = 0.0f;
+	state.rot[3] = 1.0f;
+	state.flags = 0;
+	return state;
+}
+
+uint8_t SimCodec_DiffEntity(const SimEntityState& base, const SimEntityState& state)
+{
+	uint8_t mask = 0;
+
+	//Exact comparison: a delta has to reproduce the publisher's state bit for bit
+	if(memcmp(base.pos, state.pos, sizeof(state.pos)) != 0)
+		mask |= SIM_FIELD_POS;
+	if(memcmp(base.rot, state.rot, sizeof(state.rot)) != 0)
+		mask |= SIM_FIELD_ROT;
+	if(base.flags != state.flags)
+		mask |= SIM_FIELD_FLAGS;
+
+	return mask;
+}
+
+static bool DecodeKeyframeBody(const unsigned char* p, size_t len, size_t headerSize, ZArray<SimEntityState>* out)
+{
+	//Compare against the payload size without multiplying 'count' so a bogus count can't overflow
+	uint32_t count = ReadLE32(p + 8);
+	if(count > (len - headerSize) / SIM_BINARY_ENTITY_SIZE) {
+		printf("Bad binary sim message: %u entities don't fit in %u bytes\n", count, (uint32_t)len);
+		return false;
+	}
+
+	const unsigned char* ids = p + headerSize;
+	const unsigned char* pos = ids + count * 4;
+	const unsigned char* rot = pos + count * 12;
+	const unsigned char* flags = rot + count * 16;
+
+	//Resize grows to exactly the size asked for, so appending message after message would copy everything each time
+	size_t base = out->Size();
+	if(out->Capacity() < base + count)
+		out->Reserve((base + count) * 2);
+	out->Resize(base + count);
+	SimEntityState* states = out->Data() + base;
+
+	for(uint32_t i=0; i<count; i++)
+		states[i].id = ReadLE32(ids + i*4);
+
+	for(uint32_t i=0; i<count; i++)
+		for(int j=0; j<3; j++)
+			states[i].pos[j] = ReadLEFloat(pos + (i*3 + j)*4);
+
+	for(uint32_t i=0; i<count; i++)
+		for(int j=0; j<4; j++)
+			states[i].rot[j] = ReadLEFloat(rot + (i*4 + j)*4);
+
+	for(uint32_t i=0; i<count; i++)
+		states[i].flags = ReadLE32(flags + i*4);
+
+	return true;
+}
+
+static bool DecodeDeltaBody(const unsigned char* p, size_t len, ZArray<SimEntityState>* out, ZArray<uint8_t>* masks)
+{
+	//Every entity takes at least an id and a mask byte
+	uint32_t count = ReadLE32(p + 8);
+	if(count > (len - SIM_DELTA_HEADER_SIZE) / 5) {
+		printf("Bad binary sim delta: %u entities don't fit in %u bytes\n", count, (uint32_t)len);
+		return false;
+	}
+
+	const unsigned char* ids = p + SIM_DELTA_HEADER_SIZE;
+	const unsigned char* maskBytes = ids + count * 4;
+	const unsigned char* fields = maskBytes + ((count + 3) & ~3u);
+
+	size_t nrPos = 0, nrRot = 0, nrFlags = 0;
+	for(uint32_t i=0; i<count; i++) {
+		nrPos += (maskBytes[i] & SIM_FIELD_POS) != 0;
+		nrRot += (maskBytes[i] & SIM_FIELD_ROT) != 0;
+		nrFlags += (maskBytes[i] & SIM_FIELD_FLAGS) != 0;
+	}
+
+	if(fields > p + len || (size_t)(p + len - fields) < nrPos*12 + nrRot*16 + nrFlags*4) {
+		printf("Bad binary sim delta: fields don't fit in %u bytes\n", (uint32_t)len);
+		return false;
+	}
+
+	const unsigned char* pos = fields;
+	const unsigned char* rot = pos + nrPos * 12;
+	const unsigned char* flags = rot + nrRot * 16;
+
+	size_t base = out->Size();
+	out->Resize(base + count);
+	SimEntityState* states = out->Data() + base;
+
+	size_t maskBase = masks->Size();
+	masks->Resize(maskBase + count);
+	memcpy(masks->Data() + maskBase, maskBytes, count);
+
+	for(uint32_t i=0; i<count; i++)
+	{
+		SimEntityState& state = states[i];
+		uint8_t mask = maskBytes[i];
+
+		state.id = ReadLE32(ids + i*4);
+		state.pos[0] = state.pos[1] = state.pos[2] = 0.0f;
+		state.rot[0] = state.rot[1] = state.rot[2] = state.rot[3] = 0.0f;
+		state.flags = 0;
+
+		if(mask & SIM_FIELD_POS) {
+			for(int j=0; j<3; j++)
+				state.pos[j] = ReadLEFloat(pos + j*4);
+			pos += 12;
+		}
+
+		if(mask & SIM_FIELD_ROT) {
+			for(int j=0; j<4; j++)
+				state.rot[j] = ReadLEFloat(rot + j*4);
+			rot += 16;
+		}
+
+		if(mask & SIM_FIELD_FLAGS) {
+			state.flags = ReadLE32(flags);
+			flags += 4;
+		}
+	}
+
+	return true;
+}
+
+bool SimCodec_DecodeBinary(const void* data, size_t len, SimMessageInfo* info, ZArray<SimEntityState>* out, ZArray<uint8_t>* masks)
+{
+	const unsigned char* p = (const unsigned char*)data;
+
+	if(len < SIM_BINARY_HEADER_SIZE_V1)
+		return false;
+
+	uint32_t magic = ReadLE32(p);
+	if(magic != SIM_BINARY_MAGIC && magic != SIM_DELTA_MAGIC) {
+		printf("Bad binary sim message: wrong magic\n");
+		return false;
+	}
+
+	uint16_t version = ReadLE16(p + 4);
+	size_t headerSize;
+	if(version == 1 && magic == SIM_BINARY_MAGIC) {
+		headerSize = SIM_BINARY_HEADER_SIZE_V1;
+		info->publisher = 0;
+		info->seq = 0;
+		info->publishMicros = 0;
+		info->hasSequence = false;
+	} else if(version == SIM_BINARY_VERSION && len >= SIM_BINARY_HEADER_SIZE) {
+		headerSize = SIM_BINARY_HEADER_SIZE;
+		info->publisher = ReadLE16(p + 6);
+		info->seq = ReadLE32(p + 12);
+		info->publishMicros = ReadLE64(p + 16);
+		info->hasSequence = true;
+	} else {
+		printf("Bad binary sim message: unsupported version %u\n", (unsigned)version);
+		return false;
+	}
+
+	if(magic == SIM_BINARY_MAGIC) {
+		info->type = SimMsg_Keyframe;
+		info->baselineSeq = 0;
+		return DecodeKeyframeBody(p, len, headerSize, out);
+	}
+
+	if(len < SIM_DELTA_HEADER_SIZE)
+		return false;
+
+	info->type = SimMsg_Delta;
+	info->baselineSeq = ReadLE32(p + 24);
+	return DecodeDeltaBody(p, len, out, masks);
+}
+
+void SimBaseline::Store(uint32_t keyframeSeq, const ZArray<SimEntityState>& states)
+{
+	seq = keyframeSeq;
+	valid = true;
+	entities.Clear();
+
+	for(size_t i=0; i<states.Size(); i++)
+		entities.Put(states.Data()[i].id, states.Data()[i]);
+}
+
+bool SimBaseline::Resolve(const SimMessageInfo& info, const ZArray<uint8_t>& masks, ZArray<SimEntityState>* states) const
+{
+	if(!valid || info.type != SimMsg_Delta || info.baselineSeq != seq)
+		return false;
+
+	for(size_t i=0; i<states->Size(); i++)
+	{
+		SimEntityState& state = states->Data()[i];
+		uint8_t mask = masks.Data()[i];
+
+		SimEntityState base;
+		SimEntityMap::Iterator itr = entities.Find(state.id);
+		if(itr != entities.End())
+			base = itr.GetValue();
+		else
+			base = SimCodec_DefaultState(state.id);
+
+		if(!(mask & SIM_FIELD_POS))
+			memcpy(state.pos, base.pos, sizeof(state.pos));
+		if(!(mask & SIM_FIELD_ROT))
+			memcpy(state.rot, base.rot, sizeof(state.rot));
+		if(!(mask & SIM_FIELD_FLAGS))
+			state.flags = base.flags;
+	}
+
+	return true;
+}
+
+//Set to 0 to let jansson allocate every node with malloc (allocations are still counted)
+#define SIM_JSON_ARENA 1
+
+//Starting arena size; it doubles whenever a message doesn't fit
+#define JSON_ARENA_INITIAL_SIZE (64 * 1024)
+
+/*
+Bump arena backing jansson while a sim message is decoded. Every node of the tree is
+carved out of one block and the whole block is reclaimed when the message is done, so
+decoding a message costs no heap traffic once the arena has grown to fit.
+
+json_set_alloc_funcs is global, so each thread that decodes gets its own arena through
+a TLS slot and the hooks dispatch to the calling thread's one. A tree must be freed by
+the thread that decoded it.
+*/
+struct JsonArena
+{
+	char* base;
+	size_t size;
+	size_t used;
+	size_t overflow;	//Bytes that didn't fit and went to malloc since the last reset
+	bool active;
+};
+
+static SST_Once jsonAllocOnce = SST_ONCE_INIT;
+static SST_TLS jsonArenaSlot;
+static volatile int jsonAllocations = 0;
+static volatile int jsonHeapAllocations = 0;	//Those that fell back to malloc
+static volatile int jsonArenaBytes = 0;		//Summed over every thread's arena
+
+static JsonArena* JsonArena_Current()
+{
+	return (JsonArena*)SST_Concurrency_GetTLSValue(jsonArenaSlot);
+}
+
+static void* JsonMalloc(size_t size)
+{
+	SST_Atomic_Inc(&jsonAllocations);
+
+	JsonArena* arena = JsonArena_Current();
+	if(arena != NULL && arena->active) {
+		size_t aligned = (size + 7) & ~(size_t)7;
+		if(arena->used + aligned <= arena->size) {
+			void* p = arena->base + arena->used;
+			arena->used += aligned;
+			return p;
+		}
+
+		arena->overflow += aligned;
+	}
+
+	SST_Atomic_Inc(&jsonHeapAllocations);
+	return malloc(size);
+}
+
+static void JsonFree(void* p)
+{
+	//Arena memory is reclaimed all at once by JsonArena_End
+	JsonArena* arena = JsonArena_Current();
+	if(arena != NULL && (char*)p >= arena->base && (char*)p < arena->base + arena->size)
+		return;
+
+	free(p);
+}
+
+static void JsonArena_Install(void*)
+{
+	jsonArenaSlot = SST_Concurrency_CreateTLS();
+	json_set_alloc_funcs(JsonMalloc, JsonFree);
+}
+
+static void JsonArena_Begin()
+{
+	SST_Concurrency_ExecOnce(&jsonAllocOnce, JsonArena_Install, NULL);
+
+#if SIM_JSON_ARENA
+	JsonArena* arena = JsonArena_Current();
+	if(arena == NULL) {
+		arena = (JsonArena*)calloc(1, sizeof(JsonArena));
+		if(arena == NULL)
+			return;
+
+		arena->base = (char*)malloc(JSON_ARENA_INITIAL_SIZE);
+		arena->size = arena->base ? JSON_ARENA_INITIAL_SIZE : 0;
+		SST_Atomic_Add(&jsonArenaBytes, (int)arena->size);
+		SST_Concurrency_SetTLSValue(jsonArenaSlot, arena);
+	}
+
+	arena->used = 0;
+	arena->overflow = 0;
+	arena->active = (arena->base != NULL);
+#endif
+}
+
+//Must only be called once nothing allocated since JsonArena_Begin is still referenced
+static void JsonArena_End()
+{
+	JsonArena* arena = JsonArena_Current();
+	if(arena == NULL)
+		return;
+
+	arena->active = false;
+
+	//Grow so the next message of this size fits entirely; nothing in the arena is live now
+	if(arena->overflow > 0) {
+		size_t newSize = arena->size;
+		while(newSize < arena->used + arena->overflow)
+			newSize *= 2;
+
+		char* newBase = (char*)malloc(newSize);
+		if(newBase != NULL) {
+			free(arena->base);
+			SST_Atomic_Add(&jsonArenaBytes, (int)newSize - (int)arena->size);
+			arena->base = newBase;
+			arena->size = newSize;
+		}
+	}
+
+	arena->used = 0;
+	arena->overflow = 0;
+}
+
+void SimCodec_ReleaseJsonArena()
+{
+	SST_Concurrency_ExecOnce(&jsonAllocOnce, JsonArena_Install, NULL);
+
+	JsonArena* arena = JsonArena_Current();
+	if(arena == NULL)
+		return;
+
+	SST_Atomic_Add(&jsonArenaBytes, -(int)arena->size);
+	SST_Concurrency_SetTLSValue(jsonArenaSlot, NULL);
+	free(arena->base);
+	free(arena);
+}
+
+uint32_t SimCodec_GetJsonAllocations()
+{
+	return (uint32_t)jsonAllocations;
+}
+
+uint32_t SimCodec_GetJsonHeapAllocations()
+{
+	return (uint32_t)jsonHeapAllocations;
+}
+
+size_t SimCodec_GetJsonArenaSize()
+{
+	return (size_t)SST_Atomic_LoadAcquire(&jsonArenaBytes);
+}
+
+static void ReadFloats(const json_t* array, float* out, size_t count)
+{
+	if(!json_is_array(array) || json_array_size(array) < count)
+		return;
+
+	for(size_t i=0; i<count; i++)
+		out[i] = (float)json_number_value(json_array_get(array, i));
+}
+
+//Messages look like {"pub":1, "seq":42, "time":123456789, "entities":[{"id":1, "pos":[x,y,z], "rot":[x,y,z,w], "flags":0}, ...]}
+bool SimCodec_DecodeJson(const char* data, size_t len, SimMessageInfo* info, ZArray<SimEntityState>* out)
+{
+	JsonArena_Begin();
+
+	json_error_t jerr;
+	json_t* root = json_loadb(data, len, 0, &jerr);
+	if(root == NULL) {
+		JsonArena_End();
+		printf("Bad sim message: %s (line %d)\n", jerr.text, jerr.line);
+		return false;
+	}
+
+	json_t* pub = json_object_get(root, "pub");
+	json_t* seq = json_object_get(root, "seq");
+	json_t* time = json_object_get(root, "time");
+
+	info->type = SimMsg_Keyframe;
+	info->baselineSeq = 0;
+	info->hasSequence = json_is_integer(seq);
+	info->publisher = json_is_integer(pub) ? (uint32_t)json_integer_value(pub) : 0;
+	info->seq = info->hasSequence ? (uint32_t)json_integer_value(seq) : 0;
+	info->publishMicros = json_is_integer(time) ? (uint64_t)json_integer_value(time) : 0;
+
+	json_t* list = json_object_get(root, "entities");
+	size_t count = json_array_size(list);
+
+	for(size_t i=0; i<count; i++)
+	{
+		json_t* e = json_array_get(list, i);
+		json_t* id = json_object_get(e, "id");
+		if(!json_is_integer(id))
+			continue;
+
+		SimEntityState state = SimCodec_DefaultState((uint32_t)json_integer_value(id));
+
+		ReadFloats(json_object_get(e, "pos"), state.pos, 3);
+		ReadFloats(json_object_get(e, "rot"), state.rot, 4);
+
+		json_t* flags = json_object_get(e, "flags");
+		if(json_is_integer(flags))
+			state.flags = (uint32_t)json_integer_value(flags);
+
+		out->PushBack(state);
+	}
+
+	json_decref(root);
+	JsonArena_End();
+	return true;
+}
+
+void SimCodec_Benchmark(uint32_t entityCount, uint32_t iterations)
+{
+	if(entityCount == 0 || iterations == 0)
+		return;
+
+	//Entities scattered and turned as a live world would be, so the JSON numbers are full length
+	ZArray<SimEntityState> states;
+	states.Resize(entityCount);
+	for(uint32_t i=0; i<entityCount; i++)
+	{
+		SimEntityState& state = states.Data()[i];
+		float angle = i * 0.37f;
+		state = SimCodec_DefaultState(i + 1);
+		state.pos[0] = (float)(i % 256) * 4.0f + 0.25f * sinf(angle);
+		state.pos[1] = 0.5f * cosf(angle * 3.0f);
+		state.pos[2] = (float)(i / 256) * 4.0f + 0.25f * cosf(angle);
+		state.rot[1] = sinf(angle * 0.5f);
+		state.rot[3] = cosf(angle * 0.5f);
+		state.flags = i & 3;
+	}
+
+	SimMessageInfo info;
+	info.type = SimMsg_Keyframe;
+	info.baselineSeq = 0;
+	info.publisher = 1;
+	info.seq = 1;
+	info.publishMicros = SST_OS_GetMicroTime();
+	info.hasSequence = true;
+
+	ZArray<unsigned char> binary;
+	binary.Resize(SimCodec_BinarySize(entityCount));
+	SimCodec_EncodeBinary(info, states.Data(), entityCount, binary.Data(), binary.Size());
+
+	ZArray<char> json;
+	SimCodec_EncodeJson(info, states.Data(), entityCount, &json);
+
+	ZArray<SimEntityState> decoded;
+	ZArray<uint8_t> masks;
+	SimMessageInfo decodedInfo;
+	decoded.Reserve(entityCount);
+
+	uint64_t micros[2] = { 0, 0 };
+	uint32_t failed[2] = { 0, 0 };
+
+	//Warm up both paths first, so the JSON arena has grown to fit and neither pays for first touches
+	for(uint32_t i=0; i<iterations + 1; i++)
+	{
+		decoded.Clear();
+		masks.Clear();
+		uint64_t start = SST_OS_GetMicroTime();
+		bool ok = SimCodec_DecodeBinary(binary.Data(), binary.Size(), &decodedInfo, &decoded, &masks);
+		uint64_t binaryMicros = SST_OS_GetMicroTime() - start;
+		ok = ok && decoded.Size() == entityCount;
+
+		decoded.Clear();
+		start = SST_OS_GetMicroTime();
+		bool jsonOk = SimCodec_DecodeJson(json.Data(), json.Size(), &decodedInfo, &decoded);
+		uint64_t jsonMicros = SST_OS_GetMicroTime() - start;
+		jsonOk = jsonOk && decoded.Size() == entityCount;
+
+		if(i == 0)
+			continue;
+
+		micros[0] += binaryMicros;
+		micros[1] += jsonMicros;
+		failed[0] += ok ? 0 : 1;
+		failed[1] += jsonOk ? 0 : 1;
+	}
+
+	//The render thread rarely decodes JSON, so don't keep an arena around for it
+	SimCodec_ReleaseJsonArena();
+
+	double perEntities = 10000.0 / ((double)entityCount * iterations);
+
+	printf("Sim codec decode benchmark: %u entities, %u iterations\n", entityCount, iterations);
+	printf("    binary: %.1f KB/message, %.1f us per 10k entities%s\n", (double)binary.Size() / 1024.0,
+		(double)micros[0] * perEntities, failed[0] ? ", DECODE FAILURES" : "");
+	printf("    JSON:   %.1f KB/message, %.1f us per 10k entities%s\n", (double)json.Size() / 1024.0,
+		(double)micros[1] * perEntities, failed[1] ? ", DECODE FAILURES" : "");
+}
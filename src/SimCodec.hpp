@@ -0,0 +1,152 @@
+#pragma once
+
+#include <stddef.h>
+#include <ZSTL/ZArray.hpp>
+#include <ZSTL/ZHashMap.hpp>
+
+#include "SimEntity.hpp"
+
+//Encoding used for entity updates on a sim connection
+enum SimWireFormat
+{
+	SimWire_Json,
+	SimWire_Binary
+};
+
+enum SimMessageType
+{
+	SimMsg_Keyframe,	//Full state for every entity the message lists
+	SimMsg_Delta		//Only the fields that differ from the keyframe numbered baselineSeq
+};
+
+//Per-message header carried by both wire formats
+struct SimMessageInfo
+{
+	SimMessageType type;
+	uint32_t baselineSeq;	//Deltas only
+	uint32_t publisher;		//Id of the message stream; a publisher sending several topics numbers each one separately
+	uint32_t seq;			//Increments by one per message from a publisher
+	uint64_t publishMicros;	//Publisher's clock when the message was sent
+	bool hasSequence;		//False for messages from publishers that predate sequencing
+};
+
+/*
+Binary entity update, all fields little-endian:
+
+	uint32_t magic			SIM_BINARY_MAGIC
+	uint16_t version		SIM_BINARY_VERSION
+	uint16_t publisher		(reserved, 0 in version 1)
+	uint32_t count
+	uint32_t seq			(version 2 and up)
+	uint64_t publishMicros	(version 2 and up)
+	uint32_t id[count]
+	float    pos[count][3]
+	float    rot[count][4]
+	uint32_t flags[count]
+
+Fields are stored as separate arrays so the decoder walks each one linearly.
+Version 1 messages are still accepted and decode with hasSequence == false.
+Every full message is a keyframe.
+
+Binary delta update, same header apart from the magic, then:
+
+	uint32_t baselineSeq	Keyframe the delta is relative to
+	uint32_t id[count]
+	uint8_t  mask[count]	SIM_FIELD_* bits, padded with zeros to a multiple of 4 bytes
+	float    pos[n][3]		One entry for each entity with SIM_FIELD_POS set, in id order
+	float    rot[n][4]		Likewise for SIM_FIELD_ROT
+	uint32_t flags[n]		Likewise for SIM_FIELD_FLAGS
+
+Deltas are relative to a keyframe rather than to the previous message, so later deltas
+still apply after one is lost. The lost delta itself isn't: the entities it changed stay
+stale until the next keyframe (SUB sockets can't ask the publisher for anything). Fields
+of an entity that isn't in the keyframe are relative to SimCodec_DefaultState.
+*/
+#define SIM_BINARY_MAGIC	0x455A4E4F	//"ONZE"
+#define SIM_DELTA_MAGIC		0x445A4E4F	//"ONZD"
+#define SIM_BINARY_VERSION	2
+
+#define SIM_BINARY_HEADER_SIZE_V1	12
+#define SIM_BINARY_HEADER_SIZE		24
+#define SIM_BINARY_ENTITY_SIZE		(4 + 3*4 + 4*4 + 4)
+#define SIM_DELTA_HEADER_SIZE		28
+
+#define SIM_FIELD_POS	0x01
+#define SIM_FIELD_ROT	0x02
+#define SIM_FIELD_FLAGS	0x04
+#define SIM_FIELD_ALL	(SIM_FIELD_POS | SIM_FIELD_ROT | SIM_FIELD_FLAGS)
+
+/*
+Interest management topics. Spatial publishers send each message as two frames,
+[topic][payload], where the topic names the grid cell its entities are in, so a
+subscriber's ZMQ prefix filter drops cells it isn't interested in. Cell topics are
+fixed width so no cell's topic is a prefix of another's. State that isn't tied to a
+place goes out on SIM_GLOBAL_TOPIC.
+*/
+#define SIM_CELL_SIZE		32.0f
+#define SIM_CELL_TOPIC_LENGTH	9	//'C', then x and z as 4 hex digits each, offset by 0x8000
+#define SIM_GLOBAL_TOPIC	"G"
+
+//Grid cell containing a world coordinate
+int SimCodec_CellCoord(float v);
+
+//Writes the topic for a cell into 'out', which must hold SIM_CELL_TOPIC_LENGTH + 1 chars
+void SimCodec_CellTopic(int cellX, int cellZ, char* out);
+
+//Number of bytes needed to encode 'count' entities
+size_t SimCodec_BinarySize(uint32_t count);
+
+//Encodes a message into 'out', which must hold SimCodec_BinarySize(count) bytes. Returns bytes written, or 0 if out is too small.
+size_t SimCodec_EncodeBinary(const SimMessageInfo& info, const SimEntityState* states, uint32_t count, void* out, size_t outSize);
+
+//Encodes a keyframe as a JSON message, as the sim server sends them, replacing the contents of 'out'.
+//The text is not NUL-terminated.
+void SimCodec_EncodeJson(const SimMessageInfo& info, const SimEntityState* states, uint32_t count, ZArray<char>* out);
+
+//Number of bytes needed to encode a delta with the given masks
+size_t SimCodec_BinaryDeltaSize(const uint8_t* masks, uint32_t count);
+
+//Encodes the fields selected by 'masks' of each entity as a delta against keyframe info.baselineSeq. Returns bytes written, or 0 if out is too small.
+size_t SimCodec_EncodeBinaryDelta(const SimMessageInfo& info, const SimEntityState* states, const uint8_t* masks, uint32_t count, void* out, size_t outSize);
+
+//State an entity is assumed to have when a delta references it but the keyframe doesn't
+SimEntityState SimCodec_DefaultState(uint32_t id);
+
+//SIM_FIELD_* bits for the fields of 'state' that differ from 'base'
+uint8_t SimCodec_DiffEntity(const SimEntityState& base, const SimEntityState& state);
+
+//Decoders fill in 'info', append to 'out' and return false if the message is malformed.
+//For deltas, the mask of each entity is appended to 'masks' and the fields it leaves out are zeroed;
+//SimBaseline::Resolve fills them in.
+//JSON messages are always keyframes and carry the header as top level "pub", "seq" and "time" fields.
+bool SimCodec_DecodeBinary(const void* data, size_t len, SimMessageInfo* info, ZArray<SimEntityState>* out, ZArray<uint8_t>* masks);
+bool SimCodec_DecodeJson(const char* data, size_t len, SimMessageInfo* info, ZArray<SimEntityState>* out);
+
+//The last keyframe from one publisher, which its deltas are applied against
+struct SimBaseline
+{
+	uint32_t seq;
+	bool valid;		//False until the first keyframe is stored
+	SimEntityMap entities;
+
+	SimBaseline() : seq(0), valid(false) { }
+
+	//Replaces the baseline with a decoded keyframe
+	void Store(uint32_t keyframeSeq, const ZArray<SimEntityState>& states);
+
+	//Fills in the fields a decoded delta left out. Returns false if the delta is relative to a different keyframe.
+	bool Resolve(const SimMessageInfo& info, const ZArray<uint8_t>& masks, ZArray<SimEntityState>* states) const;
+};
+
+//Total jansson allocations made by the JSON decoder, how many of them the arena couldn't serve and
+//went to malloc, and the combined size of every decoding thread's arena (0 if disabled).
+uint32_t SimCodec_GetJsonAllocations();
+uint32_t SimCodec_GetJsonHeapAllocations();
+size_t SimCodec_GetJsonArenaSize();
+
+//Frees the calling thread's JSON arena. Threads that decoded JSON call this before they exit.
+void SimCodec_ReleaseJsonArena();
+
+//Encodes the same update of entityCount entities in both wire formats, decodes each through its own
+//decoder 'iterations' times and prints the size and the decode cost per 10k entities side by side
+void SimCodec_Benchmark(uint32_t entityCount, uint32_t iterations);
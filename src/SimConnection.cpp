@@ -1,66 +1,707 @@
 #include "SimConnection.hpp"
 #include <zmq.h>
 #include <assert.h>
-#include <jansson.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <SST/SST_Time.h>
 
 
 #define HOST "10.0.0.148"
 #define PORT "4002"
 
-bool SimConnection::Initialize()
+//Set to 0 to receive and decode on the render thread inside ProcessMessages (the old behavior), for comparison
+#define SIM_THREADED_RECEIVE 1
+
+//How long the receive thread blocks waiting for traffic before checking for shutdown
+#define RECV_POLL_MS 100
+
+//Poll interval while a backlog is waiting for the render thread to free a batch
+#define RECV_BACKLOG_POLL_MS 1
+
+//Most replayed messages decoded before the batch is offered to the render thread, so fast replay still hands off in pieces
+#define REPLAY_DRAIN_LIMIT 256
+
+//How far SimConnection_Benchmark lets the publisher run ahead of the receiver, in bytes and in messages.
+//Kept well under ZMQ's default high water mark, which only sees reads every half of it, so PUB never drops.
+#define BENCHMARK_WINDOW_BYTES (32 * 1024 * 1024)
+#define BENCHMARK_WINDOW_MESSAGES 200
+
+//How long SimConnection_Benchmark waits for the subscription to reach the publisher
+#define BENCHMARK_CONNECT_MS 2000
+
+SimConnection::SimConnection()
+	: zmqContext(NULL), zmqSocket(NULL), recvThread(NULL), running(0), pending(NULL),
+	  processMicros(0), processCalls(0), recvMessages(0), recvBytes(0), startMicros(0),
+	  wireFormat(SimWire_Json), decodeMicros(0), decodedEntities(0),
+	  conflatedUpdates(0), appliedUpdates(0),
+	  droppedMessages(0), duplicateMessages(0), lateMessages(0), publisherResets(0), publisherCount(0),
+	  keyframeMessages(0), deltaMessages(0), discardedDeltas(0),
+	  interestRadius(0), interestCell(0), interestValid(0), subscribedX(0), subscribedZ(0),
+	  cellsSubscribed(false), subscriptionMoves(0),
+	  replaying(false), replaySpeed(1.0f), replayStartMicros(0), replayFirstTime(0), replayHasNext(false)
 {
+}
+
+bool SimConnection::Initialize(const char* endpoint, SimWireFormat format, int radius, const char* recordPath)
+{
+	if(endpoint == NULL)
+		endpoint = "tcp://" HOST ":" PORT;
+
+	wireFormat = format;
+	interestRadius = radius;
+
 	this->zmqContext = zmq_ctx_new();
 	assert(zmqContext != NULL);
 
 	this->zmqSocket = zmq_socket(zmqContext, ZMQ_SUB);
 	assert(zmqSocket != NULL);
 
-	if(zmq_setsockopt(zmqSocket, ZMQ_SUBSCRIBE, "", 0) != 0)
+	//With interest management, cells are added once the render thread reports a position
+	const char* topic = interestRadius > 0 ? SIM_GLOBAL_TOPIC : "";
+	if(zmq_setsockopt(zmqSocket, ZMQ_SUBSCRIBE, topic, strlen(topic)) != 0)
 		return false;
 
-	if(zmq_connect(zmqSocket, "tcp://" HOST ":" PORT) != 0)
+	if(zmq_connect(zmqSocket, endpoint) != 0)
+		return false;
+
+	if(recordPath != NULL && !recorder.Open(recordPath, wireFormat))
+		return false;
+
+	if(!StartReceiving())
 		return false;
 
 	printf("ZMQ initialized\n");
 
+	return true;
+}
 
+bool SimConnection::InitializeReplay(const char* path, float speed)
+{
+	if(!replay.Open(path))
+		return false;
+
+	wireFormat = replay.GetWireFormat();
+	interestRadius = 0;
+
+	replaying = true;
+	replaySpeed = speed;
+	replayHasNext = replay.Next(&replayNext);
+	replayFirstTime = replayHasNext ? replayNext.recvTime : 0;
+	replayStartMicros = SST_OS_GetMicroTime();
+
+	if(!StartReceiving())
+		return false;
+
+	if(speed > 0.0f)
+		printf("Replaying sim log %s at x%.2f speed\n", path, speed);
+	else
+		printf("Replaying sim log %s at full speed\n", path);
 
 	return true;
 }
 
-void SimConnection::ProcessMessages()
+bool SimConnection::StartReceiving()
+{
+	startMicros = SST_OS_GetMicroTime();
+
+	//Every batch except the one being filled starts out free
+	pending = &batchPool[0];
+	for(int i=1; i<SIM_BATCH_COUNT; i++)
+		freeQueue.Push(&batchPool[i]);
+
+#if SIM_THREADED_RECEIVE
+	//The socket is handed to the receive thread here and is not touched by the render thread again
+	running = 1;
+	recvThread = SST_Concurrency_CreateThread(ReceiveThreadMain, this);
+	if(recvThread == NULL) {
+		running = 0;
+		return false;
+	}
+#endif
+
+	return true;
+}
+
+int SimConnection::ReceiveThreadMain(void* arg)
+{
+	SimConnection* self = (SimConnection*)arg;
+
+	while(SST_Atomic_LoadAcquire(&self->running))
+	{
+		if(self->replaying) {
+			uint64_t wait = self->DrainReplay();
+			self->PublishPending();
+
+			//Same waits as the socket poll: long when idle, short while a backlog is waiting to be handed off
+			uint64_t ms = self->pending->entities.Empty() ? wait / 1000 : RECV_BACKLOG_POLL_MS;
+			if(ms > RECV_POLL_MS)
+				ms = RECV_POLL_MS;
+			if(ms > 0)
+				SST_Concurrency_SleepThread((uint32_t)ms);
+			continue;
+		}
+
+		self->UpdateSubscriptions();
+
+		zmq_pollitem_t item = { self->zmqSocket, 0, ZMQ_POLLIN, 0 };
+		long timeout = self->pending->entities.Empty() ? RECV_POLL_MS : RECV_BACKLOG_POLL_MS;
+
+		int rc = zmq_poll(&item, 1, timeout);
+		if(rc < 0) {
+			if(zmq_errno() == EINTR)
+				continue;
+
+			printf("zmq_poll failed: %s\n", zmq_strerror(zmq_errno()));
+			break;
+		}
+
+		if(rc > 0 && !self->DrainSocket())
+			break;
+
+		self->PublishPending();
+	}
+
+	SimCodec_ReleaseJsonArena();
+	return 0;
+}
+
+bool SimConnection::DrainSocket()
 {
-	char buf[4096];
+	//Frames are parsed in place out of ZMQ's buffer, so there is no size limit and no copy
+	zmq_msg_t msg;
+	zmq_msg_init(&msg);
+
+	bool ok = true;
 
 	//Read each message
-	bool done = false;
-	do {
+	for(;;) {
 
-		int nrBytes = zmq_recv(zmqSocket, buf, sizeof(buf), ZMQ_DONTWAIT);
+		int nrBytes = zmq_msg_recv(&msg, zmqSocket, ZMQ_DONTWAIT);
 
 		if(nrBytes < 0) {
-			if(errno != EAGAIN) {
+			if(zmq_errno() != EAGAIN) {
 				printf("Non-trivial error occurred.\n");
-				return;
+				ok = false;
 			}
-			else
-				done = true;
+			break;
+		}
+
+		recvBytes += zmq_msg_size(&msg);
+
+		//Spatial publishers send [topic][payload]; the topic has already done its job in the filter
+		if(zmq_msg_more(&msg))
+			continue;
+
+		uint64_t recvTime = SST_OS_GetMicroTime();
+		recvMessages++;
+
+		if(recorder.IsOpen())
+			recorder.Append(zmq_msg_data(&msg), zmq_msg_size(&msg), recvTime);
+
+		DecodeMessage((const char*)zmq_msg_data(&msg), zmq_msg_size(&msg), recvTime, pending);
+	}
+
+	zmq_msg_close(&msg);
+	return ok;
+}
+
+uint64_t SimConnection::DrainReplay()
+{
+	uint64_t now = SST_OS_GetMicroTime();
+
+	for(int i=0; replayHasNext && i<REPLAY_DRAIN_LIMIT; i++)
+	{
+		if(replaySpeed > 0.0f) {
+			uint64_t due = replayStartMicros + (uint64_t)((double)(replayNext.recvTime - replayFirstTime) / replaySpeed);
+			if(due > now)
+				return due - now;
+		}
+
+		//Messages are stamped with the time they're replayed, as if they'd just come off the socket
+		recvBytes += replayNext.length;
+		recvMessages++;
+		DecodeMessage(replayNext.data, replayNext.length, now, pending);
+
+		replayHasNext = replay.Next(&replayNext);
+		if(!replayHasNext)
+			printf("Sim replay finished after %u messages\n", recvMessages);
+	}
+
+	return replayHasNext ? 0 : (uint64_t)RECV_POLL_MS * 1000;
+}
+
+bool SimConnection::DecodeMessage(const char* data, size_t len, uint64_t recvTime, SimUpdateBatch* batch)
+{
+	uint64_t start = SST_OS_GetMicroTime();
+
+	decoded.Clear();
+	decodedMasks.Clear();
+
+	bool ok;
+	if(wireFormat == SimWire_Binary)
+		ok = SimCodec_DecodeBinary(data, len, &decodedInfo, &decoded, &decodedMasks);
+	else
+		ok = SimCodec_DecodeJson(data, len, &decodedInfo, &decoded);
+
+	decodeMicros += SST_OS_GetMicroTime() - start;
+	decodedEntities += (uint32_t)decoded.Size();
+
+	if(!ok)
+		return false;
+
+	uint64_t publishTime = 0;
+	if(decodedInfo.hasSequence && !TrackSequence(decodedInfo, recvTime, &publishTime))
+		return true;
+
+	if(!ResolveDelta())
+		return true;
+
+	ConflateInto(decoded, recvTime, publishTime, batch);
+	return true;
+}
+
+bool SimConnection::TrackSequence(const SimMessageInfo& info, uint64_t recvTime, uint64_t* publishTimeReturn)
+{
+	int64_t offset = (int64_t)(recvTime - info.publishMicros);
+
+	ZHashMap<uint32_t, SimPublisherState>::Iterator itr = publishers.Find(info.publisher);
+	if(itr == publishers.End()) {
+		//Anything older than the first message seen is treated as already received
+		SimPublisherState state;
+		state.lastSeq = info.seq;
+		state.window = ~(uint64_t)0;
+		state.clockOffset = offset;
+		state.subscriptions = subscriptionMoves;
+		publishers.Put(info.publisher, state);
+		publisherCount++;
+
+		*publishTimeReturn = recvTime;
+		return true;
+	}
+
+	SimPublisherState& pub = itr.GetValue();
+
+	//Signed difference so sequence numbers can wrap
+	int32_t diff = (int32_t)(info.seq - pub.lastSeq);
+	uint32_t age = (uint32_t)-diff;
+
+	if(diff <= 0 && age < SIM_SEQ_WINDOW) {
+		uint64_t bit = (uint64_t)1 << age;
+		if(pub.window & bit) {
+			duplicateMessages++;
+		} else {
+			//Arrived after a newer message; its state is already stale, so only count it
+			pub.window |= bit;
+			droppedMessages--;
+			lateMessages++;
+		}
+		return false;
+	}
+
+	if(diff <= 0) {
+		//Too far back to be a late message, assume the publisher restarted its sequence
+		publisherResets++;
+		pub.window = ~(uint64_t)0;
+		pub.clockOffset = offset;
+	} else if(pub.subscriptions != subscriptionMoves) {
+		//The subscribed cells changed since this publisher was last heard from, so the gap may be
+		//messages on a cell we weren't subscribed to. Re-base on this one rather than count them.
+		pub.window = ~(uint64_t)0;
+	} else {
+		droppedMessages += (uint32_t)(diff - 1);
+		pub.window = diff < SIM_SEQ_WINDOW ? (pub.window << diff) | 1 : 1;
+	}
+
+	pub.lastSeq = info.seq;
+	pub.subscriptions = subscriptionMoves;
+
+	//The fastest delivery seen is the best estimate of the clock offset plus minimum transit time
+	if(offset < pub.clockOffset)
+		pub.clockOffset = offset;
+
+	*publishTimeReturn = info.publishMicros + pub.clockOffset;
+	return true;
+}
+
+bool SimConnection::ResolveDelta()
+{
+	ZHashMap<uint32_t, SimBaseline*>::Iterator itr = baselines.Find(decodedInfo.publisher);
+
+	if(decodedInfo.type == SimMsg_Keyframe) {
+		keyframeMessages++;
+
+		//Copying every keyframe is only worth it once the publisher has shown it sends deltas
+		if(decodedInfo.hasSequence && itr != baselines.End())
+			itr.GetValue()->Store(decodedInfo.seq, decoded);
+		return true;
+	}
+
+	deltaMessages++;
+
+	if(itr == baselines.End()) {
+		//Start keeping keyframes; this delta and any until the next keyframe can't be applied
+		baselines.Put(decodedInfo.publisher, new SimBaseline());
+		discardedDeltas++;
+		return false;
+	}
+
+	if(!itr.GetValue()->Resolve(decodedInfo, decodedMasks, &decoded)) {
+		discardedDeltas++;
+		return false;
+	}
+
+	return true;
+}
+
+void SimConnection::ConflateInto(const ZArray<SimEntityState>& updates, uint64_t recvTime, uint64_t publishTime, SimUpdateBatch* batch)
+{
+	for(size_t i=0; i<updates.Size(); i++)
+	{
+		const SimEntityState& state = updates.Data()[i];
+
+		SimEntityIndexMap::Iterator itr = batch->slots.Find(state.id);
+		if(itr != batch->slots.End()) {
+			batch->entities.Data()[itr.GetValue()] = state;
+			batch->times.Data()[itr.GetValue()] = recvTime;
+			batch->publishTimes.Data()[itr.GetValue()] = publishTime;
+			conflatedUpdates++;
 		} else {
+			batch->slots.Put(state.id, (uint32_t)batch->entities.Size());
+			batch->entities.PushBack(state);
+			batch->times.PushBack(recvTime);
+			batch->publishTimes.PushBack(publishTime);
+		}
+	}
+}
+
+void SimConnection::SetInterestPosition(float x, float z)
+{
+	int cellX = SimCodec_CellCoord(x);
+	int cellZ = SimCodec_CellCoord(z);
+
+	//Both coordinates go in one int so the receive thread can't see half of an update
+	uint32_t packed = ((uint32_t)(cellX & 0xFFFF) << 16) | (uint32_t)(cellZ & 0xFFFF);
+	SST_Atomic_StoreRelease(&interestCell, (int)packed);
+	SST_Atomic_StoreRelease(&interestValid, 1);
+}
+
+static bool CellInRange(int x, int z, int centerX, int centerZ, int radius)
+{
+	return abs(x - centerX) <= radius && abs(z - centerZ) <= radius;
+}
+
+void SimConnection::SetCellSubscription(int cellX, int cellZ, bool subscribe)
+{
+	char topic[SIM_CELL_TOPIC_LENGTH + 1];
+	SimCodec_CellTopic(cellX, cellZ, topic);
+
+	if(zmq_setsockopt(zmqSocket, subscribe ? ZMQ_SUBSCRIBE : ZMQ_UNSUBSCRIBE, topic, SIM_CELL_TOPIC_LENGTH) != 0)
+		printf("Couldn't %s sim topic %s: %s\n", subscribe ? "subscribe to" : "unsubscribe from", topic, zmq_strerror(zmq_errno()));
+}
+
+void SimConnection::UpdateSubscriptions()
+{
+	if(interestRadius <= 0 || !SST_Atomic_LoadAcquire(&interestValid))
+		return;
+
+	uint32_t packed = (uint32_t)SST_Atomic_LoadAcquire(&interestCell);
+	int cellX = (int16_t)(packed >> 16);
+	int cellZ = (int16_t)(packed & 0xFFFF);
+
+	if(cellsSubscribed && cellX == subscribedX && cellZ == subscribedZ)
+		return;
+
+	int r = interestRadius;
+
+	//Add the new cells before dropping the old ones so nothing in both ranges lapses
+	for(int x = cellX - r; x <= cellX + r; x++)
+		for(int z = cellZ - r; z <= cellZ + r; z++)
+			if(!cellsSubscribed || !CellInRange(x, z, subscribedX, subscribedZ, r))
+				SetCellSubscription(x, z, true);
+
+	if(cellsSubscribed)
+		for(int x = subscribedX - r; x <= subscribedX + r; x++)
+			for(int z = subscribedZ - r; z <= subscribedZ + r; z++)
+				if(!CellInRange(x, z, cellX, cellZ, r))
+					SetCellSubscription(x, z, false);
+
+	subscribedX = cellX;
+	subscribedZ = cellZ;
+	cellsSubscribed = true;
+	subscriptionMoves++;
+}
+
+void SimConnection::PublishPending()
+{
+	if(pending->entities.Empty())
+		return;
+
+	//If the render thread hasn't returned a batch yet, keep accumulating into this one
+	SimUpdateBatch* next;
+	if(!freeQueue.Pop(&next))
+		return;
+
+	readyQueue.Push(pending);
+	pending = next;
+}
+
+void SimConnection::ApplyBatch(const SimUpdateBatch* batch)
+{
+	uint64_t now = SST_OS_GetMicroTime();
+
+	for(size_t i=0; i<batch->entities.Size(); i++)
+	{
+		const SimEntityState& state = batch->entities.Data()[i];
+		uint64_t recvTime = batch->times.Data()[i];
+		uint64_t publishTime = batch->publishTimes.Data()[i];
+
+		recvToApply.Add(now > recvTime ? now - recvTime : 0);
+		if(publishTime != 0)
+			publishToApply.Add(now > publishTime ? now - publishTime : 0);
+
+		SimEntityMap::Iterator itr = entities.Find(state.id);
+		if(itr != entities.End())
+			itr.GetValue() = state;
+		else
+			entities.Put(state.id, state);
+
+		//Publisher time spaces snapshots as the sim did, where receive time would add the network's jitter
+		interpolator.AddSnapshot(state, publishTime != 0 ? publishTime : recvTime);
+	}
+}
 
-			//If we get here, we have a valid message
-			printf("Got a message, %d bytes\n", nrBytes);
+void SimConnection::ProcessMessages()
+{
+	uint64_t start = SST_OS_GetMicroTime();
+
+#if !SIM_THREADED_RECEIVE
+	if(replaying) {
+		DrainReplay();
+	} else {
+		UpdateSubscriptions();
+		DrainSocket();
+	}
+	PublishPending();
+#endif
 
-			buf[nrBytes] = 0;
-			json_error_t jerr;
+	//Only pointer swaps happen here; decoding was done by the receive thread
+	SimUpdateBatch* batch;
+	while(readyQueue.Pop(&batch))
+	{
+		ApplyBatch(batch);
+		appliedUpdates += (uint32_t)batch->entities.Size();
 
-			json_t* root = json_loads(buf, 0, &jerr);
+		batch->Clear();
+		freeQueue.Push(batch);
+	}
+
+	interpolator.Sample(SST_OS_GetMicroTime());
+
+	processMicros += SST_OS_GetMicroTime() - start;
+	processCalls++;
+}
 
+void SimConnection::PrintStats() const
+{
+	//Receive counters are written by the receive thread; a slightly stale read is fine for reporting
+	double seconds = (double)(SST_OS_GetMicroTime() - startMicros) / 1000000.0;
+	uint32_t messages = recvMessages;
+	uint64_t bytes = recvBytes;
+	uint32_t decodedCount = decodedEntities;
+	uint32_t conflated = conflatedUpdates;
+
+	printf("SimConnection: %u frames, %.1f us/frame on render thread, %u entities\n",
+		processCalls, processCalls ? (double)processMicros / processCalls : 0.0, (uint32_t)entities.Size());
+	printf("SimConnection: received %u messages, %.2f MB (%.1f msg/s, %.2f MB/s)\n",
+		messages, (double)bytes / (1024.0 * 1024.0),
+		seconds > 0.0 ? messages / seconds : 0.0, seconds > 0.0 ? (double)bytes / (1024.0 * 1024.0) / seconds : 0.0);
+	printf("SimConnection: decoded %u %s entities, %.1f us per 10k entities, %.1f us/message\n",
+		decodedCount, wireFormat == SimWire_Binary ? "binary" : "JSON",
+		decodedCount ? (double)decodeMicros * 10000.0 / decodedCount : 0.0,
+		messages ? (double)decodeMicros / messages : 0.0);
+	if(wireFormat == SimWire_Json)
+		printf("SimConnection: %.1f JSON allocations/message, %.1f of them from the heap, %u KB arena\n",
+			messages ? (double)SimCodec_GetJsonAllocations() / messages : 0.0,
+			messages ? (double)SimCodec_GetJsonHeapAllocations() / messages : 0.0,
+			(uint32_t)(SimCodec_GetJsonArenaSize() / 1024));
+	printf("SimConnection: %u updates applied, %u superseded by newer updates before being applied\n",
+		appliedUpdates, conflated);
+	if(recorder.IsOpen())
+		printf("SimConnection: recorded %u messages, %.2f MB of log\n",
+			recorder.GetRecordCount(), (double)recorder.GetSize() / (1024.0 * 1024.0));
+	if(replaying)
+		printf("SimConnection: replaying at x%.2f speed (0 = full speed), %s\n",
+			replaySpeed, replayHasNext ? "in progress" : "finished");
+	if(interestRadius > 0)
+		printf("SimConnection: interest radius %d cells (%d cells subscribed), moved %u times\n",
+			interestRadius, (2*interestRadius + 1) * (2*interestRadius + 1), subscriptionMoves);
+	printf("SimConnection: %u keyframes, %u deltas, %u deltas discarded waiting for a keyframe\n",
+		keyframeMessages, deltaMessages, discardedDeltas);
+	printf("SimConnection: %u publishers, %u messages dropped, %u duplicate, %u late, %u sequence resets\n",
+		publisherCount, droppedMessages, duplicateMessages, lateMessages, publisherResets);
+	recvToApply.Print("SimConnection receive-to-apply");
+	publishToApply.Print("SimConnection publish-to-apply");
+
+	interpolator.PrintStats();
+}
+
+void SimConnection::Shutdown()
+{
+	if(recvThread != NULL) {
+		SST_Atomic_StoreRelease(&running, 0);
+		SST_Concurrency_WaitThread(recvThread, NULL);
+		SST_Concurrency_DestroyThread(recvThread);
+		recvThread = NULL;
+	}
+
+	recorder.Close();
+	replay.Close();
+
+	for(ZHashMap<uint32_t, SimBaseline*>::Iterator itr = baselines.Begin(); itr != baselines.End(); ++itr)
+		delete itr.GetValue();
+	baselines.Clear();
+
+	if(zmqSocket != NULL) {
+		int linger = 0;
+		zmq_setsockopt(zmqSocket, ZMQ_LINGER, &linger, sizeof(linger));
+		zmq_close(zmqSocket);
+		zmqSocket = NULL;
+	}
+
+	if(zmqContext != NULL) {
+		zmq_ctx_destroy(zmqContext);
+		zmqContext = NULL;
+	}
+}
+
+void SimConnection_Benchmark(const uint32_t* sizes, uint32_t sizeCount, uint64_t bytesPerSize)
+{
+	void* context = zmq_ctx_new();
+	void* socket = context != NULL ? zmq_socket(context, ZMQ_PUB) : NULL;
+	if(socket == NULL || zmq_bind(socket, SIM_BENCHMARK_ENDPOINT) != 0) {
+		printf("Sim connection benchmark couldn't bind %s: %s\n", SIM_BENCHMARK_ENDPOINT, zmq_strerror(zmq_errno()));
+		if(socket != NULL)
+			zmq_close(socket);
+		if(context != NULL)
+			zmq_ctx_destroy(context);
+		return;
+	}
+
+	ZArray<SimEntityState> states;
+	ZArray<unsigned char> message;
+
+	for(uint32_t s=0; s<sizeCount; s++)
+	{
+		//A keyframe of as many entities as fit in the size
+		uint32_t count = sizes[s] > SIM_BINARY_HEADER_SIZE ? (sizes[s] - SIM_BINARY_HEADER_SIZE) / SIM_BINARY_ENTITY_SIZE : 1;
+		if(count == 0)
+			count = 1;
+
+		states.Resize(count);
+		for(uint32_t i=0; i<count; i++)
+			states.Data()[i] = SimCodec_DefaultState(i + 1);
+
+		message.Resize(SimCodec_BinarySize(count));
+
+		uint32_t total = (uint32_t)(bytesPerSize / message.Size());
+		if(total == 0)
+			total = 1;
+		uint32_t window = (uint32_t)(BENCHMARK_WINDOW_BYTES / message.Size());
+		if(window > BENCHMARK_WINDOW_MESSAGES)
+			window = BENCHMARK_WINDOW_MESSAGES;
+		if(window == 0)
+			window = 1;
+
+		SimConnection* connection = new SimConnection();
+		if(!connection->Initialize(SIM_BENCHMARK_ENDPOINT, SimWire_Binary)) {
+			printf("Sim connection benchmark couldn't connect to %s\n", SIM_BENCHMARK_ENDPOINT);
+			connection->Shutdown();
+			delete connection;
+			break;
+		}
+
+		//Every message gets a sequence number of its own, or the connection would drop it as a duplicate
+		SimMessageInfo info;
+		info.type = SimMsg_Keyframe;
+		info.baselineSeq = 0;
+		info.publisher = 1;
+		info.seq = 0;
+		info.hasSequence = true;
+
+		//PUB drops everything until the subscription arrives, so probe until something gets through
+		uint64_t connectStart = SST_OS_GetMicroTime();
+		while(connection->GetReceivedMessages() == 0 && SST_OS_GetMicroTime() - connectStart < BENCHMARK_CONNECT_MS * 1000) {
+			info.publishMicros = SST_OS_GetMicroTime();
+			SimCodec_EncodeBinary(info, states.Data(), count, message.Data(), message.Size());
+			info.seq++;
+			zmq_send(socket, message.Data(), message.Size(), 0);
+
+			SST_Concurrency_SleepThread(10);
+			connection->ProcessMessages();
+		}
+
+		if(connection->GetReceivedMessages() == 0) {
+			printf("Sim connection benchmark: nothing arrived from %s\n", SIM_BENCHMARK_ENDPOINT);
+			connection->Shutdown();
+			delete connection;
+			break;
 		}
 
+		//Let the probes drain before counting
+		SST_Concurrency_SleepThread(50);
+		connection->ProcessMessages();
 
-	} while(!done);
+		uint32_t base = connection->GetReceivedMessages();
+		uint32_t sent = 0;
+		uint64_t start = SST_OS_GetMicroTime();
+		uint64_t lastSend = start;
+		uint64_t lastReceive = start;
+		uint32_t lastReceived = 0;
 
+		while(connection->GetReceivedMessages() - base < total)
+		{
+			uint32_t received = connection->GetReceivedMessages() - base;
+			if(received != lastReceived) {
+				lastReceived = received;
+				lastReceive = SST_OS_GetMicroTime();
+			}
 
+			if(sent < total && sent - received < window) {
+				info.publishMicros = SST_OS_GetMicroTime();
+				SimCodec_EncodeBinary(info, states.Data(), count, message.Data(), message.Size());
+				info.seq++;
 
+				if(zmq_send(socket, message.Data(), message.Size(), 0) >= 0) {
+					sent++;
+					lastSend = SST_OS_GetMicroTime();
+				}
+			} else {
+				//The render thread only applies what's been decoded, as it would each frame
+				connection->ProcessMessages();
 
-}
\ No newline at end of file
+				//Anything still missing this long after the last send and the last arrival was dropped
+				uint64_t now = SST_OS_GetMicroTime();
+				if(sent >= total && now - lastSend > (uint64_t)BENCHMARK_CONNECT_MS * 1000 && now - lastReceive > (uint64_t)BENCHMARK_CONNECT_MS * 1000)
+					break;
+			}
+		}
+
+		uint32_t received = connection->GetReceivedMessages() - base;
+		uint64_t micros = (received == total ? SST_OS_GetMicroTime() : lastReceive) - start;
+		double seconds = (double)micros / 1000000.0;
+
+		printf("Sim connection benchmark, %u-byte messages (%u entities): %u of %u received in %.0f ms, %.0f msg/s, %.1f MB/s\n",
+			(uint32_t)message.Size(), count, received, sent, seconds * 1000.0,
+			seconds > 0.0 ? received / seconds : 0.0,
+			seconds > 0.0 ? (double)received * message.Size() / (1024.0 * 1024.0) / seconds : 0.0);
+
+		connection->Shutdown();
+		delete connection;
+	}
+
+	int linger = 0;
+	zmq_setsockopt(socket, ZMQ_LINGER, &linger, sizeof(linger));
+	zmq_close(socket);
+	zmq_ctx_destroy(context);
+}
@@ -1,16 +1,207 @@
 #pragma once
 
+#include <SST/SST_Concurrency.h>
+#include <ZSTL/ZArray.hpp>
+#include <ZSTL/ZHashMap.hpp>
+
+#include "SimEntity.hpp"
+#include "SimCodec.hpp"
+#include "SimInterpolator.hpp"
+#include "SpscQueue.hpp"
+#include "LatencyHistogram.hpp"
+#include "SimLog.hpp"
+
+#define SIM_BATCH_COUNT 4
+
+//Local endpoint SimConnection_Benchmark publishes on
+#define SIM_BENCHMARK_ENDPOINT "tcp://127.0.0.1:4003"
+
+//Sequence numbers further than this behind the newest one are treated as a publisher restart
+#define SIM_SEQ_WINDOW 64
+
+//Sequencing state for one publisher, owned by the receive thread
+struct SimPublisherState
+{
+	uint32_t lastSeq;		//Newest sequence number seen
+	uint64_t window;		//Bit i is set if lastSeq - i has been received
+	int64_t clockOffset;	//Smallest (receive time - publish time) seen, maps publisher time onto our clock
+	uint32_t subscriptions;	//subscriptionMoves as of the newest message; a gap across a move isn't counted as drops
+};
+
+//Entity updates decoded by the receive thread, handed to the render thread as a unit.
+//Holds at most one update per entity; newer updates overwrite older ones in place.
+struct SimUpdateBatch
+{
+	ZArray<SimEntityState> entities;
+	ZArray<uint64_t> times;				//Receive time of each entry in entities
+	ZArray<uint64_t> publishTimes;		//Publish time of each entry on our clock, 0 if unknown
+	SimEntityIndexMap slots;			//Entity id -> index into entities
+
+	void Clear()
+	{
+		entities.Clear();
+		times.Clear();
+		publishTimes.Clear();
+		slots.Clear();
+	}
+};
+
 class SimConnection
 {
 	public:
-		//Connect to server
-		bool Initialize();
+		SimConnection();
+
+		//Connect to server and start the receive thread. If endpoint is NULL the default sim server is used.
+		//With an interest radius, only the global topic and the cells within that many cells of
+		//SetInterestPosition are subscribed to; with 0, everything is.
+		//With a record path, every message received is also appended to a SimLog there.
+		bool Initialize(const char* endpoint = NULL, SimWireFormat format = SimWire_Json, int interestRadius = 0,
+						const char* recordPath = NULL);
 
+		//Feeds a recorded SimLog through the receive thread instead of a socket, at 'speed' times
+		//the recorded rate. A speed of 0 replays as fast as the messages can be decoded.
+		//Publish-to-apply latency only means anything at a speed of 1.
+		bool InitializeReplay(const char* path, float speed = 1.0f);
+
+		//Moves the center of the subscribed cells. Called from OnIdle; the receive thread updates the subscriptions.
+		void SetInterestPosition(float x, float z);
+
+		//Applies updates decoded by the receive thread. Called once per frame from OnIdle.
 		void ProcessMessages();
 
 		void Shutdown();
 
+		//Latest state received for each entity
+		const SimEntityMap& GetEntities() const { return entities; }
+
+		//Entity states interpolated for this frame, SimInterpolator::GetDelay() behind the present
+		const ZArray<SimEntityState>& GetInterpolatedEntities() const { return interpolator.GetSampled(); }
+		void SetInterpolationDelay(uint64_t micros) { interpolator.SetDelay(micros); }
+
+		//Render thread time spent in ProcessMessages, for comparing against the inline path
+		uint64_t GetProcessMicros() const { return processMicros; }
+		uint32_t GetProcessCalls() const { return processCalls; }
+		uint32_t GetReceivedMessages() const { return recvMessages; }
+		void PrintStats() const;
+
 	private:
+		static int ReceiveThreadMain(void* arg);
+
+		//Sets up the batches and starts the receive thread once the message source is ready
+		bool StartReceiving();
+
+		//Reads every message currently waiting on the socket into the pending batch
+		bool DrainSocket();
+		//Decodes every replayed message that is due. Returns how long until the next one is.
+		uint64_t DrainReplay();
+
+		bool DecodeMessage(const char* data, size_t len, uint64_t recvTime, SimUpdateBatch* batch);
+
+		//Updates gap/duplicate/late counters for a message. Returns false if the message should be discarded.
+		bool TrackSequence(const SimMessageInfo& info, uint64_t recvTime, uint64_t* publishTimeReturn);
+
+		//Keeps keyframes for publishers that send deltas and fills in the fields deltas leave out.
+		//Returns false if a delta can't be applied until the next keyframe.
+		bool ResolveDelta();
+
+		//Folds decoded updates into a batch, keeping only the latest state per entity
+		void ConflateInto(const ZArray<SimEntityState>& updates, uint64_t recvTime, uint64_t publishTime, SimUpdateBatch* batch);
+
+		//Subscribes to the cells around the latest interest position and drops the ones out of range
+		void UpdateSubscriptions();
+		void SetCellSubscription(int cellX, int cellZ, bool subscribe);
+
+		//Hands the pending batch to the render thread if a free batch is available to replace it
+		void PublishPending();
+
+		void ApplyBatch(const SimUpdateBatch* batch);
+
 		void* zmqContext;
 		void* zmqSocket;
-};
\ No newline at end of file
+
+		SST_Thread recvThread;
+		volatile int running;
+
+		//Batches cycle recv thread -> readyQueue -> render thread -> freeQueue -> recv thread.
+		//The receive thread always owns 'pending', so it can keep draining the socket while the render thread is behind.
+		SimUpdateBatch batchPool[SIM_BATCH_COUNT];
+		SimUpdateBatch* pending;
+		SpscQueue<SimUpdateBatch*, SIM_BATCH_COUNT+1> readyQueue;
+		SpscQueue<SimUpdateBatch*, SIM_BATCH_COUNT+1> freeQueue;
+
+		//Receive thread scratch space for a single decoded message
+		ZArray<SimEntityState> decoded;
+		ZArray<uint8_t> decodedMasks;
+		SimMessageInfo decodedInfo;
+
+		ZHashMap<uint32_t, SimPublisherState> publishers;
+
+		//Keyframes deltas are applied against, only kept for publishers that have sent a delta
+		ZHashMap<uint32_t, SimBaseline*> baselines;
+
+		SimEntityMap entities;
+		SimInterpolator interpolator;
+
+		uint64_t processMicros;
+		uint32_t processCalls;
+
+		//Receive throughput, written only by the receive thread
+		volatile uint32_t recvMessages;
+		volatile uint64_t recvBytes;
+		uint64_t startMicros;
+
+		//Decode cost, written only by the receive thread
+		SimWireFormat wireFormat;
+		uint64_t decodeMicros;
+		volatile uint32_t decodedEntities;
+
+		//Updates superseded by a newer one for the same entity before the render thread saw them
+		volatile uint32_t conflatedUpdates;
+
+		//Updates applied to the entity table, written only by the render thread
+		uint32_t appliedUpdates;
+
+		//Sequencing, written only by the receive thread. A late message that fills a gap is moved from dropped to late.
+		volatile uint32_t droppedMessages;
+		volatile uint32_t duplicateMessages;
+		volatile uint32_t lateMessages;
+		volatile uint32_t publisherResets;
+		volatile uint32_t publisherCount;
+
+		//Message kinds, written only by the receive thread
+		volatile uint32_t keyframeMessages;
+		volatile uint32_t deltaMessages;
+		volatile uint32_t discardedDeltas;	//Arrived without the keyframe they're relative to
+
+		//Interest management. The render thread publishes its cell as packed 16-bit x and z;
+		//the socket and the subscribed range belong to the receive thread.
+		int interestRadius;
+		volatile int interestCell;
+		volatile int interestValid;
+		int subscribedX;
+		int subscribedZ;
+		bool cellsSubscribed;
+		volatile uint32_t subscriptionMoves;
+
+		//Capture of the received stream, written only by the receive thread
+		SimLogWriter recorder;
+
+		//Replay in place of the socket, read only by the receive thread. Recorded times are
+		//rescaled onto our clock from the moment replay starts.
+		SimLogReader replay;
+		bool replaying;
+		float replaySpeed;
+		uint64_t replayStartMicros;
+		uint64_t replayFirstTime;
+		SimLogRecord replayNext;
+		bool replayHasNext;
+
+		//Per-update latencies measured when the update is applied, written only by the render thread.
+		//Publish-to-apply is relative to the fastest delivery seen from each publisher, since the clocks aren't synchronized.
+		LatencyHistogram recvToApply;
+		LatencyHistogram publishToApply;
+};
+
+//Publishes binary keyframes of about each of sizes[] bytes to a SimConnection over SIM_BENCHMARK_ENDPOINT,
+//bytesPerSize bytes of them per size, and prints the messages/s and MB/s it receives and decodes
+void SimConnection_Benchmark(const uint32_t* sizes, uint32_t sizeCount, uint64_t bytesPerSize);
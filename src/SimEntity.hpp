@@ -0,0 +1,39 @@
+#pragma once
+
+#include <pstdint.h>
+#include <ZSTL/ZHashMap.hpp>
+
+// State of a single sim entity as decoded from the sim stream.
+struct SimEntityState
+{
+	uint32_t id;
+	float pos[3];
+	float rot[4];	//Quaternion, x y z w
+	uint32_t flags;
+};
+
+//Hashes entity ids for ZHashMap. Inserting into an empty bucket walks forward to the next
+//occupied one, so identity hashing of sequential ids makes every Put scan to the end of the map.
+struct SimIdHasher
+{
+	ZHashValue32 Hash(const uint32_t& id) const
+	{
+		//Murmur3 finalizer
+		uint32_t h = id;
+		h ^= h >> 16;
+		h *= 0x85ebca6b;
+		h ^= h >> 13;
+		h *= 0xc2b2ae35;
+		h ^= h >> 16;
+		return h;
+	}
+
+	int Equals(const uint32_t& first, const uint32_t& second) const
+	{
+		return first == second;
+	}
+};
+
+//Maps keyed by entity id
+typedef ZHashMap<uint32_t, SimEntityState, ZHashValue32, SimIdHasher> SimEntityMap;
+typedef ZHashMap<uint32_t, uint32_t, ZHashValue32, SimIdHasher> SimEntityIndexMap;
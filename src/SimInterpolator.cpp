@@ -0,0 +1,266 @@
+#include "SimInterpolator.hpp"
+#include <stdio.h>
+#include <math.h>
+#include <xmmintrin.h>
+#include <SST/SST_Time.h>
+
+//Set to 0 to blend with plain scalar code, for comparison
+#define SIM_INTERP_SSE 1
+
+//Keeps a zero-length quaternion from turning into NaNs when normalized
+#define MIN_QUAT_LENGTH_SQ 1e-12f
+
+SimInterpolator::SimInterpolator()
+	: delayMicros(SIM_DEFAULT_INTERP_DELAY_US), sampleMicros(0), sampleCalls(0),
+	  sampledEntities(0), heldSamples(0)
+{
+	for(int i=0; i<Lane_Count; i++)
+		lanes[i] = NULL;
+}
+
+void SimInterpolator::AddSnapshot(const SimEntityState& state, uint64_t time)
+{
+	SimSnapshot snap;
+	snap.time = time;
+	snap.state = state;
+
+	SimEntityIndexMap::Iterator itr = trackIndex.Find(state.id);
+	if(itr != trackIndex.End()) {
+		SimSnapshotRing& ring = tracks.Data()[itr.GetValue()].snapshots;
+		if(!ring.Empty() && ring.Back().time > time)
+			snap.time = ring.Back().time;
+		ring.PushBack(snap);
+	} else {
+		trackIndex.Put(state.id, (uint32_t)tracks.Size());
+		tracks.PushBack(SimEntityTrack());
+		tracks.Back().snapshots.PushBack(snap);
+	}
+}
+
+void SimInterpolator::Gather(size_t i, const SimSnapshotRing& ring, uint64_t when)
+{
+	size_t n = ring.Size();
+
+	//Find the newest snapshot at or before the render time, starting from the back since
+	//the render time is normally only a few snapshots behind the newest one
+	size_t a = n;
+	while(a > 0 && ring.At(a - 1).time > when)
+		a--;
+
+	size_t b;
+	float t;
+	if(a == 0) {
+		//Everything is newer than the render time (entity just appeared); show the oldest state
+		a = b = 0;
+		t = 0.0f;
+	} else if(a == n) {
+		//Nothing newer yet; hold the latest state rather than extrapolate
+		a = b = n - 1;
+		t = 0.0f;
+		heldSamples++;
+	} else {
+		a = a - 1;
+		b = a + 1;
+		t = (float)(when - ring.At(a).time) / (float)(ring.At(b).time - ring.At(a).time);
+	}
+
+	const SimEntityState& sa = ring.At(a).state;
+	const SimEntityState& sb = ring.At(b).state;
+
+	lanes[Lane_AX][i] = sa.pos[0];
+	lanes[Lane_AY][i] = sa.pos[1];
+	lanes[Lane_AZ][i] = sa.pos[2];
+	lanes[Lane_BX][i] = sb.pos[0];
+	lanes[Lane_BY][i] = sb.pos[1];
+	lanes[Lane_BZ][i] = sb.pos[2];
+
+	for(int j=0; j<4; j++) {
+		lanes[Lane_AQX + j][i] = sa.rot[j];
+		lanes[Lane_BQX + j][i] = sb.rot[j];
+	}
+
+	lanes[Lane_T][i] = t;
+
+	SimEntityState& out = sampled.Data()[i];
+	out.id = sa.id;
+	out.flags = sa.flags;
+}
+
+#if SIM_INTERP_SSE
+
+void SimInterpolator::Blend(size_t count)
+{
+	const __m128 signMask = _mm_set1_ps(-0.0f);
+	const __m128 half = _mm_set1_ps(0.5f);
+	const __m128 threeHalves = _mm_set1_ps(1.5f);
+	const __m128 minLength = _mm_set1_ps(MIN_QUAT_LENGTH_SQ);
+
+	for(size_t i=0; i<count; i+=4)
+	{
+		__m128 t = _mm_loadu_ps(lanes[Lane_T] + i);
+
+		//Positions: a + (b - a) * t
+		for(int k=0; k<3; k++) {
+			float* pa = lanes[Lane_AX + k] + i;
+			__m128 a = _mm_loadu_ps(pa);
+			__m128 b = _mm_loadu_ps(lanes[Lane_BX + k] + i);
+			_mm_storeu_ps(pa, _mm_add_ps(a, _mm_mul_ps(_mm_sub_ps(b, a), t)));
+		}
+
+		__m128 qa[4], qb[4];
+		for(int k=0; k<4; k++) {
+			qa[k] = _mm_loadu_ps(lanes[Lane_AQX + k] + i);
+			qb[k] = _mm_loadu_ps(lanes[Lane_BQX + k] + i);
+		}
+
+		//Negate b where it's in the opposite hemisphere so the blend takes the short way around
+		__m128 dot = _mm_add_ps(_mm_add_ps(_mm_mul_ps(qa[0], qb[0]), _mm_mul_ps(qa[1], qb[1])),
+								_mm_add_ps(_mm_mul_ps(qa[2], qb[2]), _mm_mul_ps(qa[3], qb[3])));
+		__m128 flip = _mm_and_ps(dot, signMask);
+
+		__m128 q[4];
+		for(int k=0; k<4; k++) {
+			__m128 b = _mm_xor_ps(qb[k], flip);
+			q[k] = _mm_add_ps(qa[k], _mm_mul_ps(_mm_sub_ps(b, qa[k]), t));
+		}
+
+		//Normalize with rsqrt refined by one Newton-Raphson step
+		__m128 len2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(q[0], q[0]), _mm_mul_ps(q[1], q[1])),
+								 _mm_add_ps(_mm_mul_ps(q[2], q[2]), _mm_mul_ps(q[3], q[3])));
+		len2 = _mm_max_ps(len2, minLength);
+
+		__m128 inv = _mm_rsqrt_ps(len2);
+		inv = _mm_mul_ps(inv, _mm_sub_ps(threeHalves, _mm_mul_ps(_mm_mul_ps(half, len2), _mm_mul_ps(inv, inv))));
+
+		for(int k=0; k<4; k++)
+			_mm_storeu_ps(lanes[Lane_AQX + k] + i, _mm_mul_ps(q[k], inv));
+	}
+}
+
+#else
+
+void SimInterpolator::Blend(size_t count)
+{
+	for(size_t i=0; i<count; i++)
+	{
+		float t = lanes[Lane_T][i];
+
+		for(int k=0; k<3; k++) {
+			float a = lanes[Lane_AX + k][i];
+			lanes[Lane_AX + k][i] = a + (lanes[Lane_BX + k][i] - a) * t;
+		}
+
+		float dot = 0.0f;
+		for(int k=0; k<4; k++)
+			dot += lanes[Lane_AQX + k][i] * lanes[Lane_BQX + k][i];
+
+		float sign = dot < 0.0f ? -1.0f : 1.0f;
+		float q[4];
+		float len2 = 0.0f;
+		for(int k=0; k<4; k++) {
+			float a = lanes[Lane_AQX + k][i];
+			q[k] = a + (lanes[Lane_BQX + k][i] * sign - a) * t;
+			len2 += q[k] * q[k];
+		}
+
+		if(len2 < MIN_QUAT_LENGTH_SQ)
+			len2 = MIN_QUAT_LENGTH_SQ;
+
+		float inv = 1.0f / sqrtf(len2);
+		for(int k=0; k<4; k++)
+			lanes[Lane_AQX + k][i] = q[k] * inv;
+	}
+}
+
+#endif
+
+void SimInterpolator::Sample(uint64_t now)
+{
+	uint64_t start = SST_OS_GetMicroTime();
+	uint64_t when = now > delayMicros ? now - delayMicros : 0;
+
+	size_t count = tracks.Size();
+	size_t padded = (count + 3) & ~(size_t)3;
+
+	sampled.Resize(padded);
+	scratch.Resize(padded * Lane_Count);
+	for(int k=0; k<Lane_Count; k++)
+		lanes[k] = scratch.Data() + k * padded;
+
+	for(size_t i=0; i<count; i++)
+		Gather(i, tracks.Data()[i].snapshots, when);
+
+	//Fill the tail of the last group of four with identity so it blends to something harmless
+	for(size_t i=count; i<padded; i++) {
+		for(int k=0; k<Lane_Count; k++)
+			lanes[k][i] = 0.0f;
+		lanes[Lane_AQW][i] = lanes[Lane_BQW][i] = 1.0f;
+	}
+
+	Blend(padded);
+
+	for(size_t i=0; i<count; i++)
+	{
+		SimEntityState& out = sampled.Data()[i];
+		for(int k=0; k<3; k++)
+			out.pos[k] = lanes[Lane_AX + k][i];
+		for(int k=0; k<4; k++)
+			out.rot[k] = lanes[Lane_AQX + k][i];
+	}
+
+	sampled.Resize(count);
+
+	sampleMicros += SST_OS_GetMicroTime() - start;
+	sampleCalls++;
+	sampledEntities += (uint32_t)count;
+}
+
+void SimInterpolator::PrintStats() const
+{
+	printf("SimInterpolator: %u entities, %.1f ms delay, %.1f us/sample, %.1f ns/entity, %u samples held at newest state\n",
+		(uint32_t)tracks.Size(), (double)delayMicros / 1000.0,
+		sampleCalls ? (double)sampleMicros / sampleCalls : 0.0,
+		sampledEntities ? (double)sampleMicros * 1000.0 / sampledEntities : 0.0,
+		heldSamples);
+}
+
+void SimInterpolator_Benchmark(uint32_t entityCount, uint32_t frames)
+{
+	const uint64_t tickMicros = 50000;	//20 Hz sim
+	const uint64_t frameMicros = 13333;	//75 Hz display
+	const int ticks = SIM_SNAPSHOT_COUNT;
+
+	SimInterpolator interp;
+
+	for(int tick=0; tick<ticks; tick++)
+	{
+		for(uint32_t id=0; id<entityCount; id++)
+		{
+			float angle = (float)(id + tick) * 0.1f;
+
+			SimEntityState state;
+			state.id = id;
+			state.pos[0] = (float)id;
+			state.pos[1] = (float)tick;
+			state.pos[2] = angle;
+			state.rot[0] = 0.0f;
+			state.rot[1] = sinf(angle * 0.5f);
+			state.rot[2] = 0.0f;
+			state.rot[3] = cosf(angle * 0.5f);
+			state.flags = 0;
+
+			interp.AddSnapshot(state, (uint64_t)tick * tickMicros);
+		}
+	}
+
+	//Sweep the render time across the buffered history so every frame interpolates
+	uint64_t first = interp.GetDelay();
+	uint64_t span = (uint64_t)(ticks - 1) * tickMicros;
+
+	for(uint32_t frame=0; frame<frames; frame++)
+		interp.Sample(first + (frame * frameMicros) % span);
+
+	printf("SimInterpolator benchmark: %u entities x %u frames (%s)\n",
+		entityCount, frames, SIM_INTERP_SSE ? "SSE" : "scalar");
+	interp.PrintStats();
+}
@@ -0,0 +1,106 @@
+#pragma once
+
+#include <ZSTL/ZArray.hpp>
+#include <ZSTL/ZHashMap.hpp>
+#include <ZSTL/ZRingBuffer.hpp>
+
+#include "SimEntity.hpp"
+
+//How far behind the present entities are rendered by default, and at most
+#define SIM_DEFAULT_INTERP_DELAY_US 100000
+#define SIM_MAX_INTERP_DELAY_US 200000
+
+//Highest rate a publisher is expected to send an entity's state at. Snapshots are stamped with
+//the time they were published, so this rather than the display rate decides how many the delay spans.
+#define SIM_MAX_SEND_HZ 30
+
+//Snapshots kept per entity: those SIM_MAX_INTERP_DELAY_US spans at SIM_MAX_SEND_HZ, the one before
+//the render time, and two to ride out jitter. With fewer the sampler runs out of history and holds.
+#define SIM_SNAPSHOT_COUNT ((SIM_MAX_INTERP_DELAY_US * SIM_MAX_SEND_HZ + 999999) / 1000000 + 3)
+
+//An entity state and the time it was published
+struct SimSnapshot
+{
+	uint64_t time;	//On the SST_OS_GetMicroTime() clock
+	SimEntityState state;
+};
+
+//Oldest snapshot is evicted when a new one arrives on a full ring
+typedef ZRingBuffer<SimSnapshot, ZRingBuffer_OverflowEvict, ZArrayAllocator<SimSnapshot, SIM_SNAPSHOT_COUNT> > SimSnapshotRing;
+
+struct SimEntityTrack
+{
+	SimSnapshotRing snapshots;
+
+	SimEntityTrack() : snapshots(SIM_SNAPSHOT_COUNT) { }
+};
+
+/*
+Buffers timestamped entity states and samples them at a fixed delay behind the present,
+so rendered motion follows the display rate instead of the sim tick rate and network jitter.
+
+Sampling gathers the two snapshots around the render time for every entity into
+structure-of-arrays scratch, then blends four entities at a time with SSE: lerp for
+positions, normalized lerp for rotations.
+*/
+class SimInterpolator
+{
+	public:
+		SimInterpolator();
+
+		//Clamped to SIM_MAX_INTERP_DELAY_US, which is what the snapshot rings are sized for
+		void SetDelay(uint64_t micros) { delayMicros = micros < SIM_MAX_INTERP_DELAY_US ? micros : SIM_MAX_INTERP_DELAY_US; }
+		uint64_t GetDelay() const { return delayMicros; }
+
+		//A snapshot older than the entity's newest, e.g. after the publisher's clock offset was
+		//re-estimated, is stamped with the newest one's time so the ring stays in time order
+		void AddSnapshot(const SimEntityState& state, uint64_t time);
+
+		//Interpolates every entity at (now - delay). Results stay valid until the next call.
+		void Sample(uint64_t now);
+
+		const ZArray<SimEntityState>& GetSampled() const { return sampled; }
+		size_t GetEntityCount() const { return tracks.Size(); }
+
+		uint64_t GetSampleMicros() const { return sampleMicros; }
+		uint32_t GetSampleCalls() const { return sampleCalls; }
+		void PrintStats() const;
+
+	private:
+		enum Lane
+		{
+			Lane_AX, Lane_AY, Lane_AZ,
+			Lane_BX, Lane_BY, Lane_BZ,
+			Lane_AQX, Lane_AQY, Lane_AQZ, Lane_AQW,
+			Lane_BQX, Lane_BQY, Lane_BQZ, Lane_BQW,
+			Lane_T,
+			Lane_Count
+		};
+
+		//Picks the snapshots around 'when' for one track and writes them into slot i of the scratch lanes
+		void Gather(size_t i, const SimSnapshotRing& ring, uint64_t when);
+
+		//Blends 'count' slots in place; results are left in the A lanes. count must be a multiple of 4.
+		void Blend(size_t count);
+
+		uint64_t delayMicros;
+
+		SimEntityIndexMap trackIndex;	//Entity id -> index into tracks
+		ZArray<SimEntityTrack> tracks;
+
+		//Structure-of-arrays scratch, Lane_Count runs of padded floats
+		ZArray<float> scratch;
+		float* lanes[Lane_Count];
+
+		ZArray<SimEntityState> sampled;
+
+		uint64_t sampleMicros;
+		uint32_t sampleCalls;
+		uint32_t sampledEntities;
+
+		//Samples that had no snapshot newer than the render time and held the latest state
+		uint32_t heldSamples;
+};
+
+//Samples 'entityCount' synthetic entities for 'frames' frames and prints the cost per frame
+void SimInterpolator_Benchmark(uint32_t entityCount, uint32_t frames);
@@ -0,0 +1,195 @@
+#include "SimLog.hpp"
+#include <stdio.h>
+#include <string.h>
+#include <SST/SST_SysMem.h>
+#include <SST/SST_Time.h>
+
+static inline uint64_t AlignUp(uint64_t v, uint64_t align)
+{
+	return (v + align - 1) / align * align;
+}
+
+SimLogWriter::SimLogWriter()
+	: file(NULL), map(NULL), base(NULL), mapOffset(0), mapEnd(0), fileSize(0), writePos(0), records(0)
+{
+}
+
+bool SimLogWriter::Open(const char* path, SimWireFormat format)
+{
+	Close();
+
+	file = SST_OS_OpenFile(path, SST_OPEN_WRITE | SST_OPEN_HINTSEQ);
+	if(file == NULL) {
+		printf("Couldn't open sim log %s for writing\n", path);
+		return false;
+	}
+
+	fileSize = 0;
+	writePos = 0;
+	records = 0;
+
+	if(!MapWindow(sizeof(SimLogHeader))) {
+		Close();
+		return false;
+	}
+
+	SimLogHeader* header = (SimLogHeader*)base;
+	header->magic = SIM_LOG_MAGIC;
+	header->version = SIM_LOG_VERSION;
+	header->wireFormat = (uint16_t)format;
+	header->startMicros = SST_OS_GetMicroTime();
+
+	writePos = sizeof(SimLogHeader);
+	return true;
+}
+
+bool SimLogWriter::MapWindow(uint64_t needed)
+{
+	if(map != NULL) {
+		SST_OS_DestroyMmap(map);
+		map = NULL;
+		base = NULL;
+	}
+
+	uint64_t granularity = SST_OS_GetMmapGranularity();
+	uint64_t offset = writePos / granularity * granularity;
+	uint64_t length = AlignUp(writePos + needed - offset, granularity);
+	if(length < SIM_LOG_WINDOW_SIZE)
+		length = SIM_LOG_WINDOW_SIZE;
+
+	//Grow the file to cover the window; the new space reads back as zeros, which ends the log
+	if(offset + length > fileSize) {
+		unsigned char zero = 0;
+		if(!SST_OS_SeekFile(file, (int64_t)(offset + length - 1), SST_SEEK_START) || SST_OS_WriteFile(file, &zero, 1) != 1) {
+			printf("Couldn't grow sim log to %llu bytes\n", (unsigned long long)(offset + length));
+			return false;
+		}
+		fileSize = offset + length;
+	}
+
+	map = SST_OS_CreateMmap(file, offset, (size_t)length, SST_PROTECT_READ | SST_PROTECT_WRITE);
+	if(map == NULL) {
+		printf("Couldn't map sim log at %llu\n", (unsigned long long)offset);
+		return false;
+	}
+
+	base = (unsigned char*)SST_OS_GetMmapBase(map);
+	mapOffset = offset;
+	mapEnd = offset + length;
+	return true;
+}
+
+bool SimLogWriter::Append(const void* data, size_t length, uint64_t recvTime)
+{
+	if(file == NULL)
+		return false;
+
+	uint64_t recordSize = sizeof(SimLogRecordHeader) + AlignUp(length, SIM_LOG_ALIGN);
+	if(writePos + recordSize > mapEnd && !MapWindow(recordSize)) {
+		Close();
+		return false;
+	}
+
+	SimLogRecordHeader* header = (SimLogRecordHeader*)(base + (writePos - mapOffset));
+	header->length = (uint32_t)length;
+	header->recvTime = recvTime;
+	memcpy(header + 1, data, length);
+
+	//Marked valid last, so a log cut off mid-record ends before it
+	header->flags = SIM_LOG_RECORD_VALID;
+
+	writePos += recordSize;
+	records++;
+	return true;
+}
+
+void SimLogWriter::Close()
+{
+	if(map != NULL) {
+		SST_OS_DestroyMmap(map);
+		map = NULL;
+		base = NULL;
+	}
+
+	if(file != NULL) {
+		SST_OS_CloseFile(file);
+		file = NULL;
+	}
+}
+
+SimLogReader::SimLogReader()
+	: file(NULL), map(NULL), base(NULL), size(0), readPos(0), wireFormat(SimWire_Json)
+{
+}
+
+bool SimLogReader::Open(const char* path)
+{
+	Close();
+
+	file = SST_OS_OpenFile(path, SST_OPEN_READ | SST_OPEN_HINTSEQ);
+	if(file == NULL) {
+		printf("Couldn't open sim log %s\n", path);
+		return false;
+	}
+
+	if(SST_OS_GetFileSize(file) >= sizeof(SimLogHeader))
+		map = SST_OS_CreateMmap(file, 0, 0, SST_PROTECT_READ);
+
+	if(map == NULL) {
+		printf("Couldn't map sim log %s\n", path);
+		Close();
+		return false;
+	}
+
+	base = (const unsigned char*)SST_OS_GetMmapBase(map);
+	size = SST_OS_GetMmapSize(map);
+
+	const SimLogHeader* header = (const SimLogHeader*)base;
+	if(header->magic != SIM_LOG_MAGIC || header->version != SIM_LOG_VERSION) {
+		printf("%s is not a version %d sim log\n", path, SIM_LOG_VERSION);
+		Close();
+		return false;
+	}
+
+	wireFormat = (SimWireFormat)header->wireFormat;
+	Rewind();
+	return true;
+}
+
+bool SimLogReader::Next(SimLogRecord* record)
+{
+	if(map == NULL || size - readPos < sizeof(SimLogRecordHeader))
+		return false;
+
+	const SimLogRecordHeader* header = (const SimLogRecordHeader*)(base + readPos);
+	if(!(header->flags & SIM_LOG_RECORD_VALID))
+		return false;
+
+	size_t recordSize = sizeof(SimLogRecordHeader) + (size_t)AlignUp(header->length, SIM_LOG_ALIGN);
+	if(size - readPos < recordSize)
+		return false;
+
+	record->recvTime = header->recvTime;
+	record->data = (const char*)(header + 1);
+	record->length = header->length;
+
+	readPos += recordSize;
+	return true;
+}
+
+void SimLogReader::Close()
+{
+	if(map != NULL) {
+		SST_OS_DestroyMmap(map);
+		map = NULL;
+		base = NULL;
+	}
+
+	if(file != NULL) {
+		SST_OS_CloseFile(file);
+		file = NULL;
+	}
+
+	size = 0;
+	readPos = 0;
+}
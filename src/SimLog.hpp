@@ -0,0 +1,107 @@
+#pragma once
+
+#include <SST/SST_File.h>
+#include <SST/SST_Mmap.h>
+
+#include "SimCodec.hpp"
+
+#define SIM_LOG_MAGIC 0x4C5A4E4F	//"ONZL"
+#define SIM_LOG_VERSION 1
+
+//Record headers and payloads start on multiples of this
+#define SIM_LOG_ALIGN 8
+
+//The writer grows the file and moves its map forward in steps of at least this much
+#define SIM_LOG_WINDOW_SIZE (16 * 1024 * 1024)
+
+/*
+Append-only capture of a sim message stream, in host byte order:
+
+	SimLogHeader
+	{ SimLogRecordHeader, payload padded to SIM_LOG_ALIGN } ...
+	zeros
+
+The file is grown ahead of the writer in whole windows, so it ends in zeros rather than
+at the last record; the first record header without SIM_LOG_RECORD_VALID ends the log.
+A log cut short by a crash therefore still reads back up to its last complete record.
+*/
+struct SimLogHeader
+{
+	uint32_t magic;
+	uint16_t version;
+	uint16_t wireFormat;	//SimWireFormat of the payloads
+	uint64_t startMicros;	//Receive clock when recording started
+};
+
+#define SIM_LOG_RECORD_VALID 1
+
+struct SimLogRecordHeader
+{
+	uint32_t length;		//Payload bytes, not counting padding
+	uint32_t flags;			//SIM_LOG_RECORD_VALID once the record is complete
+	uint64_t recvTime;		//SST_OS_GetMicroTime() when the message was received
+};
+
+//One message of a log, pointing into the reader's map
+struct SimLogRecord
+{
+	uint64_t recvTime;
+	const char* data;
+	size_t length;
+};
+
+//Writes a log through a window mapped over the end of the file. Not synchronized; one thread appends.
+class SimLogWriter
+{
+	public:
+		SimLogWriter();
+		~SimLogWriter() { Close(); }
+
+		bool Open(const char* path, SimWireFormat format);
+		void Close();
+		bool IsOpen() const { return file != NULL; }
+
+		bool Append(const void* data, size_t length, uint64_t recvTime);
+
+		uint32_t GetRecordCount() const { return records; }
+		uint64_t GetSize() const { return writePos; }
+
+	private:
+		//Maps a window starting at or before writePos with at least 'needed' bytes after it, growing the file if necessary
+		bool MapWindow(uint64_t needed);
+
+		SST_File file;
+		SST_MemoryMap map;
+		unsigned char* base;	//Address of mapOffset
+		uint64_t mapOffset;
+		uint64_t mapEnd;
+		uint64_t fileSize;
+		uint64_t writePos;
+		uint32_t records;
+};
+
+//Reads a log mapped in one piece. Record data is not copied and stays valid until Close.
+class SimLogReader
+{
+	public:
+		SimLogReader();
+		~SimLogReader() { Close(); }
+
+		bool Open(const char* path);
+		void Close();
+		bool IsOpen() const { return map != NULL; }
+
+		SimWireFormat GetWireFormat() const { return wireFormat; }
+
+		//Returns false at the end of the log
+		bool Next(SimLogRecord* record);
+		void Rewind() { readPos = sizeof(SimLogHeader); }
+
+	private:
+		SST_File file;
+		SST_MemoryMap map;
+		const unsigned char* base;
+		size_t size;
+		size_t readPos;
+		SimWireFormat wireFormat;
+};
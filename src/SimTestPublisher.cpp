@@ -0,0 +1,466 @@
+#include "SimTestPublisher.hpp"
+#include <zmq.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <SST/SST_Time.h>
+
+//Stream id of the first stream; each further stream (cell) takes the next one
+#define TEST_PUBLISHER_ID 1
+
+//How long the interest benchmark gives its subscriptions to reach the publisher, and waits for a tick's messages
+#define INTEREST_BENCHMARK_SETTLE_MS 200
+#define INTEREST_BENCHMARK_TIMEOUT_MS 1000
+
+//Entities are laid out on a grid this many wide, this far apart
+#define TEST_GRID_WIDTH 256
+#define TEST_GRID_SPACING 4.0f
+
+SimTestPublisher::SimTestPublisher()
+	: zmqContext(NULL), zmqSocket(NULL), thread(NULL), running(0), tickMicros(0), useDeltas(false),
+	  keyframeInterval(1), movingCount(0), tick(0),
+	  sentMessages(0), sentKeyframes(0), sentBytes(0), startMicros(0)
+{
+}
+
+bool SimTestPublisher::Start(const char* endpoint, uint32_t entityCount, float movingFraction, uint32_t tickHz,
+							 bool deltas, uint32_t keyframeInterval, bool cellTopics)
+{
+	if(tickHz == 0)
+		return false;
+
+	Reset(entityCount, movingFraction, deltas, keyframeInterval, cellTopics);
+	tickMicros = 1000000 / tickHz;
+
+	zmqContext = zmq_ctx_new();
+	if(zmqContext == NULL)
+		return false;
+
+	zmqSocket = zmq_socket(zmqContext, ZMQ_PUB);
+	if(zmqSocket == NULL || zmq_bind(zmqSocket, endpoint) != 0) {
+		printf("Sim test publisher couldn't bind %s: %s\n", endpoint, zmq_strerror(zmq_errno()));
+		Stop();
+		return false;
+	}
+
+	startMicros = SST_OS_GetMicroTime();
+
+	running = 1;
+	thread = SST_Concurrency_CreateThread(ThreadMain, this);
+	if(thread == NULL) {
+		running = 0;
+		Stop();
+		return false;
+	}
+
+	printf("Sim test publisher: %u entities (%u moving) at %u Hz on %s, %s, %u streams\n", entityCount, movingCount, tickHz, endpoint,
+		deltas ? "keyframes + deltas" : "full updates", (uint32_t)streams.Size());
+
+	return true;
+}
+
+static void HomePosition(uint32_t i, float* x, float* z)
+{
+	*x = (float)(i % TEST_GRID_WIDTH) * TEST_GRID_SPACING;
+	*z = (float)(i / TEST_GRID_WIDTH) * TEST_GRID_SPACING;
+}
+
+void SimTestPublisher::Reset(uint32_t entityCount, float movingFraction, bool deltas, uint32_t interval, bool cellTopics)
+{
+	useDeltas = deltas;
+	keyframeInterval = interval > 0 ? interval : 1;
+	movingCount = (uint32_t)(entityCount * movingFraction);
+	if(movingCount > entityCount)
+		movingCount = entityCount;
+
+	world.Resize(entityCount);
+	for(uint32_t i=0; i<entityCount; i++)
+	{
+		SimEntityState& state = world.Data()[i];
+		state = SimCodec_DefaultState(i + 1);
+		HomePosition(i, &state.pos[0], &state.pos[2]);
+	}
+
+	//Entities stay on the stream of the cell they start in; moving ones never go far from home
+	streams.Clear();
+	ZHashMap<uint32_t, uint32_t> cellStreams;
+
+	for(uint32_t i=0; i<entityCount; i++)
+	{
+		int cellX = cellTopics ? SimCodec_CellCoord(world.Data()[i].pos[0]) : 0;
+		int cellZ = cellTopics ? SimCodec_CellCoord(world.Data()[i].pos[2]) : 0;
+		uint32_t key = ((uint32_t)(cellX & 0xFFFF) << 16) | (uint32_t)(cellZ & 0xFFFF);
+
+		uint32_t index;
+		ZHashMap<uint32_t, uint32_t>::Iterator itr = cellStreams.Find(key);
+		if(itr != cellStreams.End()) {
+			index = itr.GetValue();
+		} else {
+			index = (uint32_t)streams.Size();
+			cellStreams.Put(key, index);
+			streams.Resize(index + 1);
+
+			SimTestStream& stream = streams.Data()[index];
+			stream.cellX = cellX;
+			stream.cellZ = cellZ;
+			stream.seq = 0;
+			stream.keyframeSeq = 0;
+			if(cellTopics)
+				SimCodec_CellTopic(cellX, cellZ, stream.topic);
+			else
+				stream.topic[0] = '\0';
+		}
+
+		streams.Data()[index].members.PushBack(i);
+	}
+
+	for(size_t s=0; s<streams.Size(); s++)
+	{
+		SimTestStream& stream = streams.Data()[s];
+		stream.previous.Resize(stream.members.Size());
+		for(size_t i=0; i<stream.members.Size(); i++)
+			stream.previous.Data()[i] = world.Data()[stream.members.Data()[i]];
+		stream.keyframe.Clear();
+	}
+
+	tick = 0;
+}
+
+void SimTestPublisher::Step()
+{
+	tick++;
+
+	//Moving entities circle around their home, facing along the circle
+	for(uint32_t i=0; i<movingCount; i++)
+	{
+		SimEntityState& state = world.Data()[i];
+		float angle = tick * 0.05f + i * 0.01f;
+
+		HomePosition(i, &state.pos[0], &state.pos[2]);
+		state.pos[0] += 0.5f * cosf(angle);
+		state.pos[2] += 0.5f * sinf(angle);
+		state.rot[1] = sinf(-angle * 0.5f);
+		state.rot[3] = cosf(-angle * 0.5f);
+	}
+}
+
+const ZArray<unsigned char>& SimTestPublisher::EncodeStream(size_t index)
+{
+	SimTestStream& stream = streams.Data()[index];
+
+	SimMessageInfo info;
+	info.publisher = TEST_PUBLISHER_ID + (uint32_t)index;
+	info.seq = stream.seq++;
+	info.publishMicros = SST_OS_GetMicroTime();
+	info.hasSequence = true;
+
+	uint32_t count = (uint32_t)stream.members.Size();
+	stream.current.Resize(count);
+	for(uint32_t i=0; i<count; i++)
+		stream.current.Data()[i] = world.Data()[stream.members.Data()[i]];
+
+	//Streams are staggered so their keyframes don't all land on the same tick
+	if(!useDeltas || stream.keyframe.Empty() || (tick + index) % keyframeInterval == 0)
+	{
+		info.type = SimMsg_Keyframe;
+		info.baselineSeq = 0;
+
+		message.Resize(SimCodec_BinarySize(count));
+		SimCodec_EncodeBinary(info, stream.current.Data(), count, message.Data(), message.Size());
+
+		if(useDeltas) {
+			stream.keyframe = stream.current;
+			stream.keyframeSeq = info.seq;
+		}
+		sentKeyframes++;
+	}
+	else
+	{
+		changed.Clear();
+		changedMasks.Clear();
+
+		//Send everything that differs from the keyframe, plus anything that changed back to it since the last tick
+		for(uint32_t i=0; i<count; i++)
+		{
+			const SimEntityState& state = stream.current.Data()[i];
+			uint8_t mask = SimCodec_DiffEntity(stream.keyframe.Data()[i], state);
+
+			if(mask != 0 || SimCodec_DiffEntity(stream.previous.Data()[i], state) != 0) {
+				changed.PushBack(state);
+				changedMasks.PushBack(mask);
+			}
+		}
+
+		info.type = SimMsg_Delta;
+		info.baselineSeq = stream.keyframeSeq;
+
+		uint32_t nrChanged = (uint32_t)changed.Size();
+		message.Resize(SimCodec_BinaryDeltaSize(changedMasks.Data(), nrChanged));
+		SimCodec_EncodeBinaryDelta(info, changed.Data(), changedMasks.Data(), nrChanged, message.Data(), message.Size());
+	}
+
+	stream.previous = stream.current;
+	return message;
+}
+
+int SimTestPublisher::ThreadMain(void* arg)
+{
+	SimTestPublisher* self = (SimTestPublisher*)arg;
+	uint64_t next = SST_OS_GetMicroTime();
+
+	while(SST_Atomic_LoadAcquire(&self->running))
+	{
+		self->Step();
+
+		for(size_t s=0; s<self->streams.Size(); s++)
+		{
+			const char* topic = self->streams.Data()[s].topic;
+			const ZArray<unsigned char>& msg = self->EncodeStream(s);
+
+			size_t topicLen = strlen(topic);
+			if(topicLen > 0 && zmq_send(self->zmqSocket, topic, topicLen, ZMQ_SNDMORE) < 0)
+				continue;
+
+			if(zmq_send(self->zmqSocket, msg.Data(), msg.Size(), 0) >= 0) {
+				self->sentMessages++;
+				self->sentBytes += topicLen + msg.Size();
+			}
+		}
+
+		next += self->tickMicros;
+		uint64_t now = SST_OS_GetMicroTime();
+		if(next > now)
+			SST_Concurrency_SleepThread((uint32_t)((next - now) / 1000));
+		else
+			next = now;	//Fell behind; don't try to catch up with a burst
+	}
+
+	return 0;
+}
+
+void SimTestPublisher::Stop()
+{
+	if(thread != NULL) {
+		SST_Atomic_StoreRelease(&running, 0);
+		SST_Concurrency_WaitThread(thread, NULL);
+		SST_Concurrency_DestroyThread(thread);
+		thread = NULL;
+	}
+
+	if(zmqSocket != NULL) {
+		int linger = 0;
+		zmq_setsockopt(zmqSocket, ZMQ_LINGER, &linger, sizeof(linger));
+		zmq_close(zmqSocket);
+		zmqSocket = NULL;
+	}
+
+	if(zmqContext != NULL) {
+		zmq_ctx_destroy(zmqContext);
+		zmqContext = NULL;
+	}
+}
+
+void SimTestPublisher::PrintStats() const
+{
+	double seconds = (double)(SST_OS_GetMicroTime() - startMicros) / 1000000.0;
+	uint32_t messages = sentMessages;
+	uint64_t bytes = sentBytes;
+
+	printf("SimTestPublisher: sent %u messages (%u keyframes), %.2f MB, %.1f KB/s\n",
+		messages, sentKeyframes, (double)bytes / (1024.0 * 1024.0),
+		seconds > 0.0 ? (double)bytes / 1024.0 / seconds : 0.0);
+}
+
+//Resolves a decoded message against its stream's baseline the way SimConnection's receive thread would
+static bool ResolveLikeClient(const SimMessageInfo& info, SimBaseline* baseline, ZArray<SimEntityState>* decoded, ZArray<uint8_t>* masks)
+{
+	if(info.type == SimMsg_Keyframe) {
+		baseline->Store(info.seq, *decoded);
+		return true;
+	}
+
+	return baseline->Resolve(info, *masks, decoded);
+}
+
+//Decodes one message the way SimConnection's receive thread would. Returns false if it couldn't be applied.
+static bool DecodeLikeClient(const ZArray<unsigned char>& msg, SimBaseline* baseline, ZArray<SimEntityState>* decoded, ZArray<uint8_t>* masks)
+{
+	SimMessageInfo info;
+
+	decoded->Clear();
+	masks->Clear();
+	if(!SimCodec_DecodeBinary(msg.Data(), msg.Size(), &info, decoded, masks))
+		return false;
+
+	return ResolveLikeClient(info, baseline, decoded, masks);
+}
+
+void SimTestPublisher_Benchmark(uint32_t entityCount, float movingFraction, uint32_t ticks, uint32_t keyframeInterval)
+{
+	for(int mode=0; mode<2; mode++)
+	{
+		bool deltas = (mode == 1);
+
+		SimTestPublisher publisher;
+		publisher.Reset(entityCount, movingFraction, deltas, keyframeInterval, false);
+
+		SimBaseline baseline;
+		ZArray<SimEntityState> decoded;
+		ZArray<uint8_t> masks;
+
+		uint64_t bytes = 0;
+		uint64_t decodeMicros = 0;
+		uint32_t failed = 0;
+
+		for(uint32_t i=0; i<ticks; i++)
+		{
+			publisher.Step();
+			const ZArray<unsigned char>& msg = publisher.EncodeStream(0);
+			bytes += msg.Size();
+
+			uint64_t start = SST_OS_GetMicroTime();
+			failed += DecodeLikeClient(msg, &baseline, &decoded, &masks) ? 0 : 1;
+			decodeMicros += SST_OS_GetMicroTime() - start;
+		}
+
+		printf("Sim codec benchmark (%s, keyframe every %u ticks): %u entities, %.0f%% moving, %u ticks: %.1f KB/tick, %.1f us/tick decode%s\n",
+			deltas ? "deltas" : "full updates", deltas ? keyframeInterval : 1,
+			entityCount, movingFraction * 100.0f, ticks,
+			(double)bytes / 1024.0 / ticks, (double)decodeMicros / ticks,
+			failed ? ", DECODE FAILURES" : "");
+	}
+}
+
+//Receives and decodes what one benchmark subscriber has waiting, up to 'expected' messages
+static void DrainInterestSubscriber(void* socket, uint32_t expected, SimBaseline* baselines, size_t nrStreams, uint64_t* bytesReturn,
+									uint64_t* decodeMicrosReturn, uint32_t* entitiesReturn, uint32_t* lostReturn)
+{
+	ZArray<SimEntityState> decoded;
+	ZArray<uint8_t> masks;
+
+	zmq_msg_t msg;
+	zmq_msg_init(&msg);
+
+	for(uint32_t received=0; received<expected; )
+	{
+		//The receive timeout is what ends a tick a message of went missing
+		int nrBytes = zmq_msg_recv(&msg, socket, 0);
+		if(nrBytes < 0) {
+			*lostReturn += expected - received;
+			break;
+		}
+
+		*bytesReturn += (uint64_t)nrBytes;
+		if(zmq_msg_more(&msg))
+			continue;
+		received++;
+
+		//Each stream publishes under its own id, which picks its baseline
+		SimMessageInfo info;
+		uint64_t start = SST_OS_GetMicroTime();
+		decoded.Clear();
+		masks.Clear();
+		if(SimCodec_DecodeBinary(zmq_msg_data(&msg), zmq_msg_size(&msg), &info, &decoded, &masks) &&
+		   info.publisher - TEST_PUBLISHER_ID < nrStreams)
+			ResolveLikeClient(info, &baselines[info.publisher - TEST_PUBLISHER_ID], &decoded, &masks);
+		*decodeMicrosReturn += SST_OS_GetMicroTime() - start;
+		*entitiesReturn += (uint32_t)decoded.Size();
+	}
+
+	zmq_msg_close(&msg);
+}
+
+void SimTestPublisher_InterestBenchmark(uint32_t entityCount, uint32_t ticks, int radius)
+{
+	SimTestPublisher publisher;
+	publisher.Reset(entityCount, 0.05f, true, 30, true);
+
+	size_t nrStreams = publisher.GetStreamCount();
+
+	//Stand in the middle of the world
+	float halfWidth = 0.5f * TEST_GRID_WIDTH * TEST_GRID_SPACING;
+	float halfDepth = 0.5f * (float)(entityCount / TEST_GRID_WIDTH) * TEST_GRID_SPACING;
+	int centerX = SimCodec_CellCoord(halfWidth);
+	int centerZ = SimCodec_CellCoord(halfDepth);
+
+	//One subscriber takes everything, the other only the cells in range; ZMQ does the filtering between them
+	void* context = zmq_ctx_new();
+	void* pub = context ? zmq_socket(context, ZMQ_PUB) : NULL;
+	void* subs[2] = { NULL, NULL };
+	int unlimited = 0;
+	int timeout = INTEREST_BENCHMARK_TIMEOUT_MS;
+	bool ok = pub != NULL && zmq_setsockopt(pub, ZMQ_SNDHWM, &unlimited, sizeof(unlimited)) == 0 &&
+			  zmq_bind(pub, SIM_INTEREST_BENCHMARK_ENDPOINT) == 0;
+
+	for(int mode=0; ok && mode<2; mode++) {
+		subs[mode] = zmq_socket(context, ZMQ_SUB);
+		ok = subs[mode] != NULL && zmq_setsockopt(subs[mode], ZMQ_RCVHWM, &unlimited, sizeof(unlimited)) == 0 &&
+			 zmq_setsockopt(subs[mode], ZMQ_RCVTIMEO, &timeout, sizeof(timeout)) == 0 &&
+			 zmq_connect(subs[mode], SIM_INTEREST_BENCHMARK_ENDPOINT) == 0;
+	}
+
+	uint32_t expected[2] = { (uint32_t)nrStreams, 0 };
+	ok = ok && zmq_setsockopt(subs[0], ZMQ_SUBSCRIBE, "", 0) == 0;
+	for(size_t s=0; ok && s<nrStreams; s++) {
+		const SimTestStream& stream = publisher.GetStream(s);
+		if(abs(stream.cellX - centerX) <= radius && abs(stream.cellZ - centerZ) <= radius) {
+			ok = zmq_setsockopt(subs[1], ZMQ_SUBSCRIBE, stream.topic, SIM_CELL_TOPIC_LENGTH) == 0;
+			expected[1]++;
+		}
+	}
+
+	if(!ok) {
+		printf("Sim interest benchmark couldn't set up its sockets on %s: %s\n", SIM_INTEREST_BENCHMARK_ENDPOINT, zmq_strerror(zmq_errno()));
+	} else {
+		//Subscriptions travel to the publisher asynchronously; anything sent before they arrive is dropped
+		SST_Concurrency_SleepThread(INTEREST_BENCHMARK_SETTLE_MS);
+
+		SimBaseline* baselines[2] = { new SimBaseline[nrStreams], new SimBaseline[nrStreams] };
+		uint64_t bytes[2] = { 0, 0 };
+		uint64_t decodeMicros[2] = { 0, 0 };
+		uint32_t entities[2] = { 0, 0 };
+		uint32_t lost[2] = { 0, 0 };
+
+		for(uint32_t i=0; i<ticks; i++)
+		{
+			publisher.Step();
+
+			for(size_t s=0; s<nrStreams; s++) {
+				const ZArray<unsigned char>& msg = publisher.EncodeStream(s);
+				zmq_send(pub, publisher.GetStream(s).topic, SIM_CELL_TOPIC_LENGTH, ZMQ_SNDMORE);
+				zmq_send(pub, msg.Data(), msg.Size(), 0);
+			}
+
+			for(int mode=0; mode<2; mode++)
+				DrainInterestSubscriber(subs[mode], expected[mode], baselines[mode], nrStreams, &bytes[mode], &decodeMicros[mode],
+										&entities[mode], &lost[mode]);
+		}
+
+		delete[] baselines[0];
+		delete[] baselines[1];
+
+		printf("Sim interest benchmark: %u entities in %u cells of %.0f m, %u ticks over %s\n",
+			entityCount, (uint32_t)nrStreams, SIM_CELL_SIZE, ticks, SIM_INTEREST_BENCHMARK_ENDPOINT);
+
+		for(int mode=0; mode<2; mode++)
+			printf("    %s: %u cells, %.1f KB/tick received, %.1f us/tick decode, %u entities/tick%s\n",
+				mode == 0 ? "all cells" : "cells in radius", expected[mode],
+				(double)bytes[mode] / 1024.0 / ticks, (double)decodeMicros[mode] / ticks, entities[mode] / ticks,
+				lost[mode] ? ", MESSAGES LOST" : "");
+	}
+
+	int linger = 0;
+	for(int mode=0; mode<2; mode++) {
+		if(subs[mode] != NULL) {
+			zmq_setsockopt(subs[mode], ZMQ_LINGER, &linger, sizeof(linger));
+			zmq_close(subs[mode]);
+		}
+	}
+	if(pub != NULL) {
+		zmq_setsockopt(pub, ZMQ_LINGER, &linger, sizeof(linger));
+		zmq_close(pub);
+	}
+	if(context != NULL)
+		zmq_ctx_destroy(context);
+}
@@ -0,0 +1,98 @@
+#pragma once
+
+#include <SST/SST_Concurrency.h>
+#include <ZSTL/ZArray.hpp>
+
+#include "SimEntity.hpp"
+#include "SimCodec.hpp"
+
+//Local endpoint the test publisher binds by default
+#define SIM_TEST_PUBLISHER_ENDPOINT "tcp://127.0.0.1:4002"
+
+//Local endpoint SimTestPublisher_InterestBenchmark publishes on
+#define SIM_INTEREST_BENCHMARK_ENDPOINT "tcp://127.0.0.1:4004"
+
+//One message stream of the test publisher: the whole world, or one grid cell when publishing cell topics
+struct SimTestStream
+{
+	char topic[SIM_CELL_TOPIC_LENGTH + 1];	//Empty when publishing without topics
+	int cellX;
+	int cellZ;
+
+	ZArray<uint32_t> members;				//Indices into the world
+	ZArray<SimEntityState> current;			//Member states gathered for encoding
+	ZArray<SimEntityState> previous;		//As of the last tick, to catch entities that moved back to their keyframe state
+	ZArray<SimEntityState> keyframe;
+
+	uint32_t seq;
+	uint32_t keyframeSeq;
+};
+
+/*
+Publishes a synthetic world for testing SimConnection without the sim server.
+A fraction of the entities move in circles, the rest stay put. In delta mode a
+keyframe goes out every keyframeInterval ticks and the ticks in between only
+carry entities that differ from it.
+
+With cell topics, every grid cell is its own stream sent as [topic][payload], so
+subscribers can filter the world down to the cells around them.
+*/
+class SimTestPublisher
+{
+	public:
+		SimTestPublisher();
+
+		bool Start(const char* endpoint, uint32_t entityCount, float movingFraction, uint32_t tickHz,
+				   bool deltas, uint32_t keyframeInterval, bool cellTopics);
+		void Stop();
+
+		void PrintStats() const;
+
+		//Builds the initial world. Called by Start; only needed directly when driving the publisher by hand.
+		void Reset(uint32_t entityCount, float movingFraction, bool deltas, uint32_t keyframeInterval, bool cellTopics);
+
+		//Advances the world by one tick
+		void Step();
+
+		size_t GetStreamCount() const { return streams.Size(); }
+		const SimTestStream& GetStream(size_t stream) const { return streams.Data()[stream]; }
+
+		//Encodes the current state of a stream as its next message. The result is valid until the next call.
+		const ZArray<unsigned char>& EncodeStream(size_t stream);
+
+	private:
+		static int ThreadMain(void* arg);
+
+		void* zmqContext;
+		void* zmqSocket;
+
+		SST_Thread thread;
+		volatile int running;
+
+		uint32_t tickMicros;
+		bool useDeltas;
+		uint32_t keyframeInterval;
+		uint32_t movingCount;
+
+		ZArray<SimEntityState> world;
+		ZArray<SimTestStream> streams;
+
+		ZArray<SimEntityState> changed;
+		ZArray<uint8_t> changedMasks;
+		ZArray<unsigned char> message;
+
+		uint32_t tick;
+
+		//Written only by the publisher thread
+		volatile uint32_t sentMessages;
+		volatile uint32_t sentKeyframes;
+		volatile uint64_t sentBytes;
+		uint64_t startMicros;
+};
+
+//Encodes and decodes 'ticks' ticks of a synthetic world as full updates and as keyframes plus deltas, and prints bytes and decode time for each
+void SimTestPublisher_Benchmark(uint32_t entityCount, float movingFraction, uint32_t ticks, uint32_t keyframeInterval);
+
+//Publishes a synthetic world on cell topics over a local PUB socket and prints the bytes received and decode time per
+//tick of a SUB socket subscribed to everything against one subscribed to the cells within 'radius' of the middle of the world
+void SimTestPublisher_InterestBenchmark(uint32_t entityCount, uint32_t ticks, int radius);
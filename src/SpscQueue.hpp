@@ -0,0 +1,50 @@
+#pragma once
+
+#include <SST/SST_Atomic.h>
+
+/*
+Fixed-size lock-free queue for handing items from exactly one producer thread
+to exactly one consumer thread. Holds up to N-1 items.
+*/
+template <typename T, int N>
+class SpscQueue
+{
+	public:
+		SpscQueue() : head(0), tail(0) { }
+
+		//Producer only. Returns false if the queue is full.
+		bool Push(const T& item)
+		{
+			int t = tail;
+			int next = (t + 1) % N;
+
+			if(next == SST_Atomic_LoadAcquire(&head))
+				return false;
+
+			items[t] = item;
+			SST_Atomic_StoreRelease(&tail, next);
+			return true;
+		}
+
+		//Consumer only. Returns false if the queue is empty.
+		bool Pop(T* itemReturn)
+		{
+			int h = head;
+
+			if(h == SST_Atomic_LoadAcquire(&tail))
+				return false;
+
+			*itemReturn = items[h];
+			SST_Atomic_StoreRelease(&head, (h + 1) % N);
+			return true;
+		}
+
+	private:
+		//Keep the indices on separate cache lines so the two threads don't fight over them
+		volatile int head;
+		char pad0[64 - sizeof(int)];
+		volatile int tail;
+		char pad1[64 - sizeof(int)];
+
+		T items[N];
+};